@@ -92,6 +92,7 @@ if [ -n "$REMOVE_TMP" ]; then
  while [ "$STEP" -lt "$STEPS" ]; do
     rm -f "${TMP_PATH}/pref_step$STEP" "${TMP_PATH}/pref_step$STEP.index"
     rm -f "${TMP_PATH}/aln_step$STEP" "${TMP_PATH}/aln_step$STEP.index"
+    rm -f "${TMP_PATH}/aln_step${STEP}_edges" "${TMP_PATH}/aln_step${STEP}_edges.index"
     rm -f "${TMP_PATH}/clu_step$STEP" "${TMP_PATH}/clu_step$STEP.index"
     rm -f "${TMP_PATH}/input_step$STEP" "${TMP_PATH}/input_step$STEP.index"
     rm -f "${TMP_PATH}/order_step$STEP"
@@ -69,6 +69,7 @@ if [ -n "$REMOVE_TMP" ]; then
     echo "Remove temporary files"
     rm -f "${TMP_PATH}/pref" "${TMP_PATH}/pref.index"
     rm -f "${TMP_PATH}/aln" "${TMP_PATH}/aln.index"
+    rm -f "${TMP_PATH}/aln_edges" "${TMP_PATH}/aln_edges.index"
     rm -f "${TMP_PATH}/clu_step0" "${TMP_PATH}/clu_step0.index"
     rm -f "${TMP_PATH}/order_redundancy"
     rm -f "${TMP_PATH}/clu_redundancy" "${TMP_PATH}/clu_redundancy.index"
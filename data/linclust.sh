@@ -18,22 +18,31 @@ INPUT="$1"
 TMP_PATH="$3"
 SOURCE="$INPUT"
 
-# 1. Finding exact $k$-mer matches.
-if notExists "${TMP_PATH}/pref"; then
-    # shellcheck disable=SC2086
-    $RUNNER "$MMSEQS" kmermatcher "$INPUT" "${TMP_PATH}/pref" ${KMERMATCHER_PAR} \
-        || fail "kmermatcher died"
-fi
-# 2. Hamming distance pre-clustering
-if notExists "${TMP_PATH}/pref_rescore1"; then
-    # shellcheck disable=SC2086
-    $RUNNER "$MMSEQS" rescorediagonal "$INPUT" "$INPUT" "${TMP_PATH}/pref" "${TMP_PATH}/pref_rescore1" ${HAMMING_PAR} \
-        || fail "Rescore with hamming distance step died"
-fi
-if notExists "${TMP_PATH}/pre_clust"; then
-    # shellcheck disable=SC2086
-    "$MMSEQS" clust "$INPUT" "${TMP_PATH}/pref_rescore1" "${TMP_PATH}/pre_clust" ${CLUSTER_PAR} \
-        || fail "Pre-clustering step died"
+if [ -n "$PRECLUSTER_PAR" ]; then
+    # 1. + 2. Finding exact $k$-mer matches and Hamming distance pre-clustering in one step
+    if notExists "${TMP_PATH}/pre_clust"; then
+        # shellcheck disable=SC2086
+        "$MMSEQS" kmerprecluster "$INPUT" "${TMP_PATH}/pref" "${TMP_PATH}/pre_clust" ${PRECLUSTER_PAR} \
+            || fail "kmerprecluster died"
+    fi
+else
+    # 1. Finding exact $k$-mer matches.
+    if notExists "${TMP_PATH}/pref"; then
+        # shellcheck disable=SC2086
+        $RUNNER "$MMSEQS" kmermatcher "$INPUT" "${TMP_PATH}/pref" ${KMERMATCHER_PAR} \
+            || fail "kmermatcher died"
+    fi
+    # 2. Hamming distance pre-clustering
+    if notExists "${TMP_PATH}/pref_rescore1"; then
+        # shellcheck disable=SC2086
+        $RUNNER "$MMSEQS" rescorediagonal "$INPUT" "$INPUT" "${TMP_PATH}/pref" "${TMP_PATH}/pref_rescore1" ${HAMMING_PAR} \
+            || fail "Rescore with hamming distance step died"
+    fi
+    if notExists "${TMP_PATH}/pre_clust"; then
+        # shellcheck disable=SC2086
+        "$MMSEQS" clust "$INPUT" "${TMP_PATH}/pref_rescore1" "${TMP_PATH}/pre_clust" ${CLUSTER_PAR} \
+            || fail "Pre-clustering step died"
+    fi
 fi
 
 awk '{ print $1 }' "${TMP_PATH}/pre_clust.index" > "${TMP_PATH}/order_redundancy"
@@ -103,6 +112,7 @@ if [ -n "$REMOVE_TMP" ]; then
             rm -f "${TMP_PATH}/pref_rescore2" "${TMP_PATH}/pref_rescore2.index"
         fi
         rm -f "${TMP_PATH}/aln" "${TMP_PATH}/aln.index"
+        rm -f "${TMP_PATH}/aln_edges" "${TMP_PATH}/aln_edges.index"
     fi
     rm -f "${TMP_PATH}/clust" "${TMP_PATH}/clust.index"
 
@@ -35,10 +35,12 @@ extern int filterdb(int argc, const char **argv, const Command& command);
 extern int gff2db(int argc, const char **argv, const Command& command);
 extern int indexdb(int argc, const char **argv, const Command& command);
 extern int kmermatcher(int argc, const char **argv, const Command &command);
+extern int kmerprecluster(int argc, const char **argv, const Command &command);
 extern int lca(int argc, const char **argv, const Command& command);
 extern int linclust(int argc, const char **argv, const Command& command);
 extern int map(int argc, const char **argv, const Command& command);
 extern int maskbygff(int argc, const char **argv, const Command& command);
+extern int maskdb(int argc, const char **argv, const Command& command);
 extern int mergeclusters(int argc, const char **argv, const Command& command);
 extern int mergedbs(int argc, const char **argv, const Command& command);
 extern int mergeresultsbyset(int argc, const char **argv, const Command &command);
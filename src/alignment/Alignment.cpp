@@ -10,11 +10,19 @@
 #include "SubstitutionMatrix.h"
 #include "PrefilteringIndexReader.h"
 #include "FileUtil.h"
+#include "CostScheduler.h"
+
+#include <cmath>
+#include <limits>
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
+const size_t Alignment::SCORE_BATCH_SIZE;
+const size_t Alignment::LONG_QUERY_HITS;
+const size_t Alignment::LONG_QUERY_CHUNK_SIZE;
+
 Alignment::Alignment(const std::string &querySeqDB, const std::string &querySeqDBIndex,
                      const std::string &targetSeqDB, const std::string &targetSeqDBIndex,
                      const std::string &prefDB, const std::string &prefDBIndex,
@@ -24,7 +32,7 @@ Alignment::Alignment(const std::string &querySeqDB, const std::string &querySeqD
         covThr(par.covThr), covMode(par.covMode), seqIdMode(par.seqIdMode), evalThr(par.evalThr), seqIdThr(par.seqIdThr),
         includeIdentity(par.includeIdentity), addBacktrace(par.addBacktrace), realign(par.realign), scoreBias(par.scoreBias),
         threads(static_cast<unsigned int>(par.threads)), outDB(outDB), outDBIndex(outDBIndex),
-        maxSeqLen(par.maxSeqLen), compBiasCorrection(par.compBiasCorrection), altAlignment(par.altAlignment), qdbr(NULL), qSeqLookup(NULL),
+        maxSeqLen(par.maxSeqLen), compBiasCorrection(par.compBiasCorrection), altAlignment(par.altAlignment), bandWidth(par.diagonalScoring ? par.bandWidth : 0), writeEdges(par.writeEdges), qdbr(NULL), qSeqLookup(NULL),
         tdbr(NULL), tidxdbr(NULL), tSeqLookup(NULL), templateDBIsIndex(false) {
 
 
@@ -58,6 +66,11 @@ Alignment::Alignment(const std::string &querySeqDB, const std::string &querySeqD
         alignmentMode = (alignmentMode > Parameters::ALIGNMENT_MODE_SCORE_COV) ? alignmentMode : Parameters::ALIGNMENT_MODE_SCORE_COV;
     }
 
+    // without diagonal scoring the prefilter does not report the diagonal of a hit
+    if (par.bandWidth > 0 && par.diagonalScoring == 0) {
+        Debug(Debug::WARNING) << "Banded alignment needs the prefilter diagonals of --diag-score 1. Align the full matrix.\n";
+    }
+
     initSWMode(alignmentMode);
 
     std::string scoringMatrixFile = par.scoringMatrixFile;
@@ -267,6 +280,13 @@ void Alignment::run(const unsigned int mpiRank, const unsigned int mpiNumProc,
 
         // merge output databases
         DBWriter::mergeResults(outDB, outDBIndex, splitFiles);
+        if (writeEdges) {
+            std::vector<std::pair<std::string, std::string> > edgeFiles;
+            for (unsigned int proc = 0; proc < mpiNumProc; proc++) {
+                edgeFiles.push_back(std::make_pair(splitFiles[proc].first + "_edges", splitFiles[proc].first + "_edges.index"));
+            }
+            DBWriter::mergeResults(outDB + "_edges", outDB + "_edges.index", edgeFiles);
+        }
     }
 }
 
@@ -282,6 +302,17 @@ void Alignment::run(const std::string &outDB, const std::string &outDBIndex,
 
     DBWriter dbw(outDB.c_str(), outDBIndex.c_str(), threads);
     dbw.open();
+    // target keys for clust --cluster-mode 3, the edge database of an earlier run would not match the new result
+    const std::string edgeDB = outDB + "_edges";
+    const std::string edgeDBIndex = outDB + "_edges.index";
+    DBWriter *edgeDbw = NULL;
+    if (writeEdges) {
+        edgeDbw = new DBWriter(edgeDB.c_str(), edgeDBIndex.c_str(), threads, DBWriter::BINARY_MODE);
+        edgeDbw->open();
+    } else if (FileUtil::fileExists(edgeDBIndex.c_str())) {
+        FileUtil::deleteFile(edgeDB);
+        FileUtil::deleteFile(edgeDBIndex);
+    }
 
     EvalueComputation evaluer(tdbr->getAminoAcidDBSize(), this->m, gapOpen, gapExtend, true);
     size_t totalMemory = Util::getTotalSystemMemory();
@@ -289,6 +320,27 @@ void Alignment::run(const std::string &outDB, const std::string &outDBIndex,
     if(totalMemory > prefdbr->getDataSize()){
         flushSize = dbSize;
     }
+
+    // every hit is aligned against the whole query, the prefilter entry length estimates the number of hits
+    // queries are only reordered within a flush bucket
+    CostScheduler scheduler(dbFrom, dbSize, threads);
+    for (size_t id = dbFrom; id < dbFrom + dbSize; id++) {
+        const size_t queryId = qdbr->getId(prefdbr->getDbKey(id));
+        // a missing query is reported when it is aligned
+        if (queryId != UINT_MAX) {
+            scheduler.setCost(id, qdbr->getSeqLens(queryId) * prefdbr->getSeqLens(id));
+        }
+    }
+    scheduler.sortByCost(flushSize);
+    // queries with long prefilter lists are aligned by all threads together once a bucket is done
+    std::vector<size_t> longQueries;
+    std::vector<PendingHit> longHits;
+    std::vector<Matcher::result_t> longHitResults;
+    std::vector<Matcher::result_t> longSwResults;
+    size_t longResultCount = 0;
+    size_t longPassedNum = 0;
+    unsigned int longRejected = 0;
+    size_t longPos = 0;
 #pragma omp parallel
     {
         unsigned int thread_idx = 0;
@@ -300,117 +352,172 @@ void Alignment::run(const std::string &outDB, const std::string &outDBIndex,
         char buffer[1024+32768];
         Sequence qSeq(maxSeqLen, querySeqType, m, 0, false, compBiasCorrection);
         Sequence dbSeq(maxSeqLen, targetSeqType, m, 0, false, compBiasCorrection);
-        Matcher matcher(querySeqType, maxSeqLen, m, &evaluer, compBiasCorrection, gapOpen, gapExtend);
+        Matcher matcher(querySeqType, maxSeqLen, m, &evaluer, compBiasCorrection, gapOpen, gapExtend, bandWidth);
         Matcher *realigner = NULL;
         if (realign ==  true) {
             realigner = new Matcher(querySeqType, maxSeqLen, realign_m, &evaluer, compBiasCorrection, gapOpen, gapExtend);
         }
+        std::vector<PendingHit> hits;
+        hits.reserve(SCORE_BATCH_SIZE);
+        // result records and their backtraces are reused between queries, only the first resultCount are valid
+        std::vector<Matcher::result_t> swResults;
+        Matcher::result_t res;
 
         size_t iterations = static_cast<size_t>(ceil(static_cast<double>(dbSize) / static_cast<double>(flushSize)));
         for (size_t i = 0; i < iterations; i++) {
-            size_t start = dbFrom + (i * flushSize);
+            size_t start = i * flushSize;
             size_t bucketSize = std::min(dbSize - (i * flushSize), flushSize);
 
 #pragma omp for schedule(dynamic, 5) reduction(+: alignmentsNum, totalPassedNum)
-            for (size_t id = start; id < (start + bucketSize); id++) {
-                Debug::printProgress(id);
+            for (size_t pos = start; pos < (start + bucketSize); pos++) {
+                Debug::printProgress(pos);
+                const size_t id = scheduler.getId(pos);
 
                 // get the prefiltering list
                 char *data = prefdbr->getData(id);
+                if (threads > 1 && Util::countLines(data, prefdbr->getSeqLens(id) - 1) > LONG_QUERY_HITS) {
+#pragma omp critical
+                    longQueries.push_back(id);
+                    continue;
+                }
                 unsigned int queryDbKey = prefdbr->getDbKey(id);
                 setQuerySequence(qSeq, id, queryDbKey);
 
                 matcher.initQuery(&qSeq);
                 // parse the prefiltering list and calculate a Smith-Waterman alignment for each sequence in the list
-                std::vector<Matcher::result_t> swResults;
+                size_t resultCount = 0;
                 size_t passedNum = 0;
                 unsigned int rejected = 0;
 
                 while (*data != '\0' && passedNum < maxAlnNum && rejected < maxRejected) {
-                    // DB key of the db sequence
-                    char dbKeyBuffer[255 + 1];
-                    char * words[10];
-                    Util::parseKey(data, dbKeyBuffer);
-                    const unsigned int dbKey = (unsigned int) strtoul(dbKeyBuffer, NULL, 10);
-
-                    size_t elements = Util::getWordsOfLine(data, words, 10);
-                    int diagonal = INT_MAX;
-                    // Prefilter result (need to make this better)
-                    if(elements == 3){
-                        hit_t hit = QueryMatcher::parsePrefilterHit(data);
-                        diagonal = hit.diagonal;
+                    // first pass: only the score of a batch of hits, most of them fail the e-value threshold here
+                    // the batch is not larger than the hits that are processed for sure before a limit is reached
+                    const size_t batchSize = std::min(SCORE_BATCH_SIZE, std::min(static_cast<size_t>(maxAlnNum - passedNum),
+                                                                                 static_cast<size_t>(maxRejected - rejected)));
+                    hits.clear();
+                    while (*data != '\0' && hits.size() < batchSize) {
+                        unsigned int dbKey;
+                        int diagonal;
+                        float prefilterScore;
+                        data = readPrefilterHit(data, dbKey, diagonal, prefilterScore);
+                        hits.emplace_back(dbKey, diagonal, getBandMinScore(evaluer, prefilterScore, qSeq.L));
+                        hits.back().state = scoreHit(matcher, qSeq, dbSeq, hits.back());
                     }
 
-                    setTargetSequence(dbSeq, dbKey);
-                    // check if the sequences could pass the coverage threshold
-                    if(Util::canBeCovered(covThr, covMode, static_cast<float>(qSeq.L), static_cast<float>(dbSeq.L)) == false )
-                    {
-                        rejected++;
-                        data = Util::skipLine(data);
-                        continue;
+                    // second pass: start position and backtrace of the survivors,
+                    // in prefilter order so that the accept and reject limits stop at the same hit as before
+                    for (size_t i = 0; i < hits.size() && passedNum < maxAlnNum && rejected < maxRejected; i++) {
+                        const PendingHit &hit = hits[i];
+                        if (hit.state == PendingHit::NOT_COVERED) {
+                            rejected++;
+                            continue;
+                        }
+                        alignmentsNum++;
+                        if (hit.state == PendingHit::FAILED) {
+                            rejected++;
+                            continue;
+                        }
+
+                        const bool isIdentity = alignHit(matcher, qSeq, dbSeq, hit, res);
+                        if(checkCriteriaAndAddHitToList(res, isIdentity, swResults, resultCount)){
+                            passedNum++;
+                            totalPassedNum++;
+                            rejected = 0;
+                        }else{
+                            rejected++;
+                        }
                     }
-                    const bool isIdentity = (queryDbKey == dbKey && (includeIdentity || sameQTDB)) ? true : false;
-
-                    // calculate Smith-Waterman alignment
-                    Matcher::result_t res = matcher.getSWResult(&dbSeq, diagonal, covMode, covThr, evalThr, swMode, seqIdMode, isIdentity);
-                    alignmentsNum++;
+                }
+                writeQueryResults(qSeq, dbSeq, matcher, realigner, swResults, resultCount, res,
+                                  dbw, edgeDbw, alnResultsOutString, buffer, thread_idx);
+                scheduler.entryDone(thread_idx);
+            }
 
-                    //set coverage and seqid if identity
-                    if (isIdentity) {
-                        res.qcov = 1.0f;
-                        res.dbcov = 1.0f;
-                        res.seqId = 1.0f;
-                    }
-                    if(checkCriteriaAndAddHitToList(res, isIdentity, swResults)){
-                        passedNum++;
-                        totalPassedNum++;
-                        rejected = 0;
-                    }else{
-                        rejected++;
+            // the hits of a long query are aligned in waves, the threads take the hits of a wave one by one
+            // the results of a wave are merged in prefilter order and the next wave is only started
+            // if the accept and reject limits are not reached
+            for (size_t longQuery = 0; longQuery < longQueries.size(); longQuery++) {
+                const size_t id = longQueries[longQuery];
+                const unsigned int queryDbKey = prefdbr->getDbKey(id);
+                setQuerySequence(qSeq, id, queryDbKey);
+                matcher.initQuery(&qSeq);
+#pragma omp single
+                {
+                    longHits.clear();
+                    char *data = prefdbr->getData(id);
+                    while (*data != '\0') {
+                        unsigned int dbKey;
+                        int diagonal;
+                        float prefilterScore;
+                        data = readPrefilterHit(data, dbKey, diagonal, prefilterScore);
+                        longHits.emplace_back(dbKey, diagonal, getBandMinScore(evaluer, prefilterScore, qSeq.L));
                     }
-
-                    data = Util::skipLine(data);
-                }
-                if(altAlignment > 0 && realign == false ){
-                    computeAlternativeAlignment(queryDbKey, dbSeq, swResults, matcher, evalThr, swMode);
+                    longResultCount = 0;
+                    longPassedNum = 0;
+                    longRejected = 0;
+                    longPos = 0;
                 }
 
-                // write the results
-                std::sort(swResults.begin(), swResults.end(), Matcher::compareHits);
-                if (realign == true) {
-                    realigner->initQuery(&qSeq);
-                    for (size_t result = 0; result < swResults.size(); result++) {
-                        setTargetSequence(dbSeq, swResults[result].dbKey);
-                        const bool isIdentity = (queryDbKey == swResults[result].dbKey && (includeIdentity || sameQTDB)) ? true : false;
-                        Matcher::result_t res = realigner->getSWResult(&dbSeq, INT_MAX, covMode, covThr, FLT_MAX,
-                                                                       Matcher::SCORE_COV_SEQID, seqIdMode, isIdentity);
-                        swResults[result].backtrace  = res.backtrace;
-                        swResults[result].qStartPos  = res.qStartPos;
-                        swResults[result].qEndPos    = res.qEndPos;
-                        swResults[result].dbStartPos = res.dbStartPos;
-                        swResults[result].dbEndPos   = res.dbEndPos;
-                        swResults[result].alnLength  = res.alnLength;
-                        swResults[result].seqId      = res.seqId;
-                        swResults[result].qcov       = res.qcov;
-                        swResults[result].dbcov      = res.dbcov;
+                while (longPos < longHits.size() && longPassedNum < maxAlnNum && longRejected < maxRejected) {
+                    // like the score batches, a wave is not larger than the hits that are processed for sure
+                    const size_t waveStart = longPos;
+                    const size_t waveSize = std::min(threads * LONG_QUERY_CHUNK_SIZE,
+                                                     std::min(static_cast<size_t>(maxAlnNum - longPassedNum),
+                                                              static_cast<size_t>(maxRejected - longRejected)));
+                    const size_t waveEnd = std::min(longHits.size(), waveStart + waveSize);
+#pragma omp single
+                    if (longHitResults.size() < waveEnd - waveStart) {
+                        longHitResults.resize(waveEnd - waveStart);
+                    }
+
+#pragma omp for schedule(dynamic, 1)
+                    for (size_t hitIdx = waveStart; hitIdx < waveEnd; hitIdx++) {
+                        PendingHit &hit = longHits[hitIdx];
+                        hit.state = scoreHit(matcher, qSeq, dbSeq, hit);
+                        if (hit.state == PendingHit::NOT_COVERED || hit.state == PendingHit::FAILED) {
+                            continue;
+                        }
+                        Matcher::result_t &hitResult = longHitResults[hitIdx - waveStart];
+                        const bool isIdentity = alignHit(matcher, qSeq, dbSeq, hit, hitResult);
+                        hit.state = isAcceptedHit(hitResult, isIdentity) ? PendingHit::ACCEPTED : PendingHit::REJECTED;
                     }
-                    if(altAlignment> 0 ){
-                        computeAlternativeAlignment(queryDbKey, dbSeq, swResults, matcher, FLT_MAX, Matcher::SCORE_COV_SEQID);
+
+#pragma omp single
+                    {
+                        for (size_t hitIdx = waveStart; hitIdx < waveEnd && longPassedNum < maxAlnNum && longRejected < maxRejected; hitIdx++) {
+                            const PendingHit &hit = longHits[hitIdx];
+                            if (hit.state != PendingHit::NOT_COVERED) {
+                                alignmentsNum++;
+                            }
+                            if (hit.state == PendingHit::ACCEPTED) {
+                                if (longResultCount == longSwResults.size()) {
+                                    longSwResults.push_back(Matcher::result_t());
+                                }
+                                std::swap(longSwResults[longResultCount], longHitResults[hitIdx - waveStart]);
+                                longResultCount++;
+                                longPassedNum++;
+                                totalPassedNum++;
+                                longRejected = 0;
+                            } else {
+                                longRejected++;
+                            }
+                        }
+                        longPos = waveEnd;
                     }
                 }
 
-                // put the contents of the swResults list into ffindex DB
-                for (size_t result = 0; result < swResults.size(); result++) {
-                    size_t len = Matcher::resultToBuffer(buffer, swResults[result], addBacktrace);
-                    alnResultsOutString.append(buffer, len);
+#pragma omp single
+                {
+                    writeQueryResults(qSeq, dbSeq, matcher, realigner, longSwResults, longResultCount, res,
+                                      dbw, edgeDbw, alnResultsOutString, buffer, thread_idx);
+                    scheduler.entryDone(thread_idx);
                 }
-                dbw.writeData(alnResultsOutString.c_str(), alnResultsOutString.length(), qSeq.getDbKey(), thread_idx);
-                alnResultsOutString.clear();
             }
 
 #pragma omp barrier
             if (thread_idx == 0) {
                 prefdbr->remapData();
+                longQueries.clear();
             }
 #pragma omp barrier
         }
@@ -421,8 +528,13 @@ void Alignment::run(const std::string &outDB, const std::string &outDBIndex,
     }
 
     dbw.close();
+    if (edgeDbw != NULL) {
+        edgeDbw->close();
+        delete edgeDbw;
+    }
 
     Debug(Debug::INFO) << "\nAll sequences processed.\n\n";
+    scheduler.printThreadTimes();
     Debug(Debug::INFO) << alignmentsNum << " alignments calculated.\n";
     Debug(Debug::INFO) << totalPassedNum << " sequence pairs passed the thresholds ("
                        << ((float) totalPassedNum / (float) alignmentsNum) << " of overall calculated).\n";
@@ -477,25 +589,149 @@ inline void Alignment::setTargetSequence(Sequence &seq, unsigned int key) {
 }
 
 
+char *Alignment::readPrefilterHit(char *data, unsigned int &dbKey, int &diagonal, float &score) {
+    // DB key of the db sequence
+    char dbKeyBuffer[255 + 1];
+    char * words[10];
+    Util::parseKey(data, dbKeyBuffer);
+    dbKey = (unsigned int) strtoul(dbKeyBuffer, NULL, 10);
+
+    size_t elements = Util::getWordsOfLine(data, words, 10);
+    diagonal = INT_MAX;
+    score = 0.0f;
+    // Prefilter result (need to make this better)
+    if(elements == 3){
+        hit_t hit = QueryMatcher::parsePrefilterHit(data);
+        diagonal = hit.diagonal;
+        score = hit.pScore;
+    }
+    return Util::skipLine(data);
+}
+
+int Alignment::getBandMinScore(EvalueComputation &evaluer, float prefilterScore, int queryLength) {
+    // the prefilter diagonal is the best ungapped diagonal, a full alignment is only worth it if it was significant
+    if (bandWidth == 0 || prefilterScore < -log(evalThr)) {
+        return 0;
+    }
+    const double evalue = std::max(exp(-static_cast<double>(prefilterScore)), std::numeric_limits<double>::min());
+    return evaluer.minScore(evalue, queryLength);
+}
+
+Alignment::PendingHit::State Alignment::scoreHit(Matcher &matcher, Sequence &qSeq, Sequence &dbSeq, PendingHit &hit) {
+    setTargetSequence(dbSeq, hit.dbKey);
+    // check if the sequences could pass the coverage threshold
+    if(Util::canBeCovered(covThr, covMode, static_cast<float>(qSeq.L), static_cast<float>(dbSeq.L)) == false )
+    {
+        return PendingHit::NOT_COVERED;
+    }
+    const bool isIdentity = (qSeq.getDbKey() == hit.dbKey && (includeIdentity || sameQTDB)) ? true : false;
+    // banded alignments are computed in one pass around the prefilter diagonal
+    if (isIdentity || querySeqType == Sequence::NUCLEOTIDES || (bandWidth > 0 && hit.diagonal != INT_MAX)) {
+        return PendingHit::NOT_SCORED;
+    } else if (matcher.getSWScore(&dbSeq, covMode, covThr, evalThr, hit.alignment)) {
+        return PendingHit::SCORED;
+    }
+    return PendingHit::FAILED;
+}
+
+bool Alignment::alignHit(Matcher &matcher, Sequence &qSeq, Sequence &dbSeq, const PendingHit &hit, Matcher::result_t &res) {
+    setTargetSequence(dbSeq, hit.dbKey);
+    const bool isIdentity = (qSeq.getDbKey() == hit.dbKey && (includeIdentity || sameQTDB)) ? true : false;
+
+    // calculate Smith-Waterman alignment
+    matcher.getSWResult(res, &dbSeq, hit.diagonal, covMode, covThr, evalThr, swMode, seqIdMode, isIdentity,
+                        (hit.state == PendingHit::SCORED) ? &hit.alignment : NULL, true, hit.bandMinScore);
+
+    //set coverage and seqid if identity
+    if (isIdentity) {
+        res.qcov = 1.0f;
+        res.dbcov = 1.0f;
+        res.seqId = 1.0f;
+    }
+    return isIdentity;
+}
+
+void Alignment::writeQueryResults(Sequence &qSeq, Sequence &dbSeq, Matcher &matcher, Matcher *realigner,
+                                  std::vector<Matcher::result_t> &swResults, size_t &resultCount,
+                                  Matcher::result_t &res, DBWriter &dbw, DBWriter *edgeDbw, std::string &alnResultsOutString,
+                                  char *buffer, unsigned int thread_idx) {
+    const unsigned int queryDbKey = qSeq.getDbKey();
+    if(altAlignment > 0 && realign == false ){
+        computeAlternativeAlignment(queryDbKey, dbSeq, swResults, resultCount, res, matcher, evalThr, swMode);
+    }
+
+    // write the results
+    std::sort(swResults.begin(), swResults.begin() + resultCount, Matcher::compareHits);
+    // the realignment profile is only built for queries with hits
+    if (realign == true && resultCount > 0) {
+        realigner->initQuery(&qSeq);
+        for (size_t result = 0; result < resultCount; result++) {
+            setTargetSequence(dbSeq, swResults[result].dbKey);
+            const bool isIdentity = (queryDbKey == swResults[result].dbKey && (includeIdentity || sameQTDB)) ? true : false;
+            realigner->getSWResult(res, &dbSeq, INT_MAX, covMode, covThr, FLT_MAX,
+                                   Matcher::SCORE_COV_SEQID, seqIdMode, isIdentity, NULL, true);
+            swResults[result].backtrace.swap(res.backtrace);
+            swResults[result].qStartPos  = res.qStartPos;
+            swResults[result].qEndPos    = res.qEndPos;
+            swResults[result].dbStartPos = res.dbStartPos;
+            swResults[result].dbEndPos   = res.dbEndPos;
+            swResults[result].alnLength  = res.alnLength;
+            swResults[result].seqId      = res.seqId;
+            swResults[result].qcov       = res.qcov;
+            swResults[result].dbcov      = res.dbcov;
+        }
+        if(altAlignment> 0 ){
+            computeAlternativeAlignment(queryDbKey, dbSeq, swResults, resultCount, res, matcher, FLT_MAX, Matcher::SCORE_COV_SEQID);
+        }
+    }
+
+    // put the contents of the swResults list into ffindex DB
+    for (size_t result = 0; result < resultCount; result++) {
+        // the backtraces are already compressed
+        size_t len = Matcher::resultToBuffer(buffer, swResults[result], addBacktrace, false);
+        alnResultsOutString.append(buffer, len);
+    }
+    dbw.writeData(alnResultsOutString.c_str(), alnResultsOutString.length(), queryDbKey, thread_idx);
+    alnResultsOutString.clear();
+
+    if (edgeDbw != NULL) {
+        for (size_t result = 0; result < resultCount; result++) {
+            alnResultsOutString.append((const char *) &swResults[result].dbKey, sizeof(unsigned int));
+        }
+        edgeDbw->writeData(alnResultsOutString.c_str(), alnResultsOutString.length(), queryDbKey, thread_idx);
+        alnResultsOutString.clear();
+    }
+}
+
 size_t Alignment::estimateHDDMemoryConsumption(int dbSize, int maxSeqs) {
     return 2 * (dbSize * maxSeqs * 21 * 1.75);
 }
 
 
-bool Alignment::checkCriteriaAndAddHitToList(Matcher::result_t &res, bool isIdentity, std::vector<Matcher::result_t> &swHits){
+bool Alignment::isAcceptedHit(const Matcher::result_t &res, bool isIdentity) {
     const bool evalOk = (res.eval <= evalThr); // -e
     const bool seqIdOK = (res.seqId >= seqIdThr); // --min-seq-id
     const bool covOK = Util::hasCoverage(covThr, covMode, res.qcov, res.dbcov);
     // check first if it is identity
-    if (isIdentity
-        ||
-        // general accaptance criteria
-        ( evalOk   &&
-          seqIdOK  &&
-          covOK
-        ))
+    return (isIdentity
+            ||
+            // general accaptance criteria
+            ( evalOk   &&
+              seqIdOK  &&
+              covOK
+            ));
+}
+
+bool Alignment::checkCriteriaAndAddHitToList(Matcher::result_t &res, bool isIdentity,
+                                             std::vector<Matcher::result_t> &swHits, size_t &hitCount){
+    if (isAcceptedHit(res, isIdentity))
     {
-        swHits.push_back(res);
+        // swap instead of copy, res takes over the backtrace memory of the unused record
+        if (hitCount == swHits.size()) {
+            swHits.push_back(Matcher::result_t());
+        }
+        std::swap(swHits[hitCount], res);
+        hitCount++;
         return true;
     } else {
         return false;
@@ -503,10 +739,10 @@ bool Alignment::checkCriteriaAndAddHitToList(Matcher::result_t &res, bool isIden
 }
 
 void Alignment::computeAlternativeAlignment(unsigned int queryDbKey, Sequence &dbSeq,
-                                            std::vector<Matcher::result_t> &swResults,
-                                            Matcher &matcher, float evalThr, int swMode) {
+                                            std::vector<Matcher::result_t> &swResults, size_t &resultCount,
+                                            Matcher::result_t &res, Matcher &matcher, float evalThr, int swMode) {
     int xIndex = m->aa2int[static_cast<int>('X')];
-    size_t firstItResSize = swResults.size();
+    size_t firstItResSize = resultCount;
     for(size_t i = 0; i < firstItResSize; i++) {
         const bool isIdentity = (queryDbKey == swResults[i].dbKey && (includeIdentity || sameQTDB))
                                 ? true : false;
@@ -519,11 +755,12 @@ void Alignment::computeAlternativeAlignment(unsigned int queryDbKey, Sequence &d
         }
         bool nextAlignment = true;
         for (int altAli = 0; altAli < altAlignment && nextAlignment; altAli++) {
-            Matcher::result_t res = matcher.getSWResult(&dbSeq, INT_MAX, covMode, covThr, evalThr, swMode,
-                                                        seqIdMode, isIdentity);
-            nextAlignment = checkCriteriaAndAddHitToList(res, isIdentity, swResults);
+            matcher.getSWResult(res, &dbSeq, INT_MAX, covMode, covThr, evalThr, swMode,
+                                seqIdMode, isIdentity, NULL, true);
+            nextAlignment = checkCriteriaAndAddHitToList(res, isIdentity, swResults, resultCount);
             if (nextAlignment == true) {
-                for (int pos = res.dbStartPos; pos < res.dbEndPos; pos++) {
+                const Matcher::result_t &added = swResults[resultCount - 1];
+                for (int pos = added.dbStartPos; pos < added.dbEndPos; pos++) {
                     dbSeq.int_sequence[pos] = xIndex;
                 }
             }
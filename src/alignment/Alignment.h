@@ -4,6 +4,7 @@
 #include <string>
 
 #include "DBReader.h"
+#include "DBWriter.h"
 #include "Parameters.h"
 #include "BaseMatrix.h"
 #include "Sequence.h"
@@ -78,6 +79,12 @@ private:
 
     int altAlignment;
 
+    // band width around the prefilter diagonal, 0 for the full Smith-Waterman
+    const int bandWidth;
+
+    // also write the target keys of the accepted hits as binary database <outDB>_edges
+    const bool writeEdges;
+
     BaseMatrix *m;
     // costs to open a gap
     int gapOpen;
@@ -99,6 +106,40 @@ private:
 
     bool templateDBIsIndex;
 
+    // prefilter hits of a query that are scored together before the survivors are aligned
+    static const size_t SCORE_BATCH_SIZE = 64;
+
+    // queries with more prefilter hits are aligned by all threads together
+    static const size_t LONG_QUERY_HITS = 1000;
+    // prefilter hits of a long query per thread that are aligned before their results are merged
+    static const size_t LONG_QUERY_CHUNK_SIZE = 16;
+
+    struct PendingHit {
+        enum State {
+            // the lengths can not reach the coverage threshold
+            NOT_COVERED,
+            // the score only pass already failed the e-value or coverage threshold
+            FAILED,
+            // passed the score only pass, alignment holds its result
+            SCORED,
+            // identities, nucleotides and banded alignments are aligned in one pass
+            NOT_SCORED,
+            // the alignment of a hit of a long query passed or failed the acceptance criteria
+            ACCEPTED,
+            REJECTED
+        };
+
+        unsigned int dbKey;
+        int diagonal;
+        // score a banded alignment around diagonal has to reach
+        int bandMinScore;
+        State state;
+        s_align alignment;
+
+        PendingHit(unsigned int dbKey, int diagonal, int bandMinScore)
+                : dbKey(dbKey), diagonal(diagonal), bandMinScore(bandMinScore), state(NOT_SCORED) {}
+    };
+
     void initSWMode(unsigned int alignmentMode);
 
     void setQuerySequence(Sequence &seq, size_t id, unsigned int key);
@@ -107,10 +148,35 @@ private:
 
     static size_t estimateHDDMemoryConsumption(int dbSize, int maxSeqs);
 
-    bool checkCriteriaAndAddHitToList(Matcher::result_t &result, bool isIdentity, std::vector<Matcher::result_t> &swHits);
+    // parses the next line of a prefilter list, returns the start of the following line
+    // score is the -log e-value of the prefilter and 0 for other result formats
+    static char *readPrefilterHit(char *data, unsigned int &dbKey, int &diagonal, float &score);
+
+    // gapped score with the e-value the prefilter reported for its diagonal, 0 if it does not pass the e-value threshold
+    int getBandMinScore(EvalueComputation &evaluer, float prefilterScore, int queryLength);
+
+    // coverage check and score only pass of a hit
+    PendingHit::State scoreHit(Matcher &matcher, Sequence &qSeq, Sequence &dbSeq, PendingHit &hit);
+
+    // start position and backtrace of a hit that was not rejected by scoreHit, returns if the hit is the identity
+    bool alignHit(Matcher &matcher, Sequence &qSeq, Sequence &dbSeq, const PendingHit &hit, Matcher::result_t &res);
+
+    // alternative alignments and realignment of the accepted hits of a query, writes them sorted to dbw
+    // and their target keys to edgeDbw if it is not NULL
+    void writeQueryResults(Sequence &qSeq, Sequence &dbSeq, Matcher &matcher, Matcher *realigner,
+                           std::vector<Matcher::result_t> &swResults, size_t &resultCount,
+                           Matcher::result_t &res, DBWriter &dbw, DBWriter *edgeDbw, std::string &alnResultsOutString,
+                           char *buffer, unsigned int thread_idx);
+
+    bool isAcceptedHit(const Matcher::result_t &res, bool isIdentity);
+
+    // swHits is a pool of records, an accepted result is swapped into swHits[hitCount]
+    bool checkCriteriaAndAddHitToList(Matcher::result_t &result, bool isIdentity,
+                                      std::vector<Matcher::result_t> &swHits, size_t &hitCount);
 
     void computeAlternativeAlignment(unsigned int queryDbKey, Sequence &dbSeq,
-                                     std::vector<Matcher::result_t> &vector, Matcher &matcher,
+                                     std::vector<Matcher::result_t> &vector, size_t &resultCount,
+                                     Matcher::result_t &res, Matcher &matcher,
                                      float evalThr, int swMode);
 };
 
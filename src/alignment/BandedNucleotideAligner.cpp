@@ -14,6 +14,12 @@
 #include "Debug.h"
 #include "StripedSmithWaterman.h"
 
+#ifdef AVX2
+#define ksw_extz2 ksw_extz2_avx2
+#else
+#define ksw_extz2 ksw_extz2_sse
+#endif
+
 
 BandedNucleotideAligner::BandedNucleotideAligner(BaseMatrix * subMat, size_t maxSequenceLength, int gapo, int gape) :
 fastMatrix(SubstitutionMatrix::createAsciiSubMat(*subMat))
@@ -31,6 +37,11 @@ fastMatrix(SubstitutionMatrix::createAsciiSubMat(*subMat))
     }
     this->gape = gape;
     this->gapo = gapo;
+    // ksw2 grows the cigars with realloc, they are kept between alignments
+    cigarCapacity = 16;
+    cigar = (uint32_t *) malloc(cigarCapacity * sizeof(uint32_t));
+    rightCigarCapacity = 16;
+    rightCigar = (uint32_t *) malloc(rightCigarCapacity * sizeof(uint32_t));
 }
 
 BandedNucleotideAligner::~BandedNucleotideAligner(){
@@ -41,6 +52,8 @@ BandedNucleotideAligner::~BandedNucleotideAligner(){
     delete [] fastMatrix.matrixData;
     delete [] fastMatrix.matrix;
     delete [] mat;
+    free(cigar);
+    free(rightCigar);
 }
 
 void BandedNucleotideAligner::initQuery(Sequence * query){
@@ -48,7 +61,7 @@ void BandedNucleotideAligner::initQuery(Sequence * query){
     for (int i = 0; i < query->L; ++i) {
         querySeq[i] = query->int_sequence[i];
     }
-    SmithWaterman::seq_reverse((int8_t *)querySeqRev, (int8_t *)querySeq, query->L);
+    SmithWaterman::seq_reverse((int8_t *)querySeqRev, (int8_t *)querySeq, query->L - 1);
 }
 
 
@@ -59,7 +72,7 @@ s_align BandedNucleotideAligner::align(Sequence * targetSeqObj, short diagonal,
     for (int i = 0; i < targetSeqObj->L; ++i) {
         targetSeq[i] = targetSeqObj->int_sequence[i];
     }
-    SmithWaterman::seq_reverse((int8_t *)targetSeqRev, (int8_t *)targetSeq, targetSeqObj->L);
+    SmithWaterman::seq_reverse((int8_t *)targetSeqRev, (int8_t *)targetSeq, targetSeqObj->L - 1);
 
     unsigned short distanceToDiagonal = abs(diagonal);
     DistanceCalculator::LocalAlignment alignment;
@@ -90,10 +103,8 @@ s_align BandedNucleotideAligner::align(Sequence * targetSeqObj, short diagonal,
     if(qUngappedStartPos == 0 && qUngappedEndPos == querySeqObj->L -1
        && dbUngappedStartPos == 0 && dbUngappedEndPos == targetSeqObj->L - 1){
         s_align result;
-        uint32_t * retCigar = new uint32_t[1];
-        retCigar[0] = 0;
-        retCigar[0] = querySeqObj->L << 4;
-        result.cigar = retCigar;
+        cigar[0] = querySeqObj->L << 4;
+        result.cigar = cigar;
         result.cigarLen = 1;
         result.score1 = alignment.score;
         result.qStartPos1 = qUngappedStartPos;
@@ -105,49 +116,81 @@ s_align BandedNucleotideAligner::align(Sequence * targetSeqObj, short diagonal,
         result.evalue = evaluer->computeEvalue(result.score1, querySeqObj->L);
         return result;
     }
-//    printf("%d\t%d\t%d\n", alignment.score,  alignment.startPos, alignment.endPos);
-
-    // get middle position of ungapped alignment
-    int qStartRev = (querySeqObj->L  - qUngappedEndPos) - 1;
-    int tStartRev = (targetSeqObj->L - dbUngappedEndPos) - 1;
-
-    ksw_extz_t ez;
-    int flag = 0;
-    flag |= KSW_EZ_SCORE_ONLY;
-    flag |= KSW_EZ_EXTZ_ONLY;
-    ksw_extz2_sse(0, querySeqObj->L - qStartRev, querySeqRev + qStartRev, targetSeqObj->L - tStartRev, targetSeqRev + tStartRev, 5, mat, gapo, gape, 64, 40, flag, &ez);
-
-    int qStartPos = querySeqObj->L  - ( qStartRev + ez.max_q ) -1 ;
-    int tStartPos = targetSeqObj->L - ( tStartRev + ez.max_t ) -1;
-
-    int alignFlag = 0;
-    alignFlag |= KSW_EZ_EXTZ_ONLY;
-
-    ksw_extz_t ezAlign;
-//    ezAlign.cigar = cigar;
-//    printf("%d %d\n", qStartPos, tStartPos);
-    memset(&ezAlign, 0, sizeof(ksw_extz_t));
-    ksw_extz2_sse(0, querySeqObj->L-qStartPos, querySeq+qStartPos, targetSeqObj->L-tStartPos, targetSeq+tStartPos, 5,
-                  mat, gapo, gape, 64, 40, alignFlag, &ezAlign);
-
-    std::string letterCode = "MID";
-    uint32_t * retCigar = new uint32_t[ezAlign.n_cigar];
-    for(int i = 0; i < ezAlign.n_cigar; i++){
-        retCigar[i]=ezAlign.cigar[i];
+
+    // a long ungapped seed may run across a pair of indels, only its center is kept fixed
+    const int trim = std::max(0, (qUngappedEndPos - qUngappedStartPos + 1 - SEED_CORE) / 2);
+    qUngappedStartPos += trim;
+    dbUngappedStartPos += trim;
+    qUngappedEndPos -= trim;
+    dbUngappedEndPos -= trim;
+
+    // the seed is extended in both directions, a stronger seed may cross a longer low scoring region
+    const int zdrop = std::max(ZDROP_MIN, std::min(static_cast<int>(alignment.score), ZDROP_MAX));
+    const int extendFlag = KSW_EZ_EXTZ_ONLY;
+
+    // to the left on the reversed sequences, the reversed cigar is in forward order
+    ksw_extz_t ezLeft;
+    memset(&ezLeft, 0, sizeof(ksw_extz_t));
+    ezLeft.cigar = cigar;
+    ezLeft.m_cigar = cigarCapacity;
+    ksw_extz2(0, qUngappedStartPos, querySeqRev + (querySeqObj->L - qUngappedStartPos),
+              dbUngappedStartPos, targetSeqRev + (targetSeqObj->L - dbUngappedStartPos), WILDCARD + 1,
+              mat, gapo, gape, BAND_WIDTH, zdrop, extendFlag | KSW_EZ_REV_CIGAR, &ezLeft);
+    cigar = ezLeft.cigar;
+    cigarCapacity = ezLeft.m_cigar;
+
+    // to the right
+    ksw_extz_t ezRight;
+    memset(&ezRight, 0, sizeof(ksw_extz_t));
+    ezRight.cigar = rightCigar;
+    ezRight.m_cigar = rightCigarCapacity;
+    ksw_extz2(0, querySeqObj->L - qUngappedEndPos - 1, querySeq + qUngappedEndPos + 1,
+              targetSeqObj->L - dbUngappedEndPos - 1, targetSeq + dbUngappedEndPos + 1, WILDCARD + 1,
+              mat, gapo, gape, BAND_WIDTH, zdrop, extendFlag, &ezRight);
+    rightCigar = ezRight.cigar;
+    rightCigarCapacity = ezRight.m_cigar;
+
+    // left cigar, seed and right cigar
+    int cigarLen = ezLeft.n_cigar;
+    if (cigarLen + 1 + ezRight.n_cigar > cigarCapacity) {
+        cigarCapacity = cigarLen + 1 + ezRight.n_cigar;
+        cigar = (uint32_t *) realloc(cigar, cigarCapacity * sizeof(uint32_t));
+    }
+    cigarLen = appendCigar(cigar, cigarLen, (qUngappedEndPos - qUngappedStartPos + 1) << 4);
+    for (int i = 0; i < ezRight.n_cigar; ++i) {
+        cigarLen = appendCigar(cigar, cigarLen, rightCigar[i]);
+    }
+
+    // ksw2 scores matches with mat[0], mismatches with mat[1] and the wildcard with 0, the seed is scored the same way
+    int seedScore = 0;
+    for (int i = 0; i <= qUngappedEndPos - qUngappedStartPos; ++i) {
+        const uint8_t qRes = querySeq[qUngappedStartPos + i];
+        const uint8_t tRes = targetSeq[dbUngappedStartPos + i];
+        if (qRes != WILDCARD && tRes != WILDCARD) {
+            seedScore += (qRes == tRes) ? mat[0] : mat[1];
+        }
     }
+    const int score = ezLeft.max + seedScore + ezRight.max;
     s_align result;
-    result.cigar = retCigar;
-    result.cigarLen = ezAlign.n_cigar;
-    result.score1 = ezAlign.max;
-    result.qStartPos1 = qStartPos;
-    result.qEndPos1 = qStartPos+ezAlign.max_q;
-    result.dbEndPos1 = tStartPos+ezAlign.max_t;
-    result.dbStartPos1 = tStartPos;
+    result.cigar = cigar;
+    result.cigarLen = cigarLen;
+    result.score1 = std::min(score, static_cast<int>(USHRT_MAX));
+    result.qStartPos1 = qUngappedStartPos - (ezLeft.max_q + 1);
+    result.qEndPos1 = qUngappedEndPos + (ezRight.max_q + 1);
+    result.dbStartPos1 = dbUngappedStartPos - (ezLeft.max_t + 1);
+    result.dbEndPos1 = dbUngappedEndPos + (ezRight.max_t + 1);
     result.qCov = SmithWaterman::computeCov(result.qStartPos1, result.qEndPos1, querySeqObj->L);
     result.tCov = SmithWaterman::computeCov(result.dbStartPos1, result.dbEndPos1, targetSeqObj->L);
     result.evalue = evaluer->computeEvalue(result.score1, querySeqObj->L);
-    free(ezAlign.cigar);
     return result;
-//        std::cout << static_cast<float>(aaIds)/ static_cast<float>(alignment.len) << std::endl;
+}
 
+int BandedNucleotideAligner::appendCigar(uint32_t *cigar, int cigarLen, uint32_t op) {
+    // ksw2 and SmithWaterman share the BAM encoding, length << 4 | op
+    if (cigarLen > 0 && (cigar[cigarLen - 1] & 0xf) == (op & 0xf)) {
+        cigar[cigarLen - 1] += op & ~0xfU;
+        return cigarLen;
+    }
+    cigar[cigarLen] = op;
+    return cigarLen + 1;
 }
@@ -24,7 +24,20 @@ public:
 
     s_align align(Sequence * targetSeqObj, short diagonal, EvalueComputation * evaluer);
 
+    // appends a BAM encoded cigar operation, merges it with the last one if the operation is the same
+    static int appendCigar(uint32_t *cigar, int cigarLen, uint32_t op);
+
 private:
+    // band of the ksw2 extensions
+    static const int BAND_WIDTH = 64;
+    // z-drop of the extensions is the ungapped seed score within these bounds
+    static const int ZDROP_MIN = 40;
+    static const int ZDROP_MAX = 400;
+    // length of the center of the ungapped seed that is extended
+    static const int SEED_CORE = 16;
+    // last residue of the nucleotide alphabet, ksw2 scores it with 0
+    static const uint8_t WILDCARD = 4;
+
     SubstitutionMatrix::FastMatrix fastMatrix;
     uint8_t * targetSeq;
     uint8_t * targetSeqRev;
@@ -32,7 +45,12 @@ private:
     uint8_t * querySeqRev;
     Sequence * querySeqObj;
     int8_t * mat;
-//    uint32_t * cigar;
+    // cigar of the last alignment
+    uint32_t * cigar;
+    int cigarCapacity;
+    // cigar of the extension to the right of the seed
+    uint32_t * rightCigar;
+    int rightCigarCapacity;
     int gapo;
     int gape;
 };
@@ -0,0 +1,296 @@
+#include "DiagonalRescorer.h"
+#include "DistanceCalculator.h"
+#include "Util.h"
+#include "MathUtil.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+
+enum {
+    SCORE_LOCAL = 0,
+    SCORE_START_END = 1
+};
+
+// FastMatrix covers the ascii range up to 'z'
+static const unsigned int ASCII_RANGE = 'z' + 1;
+
+DiagonalRescorer::DiagonalRescorer(const SubstitutionMatrix::FastMatrix &fastMatrix)
+        : fastMatrix(fastMatrix), rowCount(0), querySeq(NULL), queryLen(0), hasProfile(false), profile(NULL), queryCapacity(0) {
+    // residues with the same matrix column get the same profile row
+    for (unsigned int residue = 0; residue < ASCII_RANGE; residue++) {
+        unsigned int row = 0;
+        for (; row < rowCount; row++) {
+            bool isSame = true;
+            for (unsigned int i = 0; i < ASCII_RANGE && isSame; i++) {
+                isSame = fastMatrix.matrix[i][residue] == fastMatrix.matrix[i][rowResidue[row]];
+            }
+            if (isSame) {
+                break;
+            }
+        }
+        if (row == rowCount) {
+            rowResidue[rowCount] = static_cast<unsigned char>(residue);
+            rowCount++;
+        }
+        residueToRow[residue] = static_cast<unsigned char>(row);
+    }
+    for (unsigned int residue = ASCII_RANGE; residue < 256; residue++) {
+        residueToRow[residue] = residueToRow[static_cast<unsigned int>('X')];
+    }
+
+    scores = (int *) mem_align(ALIGN_INT, BLOCK_SIZE * LANES * sizeof(int));
+    Util::checkAllocation(scores, "Could not allocate scores memory in DiagonalRescorer");
+}
+
+DiagonalRescorer::~DiagonalRescorer() {
+    free(scores);
+    delete[] profile;
+}
+
+void DiagonalRescorer::setQuery(const char *querySeq, int queryLen) {
+    this->querySeq = querySeq;
+    this->queryLen = queryLen;
+    hasProfile = false;
+}
+
+void DiagonalRescorer::buildProfile() {
+    if (hasProfile) {
+        return;
+    }
+    if (queryLen > queryCapacity) {
+        delete[] profile;
+        queryCapacity = std::max(queryLen, 2 * queryCapacity);
+        profile = new(std::nothrow) char[static_cast<size_t>(rowCount) * queryCapacity];
+        Util::checkAllocation(profile, "Could not allocate profile memory in DiagonalRescorer");
+        for (unsigned int residue = 0; residue < 256; residue++) {
+            rowOffset[residue] = static_cast<size_t>(residueToRow[residue]) * queryCapacity;
+        }
+    }
+    for (unsigned int row = 0; row < rowCount; row++) {
+        char *profileRow = profile + static_cast<size_t>(row) * queryCapacity;
+        const int residue = rowResidue[row];
+        for (int pos = 0; pos < queryLen; pos++) {
+            profileRow[pos] = fastMatrix.matrix[static_cast<int>(querySeq[pos])][residue];
+        }
+    }
+    hasProfile = true;
+}
+
+bool DiagonalRescorer::computeDiagonal(Hit &hit, int &queryStart, int &targetStart) const {
+    const short diagonal = hit.diagonal;
+    const int distanceToDiagonal = abs(diagonal);
+    if (diagonal >= 0 && distanceToDiagonal < queryLen) {
+        hit.diagonalLen = std::min(hit.targetLen, queryLen - distanceToDiagonal);
+        queryStart = distanceToDiagonal;
+        targetStart = 0;
+        return true;
+    } else if (diagonal < 0 && distanceToDiagonal < hit.targetLen) {
+        hit.diagonalLen = std::min(hit.targetLen - distanceToDiagonal, queryLen);
+        queryStart = 0;
+        targetStart = distanceToDiagonal;
+        return true;
+    }
+    hit.diagonalLen = 0;
+    return false;
+}
+
+void DiagonalRescorer::computeHammingDistance(Hit *hits, size_t hitCount) {
+    // residues per register
+    const unsigned int registerLen = VECSIZE_INT * 4;
+    // every diagonal leaves less than one register, plus one register so that the
+    // rest of a diagonal can always be read from two consecutive masks
+    const size_t maxPackedLen = (hitCount + 1) * registerLen;
+    if (packedQuery.size() < maxPackedLen) {
+        packedQuery.resize(maxPackedLen);
+        packedTarget.resize(maxPackedLen);
+    }
+    queryStarts.resize(hitCount);
+
+    // full registers are compared pair by pair, the rest of every diagonal is packed
+    size_t packedLen = 0;
+    for (size_t i = 0; i < hitCount; i++) {
+        int queryStart, targetStart;
+        if (computeDiagonal(hits[i], queryStart, targetStart) == false) {
+            continue;
+        }
+        const char *query = querySeq + queryStart;
+        const char *target = hits[i].targetSeq + targetStart;
+        const unsigned int restLen = hits[i].diagonalLen % registerLen;
+        const unsigned int fullLen = hits[i].diagonalLen - restLen;
+        hits[i].distance = (fullLen > 0) ? DistanceCalculator::computeHammingDistance(query, target, fullLen) : 0;
+        // start of the rest in the packed residues
+        queryStarts[i] = static_cast<int>(packedLen);
+        memcpy(packedQuery.data() + packedLen, query + fullLen, restLen);
+        memcpy(packedTarget.data() + packedLen, target + fullLen, restLen);
+        packedLen += restLen;
+    }
+    if (packedLen == 0) {
+        return;
+    }
+
+    // residues after packedLen are not read from the masks
+    const size_t registerCount = (packedLen + registerLen - 1) / registerLen + 1;
+    equalMasks.resize(registerCount);
+    for (size_t reg = 0; reg < registerCount; reg++) {
+        const simd_int queryVec = simdi_loadu((const simd_int *) (packedQuery.data() + reg * registerLen));
+        const simd_int targetVec = simdi_loadu((const simd_int *) (packedTarget.data() + reg * registerLen));
+        equalMasks[reg] = static_cast<unsigned int>(simdi8_movemask(simdi8_eq(queryVec, targetVec)));
+    }
+
+    for (size_t i = 0; i < hitCount; i++) {
+        const unsigned int restLen = hits[i].diagonalLen % registerLen;
+        if (restLen == 0) {
+            continue;
+        }
+        const size_t reg = queryStarts[i] / registerLen;
+        const unsigned int shift = queryStarts[i] % registerLen;
+        uint64_t equal = static_cast<uint64_t>(equalMasks[reg]) | (static_cast<uint64_t>(equalMasks[reg + 1]) << registerLen);
+        equal = (equal >> shift) & ((static_cast<uint64_t>(1) << restLen) - 1);
+        hits[i].distance += restLen - MathUtil::popCount(static_cast<int>(equal));
+    }
+}
+
+void DiagonalRescorer::computeSubstitutionDistance(Hit *hits, size_t hitCount, bool globalAlignment) {
+    if (globalAlignment == false) {
+        computeLanes<SCORE_LOCAL>(hits, hitCount);
+        return;
+    }
+    // the plain sum has no dependency between positions, interleaving targets does not pay off
+    buildProfile();
+    for (size_t i = 0; i < hitCount; i++) {
+        int queryStart, targetStart;
+        if (computeDiagonal(hits[i], queryStart, targetStart)) {
+            const unsigned char *target = reinterpret_cast<const unsigned char *>(hits[i].targetSeq) + targetStart;
+            const char *queryProfile = profile + queryStart;
+            int score = 0;
+            for (unsigned int pos = 0; pos < hits[i].diagonalLen; pos++) {
+                score += queryProfile[rowOffset[target[pos]] + pos];
+            }
+            hits[i].distance = static_cast<unsigned int>(std::max(score, 0));
+        }
+    }
+}
+
+void DiagonalRescorer::computeSubstitutionStartEndDistance(Hit *hits, size_t hitCount) {
+    computeLanes<SCORE_START_END>(hits, hitCount);
+}
+
+void DiagonalRescorer::fillBlock(Hit **laneHits, const int *laneQueryStart, const int *laneTargetStart,
+                                 unsigned int laneCount, unsigned int blockStart, unsigned int blockLen) {
+    const unsigned char *target[LANES];
+    const char *queryProfile[LANES];
+    unsigned int laneEnd[LANES];
+    unsigned int minEnd = blockLen;
+    for (unsigned int lane = 0; lane < laneCount; lane++) {
+        const unsigned int diagonalLen = laneHits[lane]->diagonalLen;
+        laneEnd[lane] = (diagonalLen > blockStart) ? std::min(diagonalLen - blockStart, blockLen) : 0;
+        minEnd = std::min(minEnd, laneEnd[lane]);
+        target[lane] = reinterpret_cast<const unsigned char *>(laneHits[lane]->targetSeq) + laneTargetStart[lane] + blockStart;
+        queryProfile[lane] = profile + laneQueryStart[lane] + blockStart;
+    }
+
+    unsigned int pos = 0;
+    if (laneCount == LANES) {
+        // all lanes are still on their diagonal, gather one position of every lane at once
+        for (; pos < minEnd; pos++) {
+            int *posScores = scores + pos * LANES;
+            for (unsigned int lane = 0; lane < LANES; lane++) {
+                posScores[lane] = queryProfile[lane][rowOffset[target[lane][pos]] + pos];
+            }
+        }
+    }
+    for (unsigned int lane = 0; lane < laneCount; lane++) {
+        unsigned int lanePos = pos;
+        for (; lanePos < laneEnd[lane]; lanePos++) {
+            scores[lanePos * LANES + lane] = queryProfile[lane][rowOffset[target[lane][lanePos]] + lanePos];
+        }
+        // shorter diagonals are padded with 0, this neither changes the score nor starts a new maximum
+        for (; lanePos < blockLen; lanePos++) {
+            scores[lanePos * LANES + lane] = 0;
+        }
+    }
+}
+
+template <int type>
+void DiagonalRescorer::computeLanes(Hit *hits, size_t hitCount) {
+    buildProfile();
+    order.clear();
+    queryStarts.resize(hitCount);
+    targetStarts.resize(hitCount);
+    for (size_t i = 0; i < hitCount; i++) {
+        if (computeDiagonal(hits[i], queryStarts[i], targetStarts[i])) {
+            order.emplace_back(hits[i].diagonalLen, i);
+        }
+    }
+    std::sort(order.begin(), order.end(), std::greater<std::pair<unsigned int, unsigned int> >());
+
+    Hit *laneHits[LANES];
+    int laneQueryStart[LANES];
+    int laneTargetStart[LANES];
+    int laneScore[LANES];
+    int laneStart[LANES];
+    int laneEnd[LANES];
+
+    for (size_t group = 0; group < order.size(); group += LANES) {
+        const unsigned int laneCount = static_cast<unsigned int>(std::min(order.size() - group, static_cast<size_t>(LANES)));
+        for (unsigned int lane = 0; lane < laneCount; lane++) {
+            const unsigned int hitIdx = order[group + lane].second;
+            laneHits[lane] = &hits[hitIdx];
+            laneQueryStart[lane] = queryStarts[hitIdx];
+            laneTargetStart[lane] = targetStarts[hitIdx];
+        }
+        if (laneCount < LANES) {
+            memset(scores, 0, BLOCK_SIZE * LANES * sizeof(int));
+        }
+
+        const simd_int vZero = simdi_setzero();
+        const simd_int vOne = simdi32_set(1);
+        simd_int vScore = simdi_setzero();
+        simd_int vMaxScore = simdi_setzero();
+        simd_int vMinPos = simdi32_set(-1);
+        simd_int vMaxStart = simdi_setzero();
+        simd_int vMaxEnd = simdi_setzero();
+
+        // the first lane has the longest diagonal
+        const unsigned int groupLen = order[group].first;
+        for (unsigned int blockStart = 0; blockStart < groupLen; blockStart += BLOCK_SIZE) {
+            const unsigned int blockLen = (groupLen - blockStart < BLOCK_SIZE) ? groupLen - blockStart : BLOCK_SIZE;
+            fillBlock(laneHits, laneQueryStart, laneTargetStart, laneCount, blockStart, blockLen);
+            const simd_int *blockScores = (const simd_int *) scores;
+            for (unsigned int pos = 0; pos < blockLen; pos++) {
+                const simd_int vCurr = simdi_load(blockScores + pos);
+                if (type == SCORE_LOCAL) {
+                    vScore = simdi32_max(simdi32_add(vScore, vCurr), vZero);
+                    vMaxScore = simdi32_max(vMaxScore, vScore);
+                } else {
+                    const simd_int vPos = simdi32_set(static_cast<int>(blockStart + pos));
+                    vScore = simdi32_add(vScore, vCurr);
+                    const simd_int isMinScore = simdi32_gt(vOne, vScore);
+                    vScore = simdi_andnot(isMinScore, vScore);
+                    vMinPos = simdi_or(simdi_and(isMinScore, vPos), simdi_andnot(isMinScore, vMinPos));
+                    const simd_int isNewMaxScore = simdi32_gt(vScore, vMaxScore);
+                    vMaxEnd = simdi_or(simdi_and(isNewMaxScore, vPos), simdi_andnot(isNewMaxScore, vMaxEnd));
+                    vMaxStart = simdi_or(simdi_and(isNewMaxScore, simdi32_add(vMinPos, vOne)),
+                                         simdi_andnot(isNewMaxScore, vMaxStart));
+                    vMaxScore = simdi32_max(vMaxScore, vScore);
+                }
+            }
+        }
+
+        simdi_storeu((simd_int *) laneScore, vMaxScore);
+        if (type == SCORE_START_END) {
+            simdi_storeu((simd_int *) laneStart, vMaxStart);
+            simdi_storeu((simd_int *) laneEnd, vMaxEnd);
+        }
+        for (unsigned int lane = 0; lane < laneCount; lane++) {
+            laneHits[lane]->distance = static_cast<unsigned int>(std::max(laneScore[lane], 0));
+            if (type == SCORE_START_END) {
+                laneHits[lane]->startPos = laneStart[lane];
+                laneHits[lane]->endPos = laneEnd[lane];
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef MMSEQS_DIAGONALRESCORER_H
+#define MMSEQS_DIAGONALRESCORER_H
+
+// Batch rescoring of all hits of one query along their prefilter diagonal.
+// The query profile is built once per query and the ungapped local scores of up to VECSIZE_INT targets
+// are computed side by side in the lanes of a SIMD register. The Hamming distance compares full registers
+// pair by pair and the residues left over by all diagonals packed together, so that short diagonals fill
+// registers as well. The global sum of scores is computed pair by pair from the query profile.
+// Results are identical to the per pair functions of the DistanceCalculator.
+//
+
+#include <cstddef>
+#include <vector>
+
+#include "simd.h"
+#include "SubstitutionMatrix.h"
+
+class DiagonalRescorer {
+public:
+    struct Hit {
+        // input
+        const char *targetSeq;
+        int targetLen;
+        short diagonal;
+        // output
+        unsigned int diagonalLen;
+        unsigned int distance;
+        int startPos;
+        int endPos;
+
+        Hit(const char *targetSeq, int targetLen, short diagonal)
+                : targetSeq(targetSeq), targetLen(targetLen), diagonal(diagonal),
+                  diagonalLen(0), distance(0), startPos(-1), endPos(-1) {}
+    };
+
+    DiagonalRescorer(const SubstitutionMatrix::FastMatrix &fastMatrix);
+    ~DiagonalRescorer();
+
+    void setQuery(const char *querySeq, int queryLen);
+
+    // Hamming distance along the diagonal
+    void computeHammingDistance(Hit *hits, size_t hitCount);
+
+    // ungapped local alignment score or sum of scores along the diagonal if globalAlignment is set,
+    // only the local score is computed in SIMD lanes
+    void computeSubstitutionDistance(Hit *hits, size_t hitCount, bool globalAlignment);
+
+    // ungapped local alignment score with start and end position on the diagonal
+    void computeSubstitutionStartEndDistance(Hit *hits, size_t hitCount);
+
+private:
+    // number of diagonal positions gathered at once, the lanes state is kept between blocks
+    static const unsigned int BLOCK_SIZE = 512;
+    static const unsigned int LANES = VECSIZE_INT;
+
+    const SubstitutionMatrix::FastMatrix &fastMatrix;
+
+    // maps ascii residues to a profile row, residues with identical matrix columns share a row
+    unsigned char residueToRow[256];
+    // first ascii residue of every row
+    unsigned char rowResidue[256];
+    unsigned int rowCount;
+
+    const char *querySeq;
+    int queryLen;
+    // the profile is only built once a score needs it
+    bool hasProfile;
+
+    // start of the profile row of every ascii residue
+    size_t rowOffset[256];
+
+    // rowCount x queryCapacity scores of the query against every row
+    char *profile;
+    int queryCapacity;
+
+    // BLOCK_SIZE x LANES gathered scores, lane major
+    int *scores;
+
+    // hits with a diagonal ordered by decreasing diagonal length, so that lanes of similar length are grouped
+    std::vector<std::pair<unsigned int, unsigned int> > order;
+    std::vector<int> queryStarts;
+    std::vector<int> targetStarts;
+
+    // residues of the diagonals that do not fill a full register, packed one after another
+    std::vector<char> packedQuery;
+    std::vector<char> packedTarget;
+    // equal residues of every register of the packed residues, one bit per residue
+    std::vector<unsigned int> equalMasks;
+
+    void buildProfile();
+
+    // sets the diagonal length and the start of the diagonal in both sequences, false if there is no overlap
+    bool computeDiagonal(Hit &hit, int &queryStart, int &targetStart) const;
+
+    // gathers the profile scores of the positions [blockStart, blockStart + blockLen) of every lane
+    void fillBlock(Hit **laneHits, const int *laneQueryStart, const int *laneTargetStart, unsigned int laneCount,
+                   unsigned int blockStart, unsigned int blockLen);
+
+    template <int type>
+    void computeLanes(Hit *hits, size_t hitCount);
+};
+
+#endif //MMSEQS_DIAGONALRESCORER_H
@@ -9,11 +9,12 @@ const unsigned short Matcher::GAP_OPEN;
 const unsigned short Matcher::GAP_EXTEND;
 
 Matcher::Matcher(int querySeqType, int maxSeqLen, BaseMatrix *m, EvalueComputation * evaluer,
-                 bool aaBiasCorrection, int gapOpen, int gapExtend){
+                 bool aaBiasCorrection, int gapOpen, int gapExtend, int bandWidth){
     this->m = m;
     this->tinySubMat = NULL;
     this->gapOpen = gapOpen;
     this->gapExtend = gapExtend;
+    this->bandWidth = bandWidth;
     if(querySeqType != Sequence::PROFILE_STATE_PROFILE ) {
         setSubstitutionMatrix(m);
     }
@@ -65,9 +66,27 @@ void Matcher::initQuery(Sequence* query){
 }
 
 
+bool Matcher::getSWScore(Sequence *dbSeq, const int covMode, const float covThr, const double evalThr,
+                         s_align &alignment) {
+    int32_t maskLen = currentQuery->L / 2;
+    alignment = aligner->ssw_align_score(dbSeq->int_sequence, dbSeq->L, gapOpen, gapExtend, evaluer, maskLen);
+    return SmithWaterman::canPassThresholds(alignment, evalThr, covMode, covThr);
+}
+
 Matcher::result_t Matcher::getSWResult(Sequence* dbSeq, const int diagonal, const int covMode, const float covThr,
                                        const double evalThr, unsigned int alignmentMode, unsigned int seqIdMode,
-                                       bool isIdentity){
+                                       bool isIdentity, const s_align *scoredAlignment, bool compressBacktrace,
+                                       int bandMinScore){
+    result_t result;
+    getSWResult(result, dbSeq, diagonal, covMode, covThr, evalThr, alignmentMode, seqIdMode, isIdentity, scoredAlignment,
+                compressBacktrace, bandMinScore);
+    return result;
+}
+
+void Matcher::getSWResult(result_t &result, Sequence* dbSeq, const int diagonal, const int covMode, const float covThr,
+                          const double evalThr, unsigned int alignmentMode, unsigned int seqIdMode,
+                          bool isIdentity, const s_align *scoredAlignment, bool compressBacktrace,
+                          int bandMinScore){
     // calculation of the score and traceback of the alignment
     int32_t maskLen = currentQuery->L / 2;
 
@@ -89,6 +108,15 @@ Matcher::result_t Matcher::getSWResult(Sequence* dbSeq, const int diagonal, cons
         }
         alignment = nuclaligner->align(dbSeq,diagonal,evaluer);
         alignmentMode = Matcher::SCORE_COV_SEQID;
+    }else if(isIdentity==false && scoredAlignment != NULL){
+        // only the second pass of ssw_align is left
+        alignment = *scoredAlignment;
+        if (alignmentMode != Matcher::SCORE_ONLY && SmithWaterman::canPassThresholds(alignment, evalThr, covMode, covThr)) {
+            aligner->ssw_align_traceback(alignment, dbSeq->int_sequence, dbSeq->L, gapOpen, gapExtend, alignmentMode, covMode, covThr, maskLen);
+        }
+    }else if(isIdentity==false && bandWidth > 0 && diagonal != INT_MAX){
+        alignment = aligner->ssw_align_banded(dbSeq->int_sequence, dbSeq->L, diagonal, bandWidth, gapOpen, gapExtend,
+                                              alignmentMode, evalThr, evaluer, covMode, covThr, maskLen, bandMinScore);
     }else if(isIdentity==false){
         alignment = aligner->ssw_align(dbSeq->int_sequence, dbSeq->L, gapOpen, gapExtend, alignmentMode, evalThr, evaluer, covMode, covThr, maskLen);
     }else{
@@ -100,45 +128,64 @@ Matcher::result_t Matcher::getSWResult(Sequence* dbSeq, const int diagonal, cons
     float dbcov = 0.0;
     float seqId = 0.0;
     // compute sequence identity
-    std::string backtrace;
+    // the backtrace of the result is overwritten, so that its memory is reused
+    std::string &backtrace = result.backtrace;
+    backtrace.clear();
+    char lengthBuffer[16];
 
     int aaIds = 0;
+    // length of the gapped alignment
+    unsigned int backtraceLength = 0;
     if(alignmentMode == Matcher::SCORE_COV_SEQID){
+        // the compressed backtrace is written run by run, with the same format as compressAlignment
+        char state = 'M';
+        size_t counter = 0;
         if(isIdentity==false){
             if(alignment.cigar){
                 int32_t targetPos = alignment.dbStartPos1, queryPos = alignment.qStartPos1;
                 for (int32_t c = 0; c < alignment.cigarLen; ++c) {
                     char letter = SmithWaterman::cigar_int_to_op(alignment.cigar[c]);
                     uint32_t length = SmithWaterman::cigar_int_to_len(alignment.cigar[c]);
-                    backtrace.reserve(length);
-
-                    for (uint32_t i = 0; i < length; ++i){
-                        if (letter == 'M') {
-                            if (dbSeq->int_sequence[targetPos] == currentQuery->int_sequence[queryPos]){
-                                aaIds++;
-                            }
-                            ++queryPos;
-                            ++targetPos;
-                            backtrace.append("M");
+                    backtraceLength += length;
+                    if (letter == 'M') {
+                        for (uint32_t i = 0; i < length; ++i){
+                            aaIds += (dbSeq->int_sequence[targetPos + i] == currentQuery->int_sequence[queryPos + i]);
+                        }
+                        queryPos += length;
+                        targetPos += length;
+                    } else if (letter == 'I') {
+                        queryPos += length;
+                    } else {
+                        letter = 'D';
+                        targetPos += length;
+                    }
+                    if (compressBacktrace) {
+                        if (letter == state) {
+                            counter += length;
                         } else {
-                            if (letter == 'I') {
-                                ++queryPos;
-                                backtrace.append("I");
-                            }
-                            else{
-                                ++targetPos;
-                                backtrace.append("D");
-                            }
+                            backtrace.append(lengthBuffer, Itoa::u32toa_sse2(static_cast<uint32_t>(counter), lengthBuffer) - 1);
+                            backtrace.push_back(state);
+                            state = letter;
+                            counter = length;
                         }
+                    } else {
+                        backtrace.append(length, letter);
                     }
                 }
             }
         } else {
-            for (int32_t c = 0; c < currentQuery->L; ++c) {
-                aaIds++;
-                backtrace.append("M");
+            aaIds = currentQuery->L;
+            backtraceLength = currentQuery->L;
+            if (compressBacktrace) {
+                counter = currentQuery->L;
+            } else {
+                backtrace.append(currentQuery->L, 'M');
             }
         }
+        if (compressBacktrace) {
+            backtrace.append(lengthBuffer, Itoa::u32toa_sse2(static_cast<uint32_t>(counter), lengthBuffer) - 1);
+            backtrace.push_back(state);
+        }
     }
 
     const unsigned int qStartPos = alignment.qStartPos1;
@@ -158,7 +205,7 @@ Matcher::result_t Matcher::getSWResult(Sequence* dbSeq, const int diagonal, cons
         // compute sequence id
         if(alignment.cigar){
             // OVERWRITE alnLength with gapped value
-            alnLength = backtrace.size();
+            alnLength = backtraceLength;
         }
         seqId = Util::computeSeqId(seqIdMode, aaIds, currentQuery->L, dbSeq->L, alnLength);
 
@@ -180,9 +227,19 @@ Matcher::result_t Matcher::getSWResult(Sequence* dbSeq, const int diagonal, cons
     double evalue = alignment.evalue;
     int bitScore = static_cast<short>(evaluer->computeBitScore(alignment.score1)+0.5);
 
-    result_t result(dbSeq->getDbKey(), bitScore, qcov, dbcov, seqId, evalue, alnLength, qStartPos, qEndPos, currentQuery->L, dbStartPos, dbEndPos, dbSeq->L, backtrace);
-    delete [] alignment.cigar;
-    return result;
+    result.dbKey = dbSeq->getDbKey();
+    result.score = bitScore;
+    result.qcov = qcov;
+    result.dbcov = dbcov;
+    result.seqId = seqId;
+    result.eval = evalue;
+    result.alnLength = alnLength;
+    result.qStartPos = qStartPos;
+    result.qEndPos = qEndPos;
+    result.qLen = currentQuery->L;
+    result.dbStartPos = dbStartPos;
+    result.dbEndPos = dbEndPos;
+    result.dbLen = dbSeq->L;
 }
 
 
@@ -57,18 +57,32 @@ public:
                                           qStartPos(qStartPos), qEndPos(qEndPos), qLen(qLen),
                                           dbStartPos(dbStartPos), dbEndPos(dbEndPos), dbLen(dbLen),
                                           backtrace(backtrace) {};
-        result_t(){};
+        result_t() : dbKey(0), score(0), qcov(0), dbcov(0), seqId(0), eval(0), alnLength(0),
+                     qStartPos(0), qEndPos(0), qLen(0), dbStartPos(0), dbEndPos(0), dbLen(0) {};
     };
 
     Matcher(int querySeqType, int maxSeqLen, BaseMatrix *m,
             EvalueComputation * evaluer, bool aaBiasCorrection,
-            int gapOpen, int gapExtend);
+            int gapOpen, int gapExtend, int bandWidth = 0);
 
     ~Matcher();
 
     // run SSE2 parallelized Smith-Waterman alignment calculation and traceback
+    // scoredAlignment: result of getSWScore for dbSeq, only the second pass of the alignment is computed
+    // compressBacktrace: the backtrace is returned in the compressed format of compressAlignment
+    // bandMinScore: score the banded alignment around diagonal has to reach, see SmithWaterman::ssw_align_banded
     result_t getSWResult(Sequence* dbSeq, const int diagonal, const int covMode, const float covThr, const double evalThr,
-                         unsigned int alignmentMode, unsigned int seqIdMode, bool isIdentical);
+                         unsigned int alignmentMode, unsigned int seqIdMode, bool isIdentical,
+                         const s_align *scoredAlignment = NULL, bool compressBacktrace = false, int bandMinScore = 0);
+
+    // same as above, but overwrites an existing result so that the memory of its backtrace is reused
+    void getSWResult(result_t &result, Sequence* dbSeq, const int diagonal, const int covMode, const float covThr, const double evalThr,
+                     unsigned int alignmentMode, unsigned int seqIdMode, bool isIdentical,
+                     const s_align *scoredAlignment = NULL, bool compressBacktrace = false, int bandMinScore = 0);
+
+    // score only first pass of the alignment of amino acid and profile queries,
+    // returns false if the alignment fails the e-value or coverage threshold and can be skipped
+    bool getSWScore(Sequence *dbSeq, const int covMode, const float covThr, const double evalThr, s_align &alignment);
 
     // need for sorting the results
     static bool compareHits (const result_t &first, const result_t &second){
@@ -113,6 +127,9 @@ private:
     // costs to extend a gap
     int gapExtend;
 
+    // protein hits with a diagonal are aligned in a band of this width around it, 0 aligns the full matrix
+    int bandWidth;
+
     // calculate the query queryProfile for SIMD registers processing 8 elements
     int maxSeqLen;
 
@@ -25,9 +25,18 @@ MsaFilter::MsaFilter(int maxSeqLen, int maxSetSize, SubstitutionMatrix *m){
     this->ksort = new int[maxSetSize];
     this->display = new char[maxSetSize + 2];
     this->keep = new char[maxSetSize];
+    // grown in filter to the size of the MSA
+    this->residueMask = NULL;
+    this->sortedMask = NULL;
+    this->sortedMsa = NULL;
+    this->blockCapacity = 0;
+    this->maskBlocks = 0;
 }
 
 MsaFilter::~MsaFilter() {
+    free(residueMask);
+    free(sortedMask);
+    free(sortedMsa);
     delete [] keep;
     delete [] Nmax;
     delete [] idmaxwin;
@@ -89,26 +98,26 @@ void MsaFilter::filter(const int N_in, const int L, const int coverage, const in
             in[k] = 0;
         }
     }
-    // Determine first[k], last[k]?
-    for (k = 0; k < N_in; ++k)  // do this for ALL sequences, not only those with in[k]==1 (since in[k] may be display[k])
-    {
-        for (i = 0; i < L; ++i)
-            if (X[k][i] < MultipleAlignment::NAA)
-                break;
-        first[k] = i;
-        for (i = (L - 1); i > 0; i--)
-            if (X[k][i] < MultipleAlignment::NAA)
-                break;
-        last[k] = i;
-    }
+    computeResidueMasks(N_in, L, X);
+    const int blockSize = VECSIZE_INT * 4;
 
-    // Determine number of residues nres[k]?
+    // Determine first[k], last[k] and number of residues nres[k]
     for (k = 0; k < N_in; ++k)  // do this for ALL sequences, not only those with in[k]==1 (since in[k] may be display[k])
     {
+        const unsigned int *mask = residueMask + static_cast<size_t>(k) * maskBlocks;
+        first[k] = L;
+        last[k] = 0;
         int nr = 0;
-        for (i = first[k]; i <= last[k]; ++i)
-            if (X[k][i] < MultipleAlignment::NAA)
-                nr++;
+        for (int block = 0; block < maskBlocks; ++block) {
+            if (mask[block] == 0) {
+                continue;
+            }
+            if (first[k] == L) {
+                first[k] = block * blockSize + __builtin_ctz(mask[block]);
+            }
+            last[k] = block * blockSize + (31 - __builtin_clz(mask[block]));
+            nr += MathUtil::popCount(mask[block]);
+        }
         this->nres[k] = nr;
 //        printf("%d nres=%3i  first=%3i  last=%3i\n",k,nr,first[k],last[k]);
         if (nr == 0)
@@ -136,6 +145,8 @@ void MsaFilter::filter(const int N_in, const int L, const int coverage, const in
     for (kk = 0; kk < N_in; ++kk) {
         inkk[kk] = in[ksort[kk]];
     }
+    // the pairwise comparison reads the sequences in ksort order
+    copySortedMsa(N_in, X);
 
     // Initialize N[i], idmax[i], idprev[i]
     for (i = 0; i < first[kfirst]; ++i)
@@ -209,11 +220,14 @@ void MsaFilter::filter(const int N_in, const int L, const int coverage, const in
             qdiff_max = int(qdiff_max_frac * nres[k] + 0.9999);
 //                  printf("k=%-4i  nres=%-4i  qdiff_max=%-4i first=%-4i last=%-4i",k,nres[k],qdiff_max,first[k],last[k]);
             diff = 0;
-            for (int i = first[k]; i <= last[k]; ++i)
-                // enough different residues to reject based on minimum qid with query? => break
-                if (X[k][i] < MultipleAlignment::NAA
-                    && X[k][i] != X[kfirst][i] && ++diff >= qdiff_max)
-                    break;
+            const simd_int * XK = (simd_int *) X[k];
+            const simd_int * XQ = (simd_int *) X[kfirst];
+            const unsigned int *maskK = residueMask + static_cast<size_t>(k) * maskBlocks;
+            // enough different residues to reject based on minimum qid with query? => break
+            for (int block = first[k] / blockSize; block <= last[k] / blockSize && diff < qdiff_max; ++block) {
+                const unsigned int equal = simdi8_movemask(simdi8_eq(XK[block], XQ[block]));
+                diff += MathUtil::popCount(maskK[block] & ~equal);
+            }
 //                  printf("  diff=%4i\n",diff);
             if (diff >= qdiff_max) {
                 keep[k] = 0;
@@ -346,50 +360,47 @@ void MsaFilter::filter(const int N_in, const int L, const int coverage, const in
                 cov_kj = last_kj - first_kj + 1;
                 diff_suff = int(diff_min_frac * std::min(nres[k], cov_kj) + 0.999);  // nres[j]>nres[k] anyway because of sorting
                 diff = 0;
-                const simd_int * XK = (simd_int *) X[k];
-                const simd_int * XJ = (simd_int *) X[j];
-                const int first_kj_simd = first_kj / (VECSIZE_INT * 4);
-                const int last_kj_simd = last_kj / (VECSIZE_INT * 4) + 1;
+                const simd_int * XK = sortedMsa + static_cast<size_t>(kk) * maskBlocks;
+                const simd_int * XJ = sortedMsa + static_cast<size_t>(jj) * maskBlocks;
+                const unsigned int *maskK = sortedMask + static_cast<size_t>(kk) * maskBlocks;
+                const unsigned int *maskJ = sortedMask + static_cast<size_t>(jj) * maskBlocks;
+                const int first_kj_simd = first_kj / blockSize;
+                const int last_kj_simd = last_kj / blockSize + 1;
                 // coverage correction for simd
                 // because we do not always hit the right start with simd.
                 // This works because all sequence vector are initialized with GAPs so the sequnces is surrounded by GAPs
-                const int first_diff_simd_scalar = std::abs(
-                        first_kj_simd * (VECSIZE_INT * 4) - first_kj);
-                const int last_diff_simd_scalar = std::abs(
-                        last_kj_simd * (VECSIZE_INT * 4) - (last_kj + 1));
+                const int first_diff_simd_scalar = std::abs(first_kj_simd * blockSize - first_kj);
+                const int last_diff_simd_scalar = std::abs(last_kj_simd * blockSize - (last_kj + 1));
 
                 cov_kj += (first_diff_simd_scalar + last_diff_simd_scalar);
 
-                // _mm_set1_epi8 pseudo-instruction is slow!
-                const simd_int NAAx16 = simdi8_set(MultipleAlignment::NAA - 1);
-                for (int i = first_kj_simd; i < last_kj_simd && diff < diff_suff; ++i) {
-                    // None SIMD function
-                    // enough different residues to accept? => break
-                    // if (X[k][i] >= NAA || X[j][i] >= NAA)
-                    //    cov_kj--;
-                    // else if (X[k][i] != X[j][i] && ++diff >= diff_suff)
-                    //    break; // accept (k,j)
-
-                    const simd_int NO_AA_K = simdi8_gt(XK[i], NAAx16);  // pos without amino acid in seq k
-                    const simd_int NO_AA_J = simdi8_gt(XJ[i], NAAx16);  // pos without amino acid in seq j
-
-                    // Compute 16 bits indicating positions with GAP, ANY or ENDGAP in seq k or j
-                    // int _mm_movemask_epi8(__m128i a) creates 16-bit mask from most significant bits of
-                    // the 16 signed or unsigned 8-bit integers in a and zero-extends the upper bits.
-                    int res = simdi8_movemask(simdi_or(NO_AA_K, NO_AA_J));
-//                    for (int u = 0; u < 32; ++u) {
-//                        printf("%02d:%02d ", (int) ((char*)&XK[i])[u], (int) ((char*)&XK[i])[u]);
-//                    }
-//                    std::cout << std::endl;
-                    cov_kj -= MathUtil::popCount(res);  // subtract positions that should not contribute to coverage
-
-                    // Compute 16 bit mask that indicates positions where k and j have identical residues
-                    int c = simdi8_movemask(simdi8_eq(XK[i], XJ[i]));
-
-                    // Count positions where  k and j have different amino acids, which is equal to 16 minus the
-                    //  number of positions for which either j and k are equal or which contain ANY, GAP, or ENDGAP
-                    diff += (VECSIZE_INT * 4) - MathUtil::popCount(c | res);
-
+                // None SIMD function
+                // enough different residues to accept? => break
+                // if (X[k][i] >= NAA || X[j][i] >= NAA)
+                //    cov_kj--;
+                // else if (X[k][i] != X[j][i] && ++diff >= diff_suff)
+                //    break; // accept (k,j)
+                // two blocks are compared between the checks, counting past diff_suff does not change the decision
+                int i = first_kj_simd;
+                for (; i + 1 < last_kj_simd && diff < diff_suff; i += 2) {
+                    // positions with an amino acid in seq k and j
+                    const unsigned int both1 = maskK[i] & maskJ[i];
+                    const unsigned int both2 = maskK[i + 1] & maskJ[i + 1];
+                    // subtract positions that should not contribute to coverage
+                    cov_kj -= 2 * blockSize - MathUtil::popCount(both1) - MathUtil::popCount(both2);
+
+                    // masks that indicate positions where k and j have identical residues
+                    const unsigned int equal1 = simdi8_movemask(simdi8_eq(XK[i], XJ[i]));
+                    const unsigned int equal2 = simdi8_movemask(simdi8_eq(XK[i + 1], XJ[i + 1]));
+
+                    // count positions where k and j have different amino acids
+                    diff += MathUtil::popCount(both1 & ~equal1) + MathUtil::popCount(both2 & ~equal2);
+                }
+                if (i < last_kj_simd && diff < diff_suff) {
+                    const unsigned int both = maskK[i] & maskJ[i];
+                    cov_kj -= blockSize - MathUtil::popCount(both);
+                    const unsigned int equal = simdi8_movemask(simdi8_eq(XK[i], XJ[i]));
+                    diff += MathUtil::popCount(both & ~equal);
                 }
 //            // DEBUG
 //            printf("%20.20s with %20.20s:  diff=%i  diff_min_frac*cov_kj=%f  diff_suff=%i  nres=%i  cov_kj=%i\n",sname[k],sname[j],diff,diff_min_frac*cov_kj,diff_suff,nres[k],cov_kj);
@@ -452,6 +463,46 @@ void MsaFilter::filter(const int N_in, const int L, const int coverage, const in
     *N_out = n;
 }
 
+void MsaFilter::computeResidueMasks(int N_in, int L, const char ** X) {
+    const int blockSize = VECSIZE_INT * 4;
+    maskBlocks = (L + blockSize - 1) / blockSize;
+    const size_t size = static_cast<size_t>(N_in) * maskBlocks;
+    if (size > blockCapacity) {
+        residueMask = (unsigned int *) realloc(residueMask, size * sizeof(unsigned int));
+        Util::checkAllocation(residueMask, "Could not allocate residueMask memory in MsaFilter::computeResidueMasks");
+        sortedMask = (unsigned int *) realloc(sortedMask, size * sizeof(unsigned int));
+        Util::checkAllocation(sortedMask, "Could not allocate sortedMask memory in MsaFilter::computeResidueMasks");
+        free(sortedMsa);
+        sortedMsa = malloc_simd_int(size * blockSize);
+        Util::checkAllocation(sortedMsa, "Could not allocate sortedMsa memory in MsaFilter::computeResidueMasks");
+        blockCapacity = size;
+    }
+    // movemask only sets the lower blockSize bits
+    const unsigned int blockMask = (blockSize == 32) ? UINT_MAX : ((1u << blockSize) - 1);
+    // columns from L on are not part of the alignment
+    const unsigned int lastBlockMask = (L % blockSize == 0) ? blockMask : ((1u << (L % blockSize)) - 1);
+    const simd_int NAAx16 = simdi8_set(MultipleAlignment::NAA - 1);
+    for (int k = 0; k < N_in; ++k) {
+        const simd_int * XK = (simd_int *) X[k];
+        unsigned int *mask = residueMask + static_cast<size_t>(k) * maskBlocks;
+        for (int block = 0; block < maskBlocks; ++block) {
+            mask[block] = ~simdi8_movemask(simdi8_gt(XK[block], NAAx16)) & blockMask;
+        }
+        if (maskBlocks > 0) {
+            mask[maskBlocks - 1] &= lastBlockMask;
+        }
+    }
+}
+
+void MsaFilter::copySortedMsa(int N_in, const char ** X) {
+    const size_t blockSize = VECSIZE_INT * 4;
+    for (int kk = 0; kk < N_in; ++kk) {
+        const size_t k = ksort[kk];
+        memcpy(sortedMsa + static_cast<size_t>(kk) * maskBlocks, X[k], maskBlocks * blockSize);
+        memcpy(sortedMask + static_cast<size_t>(kk) * maskBlocks, residueMask + k * maskBlocks, maskBlocks * sizeof(unsigned int));
+    }
+}
+
 void MsaFilter::shuffleSequences(const char ** X, size_t setSize) {
     for (size_t i = 0, j = 0; j < setSize; j++) {
         if (keep[j] != 0) {
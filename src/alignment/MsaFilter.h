@@ -8,6 +8,7 @@
 
 #include <SubstitutionMatrix.h>
 #include "MultipleAlignment.h"
+#include "simd.h"
 
 class MsaFilter {
 
@@ -56,6 +57,12 @@ private:
     // prune sequence based on score
     int prune(int start, int end, float b, char * query, char *target);
 
+    // fills residueMask with one bit per column that is set if the column holds an amino acid
+    void computeResidueMasks(int N_in, int L, const char ** X);
+
+    // copies the sequences and their residue masks in ksort order to sortedMsa and sortedMask
+    void copySortedMsa(int N_in, const char ** X);
+
     BaseMatrix *m;
 
     int maxSeqLen;
@@ -83,6 +90,14 @@ private:
     char* display;
     // keep[k]=1 if sequence is included in amino acid frequencies; 0 otherwise (first=0)
     char *keep;
+    // residueMask[k * maskBlocks + b] has a bit for each of the VECSIZE_INT * 4 columns of the b-th SIMD block of seq k
+    unsigned int *residueMask;
+    // residue masks and sequences in ksort order, the accepted sequences are read one after the other
+    unsigned int *sortedMask;
+    simd_int *sortedMsa;
+    // number of SIMD blocks the buffers above can hold
+    size_t blockCapacity;
+    int maskBlocks;
 };
 
 
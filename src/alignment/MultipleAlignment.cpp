@@ -20,6 +20,14 @@ MultipleAlignment::MultipleAlignment(size_t maxSeqLen, size_t maxSetSize, Substi
     this->aligner = aligner;
     this->subMat = subMat;
     this->queryGaps = new unsigned int[maxMsaSeqLen];
+
+    this->rowBuffer = NULL;
+    this->rowBufferSize = 0;
+    this->rowStride = 0;
+    this->rowLength = 0;
+    this->rowCount = 0;
+    this->rows = NULL;
+    this->rowsSize = 0;
 }
 
 char * MultipleAlignment::initX(int len) {
@@ -30,6 +38,28 @@ char * MultipleAlignment::initX(int len) {
     return ptr;
 }
 
+size_t MultipleAlignment::columnStride(size_t setSize) {
+    return ((setSize + (VECSIZE_INT * 4) - 1) / (VECSIZE_INT * 4)) * (VECSIZE_INT * 4);
+}
+
+void MultipleAlignment::transposeMSA(const char **msaSeqs, size_t setSize, size_t length, char *columns, size_t stride) {
+    // transpose blocks of rows so that the reads stay sequential within each row
+    // and every column receives a cache line sized run of writes
+    const size_t BLOCK_SIZE = 64;
+    for (size_t kStart = 0; kStart < setSize; kStart += BLOCK_SIZE) {
+        const size_t kEnd = std::min(setSize, kStart + BLOCK_SIZE);
+        for (size_t pos = 0; pos < length; pos++) {
+            char *column = columns + pos * stride;
+            for (size_t k = kStart; k < kEnd; k++) {
+                column[k] = msaSeqs[k][pos];
+            }
+        }
+    }
+    for (size_t pos = 0; pos < length; pos++) {
+        std::fill(columns + pos * stride + setSize, columns + (pos + 1) * stride, MultipleAlignment::GAP);
+    }
+}
+
 void MultipleAlignment::deleteMSA(MultipleAlignment::MSAResult * res){
     for(size_t i = 0; i < res->setSize; i++) {
         free(res->msaSequence[i]);
@@ -40,6 +70,8 @@ void MultipleAlignment::deleteMSA(MultipleAlignment::MSAResult * res){
 MultipleAlignment::~MultipleAlignment() {
 
     delete [] queryGaps;
+    free(rowBuffer);
+    delete [] rows;
 }
 
 
@@ -269,6 +301,87 @@ MultipleAlignment::MSAResult MultipleAlignment::computeMSA(Sequence *centerSeq,
     return MSAResult(centerSeqSize, centerSeq->L, edgeSeqs.size() + 1, msaSequence, alignmentResults);
 }
 
+char *MultipleAlignment::nextRow() {
+    if ((rowCount + 1) * rowStride > rowBufferSize) {
+        // rows are only addressed by their index until getMSA, so the buffer can move
+        const size_t size = std::max((rowCount + 1) * rowStride, 2 * rowBufferSize);
+        char *buffer = (char *) malloc_simd_int(size);
+        Util::checkAllocation(buffer, "Could not allocate rowBuffer in MultipleAlignment");
+        if (rowBuffer != NULL) {
+            memcpy(buffer, rowBuffer, rowCount * rowStride);
+            free(rowBuffer);
+        }
+        rowBuffer = buffer;
+        rowBufferSize = size;
+    }
+    char *row = rowBuffer + rowCount * rowStride;
+    rowCount++;
+    return row;
+}
+
+void MultipleAlignment::beginMSA(Sequence *centerSeq) {
+    // same padding as initX
+    rowLength = centerSeq->L;
+    rowStride = (rowLength / (VECSIZE_INT * 4) + 2) * (VECSIZE_INT * 4);
+    rowCount = 0;
+    char *row = nextRow();
+    for (size_t pos = 0; pos < rowLength; pos++) {
+        row[pos] = (char) centerSeq->int_sequence[pos];
+    }
+    std::fill(row + rowLength, row + rowStride, GAP);
+}
+
+void MultipleAlignment::addMember(int qStartPos, int dbStartPos, const char *backtrace,
+                                  const unsigned char *residues, size_t length) {
+    char *row = nextRow();
+    std::fill(row, row + rowStride, GAP);
+    // HACK: score was 0 and sequence was rejected, so we fill in an empty gap sequence
+    if (dbStartPos < 0) {
+        Debug(Debug::WARNING) << "Edge sequence " << (rowCount - 2) << " was not aligned." << "\n";
+        return;
+    }
+    size_t queryPos = qStartPos;
+    size_t targetPos = dbStartPos;
+    // walk over the runs of the compressed backtrace, deletions do not show up in the center coordinates
+    const char *bt = backtrace;
+    while (true) {
+        size_t count = 0;
+        while (*bt >= '0' && *bt <= '9') {
+            count = count * 10 + (*bt - '0');
+            bt++;
+        }
+        const char state = *bt;
+        if (state == 'M') {
+            if (queryPos + count > rowLength || targetPos + count > length) {
+                Debug(Debug::ERROR) << "Backtrace of edge sequence " << (rowCount - 2) << " exceeds its alignment" << "\n";
+                EXIT(EXIT_FAILURE);
+            }
+            for (size_t i = 0; i < count; i++) {
+                row[queryPos++] = residues[targetPos++];
+            }
+        } else if (state == 'I') {
+            queryPos += count;
+        } else if (state == 'D') {
+            targetPos += count;
+        } else {
+            break;
+        }
+        bt++;
+    }
+}
+
+MultipleAlignment::MSAResult MultipleAlignment::getMSA() {
+    if (rowCount > rowsSize) {
+        delete [] rows;
+        rows = new char*[rowCount];
+        rowsSize = rowCount;
+    }
+    for (size_t k = 0; k < rowCount; k++) {
+        rows[k] = rowBuffer + k * rowStride;
+    }
+    return MSAResult(rowLength, rowLength, rowCount, rows);
+}
+
 MultipleAlignment::MSAResult MultipleAlignment::singleSequenceMSA(Sequence *centerSeq) {
     size_t queryMSASize = 0;
     char ** msaSequence = new char *[1];
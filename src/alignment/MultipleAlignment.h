@@ -51,10 +51,25 @@ public:
     // init aligned memory for the MSA
     static char *initX(int len);
 
+    // distance between two columns of a transposed MSA, setSize rounded up to the SIMD width
+    static size_t columnStride(size_t setSize);
+
+    // copy the MSA column-major: residue k of column pos is at columns[pos * stride + k],
+    // columns are padded with GAP from setSize to stride
+    static void transposeMSA(const char **msaSeqs, size_t setSize, size_t length, char *columns, size_t stride);
+
     MSAResult computeMSA(Sequence *pSequence, std::vector<Sequence *> vector, std::vector<Matcher::result_t> vector1,
                          bool i);
     // clean memory for MSA
     static void deleteMSA(MultipleAlignment::MSAResult * res);
+
+    // Builds the same MSA as computeMSA with noDeletionMSA while the alignment results are read, without a Sequence
+    // per member: beginMSA writes the center row, addMember the row of the next member from the compressed backtrace
+    // of its alignment result and its residues mapped to int. The rows are kept in a buffer that is reused by the
+    // next beginMSA, the result of getMSA must not be passed to deleteMSA.
+    void beginMSA(Sequence *centerSeq);
+    void addMember(int qStartPos, int dbStartPos, const char *backtrace, const unsigned char *residues, size_t length);
+    MSAResult getMSA();
 	
 	
 private:
@@ -66,6 +81,17 @@ private:
     size_t maxMsaSeqLen;
     unsigned int * queryGaps;
 
+    // rows of the MSA built by beginMSA and addMember, row k starts at rowBuffer + k * rowStride
+    char *rowBuffer;
+    size_t rowBufferSize;
+    size_t rowStride;
+    size_t rowLength;
+    size_t rowCount;
+    char **rows;
+    size_t rowsSize;
+
+    char *nextRow();
+
     std::vector<Matcher::result_t> computeBacktrace(Sequence *center, std::vector<Sequence *> sequences);
 
     void computeQueryGaps(unsigned int *queryGaps, Sequence *center, std::vector<Sequence *> seqs,
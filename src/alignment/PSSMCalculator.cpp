@@ -2,6 +2,9 @@
 // Created by mad on 3/24/15.
 //
 #include "PSSMCalculator.h"
+
+#include <climits>
+
 #include "simd.h"
 #include "MathUtil.h"
 #include "SubstitutionMatrix.h"
@@ -26,11 +29,15 @@ PSSMCalculator::PSSMCalculator(SubstitutionMatrix *subMat, size_t maxSeqLength,
     for (size_t j = 0; j < maxSeqLength; j++) {
         this->w_contrib[j] = (float *) malloc_simd_int(NAA_VECSIZE * sizeof(float));
     }
-    wi = new float[maxSetSize];
+    // padded to the stride of the transposed MSA
+    wi = (float *) malloc_simd_float(MultipleAlignment::columnStride(maxSetSize) * sizeof(float));
     naa = new int[maxSeqLength];
     this->pca = pca;
     this->pcb = pcb;
-
+    // grown on demand, a transposed MSA of maxSetSize sequences of maxSeqLength can be huge
+    this->msaColumns = NULL;
+    this->msaColumnsSize = 0;
+    this->msaColumnStride = 0;
 }
 
 PSSMCalculator::~PSSMCalculator() {
@@ -45,8 +52,21 @@ PSSMCalculator::~PSSMCalculator() {
         free(w_contrib[j]);
     }
     delete [] w_contrib;
-    delete [] wi;
+    free(wi);
     delete [] naa;
+    free(msaColumns);
+}
+
+void PSSMCalculator::transposeMSA(size_t setSize, size_t queryLength, const char **msaSeqs) {
+    msaColumnStride = MultipleAlignment::columnStride(setSize);
+    const size_t size = msaColumnStride * queryLength;
+    if (size > msaColumnsSize) {
+        free(msaColumns);
+        msaColumns = (char *) malloc_simd_int(size);
+        Util::checkAllocation(msaColumns, "Could not allocate msaColumns in PSSMCalculator");
+        msaColumnsSize = size;
+    }
+    MultipleAlignment::transposeMSA(msaSeqs, setSize, queryLength, msaColumns, msaColumnStride);
 }
 
 PSSMCalculator::Profile PSSMCalculator::computePSSMFromMSA(size_t setSize,
@@ -54,7 +74,8 @@ PSSMCalculator::Profile PSSMCalculator::computePSSMFromMSA(size_t setSize,
                                            const char **msaSeqs,
                                            bool wg) {
     // Quick and dirty calculation of the weight per sequence wg[k]
-    computeSequenceWeights(seqWeight, queryLength, setSize, msaSeqs);
+    transposeMSA(setSize, queryLength, msaSeqs);
+    computeSequenceWeights(seqWeight, queryLength, setSize, msaColumns, msaColumnStride);
     MathUtil::NormalizeTo1(seqWeight, setSize);
     if (wg == false) {
         // compute context specific counts and Neff
@@ -163,13 +184,18 @@ void PSSMCalculator::computeNeff_M(float *frequency, float *seqWeight, float *Ne
     Neff_HMM /= queryLength;
     float Nlim = fmax(10.0, Neff_HMM + 1.0);    // limiting Neff
     float scale = MathUtil::flog2((Nlim - Neff_HMM) / (Nlim - 1.0));  // for calculating Neff for those seqs with inserts at specific pos
-    for (size_t pos = 0; pos < queryLength; pos++) {
-        float w_M = -1.0 / setSize;
-        for (size_t k = 0; k < setSize; ++k){
-            if ( msaSeqs[k][pos] != MultipleAlignment::GAP) {
-                w_M += seqWeight[k];
-            }
+    // sum up w_M of all columns in Neff_M, streaming through the rows keeps the order of the
+    // additions per column and lets the compiler vectorize over the columns
+    std::fill(Neff_M, Neff_M + queryLength, -1.0f / setSize);
+    for (size_t k = 0; k < setSize; ++k) {
+        const char *seq = msaSeqs[k];
+        const float weight = seqWeight[k];
+        for (size_t pos = 0; pos < queryLength; pos++) {
+            Neff_M[pos] += (seq[pos] != MultipleAlignment::GAP) ? weight : 0.0f;
         }
+    }
+    for (size_t pos = 0; pos < queryLength; pos++) {
+        const float w_M = Neff_M[pos];
         Neff_M[pos] = (w_M < 0) ? 1.0 : Nlim - (Nlim - 1.0) * MathUtil::fpow2(scale * w_M);
 //        fprintf(stderr,"M  i=%3i  ncol=---  Neff_M=%5.2f  Nlim=%5.2f  w_M=%5.3f  Neff_M=%5.2f\n",pos,Neff_HMM,Nlim,w_M,Neff_M[pos]);
     }
@@ -177,30 +203,50 @@ void PSSMCalculator::computeNeff_M(float *frequency, float *seqWeight, float *Ne
 
 void PSSMCalculator::computeSequenceWeights(float *seqWeight, size_t queryLength,
                                             size_t setSize, const char **msaSeqs) {
+    const size_t stride = MultipleAlignment::columnStride(setSize);
+    char *msaColumns = (char *) malloc_simd_int(stride * queryLength);
+    Util::checkAllocation(msaColumns, "Could not allocate msaColumns in computeSequenceWeights");
+    MultipleAlignment::transposeMSA(msaSeqs, setSize, queryLength, msaColumns, stride);
+    computeSequenceWeights(seqWeight, queryLength, setSize, msaColumns, stride);
+    free(msaColumns);
+}
+
+void PSSMCalculator::computeSequenceWeights(float *seqWeight, size_t queryLength, size_t setSize,
+                                            const char *msaColumns, size_t stride) {
     unsigned int *number_res = new unsigned int[setSize];
+    // nl * distinct_aa_count of the residue of each sequence in the current column and nres + 30 of each sequence
+    float *residueTerm = (float *) malloc_simd_float(stride * sizeof(float));
+    float *lengthTerm = (float *) malloc_simd_float(stride * sizeof(float));
+    float *weight = (float *) malloc_simd_float(stride * sizeof(float));
     // initialized wg[k] with tiny pseudo counts
-    std::fill(seqWeight, seqWeight + setSize,  1e-6);
+    std::fill(weight, weight + stride, 1e-6);
     // count number of residues per sequence
-    for (size_t k = 0; k < setSize; ++k)
-    {
-        unsigned int nr = 0;
-        for (size_t pos = 0; pos < queryLength; pos++) {
-            if (msaSeqs[k][pos] != MultipleAlignment::GAP) {
-                nr++;
-            }
+    std::fill(number_res, number_res + setSize, 0);
+    for (size_t pos = 0; pos < queryLength; pos++) {
+        const char *column = msaColumns + pos * stride;
+        for (size_t k = 0; k < setSize; ++k) {
+            number_res[k] += (column[k] != MultipleAlignment::GAP);
         }
-        number_res[k] = nr;
     }
+    for (size_t k = 0; k < setSize; ++k) {
+        lengthTerm[k] = float(number_res[k]) + 30.0f;
+    }
+    std::fill(lengthTerm + setSize, lengthTerm + stride, 30.0f);
+
+    // nl * distinct_aa_count of each letter, 0 for X, gaps and the padding
+    float aaTerm[UCHAR_MAX + 1];
+    std::fill(aaTerm, aaTerm + UCHAR_MAX + 1, 0.0f);
+    const simd_float one = simdf32_set(1.0f);
+    const simd_float zero = simdf32_setzero();
     for (size_t pos = 0; pos < queryLength; pos++) {
+        const unsigned char *column = (const unsigned char *) msaColumns + pos * stride;
         int nl[ Sequence::PROFILE_AA_SIZE ];  //nl[a] = number of seq's with amino acid a at position l
         //number of different amino acids (ignore X)
         std::fill(nl, nl + Sequence::PROFILE_AA_SIZE,  0);
         for (size_t k = 0; k < setSize; ++k) {
-            if (msaSeqs[k][pos] != MultipleAlignment::GAP) {
-                const unsigned int aa_pos = msaSeqs[k][pos];
-                if(aa_pos < Sequence::PROFILE_AA_SIZE){
-                    nl[aa_pos]++;
-                }
+            const unsigned int aa_pos = column[k];
+            if (aa_pos < Sequence::PROFILE_AA_SIZE) {
+                nl[aa_pos]++;
             }
         }
         //count distinct amino acids (ignore X)
@@ -210,34 +256,33 @@ void PSSMCalculator::computeSequenceWeights(float *seqWeight, size_t queryLength
                 ++distinct_aa_count;
             }
         }
-//        if(distinct_aa_count == 0){
-//            Debug(Debug::ERROR) << "Error in computeSequenceWeights. Distinct amino acid count is 0.\n";
-//            EXIT(EXIT_FAILURE);
-//        }
+        // no contribution to any sequence
+        if (distinct_aa_count == 0) {
+            continue;
+        }
         // Compute sequence Weight
         // "Position-based Sequence Weights", Henikoff (1994)
-        for (size_t k = 0; k < setSize; ++k) {
-            if (msaSeqs[k][pos] != MultipleAlignment::GAP) {
-                if(distinct_aa_count == 0){
-                    seqWeight[k] += 0.0;
-                } else {
-                    const unsigned int aa_pos = msaSeqs[k][pos];
-//                    std::cout << "k="<< k << "\t";
-                    if(aa_pos < Sequence::PROFILE_AA_SIZE){ // Treat score of X with other amino acid as 0.0
-                        seqWeight[k] += 1.0f / (float(nl[aa_pos]) * float(distinct_aa_count) * (float(number_res[k]) + 30.0f));
-//                        std::cout << number_res[k] << "\t" << distinct_aa_count << "\t" <<  nl[aa_pos] << "\t";
-                    }
-                }
-                // ensure that each residue of a short sequence contributes as much as a residue of a long sequence:
-                // contribution is proportional to one over sequence length nres[k] plus 30.
-            }
+        // ensure that each residue of a short sequence contributes as much as a residue of a long sequence:
+        // contribution is proportional to one over sequence length nres[k] plus 30.
+        for (size_t aa = 0; aa < Sequence::PROFILE_AA_SIZE; ++aa) {
+            aaTerm[aa] = float(nl[aa]) * float(distinct_aa_count);
+        }
+        for (size_t k = 0; k < stride; ++k) {
+            residueTerm[k] = aaTerm[column[k]];
+        }
+        // the products and the division are evaluated as in the scalar formula
+        // 1.0f / (nl * distinct_aa_count * (nres + 30.0f)), each sequence receives the same sums
+        for (size_t k = 0; k < stride; k += VECSIZE_FLOAT) {
+            const simd_float term = simdf32_load(residueTerm + k);
+            const simd_float contribution = simdf32_div(one, simdf32_mul(term, simdf32_load(lengthTerm + k)));
+            const simd_float isResidue = simdf32_gt(term, zero);
+            simdf32_store(weight + k, simdf32_add(simdf32_load(weight + k), simdf32_and(isResidue, contribution)));
         }
     }
-//    std::cout << setSize << std::endl;
-//    std::cout << " Seq. Weight: " << std::endl;
-//    for (size_t k = 0; k < setSize; ++k) {
-//        std::cout << " k="<< k << "\t" << seqWeight[k] << std::endl;
-//    }
+    std::copy(weight, weight + setSize, seqWeight);
+    free(weight);
+    free(lengthTerm);
+    free(residueTerm);
     delete [] number_res;
 }
 
@@ -263,17 +308,19 @@ void PSSMCalculator::computePseudoCounts(float *profile, float *frequency,
 }
 
 void PSSMCalculator::computeMatchWeights(float * matchWeight, float * seqWeight, size_t setSize, size_t queryLength, const char **msaSeqs) {
-    for (size_t pos = 0; pos < queryLength; pos++) {
-        memset(matchWeight + pos * Sequence::PROFILE_AA_SIZE, 0,
-               Sequence::PROFILE_AA_SIZE * sizeof(float));
-        for (size_t k = 0; k < setSize; ++k){
-            if(msaSeqs[k][pos] != MultipleAlignment::GAP){
-                unsigned int aa_pos = msaSeqs[k][pos];
-                if(aa_pos < Sequence::PROFILE_AA_SIZE) { // Treat score of X with other amino acid as 0.0
-                    matchWeight[pos * Sequence::PROFILE_AA_SIZE + aa_pos] += seqWeight[k];
-                }
+    memset(matchWeight, 0, queryLength * Sequence::PROFILE_AA_SIZE * sizeof(float));
+    // row by row, consecutive additions go to different columns instead of waiting for each other
+    for (size_t k = 0; k < setSize; ++k) {
+        const char *seq = msaSeqs[k];
+        const float weight = seqWeight[k];
+        for (size_t pos = 0; pos < queryLength; pos++) {
+            const unsigned int aa_pos = seq[pos];
+            if (aa_pos < Sequence::PROFILE_AA_SIZE) { // Treat score of X with other amino acid as 0.0
+                matchWeight[pos * Sequence::PROFILE_AA_SIZE + aa_pos] += weight;
             }
         }
+    }
+    for (size_t pos = 0; pos < queryLength; pos++) {
         MathUtil::NormalizeTo1(&matchWeight[pos * Sequence::PROFILE_AA_SIZE], Sequence::PROFILE_AA_SIZE, subMat->pBack);
     }
 }
@@ -304,23 +351,26 @@ void PSSMCalculator::computeContextSpecificWeights(float * matchWeight, float *w
         for (int i = queryLength - 1; i >= 0 && X[k][i] == MultipleAlignment::GAP; i--)
             ((char**)X)[k][i] = ENDGAP;
     }
+    // the loops over all sequences of a column read the transposed MSA
+    transposeMSA(setSize, queryLength, X);
     //////////////////////////////////////////////////////////////////////////////////////////////
     // Main loop through alignment columns
     for (size_t i = 0; i < queryLength; i++)  // Calculate wi[k] at position i as well as Neff[i]
     {
         bool change = 0;
+        const char *column = msaColumns + i * msaColumnStride;
+        const char *prevColumn = (i == 0) ? NULL : column - msaColumnStride;
         // Check all sequences k and update n[j][a] and ri[j] if necessary
         for (size_t k = 0; k < setSize; ++k) {
             // Update amino acid and GAP / ENDGAP counts for sequences with AA in i-1 and GAP/ENDGAP in i or vice versa
-//            printf("%d %d %d\n", k, i, (int) X[k][i - 1]);
-            if ((i == 0  && X[k][i] < MultipleAlignment::ANY) ||
-                (i != 0  && X[k][i - 1] >= MultipleAlignment::ANY && X[k][i] < MultipleAlignment::ANY)) {  // ... if sequence k was NOT included in i-1 and has to be included for column i
+            if ((i == 0  && column[k] < MultipleAlignment::ANY) ||
+                (i != 0  && prevColumn[k] >= MultipleAlignment::ANY && column[k] < MultipleAlignment::ANY)) {  // ... if sequence k was NOT included in i-1 and has to be included for column i
                 change = 1;
                 nseqi++;
                 for (size_t j = 0; j < queryLength; ++j){
                     n[j][(int) X[k][j]]++;
                 }
-            } else if ( i != 0 && X[k][i - 1] < MultipleAlignment::ANY && X[k][i] >= MultipleAlignment::ANY) {  // ... if sequence k WAS included in i-1 and has to be thrown out for column i
+            } else if ( i != 0 && prevColumn[k] < MultipleAlignment::ANY && column[k] >= MultipleAlignment::ANY) {  // ... if sequence k WAS included in i-1 and has to be thrown out for column i
                 change = 1;
                 nseqi--;
                 for (size_t j = 0; j < queryLength; ++j)
@@ -341,7 +391,7 @@ void PSSMCalculator::computeContextSpecificWeights(float * matchWeight, float *w
 
             // Initialize weights and numbers of residues for subalignment i
             int ncol = 0;
-            for (size_t k = 0; k < setSize; ++k)
+            for (size_t k = 0; k < msaColumnStride; ++k)
                 wi[k] = 1E-8;  // for pathological alignments all wi[k] can get 0;
 
             // Find min and max borders between which > fraction MAXENDGAPFRAC of sequences in subalignment contain an aa
@@ -361,7 +411,7 @@ void PSSMCalculator::computeContextSpecificWeights(float * matchWeight, float *w
             if (ncol < NCOLMIN) {
                 // Take global weights
                 for (size_t k = 0; k < setSize; ++k){
-                    wi[k] = (X[k][i] < MultipleAlignment::ANY)? wg[k] : 0.0f;
+                    wi[k] = (column[k] < MultipleAlignment::ANY)? wg[k] : 0.0f;
                 }
             } else {
                 // Count number of different amino acids in column j
@@ -388,11 +438,39 @@ void PSSMCalculator::computeContextSpecificWeights(float * matchWeight, float *w
                 }
 
                 // Compute pos-specific weights wi[k]
+                // each wi[k] still sums up its contributions from jmin to jmax in order,
+                // but the sums of different sequences are computed side by side from the transposed MSA
+#ifdef AVX2
+                const __m256i seven = _mm256_set1_epi32(7);
+                const __m256i fifteen = _mm256_set1_epi32(15);
+                for (size_t k = 0; k < setSize; k += 8) {
+                    __m256 weight = _mm256_load_ps(wi + k);
+                    for (int j = jmin; j <= jmax; ++j) {  // innermost, time-critical loop; O(L*setSize*L)
+                        const float *contrib = w_contrib[j];
+                        const __m128i residues = _mm_loadl_epi64((const __m128i *) (msaColumns + j * msaColumnStride + k));
+                        const __m256i aa = _mm256_cvtepu8_epi32(residues);
+                        // look up w_contrib[j][aa] in the three blocks of eight letters
+                        __m256 value = _mm256_permutevar8x32_ps(_mm256_load_ps(contrib), aa);
+                        value = _mm256_blendv_ps(value, _mm256_permutevar8x32_ps(_mm256_load_ps(contrib + 8), aa),
+                                                 _mm256_castsi256_ps(_mm256_cmpgt_epi32(aa, seven)));
+                        value = _mm256_blendv_ps(value, _mm256_permutevar8x32_ps(_mm256_load_ps(contrib + 16), aa),
+                                                 _mm256_castsi256_ps(_mm256_cmpgt_epi32(aa, fifteen)));
+                        weight = _mm256_add_ps(weight, value);
+                    }
+                    _mm256_store_ps(wi + k, weight);
+                }
+#else
+                for (int j = jmin; j <= jmax; ++j) {  // O(L*setSize*L)
+                    const char *columnJ = msaColumns + j * msaColumnStride;
+                    const float *contrib = w_contrib[j];
+                    for (size_t k = 0; k < setSize; ++k)  // innermost, time-critical loop
+                        wi[k] += contrib[(int) columnJ[k]];
+                }
+#endif
+                // sequences that are not part of the subalignment keep their initial weight
                 for (size_t k = 0; k < setSize; ++k) {
-                    if (X[k][i] >= MultipleAlignment::ANY)
-                        continue;
-                    for (int j = jmin; j <= jmax; ++j)  // innermost, time-critical loop; O(L*setSize*L)
-                        wi[k] += w_contrib[j][(int) X[k][j]];
+                    if (column[k] >= MultipleAlignment::ANY)
+                        wi[k] = 1E-8;
                 }
             }
 
@@ -442,7 +520,7 @@ void PSSMCalculator::computeContextSpecificWeights(float * matchWeight, float *w
         for (int a = 0; a < 20; ++a)
             matchWeight[i * Sequence::PROFILE_AA_SIZE + a] = 0.0;
         for (size_t k = 0; k < setSize; ++k)
-            matchWeight[i * Sequence::PROFILE_AA_SIZE + (int) X[k][i]] += wi[k];
+            matchWeight[i * Sequence::PROFILE_AA_SIZE + (int) column[k]] += wi[k];
         MathUtil::NormalizeTo1((matchWeight+ i * Sequence::PROFILE_AA_SIZE), MultipleAlignment::NAA, subMat->pBack);
     }
     // remove end gaps
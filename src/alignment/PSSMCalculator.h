@@ -37,6 +37,10 @@ public:
     // Compute weight for sequence based on "Position-based Sequence Weights' (1994)
     static void computeSequenceWeights(float *seqWeight, size_t queryLength, size_t setSize, const char **msaSeqs);
 
+    // same on an MSA transposed by MultipleAlignment::transposeMSA
+    static void computeSequenceWeights(float *seqWeight, size_t queryLength, size_t setSize,
+                                       const char *msaColumns, size_t stride);
+
 private:
     SubstitutionMatrix * subMat;
 
@@ -72,6 +76,13 @@ private:
 
     size_t maxSeqLength;
 
+    // column-major copy of the current MSA, see MultipleAlignment::transposeMSA
+    char *msaColumns;
+    size_t msaColumnsSize;
+    size_t msaColumnStride;
+
+    void transposeMSA(size_t setSize, size_t queryLength, const char **msaSeqs);
+
     // compute position-specific scoring matrix PSSM score
     // 1.) convert PFM to PPM (position probability matrix)
     //     Both PPMs assume statistical independence between positions in the pattern
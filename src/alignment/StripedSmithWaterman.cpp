@@ -53,10 +53,22 @@ SmithWaterman::SmithWaterman(size_t maxSequenceLength, int aaSize, bool aaBiasCo
 	profile->mat_rev            = new int8_t[maxSequenceLength * aaSize * 2];
 	profile->mat                = new int8_t[maxSequenceLength * aaSize * 2];
 	tmp_composition_bias   = new float[maxSequenceLength];
+	tmp_background_score   = new float[aaSize];
 	/* array to record the largest score of each reference position */
 	maxColumn = new uint8_t[maxSequenceLength*sizeof(uint16_t)];
 	memset(maxColumn, 0, maxSequenceLength*sizeof(uint16_t));
 
+	// banded_sw buffers, they grow with the largest alignment and are reused
+	bandCapacity = 8;
+	h_b = (int32_t*)malloc(bandCapacity * sizeof(int32_t));
+	e_b = (int32_t*)malloc(bandCapacity * sizeof(int32_t));
+	h_c = (int32_t*)malloc(bandCapacity * sizeof(int32_t));
+	directionCapacity = 1024;
+	direction = (int8_t*)malloc(directionCapacity * sizeof(int8_t));
+	cigarCapacity = 16;
+	cigarReverse = (uint32_t*)malloc(cigarCapacity * sizeof(uint32_t));
+	cigarBuffer = (uint32_t*)malloc(cigarCapacity * sizeof(uint32_t));
+
 	memset(profile->query_sequence, 0, maxSequenceLength * sizeof(int8_t));
 	memset(profile->query_rev_sequence, 0, maxSequenceLength * sizeof(int8_t));
 	memset(profile->mat_rev, 0, maxSequenceLength * aaSize);
@@ -82,7 +94,14 @@ SmithWaterman::~SmithWaterman(){
 	delete [] profile->mat_rev;
 	delete [] profile->mat;
 	delete [] tmp_composition_bias;
+	delete [] tmp_background_score;
 	delete [] maxColumn;
+	free(h_b);
+	free(e_b);
+	free(h_c);
+	free(direction);
+	free(cigarReverse);
+	free(cigarBuffer);
 	delete profile;
 }
 
@@ -136,11 +155,24 @@ s_align SmithWaterman::ssw_align (
 		EvalueComputation * evaluer,
 		const int covMode, const float covThr,
 		const int32_t maskLen) {
+	s_align r = ssw_align_score(db_sequence, db_length, gap_open, gap_extend, evaluer, maskLen);
+	if (alignmentMode == 0 || ((alignmentMode == 2 || alignmentMode == 1) && canPassThresholds(r, evalueThr, covMode, covThr) == false)){
+		return r;
+	}
+	ssw_align_traceback(r, db_sequence, db_length, gap_open, gap_extend, alignmentMode, covMode, covThr, maskLen);
+	return r;
+}
 
-	alignment_end* bests = 0, *bests_reverse = 0;
-	int32_t word = 0, query_length = profile->query_length;
-	int32_t band_width = 0;
-	cigar* path;
+s_align SmithWaterman::ssw_align_score (
+		const int *db_sequence,
+		int32_t db_length,
+		const uint8_t gap_open,
+		const uint8_t gap_extend,
+		EvalueComputation * evaluer,
+		const int32_t maskLen) {
+
+	alignment_end* bests = 0;
+	int32_t query_length = profile->query_length;
 	s_align r;
 	r.dbStartPos1 = -1;
 	r.qStartPos1 = -1;
@@ -155,16 +187,15 @@ s_align SmithWaterman::ssw_align (
 		bests = sw_sse2_byte(db_sequence, 0, db_length, query_length, gap_open, gap_extend, profile->profile_byte, -1, profile->bias, maskLen);
 
 		if (profile->profile_word && bests[0].score == 255) {
-			free(bests);
+			buildWordProfile();
 			bests = sw_sse2_word(db_sequence, 0, db_length, query_length, gap_open, gap_extend, profile->profile_word, -1, maskLen);
-			word = 1;
 		} else if (bests[0].score == 255) {
 			fprintf(stderr, "Please set 2 to the score_size parameter of the function ssw_init, otherwise the alignment results will be incorrect.\n");
 			EXIT(EXIT_FAILURE);
 		}
 	}else if (profile->profile_word) {
+		buildWordProfile();
 		bests = sw_sse2_word(db_sequence, 0, db_length, query_length, gap_open, gap_extend, profile->profile_word, -1, maskLen);
-		word = 1;
 	}else {
 		fprintf(stderr, "Please call the function ssw_init before ssw_align.\n");
 		EXIT(EXIT_FAILURE);
@@ -179,20 +210,38 @@ s_align SmithWaterman::ssw_align (
 		r.score2 = 0;
 		r.ref_end2 = -1;
 	}
-	free(bests);
-	int32_t queryOffset = query_length - r.qEndPos1;
 	r.evalue = evaluer->computeEvalue(r.score1, query_length);
-	bool hasLowerEvalue = r.evalue > evalueThr;
 	r.qCov = computeCov(0, r.qEndPos1, query_length);
 	r.tCov = computeCov(0, r.dbEndPos1, db_length);
-    bool hasLowerCoverage = !(Util::hasCoverage(covThr, covMode, r.qCov, r.tCov));
+	return r;
+}
 
-	if (alignmentMode == 0 || ((alignmentMode == 2 || alignmentMode == 1) && hasLowerEvalue && hasLowerCoverage)){
-		goto end;
-	}
+bool SmithWaterman::canPassThresholds(const s_align &r, const double evalueThr, const int covMode, const float covThr) {
+	// the e-value is final, the coverage is an upper bound as long as the start position is not known
+	return r.evalue <= evalueThr && Util::hasCoverage(covThr, covMode, r.qCov, r.tCov);
+}
+
+void SmithWaterman::ssw_align_traceback (
+		s_align &r,
+		const int *db_sequence,
+		int32_t db_length,
+		const uint8_t gap_open,
+		const uint8_t gap_extend,
+		const uint8_t alignmentMode,
+		const int covMode, const float covThr,
+		const int32_t maskLen) {
+
+	alignment_end* bests_reverse = 0;
+	int32_t query_length = profile->query_length;
+	int32_t band_width = 0;
+	int32_t cigarLen;
+	int32_t queryOffset = query_length - r.qEndPos1;
+	// same overflow test as in sw_sse2_byte, the first pass switched to words for these scores
+	const bool word = profile->profile_byte == NULL || r.score1 + profile->bias >= 255;
+	bool hasLowerCoverage;
 
 	// Find the beginning position of the best alignment.
-	if (word == 0) {
+	if (word == false) {
 		if(profile->sequence_type == Sequence::HMM_PROFILE || profile->sequence_type == Sequence::PROFILE_STATE_PROFILE) {
 			createQueryProfile<int8_t, VECSIZE_INT * 4, PROFILE>(profile->profile_rev_byte, profile->query_rev_sequence, NULL, profile->mat_rev,
 																 r.qEndPos1 + 1, profile->alphabetSize, profile->bias, queryOffset, profile->query_length);
@@ -224,9 +273,8 @@ s_align SmithWaterman::ssw_align (
 	r.qCov = computeCov(r.qStartPos1, r.qEndPos1, query_length);
 	r.tCov = computeCov(r.dbStartPos1, r.dbEndPos1, db_length);
 	hasLowerCoverage = !(Util::hasCoverage(covThr, covMode, r.qCov, r.tCov));
-	free(bests_reverse);
 	if (alignmentMode == 1 || hasLowerCoverage) // just start and end point are needed
-		goto end;
+		return;
 
 	// Generate cigar.
 	db_length = r.dbEndPos1 - r.dbStartPos1 + 1;
@@ -234,32 +282,293 @@ s_align SmithWaterman::ssw_align (
 	band_width = abs(db_length - query_length) + 1;
 
 	if(profile->sequence_type == Sequence::HMM_PROFILE || profile->sequence_type == Sequence::PROFILE_STATE_PROFILE) {
-		path = banded_sw<PROFILE>(db_sequence + r.dbStartPos1, profile->query_sequence + r.qStartPos1,
+		cigarLen = banded_sw<PROFILE>(db_sequence + r.dbStartPos1, profile->query_sequence + r.qStartPos1,
 				NULL, db_length, query_length,
 				r.qStartPos1, r.score1, gap_open, gap_extend, band_width,
 				profile->mat, profile->query_length);
 	}else {
-		path = banded_sw<SUBSTITUTIONMATRIX>(db_sequence + r.dbStartPos1,
+		cigarLen = banded_sw<SUBSTITUTIONMATRIX>(db_sequence + r.dbStartPos1,
 				profile->query_sequence + r.qStartPos1,
 				profile->composition_bias + r.qStartPos1,
 				db_length, query_length, r.qStartPos1, r.score1,
 				gap_open, gap_extend, band_width,
 				profile->mat, profile->alphabetSize);
 	}
-	if (path == 0) {
-		;
+	if (cigarLen > 0) {
+		r.cigar = cigarBuffer;
+		r.cigarLen = cigarLen;
 	}
-	else {
-		r.cigar = path->seq;
-		r.cigarLen = path->length;
-	}	delete(path);
+}
 
 
-	end:
-	return r;
+
+int SmithWaterman::resolveDiagonal(int diagonal, int32_t db_length) const {
+	// the prefilter stores the diagonal as unsigned short, longer sequences are only known modulo 65536
+	const int32_t query_length = profile->query_length;
+	int resolved = INT_MAX;
+	for (int candidate = static_cast<short>(diagonal) - 65536; candidate <= query_length - 1; candidate += 65536) {
+		if (candidate < -(db_length - 1)) {
+			continue;
+		}
+		if (resolved != INT_MAX) {
+			return INT_MAX;
+		}
+		resolved = candidate;
+	}
+	return resolved;
 }
 
+s_align SmithWaterman::ssw_align_banded (
+		const int *db_sequence,
+		int32_t db_length,
+		int diagonal,
+		int32_t bandWidth,
+		const uint8_t gap_open,
+		const uint8_t gap_extend,
+		const uint8_t alignmentMode,
+		const double evalueThr,
+		EvalueComputation * evaluer,
+		const int covMode, const float covThr,
+		const int32_t maskLen,
+		const int32_t minScore) {
+	const int32_t query_length = profile->query_length;
+	const int32_t shorterLength = std::min(query_length, db_length);
+	diagonal = resolveDiagonal(diagonal, db_length);
+	s_align r;
+	r.score1 = 0;
+	while (diagonal != INT_MAX && bandWidth > 0 && (2 * bandWidth + 1) * BANDED_MIN_GAIN <= shorterLength) {
+		int32_t cigarLen;
+		bool touchesBorder;
+		if(profile->sequence_type == Sequence::HMM_PROFILE || profile->sequence_type == Sequence::PROFILE_STATE_PROFILE) {
+			touchesBorder = banded_diagonal_sw<PROFILE>(r, cigarLen, db_sequence, db_length, diagonal, bandWidth, gap_open, gap_extend);
+		} else {
+			touchesBorder = banded_diagonal_sw<SUBSTITUTIONMATRIX>(r, cigarLen, db_sequence, db_length, diagonal, bandWidth, gap_open, gap_extend);
+		}
+		if (r.score1 == 0) {
+			break;
+		}
+		if (touchesBorder == false) {
+			// the band missed the alignment the prefilter found on another diagonal
+			if (r.score1 < minScore) {
+				break;
+			}
+			r.score2 = 0;
+			r.ref_end2 = -1;
+			r.evalue = evaluer->computeEvalue(r.score1, query_length);
+			r.qCov = computeCov(r.qStartPos1, r.qEndPos1, query_length);
+			r.tCov = computeCov(r.dbStartPos1, r.dbEndPos1, db_length);
+			r.cigar = 0;
+			r.cigarLen = 0;
+			if (alignmentMode == 0) {
+				// same fields as the score only pass of ssw_align
+				r.dbStartPos1 = -1;
+				r.qStartPos1 = -1;
+				r.qCov = computeCov(0, r.qEndPos1, query_length);
+				r.tCov = computeCov(0, r.dbEndPos1, db_length);
+			}
+			// the prefilter expects an alignment that passes the thresholds, it might lie outside of the band
+			if (minScore > 0 && canPassThresholds(r, evalueThr, covMode, covThr) == false) {
+				break;
+			}
+			if (alignmentMode == 2) {
+				r.cigar = cigarBuffer;
+				r.cigarLen = cigarLen;
+			}
+			return r;
+		}
+		// the best path might leave the band, retry with a wider one
+		bandWidth *= 2;
+	}
+	return ssw_align(db_sequence, db_length, gap_open, gap_extend, alignmentMode, evalueThr, evaluer, covMode, covThr, maskLen);
+}
+
+template <const unsigned int type>
+bool SmithWaterman::banded_diagonal_sw(s_align &r, int32_t &cigarLen, const int *db_sequence, int32_t db_length,
+									   int diagonal, int32_t bandWidth, const uint8_t gap_open, const uint8_t gap_extend) {
+#define kroundup32(x) (--(x), (x)|=(x)>>1, (x)|=(x)>>2, (x)|=(x)>>4, (x)|=(x)>>8, (x)|=(x)>>16, ++(x))
+	// band cell k of query row i is the target position j = i - diagonal + k - bandWidth
+	// direction bits: 0-1 source of H (0: start, 1: diagonal, 2: E, 3: F), 2: E extends E, 3: F extends F
+	const int32_t query_length = profile->query_length;
+	const int8_t *query_sequence = profile->query_sequence;
+	const int8_t *compositionBias = profile->composition_bias;
+	const int8_t *mat = profile->mat;
+	const int32_t n = (type == PROFILE) ? query_length : profile->alphabetSize;
+	const int32_t width = 2 * bandWidth + 1;
+	const int32_t minusInf = INT_MIN / 2;
+
+	// rows that share at least one cell with the target
+	const int32_t rowStart = std::max(0, diagonal - bandWidth);
+	const int32_t rowEnd = std::min(query_length - 1, db_length - 1 + diagonal + bandWidth);
+
+	// h_b and e_b hold one row of the band and one cell right of it, the row is updated in place since cell k
+	// only needs the cells k and k + 1 of the previous row
+	while (width + 1 >= bandCapacity) {
+		++bandCapacity;
+		kroundup32(bandCapacity);
+		h_b = (int32_t*)realloc(h_b, bandCapacity * sizeof(int32_t));
+		e_b = (int32_t*)realloc(e_b, bandCapacity * sizeof(int32_t));
+		h_c = (int32_t*)realloc(h_c, bandCapacity * sizeof(int32_t));
+	}
+	const int64_t directionSize = static_cast<int64_t>(rowEnd - rowStart + 1) * width;
+	while (directionSize >= directionCapacity) {
+		++directionCapacity;
+		kroundup32(directionCapacity);
+		direction = (int8_t*)realloc(direction, directionCapacity * sizeof(int8_t));
+	}
+	for (int32_t k = 0; k <= width; k++) {
+		h_b[k] = 0;
+		e_b[k] = minusInf;
+	}
+
+	int32_t max = 0, maxI = -1, maxJ = -1, maxK = -1;
+	for (int32_t i = rowStart; i <= rowEnd; i++) {
+		int8_t *directionRow = direction + static_cast<int64_t>(i - rowStart) * width;
+		const int32_t jOffset = i - diagonal - bandWidth;
+		const int32_t kStart = std::max(0, -jOffset);
+		const int32_t kEnd = std::min(width - 1, db_length - 1 - jOffset);
+		for (int32_t k = 0; k < kStart; k++) {
+			h_b[k] = 0;
+			e_b[k] = minusInf;
+		}
+		int32_t hLeft = 0, f = minusInf;
+		for (int32_t k = kStart; k <= kEnd; k++) {
+			const int32_t j = jOffset + k;
+			int8_t d = 0;
+			const int32_t eOpen = h_b[k + 1] - gap_open;
+			const int32_t eExtend = e_b[k + 1] - gap_extend;
+			int32_t e;
+			if (eExtend >= eOpen) {
+				e = eExtend;
+				d |= 4;
+			} else {
+				e = eOpen;
+			}
+			const int32_t fOpen = hLeft - gap_open;
+			const int32_t fExtend = f - gap_extend;
+			if (fExtend >= fOpen) {
+				f = fExtend;
+				d |= 8;
+			} else {
+				f = fOpen;
+			}
+			int32_t h = h_b[k];
+			if (type == SUBSTITUTIONMATRIX) {
+				h += mat[db_sequence[j] * n + query_sequence[i]] + compositionBias[i];
+			}
+			if (type == PROFILE) {
+				h += mat[db_sequence[j] * n + i];
+			}
+			if (h >= e && h >= f) {
+				d |= 1;
+			} else if (e >= f) {
+				h = e;
+				d |= 2;
+			} else {
+				h = f;
+				d |= 3;
+			}
+			if (h <= 0) {
+				h = 0;
+				d &= ~3;
+			}
+			// the earliest target position wins ties, then the earliest query position
+			if (h > max || (h == max && h > 0 && j < maxJ)) {
+				max = h;
+				maxI = i;
+				maxJ = j;
+				maxK = k;
+			}
+			h_b[k] = h;
+			e_b[k] = e;
+			directionRow[k] = d;
+			hLeft = h;
+		}
+		for (int32_t k = kEnd + 1; k < width; k++) {
+			h_b[k] = 0;
+			e_b[k] = minusInf;
+		}
+	}
+	r.score1 = max > USHRT_MAX ? USHRT_MAX : max;
+	if (max == 0) {
+		cigarLen = 0;
+		return false;
+	}
 
+	// trace back from the best cell, state 0: H, 1: E, 2: F
+	bool touchesBorder = false;
+	int32_t i = maxI, j = maxJ, k = maxK, state = 0;
+	int32_t l = 0, runLength = 0;
+	char op = 'M', prevOp = 'M';
+	while (true) {
+		touchesBorder |= (k == 0 || k == width - 1);
+		const int8_t d = direction[static_cast<int64_t>(i - rowStart) * width + k];
+		if (state == 0) {
+			const int8_t source = d & 3;
+			if (source == 2) {
+				state = 1;
+				continue;
+			} else if (source == 3) {
+				state = 2;
+				continue;
+			}
+		}
+		bool last = false;
+		if (state == 0) {
+			op = 'M';
+			last = (i == rowStart || j == 0 || (direction[static_cast<int64_t>(i - 1 - rowStart) * width + k] & 3) == 0);
+		} else if (state == 1) {
+			op = 'I';
+			state = (d & 4) ? 1 : 0;
+		} else {
+			op = 'D';
+			state = (d & 8) ? 2 : 0;
+		}
+		if (op == prevOp || runLength == 0) {
+			++runLength;
+		} else {
+			while (l + 1 >= cigarCapacity) {
+				++cigarCapacity;
+				kroundup32(cigarCapacity);
+				cigarReverse = (uint32_t*)realloc(cigarReverse, cigarCapacity * sizeof(uint32_t));
+				cigarBuffer = (uint32_t*)realloc(cigarBuffer, cigarCapacity * sizeof(uint32_t));
+			}
+			cigarReverse[l++] = to_cigar_int(runLength, prevOp);
+			runLength = 1;
+		}
+		prevOp = op;
+		if (last) {
+			break;
+		}
+		if (op == 'M') {
+			--i;
+			--j;
+		} else if (op == 'I') {
+			--i;
+			++k;
+		} else {
+			--j;
+			--k;
+		}
+	}
+	while (l + 1 >= cigarCapacity) {
+		++cigarCapacity;
+		kroundup32(cigarCapacity);
+		cigarReverse = (uint32_t*)realloc(cigarReverse, cigarCapacity * sizeof(uint32_t));
+		cigarBuffer = (uint32_t*)realloc(cigarBuffer, cigarCapacity * sizeof(uint32_t));
+	}
+	cigarReverse[l++] = to_cigar_int(runLength, prevOp);
+	for (int32_t c = 0; c < l; c++) {
+		cigarBuffer[c] = cigarReverse[l - 1 - c];
+	}
+	cigarLen = l;
+
+	r.qStartPos1 = i;
+	r.dbStartPos1 = j;
+	r.qEndPos1 = maxI;
+	r.dbEndPos1 = maxJ;
+	return touchesBorder;
+#undef kroundup32
+}
 
 char SmithWaterman::cigar_int_to_op (uint32_t cigar_int)
 {
@@ -485,7 +794,7 @@ SmithWaterman::alignment_end* SmithWaterman::sw_sse2_byte (const int* db_sequenc
 	}
 
 	/* Find the most possible 2nd best alignment. */
-	alignment_end* bests = (alignment_end*) calloc(2, sizeof(alignment_end));
+	alignment_end* bests = bestEnds;
 	bests[0].score = max + bias >= 255 ? 255 : max;
 	bests[0].ref = end_db;
 	bests[0].read = end_query;
@@ -662,7 +971,7 @@ SmithWaterman::alignment_end* SmithWaterman::sw_sse2_word (const int* db_sequenc
 	}
 
 	/* Find the most possible 2nd best alignment. */
-	SmithWaterman::alignment_end* bests = (alignment_end*) calloc(2, sizeof(alignment_end));
+	SmithWaterman::alignment_end* bests = bestEnds;
 	bests[0].score = max;
 	bests[0].ref = end_ref;
 	bests[0].read = end_read;
@@ -701,7 +1010,7 @@ void SmithWaterman::ssw_init (const Sequence* q,
 	int32_t compositionBias = 0;
 	bool isProfile = q->getSequenceType() == Sequence::HMM_PROFILE || q->getSequenceType() == Sequence::PROFILE_STATE_PROFILE;
 	if(isProfile == false && aaBiasCorrection == true) {
-		SubstitutionMatrix::calcLocalAaBiasCorrection(m, q->int_sequence, q->L, tmp_composition_bias);
+		SubstitutionMatrix::calcLocalAaBiasCorrection(m, q->int_sequence, q->L, tmp_composition_bias, tmp_background_score);
 		for(int i =0; i < q->L; i++){
 			profile->composition_bias[i] = (int8_t) (tmp_composition_bias[i] < 0.0)? tmp_composition_bias[i] - 0.5: tmp_composition_bias[i] + 0.5;
 			compositionBias = (static_cast<int8_t>(compositionBias) < profile->composition_bias[i])
@@ -748,28 +1057,9 @@ void SmithWaterman::ssw_init (const Sequence* q,
 			createQueryProfile<int8_t, VECSIZE_INT * 4, SUBSTITUTIONMATRIX>(profile->profile_byte, profile->query_sequence, profile->composition_bias, profile->mat, q->L, alphabetSize, bias, 0, 0);
 		}
 	}
-	if (score_size == 1 || score_size == 2) {
-		if(q->getSequenceType() == Sequence::HMM_PROFILE || q->getSequenceType() == Sequence::PROFILE_STATE_PROFILE){
-			createQueryProfile<int16_t, VECSIZE_INT * 2, PROFILE>(profile->profile_word, profile->query_sequence, NULL, profile->mat, q->L, alphabetSize, 0, 1, q->L);
-			for(int32_t i = 0; i< alphabetSize; i++) {
-				profile->profile_word_linear[i] = &profile_word_linear_data[i*q->L];
-				for (int j = 0; j < q->L; j++) {
-					//TODO is this right? :O
-					profile->profile_word_linear[i][j] = mat[i * q->L + j];
-				}
-			}
-		}else{
-			createQueryProfile<int16_t, VECSIZE_INT * 2, SUBSTITUTIONMATRIX>(profile->profile_word, profile->query_sequence, profile->composition_bias, profile->mat, q->L, alphabetSize, 0, 0, 0);
-			for(int32_t i = 0; i< alphabetSize; i++) {
-				profile->profile_word_linear[i] = &profile_word_linear_data[i*q->L];
-				for (int j = 0; j < q->L; j++) {
-					profile->profile_word_linear[i][j] = mat[i * alphabetSize + q->int_sequence[j]] + profile->composition_bias[j];
-				}
-			}
-		}
-
-
-	}
+	// the word profile is only needed for targets that overflow the byte score, it is built on first use
+	profile->word_mat = mat;
+	profile->has_word_profile = false;
 	// create reverse structures
 	seq_reverse( profile->query_rev_sequence, profile->query_sequence, q->L);
 	seq_reverse( profile->composition_bias_rev, profile->composition_bias, q->L);
@@ -783,9 +1073,40 @@ void SmithWaterman::ssw_init (const Sequence* q,
 	}
 	profile->query_length = q->L;
 	profile->alphabetSize = alphabetSize;
+	if (score_size == 1) {
+		buildWordProfile();
+	}
+}
+
+void SmithWaterman::buildWordProfile() {
+	if (profile->has_word_profile) {
+		return;
+	}
+	const int32_t queryLength = profile->query_length;
+	const int32_t alphabetSize = profile->alphabetSize;
+	const int8_t *mat = profile->word_mat;
+	if(profile->sequence_type == Sequence::HMM_PROFILE || profile->sequence_type == Sequence::PROFILE_STATE_PROFILE){
+		createQueryProfile<int16_t, VECSIZE_INT * 2, PROFILE>(profile->profile_word, profile->query_sequence, NULL, profile->mat, queryLength, alphabetSize, 0, 1, queryLength);
+		for(int32_t i = 0; i< alphabetSize; i++) {
+			profile->profile_word_linear[i] = &profile_word_linear_data[i*queryLength];
+			for (int j = 0; j < queryLength; j++) {
+				//TODO is this right? :O
+				profile->profile_word_linear[i][j] = mat[i * queryLength + j];
+			}
+		}
+	}else{
+		createQueryProfile<int16_t, VECSIZE_INT * 2, SUBSTITUTIONMATRIX>(profile->profile_word, profile->query_sequence, profile->composition_bias, profile->mat, queryLength, alphabetSize, 0, 0, 0);
+		for(int32_t i = 0; i< alphabetSize; i++) {
+			profile->profile_word_linear[i] = &profile_word_linear_data[i*queryLength];
+			for (int j = 0; j < queryLength; j++) {
+				profile->profile_word_linear[i][j] = mat[i * alphabetSize + profile->query_sequence[j]] + profile->composition_bias[j];
+			}
+		}
+	}
+	profile->has_word_profile = true;
 }
 template <const unsigned int type>
-SmithWaterman::cigar * SmithWaterman::banded_sw(const int *db_sequence, const int8_t *query_sequence, const int8_t * compositionBias,
+int32_t SmithWaterman::banded_sw(const int *db_sequence, const int8_t *query_sequence, const int8_t * compositionBias,
 												int32_t db_length, int32_t query_length, int32_t queryStart,
 												int32_t score, const uint32_t gap_open,
 												const uint32_t gap_extend, int32_t band_width, const int8_t *mat, int32_t n) {
@@ -802,18 +1123,13 @@ SmithWaterman::cigar * SmithWaterman::banded_sw(const int *db_sequence, const in
 	/* Convert the coordinate in the direction matrix into the coordinate in one line of the band. */
 #define set_d(u, w, i, j, p) { int x=(i)-(w); x=x>0?x:0; x=(j)-x; (u)=x*3+p; }
 
-	uint32_t *c = (uint32_t*)malloc(16 * sizeof(uint32_t)), *c1;
-	int32_t i, j, e, f, temp1, temp2, s = 16, s1 = 8, l, max = 0;
-	int64_t s2 = 1024;
+	// the buffers are members of the aligner, s, s1 and s2 are their capacities
+	uint32_t *c = cigarReverse;
+	int32_t i, j, e, f, temp1, temp2, s = cigarCapacity, s1 = bandCapacity, l, max = 0;
+	int64_t s2 = directionCapacity;
 	char op, prev_op;
 	int64_t width, width_d;
-	int32_t *h_b, *e_b, *h_c;
-	int8_t *direction, *direction_line;
-	cigar* result = new cigar();
-	h_b = (int32_t*)malloc(s1 * sizeof(int32_t));
-	e_b = (int32_t*)malloc(s1 * sizeof(int32_t));
-	h_c = (int32_t*)malloc(s1 * sizeof(int32_t));
-	direction = (int8_t*)malloc(s2 * sizeof(int8_t));
+	int8_t *direction_line;
 
 	do {
 		width = band_width * 2 + 3, width_d = band_width * 2 + 1;
@@ -926,12 +1242,13 @@ SmithWaterman::cigar * SmithWaterman::banded_sw(const int *db_sequence, const in
 				break;
 			default:
 				fprintf(stderr, "Trace back error: %d.\n", direction_line[temp1 - 1]);
-				free(direction);
-				free(h_c);
-				free(e_b);
-				free(h_b);
-				free(c);
-				delete result;
+				bandCapacity = s1;
+				directionCapacity = s2;
+				cigarReverse = c;
+				if (s > cigarCapacity) {
+					cigarCapacity = s;
+					cigarBuffer = (uint32_t*)realloc(cigarBuffer, cigarCapacity * sizeof(uint32_t));
+				}
 				return 0;
 		}
 		if (op == prev_op) ++e;
@@ -966,25 +1283,24 @@ SmithWaterman::cigar * SmithWaterman::banded_sw(const int *db_sequence, const in
 		c[l - 1] = to_cigar_int(1, 'M');
 	}
 
+	bandCapacity = s1;
+	directionCapacity = s2;
+	cigarReverse = c;
+	if (s > cigarCapacity) {
+		cigarCapacity = s;
+		cigarBuffer = (uint32_t*)realloc(cigarBuffer, cigarCapacity * sizeof(uint32_t));
+	}
+
 	// reverse cigar
-	c1 = (uint32_t*)new uint32_t[l * sizeof(uint32_t)];
 	s = 0;
 	e = l - 1;
 	while (LIKELY(s <= e)) {
-		c1[s] = c[e];
-		c1[e] = c[s];
+		cigarBuffer[s] = c[e];
+		cigarBuffer[e] = c[s];
 		++ s;
 		-- e;
 	}
-	result->seq = c1;
-	result->length = l;
-
-	free(direction);
-	free(h_c);
-	free(e_b);
-	free(h_b);
-	free(c);
-	return result;
+	return l;
 #undef kroundup32
 #undef set_u
 #undef set_d
@@ -1083,15 +1399,17 @@ s_align SmithWaterman::scoreIdentical(int *dbSeq, int L, EvalueComputation * eva
 
 	r.qEndPos1 = L -1;
 	r.dbEndPos1 = L -1;
-	r.cigarLen = L;
 	r.qCov =  1.0;
 	r.tCov = 1.0;
-	r.cigar = new uint32_t[L];
+	// a single match run over the full length
+	cigarBuffer[0] = to_cigar_int(L, 'M');
+	r.cigar = cigarBuffer;
+	r.cigarLen = 1;
+	buildWordProfile();
 	short score = 0;
 	for(int pos = 0; pos < L; pos++){
 		int currScore = profile->profile_word_linear[dbSeq[pos]][pos];
 		score += currScore;
-		r.cigar[pos] = 'M';
 	}
 	r.score1=score;
 	r.evalue = evaluer->computeEvalue(r.score1, profile->query_length);
@@ -67,6 +67,7 @@ typedef struct {
     int32_t ref_end2;
     float qCov;
     float tCov;
+    // owned by the aligner that computed the alignment, valid until its next alignment
     uint32_t* cigar;
     int32_t cigarLen;
     double evalue;
@@ -144,6 +145,50 @@ public:
                         const int covMode, const float covThr,
                         const int32_t maskLen);
 
+    // ssw_align is split into two passes, so that the start position and cigar are only computed for alignments
+    // that can still pass the thresholds.
+    // The first pass returns the scores, the end positions and the e-value of the best alignment. The coverages are
+    // upper bounds, since the start positions are not known yet.
+    s_align ssw_align_score(const int *db_sequence,
+                            int32_t db_length,
+                            const uint8_t gap_open,
+                            const uint8_t gap_extend,
+                            EvalueComputation *evaluer,
+                            const int32_t maskLen);
+
+    // false if an alignment of the first pass fails the e-value or coverage threshold
+    static bool canPassThresholds(const s_align &r, const double evalueThr, const int covMode, const float covThr);
+
+    // The second pass adds the start positions and, for alignmentMode 2, the cigar to an alignment of ssw_align_score.
+    void ssw_align_traceback(s_align &r,
+                             const int *db_sequence,
+                             int32_t db_length,
+                             const uint8_t gap_open,
+                             const uint8_t gap_extend,
+                             const uint8_t alignmentMode,
+                             const int covMode, const float covThr,
+                             const int32_t maskLen);
+
+
+    // Smith-Waterman restricted to a band of bandWidth diagonals on each side of the prefilter diagonal
+    // (query position - target position, as stored by the prefilter). The band is doubled while the best path
+    // touches its border. The full ssw_align is used if the band stops being much smaller than the matrix or if
+    // the diagonal is ambiguous. minScore is the score the prefilter hit is expected to reach, 0 if it is unknown
+    // or the hit is not expected to pass the thresholds. If the banded alignment scores below minScore, or minScore
+    // is set and the banded alignment fails the e-value or coverage threshold, the full ssw_align is used as well.
+    // score2 is not computed.
+    s_align ssw_align_banded(const int *db_sequence,
+                             int32_t db_length,
+                             int diagonal,
+                             int32_t bandWidth,
+                             const uint8_t gap_open,
+                             const uint8_t gap_extend,
+                             const uint8_t alignmentMode,
+                             const double evalueThr,
+                             EvalueComputation *evaluer,
+                             const int covMode, const float covThr,
+                             const int32_t maskLen,
+                             const int32_t minScore);
 
     /*!	@function computed ungapped alignment score
 
@@ -162,7 +207,8 @@ public:
    @param	mat	pointer to the substitution matrix; mat needs to be corresponding to the read sequence
    @param	n	the square root of the number of elements in mat (mat has n*n elements)
    @param	score_size	estimated Smith-Waterman score; if your estimated best alignment score is surely < 255 please set 0; if
-   your estimated best alignment score >= 255, please set 1; if you don't know, please set 2
+   your estimated best alignment score >= 255, please set 1; if you don't know, please set 2. With 2 the word profile
+   is built on the first alignment that overflows the byte score. mat has to stay valid until the next ssw_init.
    @return	pointer to the query profile structure
    @note	example for parameter read and mat:
    If the query sequence is: ACGTATC, the sequence that read points to can be: 1234142
@@ -229,6 +275,9 @@ private:
         int32_t alphabetSize;
         uint8_t bias;
         short ** profile_word_linear;
+        // matrix passed to ssw_init, it has to stay valid while the query is aligned
+        const int8_t* word_mat;
+        bool has_word_profile;
     };
     simd_int* vHStore;
     simd_int* vHLoad;
@@ -242,11 +291,8 @@ private:
         int32_t read;    //alignment ending position on read, 0-based
     } alignment_end;
 
-
-    typedef struct {
-        uint32_t* seq;
-        int32_t length;
-    } cigar;
+    // reused by every call of sw_sse2_byte and sw_sse2_word
+    alignment_end bestEnds[2];
 
     /* Striped Smith-Waterman
      Record the highest score of each reference position.
@@ -279,8 +325,21 @@ private:
                                  uint16_t terminate,
                                  int32_t maskLen);
 
+    // writes the cigar to cigarBuffer and returns its length, 0 if the trace back failed
+    template <const unsigned int type>
+    int32_t banded_sw(const int *db_sequence, const int8_t *query_sequence, const int8_t * compositionBias, int32_t db_length, int32_t query_length, int32_t queryStart, int32_t score, const uint32_t gap_open, const uint32_t gap_extend, int32_t band_width, const int8_t *mat, int32_t n);
+
+    // the banded alignment falls back to ssw_align if the band is wider than 1/BANDED_MIN_GAIN of the shorter sequence
+    const static int32_t BANDED_MIN_GAIN = 32;
+
+    // maps the unsigned short prefilter diagonal to the only diagonal within the matrix, INT_MAX if it is ambiguous
+    int resolveDiagonal(int diagonal, int32_t db_length) const;
+
+    // scores the band around diagonal, sets the positions of the best alignment in r and writes its cigar to
+    // cigarBuffer. Returns true if the best path touches the border of the band.
     template <const unsigned int type>
-    SmithWaterman::cigar *banded_sw(const int *db_sequence, const int8_t *query_sequence, const int8_t * compositionBias, int32_t db_length, int32_t query_length, int32_t queryStart, int32_t score, const uint32_t gap_open, const uint32_t gap_extend, int32_t band_width, const int8_t *mat, int32_t n);
+    bool banded_diagonal_sw(s_align &r, int32_t &cigarLen, const int *db_sequence, int32_t db_length,
+                            int diagonal, int32_t bandWidth, const uint8_t gap_open, const uint8_t gap_extend);
 
     /*!	@function		Produce CIGAR 32-bit unsigned integer from CIGAR operation and CIGAR length
      @param	length		length of CIGAR
@@ -295,11 +354,27 @@ private:
     const static unsigned int SUBSTITUTIONMATRIX = 1;
     const static unsigned int PROFILE = 2;
 
+    // builds profile_word and profile_word_linear of the current query, if they were not built yet
+    void buildWordProfile();
+
     template <typename T, size_t Elements, const unsigned int type>
     void createQueryProfile(simd_int *profile, const int8_t *query_sequence, const int8_t * composition_bias, const int8_t *mat, const int32_t query_length, const int32_t aaSize, uint8_t bias, const int32_t offset, const int32_t entryLength);
 
     float *tmp_composition_bias;
+    float *tmp_background_score;
     short * profile_word_linear_data;
     bool aaBiasCorrection;
+
+    // banded_sw dynamic programming band and direction matrix
+    int32_t *h_b;
+    int32_t *e_b;
+    int32_t *h_c;
+    int32_t bandCapacity;
+    int8_t *direction;
+    int64_t directionCapacity;
+    // cigar in trace back order and the returned cigar
+    uint32_t *cigarReverse;
+    uint32_t *cigarBuffer;
+    int32_t cigarCapacity;
 };
 #endif /* SMITH_WATERMAN_SSE2_H */
@@ -1,15 +1,18 @@
 #include "DistanceCalculator.h"
+#include "DiagonalRescorer.h"
 #include "Util.h"
 #include "Parameters.h"
 #include "Matcher.h"
 #include "Debug.h"
 #include "DBReader.h"
 #include "DBWriter.h"
+#include "FileUtil.h"
 #include "QueryMatcher.h"
 #include "CovSeqidQscPercMinDiag.out.h"
 #include "CovSeqidQscPercMinDiagTargetCov.out.h"
 #include "QueryMatcher.h"
 #include "NucleotideMatrix.h"
+#include "kmermatcher.h"
 
 #ifdef OPENMP
 #include <omp.h>
@@ -40,8 +43,33 @@ float parsePrecisionLib(const std::string &scoreFile, double targetSeqid, double
     return 0;
 }
 
+// target keys of the accepted hits for clust --cluster-mode 3, NULL without --write-edges
+// the edge database of an earlier run is removed, since it would not match the new result
+static DBWriter *openEdgeWriter(const Parameters &par, const std::string &resultDb) {
+    const std::string edgeDb = resultDb + "_edges";
+    const std::string edgeDbIndex = resultDb + "_edges.index";
+    if (par.writeEdges == false) {
+        if (FileUtil::fileExists(edgeDbIndex.c_str())) {
+            FileUtil::deleteFile(edgeDb);
+            FileUtil::deleteFile(edgeDbIndex);
+        }
+        return NULL;
+    }
+    DBWriter *edgeWriter = new DBWriter(edgeDb.c_str(), edgeDbIndex.c_str(), par.threads, DBWriter::BINARY_MODE);
+    edgeWriter->open();
+    return edgeWriter;
+}
+
+static void closeEdgeWriter(DBWriter *edgeWriter) {
+    if (edgeWriter != NULL) {
+        edgeWriter->close();
+        delete edgeWriter;
+    }
+}
+
 int doRescorediagonal(Parameters &par,
                       DBWriter &resultWriter,
+                      DBWriter *edgeWriter,
                       DBReader<unsigned int> &resultReader,
               const size_t dbFrom, const size_t dbSize) {
     Debug(Debug::INFO) << "Query database: " << par.db1 << "\n";
@@ -123,6 +151,11 @@ int doRescorediagonal(Parameters &par,
             alnResults.reserve(300);
             std::vector<hit_t> shortResults;
             shortResults.reserve(300);
+            std::vector<DiagonalRescorer::Hit> hits;
+            hits.reserve(300);
+            std::vector<std::pair<size_t, unsigned int> > hitEntries;
+            hitEntries.reserve(300);
+            DiagonalRescorer rescorer(fastMatrix);
 
 #pragma omp for schedule(dynamic, 1)
             for (size_t id = start; id < (start + bucketSize); id++) {
@@ -141,10 +174,14 @@ int doRescorediagonal(Parameters &par,
                 // -2 because of \n\0 in sequenceDB
 //                }
 
-                std::vector<hit_t> results = QueryMatcher::parsePrefilterHits(data);
+                std::vector<hit_t> results;
+                if (par.kmerResultMode == Parameters::KMER_RESULT_EDGE_LIST) {
+                    KmerEdge::parseEdges(data, resultReader.getSeqLens(id), results);
+                } else {
+                    results = QueryMatcher::parsePrefilterHits(data);
+                }
                 for (size_t entryIdx = 0; entryIdx < results.size(); entryIdx++) {
                     unsigned int targetId = tdbr->getId(results[entryIdx].seqId);
-                    const bool isIdentity = (queryId == targetId && (par.includeIdentity || sameDB))? true : false;
                     char * targetSeq = tdbr->getData(targetId);
                     int dbLen = std::max(0, static_cast<int>(tdbr->getSeqLens(targetId)) - 2);
 
@@ -153,38 +190,31 @@ int doRescorediagonal(Parameters &par,
                     if(Util::canBeCovered(par.covThr, par.covMode, queryLength, targetLength)==false){
                         continue;
                     }
-                    short diagonal = results[entryIdx].diagonal;
+                    hits.emplace_back(targetSeq, dbLen, results[entryIdx].diagonal);
+                    hitEntries.emplace_back(entryIdx, targetId);
+                }
+
+                // score all hits of the query in one batch
+                rescorer.setQuery(querySeq, queryLen);
+                if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
+                    rescorer.computeHammingDistance(hits.data(), hits.size());
+                } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION) {
+                    rescorer.computeSubstitutionDistance(hits.data(), hits.size(), par.globalAlignment);
+                } else if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT) {
+                    rescorer.computeSubstitutionStartEndDistance(hits.data(), hits.size());
+                }
+
+                for (size_t hitIdx = 0; hitIdx < hits.size(); hitIdx++) {
+                    const size_t entryIdx = hitEntries[hitIdx].first;
+                    const unsigned int targetId = hitEntries[hitIdx].second;
+                    const bool isIdentity = (queryId == targetId && (par.includeIdentity || sameDB))? true : false;
+                    const char * targetSeq = hits[hitIdx].targetSeq;
+                    int dbLen = hits[hitIdx].targetLen;
+                    short diagonal = hits[hitIdx].diagonal;
                     unsigned short distanceToDiagonal = abs(diagonal);
-                    unsigned int diagonalLen = 0;
-                    unsigned int distance = 0;
-                    DistanceCalculator::LocalAlignment alignment;
-                    if (diagonal >= 0 && distanceToDiagonal < queryLen) {
-                        diagonalLen = std::min(dbLen, queryLen - distanceToDiagonal);
-                        if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
-                            distance = DistanceCalculator::computeHammingDistance(
-                                    querySeq + distanceToDiagonal, targetSeq, diagonalLen);
-                        } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION) {
-                            distance = DistanceCalculator::computeSubstitutionDistance(
-                                    querySeq + distanceToDiagonal, targetSeq, diagonalLen, fastMatrix.matrix, par.globalAlignment);
-                        } else if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT) {
-                            alignment = DistanceCalculator::computeSubstitutionStartEndDistance(
-                                    querySeq + distanceToDiagonal, targetSeq, diagonalLen, fastMatrix.matrix);
-                            distance = alignment.score;
-                        }
-                    } else if (diagonal < 0 && distanceToDiagonal < dbLen) {
-                        diagonalLen = std::min(dbLen - distanceToDiagonal, queryLen);
-                        if (par.rescoreMode == Parameters::RESCORE_MODE_HAMMING) {
-                            distance = DistanceCalculator::computeHammingDistance(
-                                    querySeq, targetSeq + distanceToDiagonal, diagonalLen);
-                        } else if (par.rescoreMode == Parameters::RESCORE_MODE_SUBSTITUTION) {
-                            distance = DistanceCalculator::computeSubstitutionDistance(
-                                    querySeq, targetSeq + distanceToDiagonal, diagonalLen, fastMatrix.matrix, par.globalAlignment);
-                        } else if (par.rescoreMode == Parameters::RESCORE_MODE_ALIGNMENT) {
-                            alignment = DistanceCalculator::computeSubstitutionStartEndDistance(
-                                    querySeq, targetSeq + distanceToDiagonal, diagonalLen, fastMatrix.matrix);
-                            distance = alignment.score;
-                        }
-                    }
+                    unsigned int diagonalLen = hits[hitIdx].diagonalLen;
+                    unsigned int distance = hits[hitIdx].distance;
+                    DistanceCalculator::LocalAlignment alignment(hits[hitIdx].startPos, hits[hitIdx].endPos, distance);
 
                     double seqId = 0;
                     double evalue = 0.0;
@@ -297,8 +327,20 @@ int doRescorediagonal(Parameters &par,
 
                 resultWriter.writeData(resultBuffer.c_str(), resultBuffer.length(), queryKey, thread_idx);
                 resultBuffer.clear();
+                if (edgeWriter != NULL) {
+                    for (size_t i = 0; i < alnResults.size(); ++i) {
+                        resultBuffer.append((const char *) &alnResults[i].dbKey, sizeof(unsigned int));
+                    }
+                    for (size_t i = 0; i < shortResults.size(); ++i) {
+                        resultBuffer.append((const char *) &shortResults[i].seqId, sizeof(unsigned int));
+                    }
+                    edgeWriter->writeData(resultBuffer.c_str(), resultBuffer.length(), queryKey, thread_idx);
+                    resultBuffer.clear();
+                }
                 shortResults.clear();
                 alnResults.clear();
+                hits.clear();
+                hitEntries.clear();
             }
         }
         resultReader.remapData();
@@ -335,8 +377,10 @@ int rescorediagonal(int argc, const char **argv, const Command &command) {
 
     DBWriter resultWriter(tmpOutput.first.c_str(), tmpOutput.second.c_str(), par.threads);
     resultWriter.open();
-    int status = doRescorediagonal(par, resultWriter, resultReader, dbFrom, dbSize);
+    DBWriter *edgeWriter = openEdgeWriter(par, tmpOutput.first);
+    int status = doRescorediagonal(par, resultWriter, edgeWriter, resultReader, dbFrom, dbSize);
     resultWriter.close();
+    closeEdgeWriter(edgeWriter);
 
     MPI_Barrier(MPI_COMM_WORLD);
     if(MMseqsMPI::rank == 0) {
@@ -346,12 +390,21 @@ int rescorediagonal(int argc, const char **argv, const Command &command) {
             splitFiles.push_back(std::make_pair(tmpFile.first,  tmpFile.second));
         }
         DBWriter::mergeResults(par.db4, par.db4Index, splitFiles);
+        if (par.writeEdges) {
+            std::vector<std::pair<std::string, std::string>> edgeFiles;
+            for (unsigned int proc = 0; proc < MMseqsMPI::numProc; ++proc) {
+                edgeFiles.push_back(std::make_pair(splitFiles[proc].first + "_edges", splitFiles[proc].first + "_edges.index"));
+            }
+            DBWriter::mergeResults(par.db4 + "_edges", par.db4 + "_edges.index", edgeFiles);
+        }
     }
 #else
     DBWriter resultWriter(par.db4.c_str(), par.db4Index.c_str(), par.threads);
     resultWriter.open();
-    int status = doRescorediagonal(par, resultWriter, resultReader, 0, resultReader.getSize());
+    DBWriter *edgeWriter = openEdgeWriter(par, par.db4);
+    int status = doRescorediagonal(par, resultWriter, edgeWriter, resultReader, 0, resultReader.getSize());
     resultWriter.close();
+    closeEdgeWriter(edgeWriter);
 
 #endif
 
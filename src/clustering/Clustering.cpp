@@ -6,12 +6,17 @@
 #include "itoa.h"
 #include "Timer.h"
 
+#include <algorithm>
+
 Clustering::Clustering(const std::string &seqDB, const std::string &seqDBIndex,
                        const std::string &alnDB, const std::string &alnDBIndex,
                        const std::string &outDB, const std::string &outDBIndex,
-                       unsigned int maxIteration, int similarityScoreType, int threads) : maxIteration(maxIteration),
+                       unsigned int maxIteration, int similarityScoreType, bool parallelSetCover,
+                       int threads, size_t memoryLimit) : maxIteration(maxIteration),
                                                                similarityScoreType(similarityScoreType),
+                                                               parallelSetCover(parallelSetCover),
                                                                threads(threads),
+                                                               memoryLimit(memoryLimit),
                                                                outDB(outDB),
                                                                outDBIndex(outDBIndex) {
     Debug(Debug::INFO) << "Init...\n";
@@ -35,13 +40,14 @@ Clustering::~Clustering() {
 void Clustering::run(int mode) {
     Timer timer;
 
-    DBWriter *dbw = new DBWriter(outDB.c_str(), outDBIndex.c_str(), 1);
+    DBWriter *dbw = new DBWriter(outDB.c_str(), outDBIndex.c_str(), threads);
     dbw->open();
 
-    std::unordered_map<unsigned int, std::vector<unsigned int>> ret;
+    std::pair<unsigned int, unsigned int> *ret = NULL;
     ClusteringAlgorithms *algorithm = new ClusteringAlgorithms(seqDbr, alnDbr,
                                                                threads, similarityScoreType,
-                                                               maxIteration);
+                                                               maxIteration, outDB + "_graph", memoryLimit,
+                                                               parallelSetCover);
 
     if (mode == Parameters::GREEDY) {
         Debug(Debug::INFO) << "Clustering mode: Greedy\n";
@@ -55,13 +61,17 @@ void Clustering::run(int mode) {
     } else if (mode == Parameters::CONNECTED_COMPONENT) {
         Debug(Debug::INFO) << "Clustering mode: Connected Component\n";
         ret = algorithm->execute(3);
+    } else if (mode == Parameters::CONNECTED_COMPONENT_MEM) {
+        Debug(Debug::INFO) << "Clustering mode: Connected Component Low Mem\n";
+        ret = algorithm->execute(5);
     } else {
         Debug(Debug::ERROR) << "ERROR: Wrong clustering mode!\n";
         EXIT(EXIT_FAILURE);
     }
 
     Debug(Debug::INFO) << "Writing results...\n";
-    writeData(dbw, ret);
+    size_t cluNum = writeData(dbw, seqDbr, ret, seqDbr->getSize(), threads);
+    delete [] ret;
     Debug(Debug::INFO) << "...done.\n";
     Debug(Debug::INFO) << "Time for clustering: " << timer.lap() << "\n";
 
@@ -69,7 +79,6 @@ void Clustering::run(int mode) {
 
     size_t dbSize = alnDbr->getSize();
     size_t seqDbSize = seqDbr->getSize();
-    size_t cluNum = ret.size();
 
     seqDbr->close();
     alnDbr->close();
@@ -82,22 +91,47 @@ void Clustering::run(int mode) {
     Debug(Debug::INFO) << "Number of clusters: " << cluNum << "\n";
 }
 
-void Clustering::writeData(DBWriter *dbw, const std::unordered_map<unsigned int, std::vector<unsigned int>> &ret) {
-    std::unordered_map<unsigned int, std::vector<unsigned int> >::const_iterator iterator;
-    std::string resultStr;
-    resultStr.reserve(1024*1024*1024);
-    char buffer[32];
-    for (iterator = ret.begin(); iterator != ret.end(); ++iterator) {
-        std::vector<unsigned int> elements = (*iterator).second;
-        // first entry is the representative sequence
-        for (size_t i = 0; i < elements.size(); i++) {
-            unsigned int nextDbKey = seqDbr->getDbKey(elements[i]);
-            char * outpos = Itoa::u32toa_sse2(nextDbKey, buffer);
-            resultStr.append(buffer, (outpos - buffer - 1) );
+size_t Clustering::writeData(DBWriter *dbw, DBReader<unsigned int> *seqDbr,
+                             const std::pair<unsigned int, unsigned int> *ret, size_t dbSize, int threads) {
+    // split the sorted assignment at cluster borders, one part per thread
+    std::vector<size_t> threadOffsets;
+    threadOffsets.push_back(0);
+    for (int thread = 1; thread < threads; thread++) {
+        size_t pos = std::max(threadOffsets.back(), (dbSize / threads) * thread);
+        while (pos > 0 && pos < dbSize && ret[pos].first == ret[pos - 1].first) {
+            pos++;
+        }
+        threadOffsets.push_back(pos);
+    }
+    threadOffsets.push_back(dbSize);
+
+    size_t cluNum = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:cluNum)
+    for (int thread = 0; thread < threads; thread++) {
+        std::string resultStr;
+        resultStr.reserve(1024 * 1024);
+        char buffer[32];
+        size_t pos = threadOffsets[thread];
+        while (pos < threadOffsets[thread + 1]) {
+            const unsigned int representative = ret[pos].first;
+            // first entry is the representative sequence
+            char *outpos = Itoa::u32toa_sse2(seqDbr->getDbKey(representative), buffer);
+            resultStr.append(buffer, (outpos - buffer - 1));
             resultStr.push_back('\n');
+            for (; pos < threadOffsets[thread + 1] && ret[pos].first == representative; pos++) {
+                // and don't add it a second time
+                if (ret[pos].second == representative) {
+                    continue;
+                }
+                outpos = Itoa::u32toa_sse2(seqDbr->getDbKey(ret[pos].second), buffer);
+                resultStr.append(buffer, (outpos - buffer - 1));
+                resultStr.push_back('\n');
+            }
+            unsigned int dbKey = seqDbr->getDbKey(representative);
+            dbw->writeData(resultStr.c_str(), resultStr.length(), dbKey, thread);
+            resultStr.clear();
+            cluNum++;
         }
-        unsigned int dbKey = seqDbr->getDbKey((*iterator).first);
-        dbw->writeData(resultStr.c_str(), resultStr.length(), dbKey);
-        resultStr.clear();
     }
+    return cluNum;
 }
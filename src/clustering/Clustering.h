@@ -3,7 +3,6 @@
 
 #include <list>
 #include <string>
-#include <unordered_map>
 
 #include "DBReader.h"
 #include "DBWriter.h"
@@ -14,16 +13,19 @@ public:
     Clustering(const std::string &seqDB, const std::string &seqDBIndex,
                const std::string &alnResultsDB, const std::string &alnResultsDBIndex,
                const std::string &outDB, const std::string &outDBIndex,
-               unsigned int maxIteration, int similarityScoreType, int threads);
+               unsigned int maxIteration, int similarityScoreType, bool parallelSetCover,
+               int threads, size_t memoryLimit);
 
     void run(int mode);
 
 
     ~Clustering();
 
-private:
+    // writes the sorted (representative, member) array as cluster DB, returns the number of clusters
+    static size_t writeData(DBWriter *dbw, DBReader<unsigned int> *seqDbr,
+                            const std::pair<unsigned int, unsigned int> *ret, size_t dbSize, int threads);
 
-    void writeData(DBWriter *dbw, const std::unordered_map<unsigned int, std::vector<unsigned int>> &ret);
+private:
 
     DBReader<unsigned int> *seqDbr;
     DBReader<unsigned int> *alnDbr;
@@ -31,8 +33,12 @@ private:
     //values for affinity clustering
     unsigned int maxIteration;
     int similarityScoreType;
+    // round based set cover, ties are broken by sequence length
+    bool parallelSetCover;
 
     int threads;
+    // memory that may be used to sort one bucket of the clustering graph
+    size_t memoryLimit;
     std::string outDB;
     std::string outDBIndex;
 };
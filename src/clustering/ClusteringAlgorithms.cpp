@@ -1,16 +1,37 @@
 #include "ClusteringAlgorithms.h"
 #include "Util.h"
 #include "Debug.h"
+#include "UnionFind.h"
 #include "AlignmentSymmetry.h"
-#include "Timer.h"
+#include "FileUtil.h"
 
 #include <queue>
 #include <algorithm>
 #include <climits>
-#include <unordered_map>
+#include <cmath>
+#include <cstring>
+
+template <typename T>
+static inline void atomicMin(T *target, T value) {
+    T current;
+    __atomic_load(target, &current, __ATOMIC_RELAXED);
+    do {
+        if (current <= value) break;
+    } while (!__atomic_compare_exchange(target, &current, &value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+template <typename T>
+static inline void atomicMax(T *target, T value) {
+    T current;
+    __atomic_load(target, &current, __ATOMIC_RELAXED);
+    do {
+        if (current >= value) break;
+    } while (!__atomic_compare_exchange(target, &current, &value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
 
 ClusteringAlgorithms::ClusteringAlgorithms(DBReader<unsigned int>* seqDbr, DBReader<unsigned int>* alnDbr,
-                                           int threads, int scoretype, int maxiterations){
+                                           int threads, int scoretype, int maxiterations,
+                                           const std::string &graphPrefix, size_t memoryLimit, bool parallelSetCover){
     this->seqDbr=seqDbr;
     if(seqDbr->getSize() != alnDbr->getSize()){
         Debug(Debug::ERROR) << "Sequence db size != result db size\n";
@@ -21,6 +42,9 @@ ClusteringAlgorithms::ClusteringAlgorithms(DBReader<unsigned int>* seqDbr, DBRea
     this->threads=threads;
     this->scoretype=scoretype;
     this->maxiterations=maxiterations;
+    this->graphPrefix=graphPrefix;
+    this->memoryLimit=memoryLimit;
+    this->parallelSetCover=parallelSetCover;
     ///time
     this->clustersizes=new int[dbSize];
     std::fill_n(clustersizes, dbSize, 0);
@@ -30,9 +54,7 @@ ClusteringAlgorithms::~ClusteringAlgorithms(){
     delete [] clustersizes;
 }
 
-std::unordered_map<unsigned int, std::vector<unsigned int>>  ClusteringAlgorithms::execute(int mode) {
-    const char * data = alnDbr->getData();
-    const size_t dataSize = alnDbr->getDataSize();
+std::pair<unsigned int, unsigned int> * ClusteringAlgorithms::execute(int mode) {
     // init data
 
     unsigned int *assignedcluster = new(std::nothrow) unsigned int[dbSize];
@@ -42,99 +64,83 @@ std::unordered_map<unsigned int, std::vector<unsigned int>>  ClusteringAlgorithm
     //time
     if (mode==4) {
         greedyIncrementalLowMem(assignedcluster);
-    }else {
-        const size_t elementCount = Util::countLines(data, dataSize);
-        unsigned int * elements = new(std::nothrow) unsigned int[elementCount];
-        Util::checkAllocation(elements, "Could not allocate elements memory in ClusteringAlgorithms::execute");
-        unsigned int ** elementLookupTable = new(std::nothrow) unsigned int*[dbSize];
-        Util::checkAllocation(elementLookupTable, "Could not allocate elementLookupTable memory in ClusteringAlgorithms::execute");
-        unsigned short **scoreLookupTable = new(std::nothrow) unsigned short *[dbSize];
-        Util::checkAllocation(scoreLookupTable, "Could not allocate scoreLookupTable memory in ClusteringAlgorithms::execute");
-        unsigned short *score = NULL;
-        size_t *elementOffsets = new(std::nothrow) size_t[dbSize + 1];
-        Util::checkAllocation(elementOffsets, "Could not allocate elementOffsets memory in ClusteringAlgorithms::execute");
-        elementOffsets[dbSize] = 0;
-        short *bestscore = new(std::nothrow) short[dbSize];
-        Util::checkAllocation(bestscore, "Could not allocate bestscore memory in ClusteringAlgorithms::execute");
-        std::fill_n(bestscore, dbSize, SHRT_MIN);
-
-        readInClusterData(elementLookupTable, elements, scoreLookupTable, score, elementOffsets, elementCount);
-
+    } else if (mode == 5) {
+        connectedComponentsLowMem(assignedcluster);
+    } else {
+        ClusteringGraph graph(seqDbr, alnDbr, graphPrefix, scoretype, memoryLimit);
+        graph.build();
+        maxClustersize = static_cast<unsigned int>(graph.getMaxDegree());
+        for (size_t i = 0; i < dbSize; i++) {
+            clustersizes[i] = static_cast<int>(graph.getDegree(i));
+        }
 
         if (mode==2){
-            greedyIncremental(elementLookupTable, elementOffsets,
-                              dbSize, assignedcluster);
-        }else {
+            greedyIncremental(graph, assignedcluster);
+        } else if (mode == 1 && parallelSetCover) {
+            setCoverParallel(graph, assignedcluster);
+        } else {
             ClusteringAlgorithms::initClustersizes();
             if (mode == 1) {
-                setCover(elementLookupTable, scoreLookupTable, assignedcluster, bestscore, elementOffsets);
+                // sequential, the order of sorted_clustersizes breaks ties between equally sized sets
+                short *bestscore = new(std::nothrow) short[dbSize];
+                Util::checkAllocation(bestscore, "Could not allocate bestscore memory in ClusteringAlgorithms::execute");
+                std::fill_n(bestscore, dbSize, SHRT_MIN);
+                setCover(graph, assignedcluster, bestscore);
+                delete [] bestscore;
             } else if (mode == 3) {
                 Debug(Debug::INFO) << "connected component mode" << "\n";
-                for (int cl_size = dbSize - 1; cl_size >= 0; cl_size--) {
-                    unsigned int representative = sorted_clustersizes[cl_size];
-                    if (assignedcluster[representative] == UINT_MAX) {
-                        assignedcluster[representative] = representative;
-                        std::queue<int> myqueue;
-                        myqueue.push(representative);
-                        std::queue<int> iterationcutoffs;
-                        iterationcutoffs.push(0);
-                        //delete clusters of members;
-                        while (!myqueue.empty()) {
-                            int currentid = myqueue.front();
-                            int iterationcutoff = iterationcutoffs.front();
-                            assignedcluster[currentid] = representative;
-                            myqueue.pop();
-                            iterationcutoffs.pop();
-                            size_t elementSize = (elementOffsets[currentid + 1] - elementOffsets[currentid]);
-                            for (size_t elementId = 0; elementId < elementSize; elementId++) {
-                                unsigned int elementtodelete = elementLookupTable[currentid][elementId];
-                                if (assignedcluster[elementtodelete] == UINT_MAX && iterationcutoff < maxiterations) {
-                                    myqueue.push(elementtodelete);
-                                    iterationcutoffs.push((iterationcutoff + 1));
-                                }
-                                assignedcluster[elementtodelete] = representative;
-                            }
-                        }
-
-                    }
-                }
+                connectedComponents(graph, assignedcluster);
             }
             //delete unnecessary datastructures
             delete [] sorted_clustersizes;
             delete [] clusterid_to_arrayposition;
             delete [] borders_of_set;
         }
-
-        delete [] elementLookupTable;
-        delete [] elements;
-        delete [] elementOffsets;
-        delete [] scoreLookupTable;
-        delete [] score;
-        delete [] bestscore;
     }
 
+    std::pair<unsigned int, unsigned int> *assignment = sortByRepresentative(seqDbr, assignedcluster, dbSize);
+    delete [] assignedcluster;
+    return assignment;
+}
 
-
-    std::unordered_map<unsigned int, std::vector<unsigned int>> retMap;
+std::pair<unsigned int, unsigned int> * ClusteringAlgorithms::sortByRepresentative(DBReader<unsigned int> *seqDbr,
+                                                                                   unsigned int *assignedcluster,
+                                                                                   size_t dbSize) {
     for(size_t i = 0; i < dbSize; i++) {
         if(assignedcluster[i] == UINT_MAX){
             Debug(Debug::ERROR) << "there must be an error: " << seqDbr->getDbKey(i) <<
                                 " is not assigned to a cluster\n";
-            continue;
-        }
-
-        // make sure the representative is always the first entry
-        if(retMap.find(assignedcluster[i]) == retMap.end()) {
-            retMap[assignedcluster[i]].push_back(assignedcluster[i]);
+            assignedcluster[i] = i;
         }
+    }
 
-        // and don't add it a second time
-        if(i != assignedcluster[i]) {
-            retMap[assignedcluster[i]].push_back(i);
+    // counting sort by representative
+    size_t *offsets = new(std::nothrow) size_t[dbSize + 1];
+    Util::checkAllocation(offsets, "Could not allocate offsets memory in ClusteringAlgorithms::sortByRepresentative");
+    std::fill_n(offsets, dbSize + 1, 0);
+#pragma omp parallel for schedule(static)
+    for(size_t i = 0; i < dbSize; i++) {
+        __sync_fetch_and_add(&offsets[assignedcluster[i]], 1);
+    }
+    AlignmentSymmetry::computeOffsetFromCounts(offsets, dbSize);
+    std::pair<unsigned int, unsigned int> *assignment = new(std::nothrow) std::pair<unsigned int, unsigned int>[dbSize];
+    Util::checkAllocation(assignment, "Could not allocate assignment memory in ClusteringAlgorithms::sortByRepresentative");
+#pragma omp parallel for schedule(static)
+    for(size_t i = 0; i < dbSize; i++) {
+        const size_t pos = __sync_fetch_and_add(&offsets[assignedcluster[i]], 1);
+        assignment[pos].first = assignedcluster[i];
+        assignment[pos].second = i;
+    }
+    // offsets[i] points now to the end of cluster i
+#pragma omp parallel for schedule(dynamic, 1000)
+    for(size_t i = 0; i < dbSize; i++) {
+        const size_t start = (i == 0) ? 0 : offsets[i - 1];
+        if (offsets[i] - start > 1) {
+            std::sort(assignment + start, assignment + offsets[i]);
         }
     }
-    delete [] assignedcluster;
-    return retMap;
+    delete [] offsets;
+    return assignment;
 }
 
 void ClusteringAlgorithms::initClustersizes(){
@@ -172,6 +178,112 @@ void ClusteringAlgorithms::initClustersizes(){
 }
 
 
+void ClusteringAlgorithms::connectedComponentsBfs(const ClusteringGraph &graph, unsigned int *assignedcluster) {
+    for (int cl_size = dbSize - 1; cl_size >= 0; cl_size--) {
+        unsigned int representative = sorted_clustersizes[cl_size];
+        if (assignedcluster[representative] == UINT_MAX) {
+            assignedcluster[representative] = representative;
+            std::queue<int> myqueue;
+            myqueue.push(representative);
+            std::queue<int> iterationcutoffs;
+            iterationcutoffs.push(0);
+            //delete clusters of members;
+            while (!myqueue.empty()) {
+                int currentid = myqueue.front();
+                int iterationcutoff = iterationcutoffs.front();
+                assignedcluster[currentid] = representative;
+                myqueue.pop();
+                iterationcutoffs.pop();
+                const size_t elementSize = graph.getDegree(currentid);
+                const unsigned int *elementLookup = graph.getElements(currentid);
+                for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                    unsigned int elementtodelete = elementLookup[elementId];
+                    if (assignedcluster[elementtodelete] == UINT_MAX && iterationcutoff < maxiterations) {
+                        myqueue.push(elementtodelete);
+                        iterationcutoffs.push((iterationcutoff + 1));
+                    }
+                    assignedcluster[elementtodelete] = representative;
+                }
+            }
+
+        }
+    }
+}
+
+void ClusteringAlgorithms::connectedComponents(const ClusteringGraph &graph, unsigned int *assignedcluster) {
+    // the sequential BFS starts at the element with the highest position in sorted_clustersizes
+    // so this element has to become the root of the union-find component
+    UnionFind components(dbSize, clusterid_to_arrayposition);
+#pragma omp parallel for schedule(dynamic, 1000)
+    for (size_t i = 0; i < dbSize; i++) {
+        const size_t elementSize = graph.getDegree(i);
+        const unsigned int *elementLookup = graph.getElements(i);
+        for (size_t elementId = 0; elementId < elementSize; elementId++) {
+            components.unite(static_cast<unsigned int>(i), elementLookup[elementId]);
+        }
+    }
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < dbSize; i++) {
+        assignedcluster[i] = components.find(static_cast<unsigned int>(i));
+    }
+
+    // the BFS reaches only elements up to a depth of maxiterations + 1
+    // check with a level synchronous BFS from all roots that no element lies deeper
+    unsigned int *depth = new(std::nothrow) unsigned int[dbSize];
+    Util::checkAllocation(depth, "Could not allocate depth memory in ClusteringAlgorithms::connectedComponents");
+    std::vector<unsigned int> frontier;
+    for (size_t i = 0; i < dbSize; i++) {
+        depth[i] = UINT_MAX;
+        if (assignedcluster[i] == i) {
+            depth[i] = 0;
+            frontier.push_back(static_cast<unsigned int>(i));
+        }
+    }
+    unsigned int level = 0;
+    while (frontier.empty() == false && level <= static_cast<unsigned int>(maxiterations)) {
+        std::vector<unsigned int> nextFrontier;
+#pragma omp parallel
+        {
+            std::vector<unsigned int> threadFrontier;
+#pragma omp for schedule(dynamic, 100) nowait
+            for (size_t pos = 0; pos < frontier.size(); pos++) {
+                const unsigned int currentid = frontier[pos];
+                const size_t elementSize = graph.getDegree(currentid);
+                const unsigned int *elementLookup = graph.getElements(currentid);
+                for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                    const unsigned int element = elementLookup[elementId];
+                    if (__sync_bool_compare_and_swap(&depth[element], UINT_MAX, level + 1)) {
+                        threadFrontier.push_back(element);
+                    }
+                }
+            }
+#pragma omp critical
+            nextFrontier.insert(nextFrontier.end(), threadFrontier.begin(), threadFrontier.end());
+        }
+        frontier.swap(nextFrontier);
+        level++;
+    }
+    bool isTooDeep = false;
+    for (size_t pos = 0; pos < frontier.size() && isTooDeep == false; pos++) {
+        const unsigned int currentid = frontier[pos];
+        const size_t elementSize = graph.getDegree(currentid);
+        const unsigned int *elementLookup = graph.getElements(currentid);
+        for (size_t elementId = 0; elementId < elementSize; elementId++) {
+            if (depth[elementLookup[elementId]] == UINT_MAX) {
+                isTooDeep = true;
+                break;
+            }
+        }
+    }
+    delete[] depth;
+
+    if (isTooDeep) {
+        Debug(Debug::INFO) << "Components are deeper than --max-iterations. Fall back to sequential breadth first search.\n";
+        std::fill_n(assignedcluster, dbSize, UINT_MAX);
+        connectedComponentsBfs(graph, assignedcluster);
+    }
+}
+
 void ClusteringAlgorithms::removeClustersize(int clusterid){
     clustersizes[clusterid]=0;
     sorted_clustersizes[clusterid_to_arrayposition[clusterid]] = UINT_MAX;
@@ -193,8 +305,7 @@ void ClusteringAlgorithms::decreaseClustersize(int clusterid){
     clustersizes[clusterid]--;
 }
 
-void ClusteringAlgorithms::setCover(unsigned int **elementLookupTable, unsigned short ** elementScoreLookupTable,
-                                    unsigned int *assignedcluster, short *bestscore, size_t *newElementOffsets) {
+void ClusteringAlgorithms::setCover(const ClusteringGraph &graph, unsigned int *assignedcluster, short *bestscore) {
     for (int cl_size = dbSize - 1; cl_size >= 0; cl_size--) {
         const unsigned int representative = sorted_clustersizes[cl_size];
         if (representative == UINT_MAX) {
@@ -205,11 +316,13 @@ void ClusteringAlgorithms::setCover(unsigned int **elementLookupTable, unsigned
         assignedcluster[representative] = representative;
 
         //delete clusters of members;
-        size_t elementSize = (newElementOffsets[representative + 1] - newElementOffsets[representative]);
+        const size_t elementSize = graph.getDegree(representative);
+        const unsigned int *elementLookup = graph.getElements(representative);
+        const unsigned short *elementScoreLookup = graph.getScores(representative);
         for (size_t elementId = 0; elementId < elementSize; elementId++) {
-            const unsigned int elementtodelete = elementLookupTable[representative][elementId];
+            const unsigned int elementtodelete = elementLookup[elementId];
             // float seqId = elementScoreTable[representative][elementId];
-            const short seqId = elementScoreLookupTable[representative][elementId];
+            const short seqId = elementScoreLookup[elementId];
             //  Debug(Debug::INFO)<<seqId<<"\t"<<bestscore[elementtodelete]<<"\n";
             // becareful of this criteria
             if (seqId > bestscore[elementtodelete]) {
@@ -228,9 +341,9 @@ void ClusteringAlgorithms::setCover(unsigned int **elementLookupTable, unsigned
 
         for (size_t elementId = 0; elementId < elementSize; elementId++) {
             bool representativefound = false;
-            const unsigned int elementtodelete = elementLookupTable[representative][elementId];
-            const unsigned int currElementSize = (newElementOffsets[elementtodelete + 1] -
-                                                  newElementOffsets[elementtodelete]);
+            const unsigned int elementtodelete = elementLookup[elementId];
+            const unsigned int currElementSize = graph.getDegree(elementtodelete);
+            const unsigned int *currElementLookup = graph.getElements(elementtodelete);
             if (elementtodelete == representative) {
                 clustersizes[elementtodelete] = -1;
                 continue;
@@ -241,7 +354,7 @@ void ClusteringAlgorithms::setCover(unsigned int **elementLookupTable, unsigned
             clustersizes[elementtodelete] = -1;
             //decrease clustersize of sets that contain the element
             for (size_t elementId2 = 0; elementId2 < currElementSize; elementId2++) {
-                const unsigned int elementtodecrease = elementLookupTable[elementtodelete][elementId2];
+                const unsigned int elementtodecrease = currElementLookup[elementId2];
                 if (representative == elementtodecrease) {
                     representativefound = true;
                 }
@@ -261,75 +374,274 @@ void ClusteringAlgorithms::setCover(unsigned int **elementLookupTable, unsigned
     }
 }
 
+void ClusteringAlgorithms::setCoverParallel(const ClusteringGraph &graph, unsigned int *assignedcluster) {
+    // Parallel greedy set cover in rounds (--parallel-set-cover).
+    // Every round takes all sets with the currently largest number of uncovered elements as candidates.
+    // A candidate is selected if it has the smallest id (longest sequence) of all candidates containing
+    // one of its uncovered elements. Selected sets do not share uncovered elements, so each of them is
+    // still a largest set after the others were applied. The result is therefore a valid sequential greedy
+    // set cover, that breaks ties between equally sized sets by sequence length (longest first).
+    // setCover breaks these ties by the position in sorted_clustersizes, which changes with every decrease,
+    // so the representatives of the two versions can differ if sets of equal size compete for elements.
+    // Elements are assigned to the representative with the best score (earliest one in case of a tie).
+    unsigned int *owner = new(std::nothrow) unsigned int[dbSize];
+    Util::checkAllocation(owner, "Could not allocate owner memory in ClusteringAlgorithms::setCoverParallel");
+    unsigned long long *bestAssignment = new(std::nothrow) unsigned long long[dbSize];
+    Util::checkAllocation(bestAssignment, "Could not allocate bestAssignment memory in ClusteringAlgorithms::setCoverParallel");
+    unsigned int *representativeByOrder = new(std::nothrow) unsigned int[dbSize];
+    Util::checkAllocation(representativeByOrder, "Could not allocate representativeByOrder memory in ClusteringAlgorithms::setCoverParallel");
+    char *changed = new(std::nothrow) char[dbSize];
+    Util::checkAllocation(changed, "Could not allocate changed memory in ClusteringAlgorithms::setCoverParallel");
+    std::fill_n(owner, dbSize, UINT_MAX);
+    std::fill_n(bestAssignment, dbSize, 0);
+    std::fill_n(changed, dbSize, 0);
+
+    // lazy buckets: an entry is only valid if the set is still uncovered and has this size
+    std::vector<std::vector<unsigned int> > buckets(maxClustersize + 1);
+    for (size_t i = 0; i < dbSize; i++) {
+        buckets[clustersizes[i]].push_back(static_cast<unsigned int>(i));
+    }
+
+    size_t representativeCount = 0;
+    int maxSize = static_cast<int>(maxClustersize);
+    std::vector<unsigned int> candidates;
+    std::vector<char> isSelected;
+    std::vector<unsigned int> covered;
+    std::vector<unsigned int> decreased;
+    while (maxSize >= 0) {
+        candidates.clear();
+        for (size_t pos = 0; pos < buckets[maxSize].size(); pos++) {
+            const unsigned int setId = buckets[maxSize][pos];
+            if (clustersizes[setId] == maxSize) {
+                candidates.push_back(setId);
+            }
+        }
+        if (candidates.empty()) {
+            std::vector<unsigned int>().swap(buckets[maxSize]);
+            maxSize--;
+            continue;
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        // claim all uncovered elements
+#pragma omp parallel for schedule(dynamic, 100)
+        for (size_t pos = 0; pos < candidates.size(); pos++) {
+            const unsigned int setId = candidates[pos];
+            atomicMin(&owner[setId], setId);
+            const size_t elementSize = graph.getDegree(setId);
+            const unsigned int *elementLookup = graph.getElements(setId);
+            for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                const unsigned int element = elementLookup[elementId];
+                if (clustersizes[element] >= 0) {
+                    atomicMin(&owner[element], setId);
+                }
+            }
+        }
+        isSelected.assign(candidates.size(), 0);
+#pragma omp parallel for schedule(dynamic, 100)
+        for (size_t pos = 0; pos < candidates.size(); pos++) {
+            const unsigned int setId = candidates[pos];
+            bool selected = (owner[setId] == setId);
+            const size_t elementSize = graph.getDegree(setId);
+            const unsigned int *elementLookup = graph.getElements(setId);
+            for (size_t elementId = 0; elementId < elementSize && selected; elementId++) {
+                const unsigned int element = elementLookup[elementId];
+                selected = (clustersizes[element] < 0 || owner[element] == setId);
+            }
+            isSelected[pos] = selected;
+        }
+#pragma omp parallel for schedule(dynamic, 100)
+        for (size_t pos = 0; pos < candidates.size(); pos++) {
+            const unsigned int setId = candidates[pos];
+            owner[setId] = UINT_MAX;
+            const size_t elementSize = graph.getDegree(setId);
+            const unsigned int *elementLookup = graph.getElements(setId);
+            for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                owner[elementLookup[elementId]] = UINT_MAX;
+            }
+        }
+
+        // not selected candidates stay in the bucket
+        buckets[maxSize].clear();
+        size_t selectedCount = 0;
+        for (size_t pos = 0; pos < candidates.size(); pos++) {
+            if (isSelected[pos]) {
+                representativeByOrder[representativeCount + selectedCount] = candidates[pos];
+                candidates[selectedCount] = candidates[pos];
+                selectedCount++;
+            } else {
+                buckets[maxSize].push_back(candidates[pos]);
+            }
+        }
+        candidates.resize(selectedCount);
+
+        // cover the elements of the selected sets
+        covered.clear();
+#pragma omp parallel
+        {
+            std::vector<unsigned int> threadCovered;
+#pragma omp for schedule(dynamic, 100) nowait
+            for (size_t pos = 0; pos < candidates.size(); pos++) {
+                const unsigned int representative = candidates[pos];
+                const unsigned long long order = UINT_MAX - static_cast<unsigned int>(representativeCount + pos);
+                clustersizes[representative] = -1;
+                atomicMax(&bestAssignment[representative], order);
+                const size_t elementSize = graph.getDegree(representative);
+                const unsigned int *elementLookup = graph.getElements(representative);
+                const unsigned short *elementScoreLookup = graph.getScores(representative);
+                for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                    const unsigned int element = elementLookup[elementId];
+                    const short seqId = elementScoreLookup[elementId];
+                    const unsigned long long score = static_cast<unsigned long long>(static_cast<int>(seqId) - SHRT_MIN);
+                    atomicMax(&bestAssignment[element], (score << 32) | order);
+                    if (element != representative && clustersizes[element] >= 0) {
+                        clustersizes[element] = -1;
+                        threadCovered.push_back(element);
+                    }
+                }
+            }
+#pragma omp critical
+            covered.insert(covered.end(), threadCovered.begin(), threadCovered.end());
+        }
+        representativeCount += candidates.size();
+
+        //decrease clustersize of sets that contain the covered elements
+        decreased.clear();
+#pragma omp parallel
+        {
+            std::vector<unsigned int> threadDecreased;
+#pragma omp for schedule(dynamic, 100) nowait
+            for (size_t pos = 0; pos < covered.size(); pos++) {
+                const unsigned int element = covered[pos];
+                const size_t elementSize = graph.getDegree(element);
+                const unsigned int *elementLookup = graph.getElements(element);
+                for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                    const unsigned int elementtodecrease = elementLookup[elementId];
+                    int size = __atomic_load_n(&clustersizes[elementtodecrease], __ATOMIC_RELAXED);
+                    // a set keeps at least its own element
+                    while (size > 1 && __atomic_compare_exchange_n(&clustersizes[elementtodecrease], &size, size - 1,
+                                                                   false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false) {
+                        ;
+                    }
+                    if (size > 1 && __sync_bool_compare_and_swap(&changed[elementtodecrease], 0, 1)) {
+                        threadDecreased.push_back(elementtodecrease);
+                    }
+                }
+            }
+#pragma omp critical
+            decreased.insert(decreased.end(), threadDecreased.begin(), threadDecreased.end());
+        }
+        for (size_t pos = 0; pos < decreased.size(); pos++) {
+            const unsigned int setId = decreased[pos];
+            changed[setId] = 0;
+            if (clustersizes[setId] >= 0) {
+                buckets[clustersizes[setId]].push_back(setId);
+            }
+        }
+    }
+
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < dbSize; i++) {
+        const unsigned int order = UINT_MAX - static_cast<unsigned int>(bestAssignment[i] & UINT_MAX);
+        assignedcluster[i] = representativeByOrder[order];
+    }
+
+    delete[] changed;
+    delete[] representativeByOrder;
+    delete[] bestAssignment;
+    delete[] owner;
+}
+
 void ClusteringAlgorithms::greedyIncrementalLowMem( unsigned int *assignedcluster) {
     // two step clustering
     // 1.) we define the rep. sequences by minimizing the ids (smaller ID = longer sequence)
+    //     the minimum does not depend on the order of the edges, so the alignment database is streamed
+    //     once in its storage order without any graph or per edge index lookup
+    //     the binary edge database written by align/rescorediagonal --write-edges is read instead of the text result if it exists
     // 2.) we correct maybe wrong assigned sequence by checking if the assigned sequence is really a rep. seq.
     //     if they are not make them rep. seq.
-#pragma omp parallel for schedule(dynamic, 1000)
-    for(size_t i = 0; i < dbSize; i++) {
-        unsigned int clusterKey = seqDbr->getDbKey(i);
-        unsigned int clusterId = seqDbr->getId(clusterKey);
-
-        // try to set your self as cluster centriod
-        // if some other cluster covered
-        unsigned int targetId;
-        __atomic_load(&assignedcluster[clusterId], &targetId ,__ATOMIC_RELAXED);
-        do {
-            if (targetId <= clusterId) break;
-        } while (!__atomic_compare_exchange(&assignedcluster[clusterId],  &targetId,  &clusterId , false,  __ATOMIC_RELAXED, __ATOMIC_RELAXED));
-
-
-        const size_t alnId = alnDbr->getId(clusterKey);
-        char *data = alnDbr->getData(alnId);
-
-        while (*data != '\0') {
-            char dbKey[255 + 1];
-            Util::parseKey(data, dbKey);
-            const unsigned int key = (unsigned int) strtoul(dbKey, NULL, 10);
-            unsigned int currElement = seqDbr->getId(key);
-            unsigned int targetId;
-
-            __atomic_load(&assignedcluster[currElement], &targetId ,__ATOMIC_RELAXED);
-            do {
-                if (targetId <= clusterId) break;
-            } while (!__atomic_compare_exchange(&assignedcluster[currElement],  &targetId,  &clusterId , false,  __ATOMIC_RELAXED, __ATOMIC_RELAXED));
-
-            if (currElement == UINT_MAX || currElement > seqDbr->getSize()) {
-                Debug(Debug::ERROR) << "ERROR: Element " << dbKey
-                                    << " contained in some alignment list, but not contained in the sequence database!\n";
+    unsigned int maxKey = 0;
+    unsigned int *keyToId = ClusteringGraph::createKeyToIdLookup(seqDbr, maxKey);
+
+    const std::string edgeDb = std::string(alnDbr->getDataFileName()) + "_edges";
+    const std::string edgeDbIndex = edgeDb + ".index";
+    DBReader<unsigned int> *edgeDbr = NULL;
+    if (FileUtil::fileExists(edgeDbIndex.c_str())) {
+        edgeDbr = new DBReader<unsigned int>(edgeDb.c_str(), edgeDbIndex.c_str());
+        edgeDbr->open(DBReader<unsigned int>::LINEAR_ACCCESS);
+        if (edgeDbr->getSize() != alnDbr->getSize()) {
+            Debug(Debug::WARNING) << "Ignoring " << edgeDb << ", it does not match the alignment database.\n";
+            edgeDbr->close();
+            delete edgeDbr;
+            edgeDbr = NULL;
+        } else {
+            Debug(Debug::INFO) << "Reading edges from " << edgeDb << "\n";
+        }
+    }
+    DBReader<unsigned int> *reader = (edgeDbr != NULL) ? edgeDbr : alnDbr;
+
+    const size_t alnSize = reader->getSize();
+    const size_t flushSize = 1000000;
+    size_t iterations = static_cast<size_t>(ceil(static_cast<double>(alnSize) / static_cast<double>(flushSize)));
+    for (size_t it = 0; it < iterations; it++) {
+        size_t start = it * flushSize;
+        size_t bucketSize = std::min(alnSize - (it * flushSize), flushSize);
+#pragma omp parallel for schedule(dynamic, 100)
+        for (size_t i = start; i < (start + bucketSize); i++) {
+            Debug::printProgress(i);
+            const unsigned int clusterKey = reader->getDbKey(i);
+            const unsigned int clusterId = (clusterKey <= maxKey) ? keyToId[clusterKey] : UINT_MAX;
+            if (clusterId == UINT_MAX) {
+                Debug(Debug::ERROR) << "ERROR: Alignment result " << clusterKey
+                                    << " has no entry in the sequence database!\n";
                 EXIT(EXIT_FAILURE);
             }
-            data = Util::skipLine(data);
+            char *data = reader->getData(i);
+            if (edgeDbr != NULL) {
+                // target keys, the entry length includes the terminating null byte
+                const size_t entryLength = edgeDbr->getSeqLens(i);
+                const size_t edgeCount = (entryLength > 0) ? (entryLength - 1) / sizeof(unsigned int) : 0;
+                for (size_t edge = 0; edge < edgeCount; edge++) {
+                    unsigned int key;
+                    memcpy(&key, data + edge * sizeof(unsigned int), sizeof(unsigned int));
+                    const unsigned int currElement = (key <= maxKey) ? keyToId[key] : UINT_MAX;
+                    if (currElement == UINT_MAX) {
+                        Debug(Debug::ERROR) << "ERROR: Element " << key
+                                            << " contained in some alignment list, but not contained in the sequence database!\n";
+                        EXIT(EXIT_FAILURE);
+                    }
+                    atomicMin(&assignedcluster[currElement], clusterId);
+                }
+                continue;
+            }
+            while (*data != '\0') {
+                const unsigned int key = Util::fast_atoi<unsigned int>(data);
+                const unsigned int currElement = (key <= maxKey) ? keyToId[key] : UINT_MAX;
+                if (currElement == UINT_MAX) {
+                    char dbKey[255 + 1];
+                    Util::parseKey(data, dbKey);
+                    Debug(Debug::ERROR) << "ERROR: Element " << dbKey
+                                        << " contained in some alignment list, but not contained in the sequence database!\n";
+                    EXIT(EXIT_FAILURE);
+                }
+                atomicMin(&assignedcluster[currElement], clusterId);
+                data = Util::skipLine(data);
+            }
         }
+        reader->remapData();
+    }
+    delete[] keyToId;
+    if (edgeDbr != NULL) {
+        edgeDbr->close();
+        delete edgeDbr;
     }
 
-#pragma omp parallel for schedule(dynamic, 1000)
-    for(size_t id = 0; id < dbSize; id++) {
-        unsigned int clusterKey = seqDbr->getDbKey(id);
-        unsigned int clusterId = id;
-
-        const size_t alnId = alnDbr->getId(clusterKey);
-        char *data = alnDbr->getData(alnId);
-
-        while (*data != '\0') {
-            char dbKey[255 + 1];
-            Util::parseKey(data, dbKey);
-            const unsigned int key = (unsigned int) strtoul(dbKey, NULL, 10);
-            unsigned int currElement = seqDbr->getId(key);
-            unsigned int targetId;
-
-            __atomic_load(&assignedcluster[currElement], &targetId ,__ATOMIC_RELAXED);
-            do {
-                if (targetId <= clusterId) break;
-            } while (!__atomic_compare_exchange(&assignedcluster[currElement],  &targetId,  &clusterId , false,  __ATOMIC_RELAXED, __ATOMIC_RELAXED));
-
-            if (currElement == UINT_MAX || currElement > seqDbr->getSize()) {
-                Debug(Debug::ERROR) << "ERROR: Element " << dbKey
-                                    << " contained in some alignment list, but not contained in the sequence database!\n";
-                EXIT(EXIT_FAILURE);
-            }
-            data = Util::skipLine(data);
+    // try to set your self as cluster centriod if no longer sequence covered you
+#pragma omp parallel for schedule(static)
+    for (size_t id = 0; id < dbSize; id++) {
+        if (assignedcluster[id] > id) {
+            assignedcluster[id] = static_cast<unsigned int>(id);
         }
     }
 
@@ -342,86 +654,106 @@ void ClusteringAlgorithms::greedyIncrementalLowMem( unsigned int *assignedcluste
     }
 }
 
-void ClusteringAlgorithms::greedyIncremental(unsigned int **elementLookupTable, size_t *elementOffsets,
-                                             size_t n, unsigned int *assignedcluster) {
-    for(size_t i = 0; i < n; i++) {
-        // seqDbr is descending sorted by length
-        // the assumption is that clustering is B -> B (not A -> B)
-        Debug::printProgress(i);
-        if(assignedcluster[i] == UINT_MAX){
-            size_t elementSize = (elementOffsets[i + 1] - elementOffsets[i]);
-            for (size_t elementId = 0; elementId < elementSize; elementId++) {
-                const unsigned int currElm = elementLookupTable[i][elementId];
-                if(assignedcluster[currElm] == currElm){
-                    assignedcluster[i] = currElm;
-                    break;
-                }
+void ClusteringAlgorithms::connectedComponentsLowMem(unsigned int *assignedcluster) {
+    // The alignment database is streamed once in its storage order and every edge is merged into a
+    // lock-free union-find, so only O(N) memory is needed independent of the number of edges.
+    // Components are the full transitive closure of the alignment graph, the depth limit
+    // (--max-iterations) of the graph based connected component mode is not applied.
+    // The representative of each component is its longest sequence (smallest id).
+    unsigned int maxKey = 0;
+    unsigned int *keyToId = ClusteringGraph::createKeyToIdLookup(seqDbr, maxKey);
+    UnionFind unionFind(dbSize);
+
+    const size_t alnSize = alnDbr->getSize();
+    const size_t flushSize = 1000000;
+    size_t iterations = static_cast<size_t>(ceil(static_cast<double>(alnSize) / static_cast<double>(flushSize)));
+    for (size_t it = 0; it < iterations; it++) {
+        size_t start = it * flushSize;
+        size_t bucketSize = std::min(alnSize - (it * flushSize), flushSize);
+#pragma omp parallel for schedule(dynamic, 100)
+        for (size_t i = start; i < (start + bucketSize); i++) {
+            Debug::printProgress(i);
+            const unsigned int clusterKey = alnDbr->getDbKey(i);
+            const unsigned int clusterId = (clusterKey <= maxKey) ? keyToId[clusterKey] : UINT_MAX;
+            if (clusterId == UINT_MAX) {
+                Debug(Debug::ERROR) << "ERROR: Alignment result " << clusterKey
+                                    << " has no entry in the sequence database!\n";
+                EXIT(EXIT_FAILURE);
             }
-            if(assignedcluster[i] == UINT_MAX) {
-                assignedcluster[i] = i;
+            char *data = alnDbr->getData(i);
+            while (*data != '\0') {
+                const unsigned int key = Util::fast_atoi<unsigned int>(data);
+                const unsigned int currElement = (key <= maxKey) ? keyToId[key] : UINT_MAX;
+                if (currElement == UINT_MAX) {
+                    char dbKey[255 + 1];
+                    Util::parseKey(data, dbKey);
+                    Debug(Debug::ERROR) << "ERROR: Element " << dbKey
+                                        << " contained in some alignment list, but not contained in the sequence database!\n";
+                    EXIT(EXIT_FAILURE);
+                }
+                unionFind.unite(clusterId, currElement);
+                data = Util::skipLine(data);
             }
         }
+        alnDbr->remapData();
     }
-}
+    delete[] keyToId;
 
-void ClusteringAlgorithms::readInClusterData(unsigned int **elementLookupTable, unsigned int *&elements,
-                                             unsigned short **scoreLookupTable, unsigned short *&scores,
-                                             size_t *elementOffsets, size_t totalElementCount) {
-    Timer timer;
-#pragma omp parallel for schedule(dynamic, 1000)
-    for(size_t i = 0; i < dbSize; i++) {
-        const unsigned int clusterId = seqDbr->getDbKey(i);
-        const size_t alnId = alnDbr->getId(clusterId);
-        const char *data = alnDbr->getData(alnId);
-        const size_t dataSize = alnDbr->getSeqLens(alnId);
-        elementOffsets[i] = Util::countLines(data, dataSize);
-    }
-
-    // make offset table
-    AlignmentSymmetry::computeOffsetFromCounts(elementOffsets, dbSize);
-    // set element edge pointers by using the offset table
-    AlignmentSymmetry::setupPointers<unsigned int>(elements, elementLookupTable, elementOffsets, dbSize,
-                                                   totalElementCount);
-    // fill elements
-    AlignmentSymmetry::readInData(alnDbr, seqDbr, elementLookupTable, NULL, 0, elementOffsets);
-    Debug(Debug::INFO) << "\nSort entries.\n";
-    AlignmentSymmetry::sortElements(elementLookupTable, elementOffsets, dbSize);
-    Debug(Debug::INFO) << "\nFind missing connections.\n";
-
-    size_t *newElementOffsets = new size_t[dbSize + 1];
-    memcpy(newElementOffsets, elementOffsets, sizeof(size_t) * (dbSize + 1));
-
-    // findMissingLinks detects new possible connections and updates the elementOffsets with new sizes
-    const size_t symmetricElementCount = AlignmentSymmetry::findMissingLinks(elementLookupTable,
-                                                                             newElementOffsets, dbSize,
-                                                                             threads);
-    // resize elements
-    delete[] elements;
-    elements = new(std::nothrow) unsigned int[symmetricElementCount];
-    Util::checkAllocation(elements, "Could not allocate elements memory in readInClusterData");
-    std::fill_n(elements, symmetricElementCount, UINT_MAX);
-    // init score vector
-    scores = new(std::nothrow) unsigned short[symmetricElementCount];
-    Util::checkAllocation(scores, "Could not allocate scores memory in readInClusterData");
-    std::fill_n(scores, symmetricElementCount, 0);
-    Debug(Debug::INFO) << "\nFound " << symmetricElementCount - totalElementCount << " new connections.\n";
-    AlignmentSymmetry::setupPointers<unsigned int>  (elements, elementLookupTable, newElementOffsets, dbSize, symmetricElementCount);
-    AlignmentSymmetry::setupPointers<unsigned short>(scores, scoreLookupTable, newElementOffsets, dbSize, symmetricElementCount);
-    //time
-    Debug(Debug::INFO) << "\nReconstruct initial order.\n";
-    alnDbr->remapData(); // need to free memory
-    AlignmentSymmetry::readInData(alnDbr, seqDbr, elementLookupTable, scoreLookupTable, scoretype, elementOffsets);
-    alnDbr->remapData(); // need to free memory
-    Debug(Debug::INFO) << "\nAdd missing connections.\n";
-    AlignmentSymmetry::addMissingLinks(elementLookupTable, elementOffsets, newElementOffsets, dbSize, scoreLookupTable);
-    maxClustersize = 0;
+#pragma omp parallel for schedule(static)
     for (size_t i = 0; i < dbSize; i++) {
-        size_t elementCount = newElementOffsets[i + 1] - newElementOffsets[i];
-        maxClustersize = std::max((unsigned int) elementCount, maxClustersize);
-        clustersizes[i] = elementCount;
+        assignedcluster[i] = unionFind.find(static_cast<unsigned int>(i));
     }
+}
 
-    memcpy(elementOffsets, newElementOffsets, sizeof(size_t) * (dbSize + 1));
-    delete[] newElementOffsets;
-    Debug(Debug::INFO) << "\nTime for read in: " << timer.lap() << "\n";
+void ClusteringAlgorithms::greedyIncremental(const ClusteringGraph &graph, unsigned int *assignedcluster) {
+    // seqDbr is descending sorted by length
+    // the assumption is that clustering is B -> B (not A -> B)
+    // Sequentially a sequence joins the first representative in its list or becomes a representative.
+    // Only longer sequences (smaller id) can already be a representative at this point, so a sequence can be
+    // decided as soon as all longer sequences in front of this representative are decided.
+    // We decide a window of sequences in parallel rounds until all of them are decided, the result is identical.
+    const size_t windowSize = std::max(static_cast<size_t>(threads) * 4096, static_cast<size_t>(65536));
+    std::vector<unsigned int> pending;
+    pending.reserve(windowSize);
+    size_t nextId = 0;
+    while (nextId < dbSize || pending.empty() == false) {
+        while (pending.size() < windowSize && nextId < dbSize) {
+            Debug::printProgress(nextId);
+            pending.push_back(static_cast<unsigned int>(nextId));
+            nextId++;
+        }
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t pos = 0; pos < pending.size(); pos++) {
+            const unsigned int i = pending[pos];
+            unsigned int decision = i;
+            const size_t elementSize = graph.getDegree(i);
+            const unsigned int *elementLookup = graph.getElements(i);
+            for (size_t elementId = 0; elementId < elementSize; elementId++) {
+                const unsigned int currElm = elementLookup[elementId];
+                if (currElm >= i) {
+                    continue;
+                }
+                const unsigned int currAssignment = __atomic_load_n(&assignedcluster[currElm], __ATOMIC_ACQUIRE);
+                if (currAssignment == UINT_MAX) {
+                    decision = UINT_MAX;
+                    break;
+                }
+                if (currAssignment == currElm) {
+                    decision = currElm;
+                    break;
+                }
+            }
+            if (decision != UINT_MAX) {
+                __atomic_store_n(&assignedcluster[i], decision, __ATOMIC_RELEASE);
+            }
+        }
+        size_t writePos = 0;
+        for (size_t pos = 0; pos < pending.size(); pos++) {
+            if (assignedcluster[pending[pos]] == UINT_MAX) {
+                pending[writePos] = pending[pos];
+                writePos++;
+            }
+        }
+        pending.resize(writePos);
+    }
 }
@@ -8,16 +8,24 @@
 #include <set>
 #include <list>
 #include <vector>
-#include <unordered_map>
 
 #include "DBReader.h"
 #include "SetElement.h"
+#include "ClusteringGraph.h"
 
 class ClusteringAlgorithms {
 public:
-    ClusteringAlgorithms(DBReader<unsigned int>* seqDbr, DBReader<unsigned int>* alnDbr, int threads,int scoretype, int maxiterations);
+    ClusteringAlgorithms(DBReader<unsigned int>* seqDbr, DBReader<unsigned int>* alnDbr, int threads,int scoretype, int maxiterations,
+                         const std::string &graphPrefix, size_t memoryLimit, bool parallelSetCover);
     ~ClusteringAlgorithms();
-    std::unordered_map<unsigned int, std::vector<unsigned int>> execute(int mode);
+    // returns the (representative, member) ids of all sequences sorted by representative and member
+    std::pair<unsigned int, unsigned int> * execute(int mode);
+
+    // turns the representative id of every sequence into the sorted (representative, member) array,
+    // unassigned sequences become their own representative
+    static std::pair<unsigned int, unsigned int> * sortByRepresentative(DBReader<unsigned int> *seqDbr,
+                                                                        unsigned int *assignedcluster,
+                                                                        size_t dbSize);
 private:
     DBReader<unsigned int>* seqDbr;
 
@@ -26,6 +34,9 @@ private:
 
     int threads;
     int scoretype;
+    std::string graphPrefix;
+    size_t memoryLimit;
+    bool parallelSetCover;
 //datastructures
     unsigned int maxClustersize;
     unsigned int dbSize;
@@ -41,23 +52,25 @@ private:
     void removeClustersize(int clusterid);
 
     void decreaseClustersize(int clusterid);
+
 //for connected component
     int maxiterations;
 
+    void connectedComponents(const ClusteringGraph &graph, unsigned int *assignedcluster);
 
-    void setCover(unsigned int **elementLookup, unsigned short ** elementScoreLookupTable,
-                  unsigned int *assignedcluster, short *bestscore, size_t *offsets);
+    void connectedComponentsBfs(const ClusteringGraph &graph, unsigned int *assignedcluster);
 
-    void greedyIncremental(unsigned int **elementLookupTable, size_t *elementOffsets,
-                           size_t n, unsigned int *assignedcluster) ;
+    void connectedComponentsLowMem(unsigned int *assignedcluster);
 
+    void setCover(const ClusteringGraph &graph, unsigned int *assignedcluster, short *bestscore);
 
-    void greedyIncrementalLowMem(unsigned int *assignedcluster) ;
+    // ties between equally sized sets are broken by sequence length instead of the order of sorted_clustersizes
+    void setCoverParallel(const ClusteringGraph &graph, unsigned int *assignedcluster);
 
+    void greedyIncremental(const ClusteringGraph &graph, unsigned int *assignedcluster);
 
-    void readInClusterData(unsigned int **elementLookupTable, unsigned int *&elements,
-                           unsigned short **scoreLookupTable, unsigned short *&scores,
-                           size_t *elementOffsets, size_t totalElementCount)  ;
+
+    void greedyIncrementalLowMem(unsigned int *assignedcluster) ;
 
 };
 
@@ -0,0 +1,346 @@
+#include "ClusteringGraph.h"
+#include "AlignmentSymmetry.h"
+#include "Parameters.h"
+#include "FileUtil.h"
+#include "Debug.h"
+#include "Util.h"
+#include "Timer.h"
+#include "omptl/omptl_algorithm"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+ClusteringGraph::ClusteringGraph(DBReader<unsigned int> *seqDbr, DBReader<unsigned int> *alnDbr,
+                                 const std::string &graphPrefix, int scoretype, size_t memoryLimit) :
+        seqDbr(seqDbr), alnDbr(alnDbr), scoretype(scoretype), memoryLimit(memoryLimit),
+        dbSize(seqDbr->getSize()), elementCount(0), maxDegree(0),
+        offsets(NULL), elements(NULL), scores(NULL), keyToId(NULL), maxKey(0),
+        offsetsSize(0), elementsSize(0), scoresSize(0) {
+    offsetFile = graphPrefix + ".offsets";
+    elementFile = graphPrefix + ".elements";
+    scoreFile = graphPrefix + ".scores";
+}
+
+ClusteringGraph::~ClusteringGraph() {
+    if (keyToId != NULL) {
+        delete[] keyToId;
+    }
+    if (offsets != NULL) {
+        munmap(offsets, offsetsSize);
+        FileUtil::deleteFile(offsetFile);
+    }
+    if (elements != NULL) {
+        munmap(elements, elementsSize);
+    }
+    if (scores != NULL) {
+        munmap(scores, scoresSize);
+    }
+    if (FileUtil::fileExists(elementFile.c_str())) {
+        FileUtil::deleteFile(elementFile);
+    }
+    if (FileUtil::fileExists(scoreFile.c_str())) {
+        FileUtil::deleteFile(scoreFile);
+    }
+}
+
+unsigned int *ClusteringGraph::createKeyToIdLookup(DBReader<unsigned int> *seqDbr, unsigned int &maxKey) {
+    maxKey = seqDbr->getLastKey();
+    unsigned int *lookup = new(std::nothrow) unsigned int[static_cast<size_t>(maxKey) + 1];
+    Util::checkAllocation(lookup, "Could not allocate lookup memory in ClusteringGraph::createKeyToIdLookup");
+    std::fill_n(lookup, static_cast<size_t>(maxKey) + 1, UINT_MAX);
+    const size_t size = seqDbr->getSize();
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < size; i++) {
+        lookup[seqDbr->getDbKey(i)] = static_cast<unsigned int>(i);
+    }
+    return lookup;
+}
+
+void ClusteringGraph::build() {
+    Timer timer;
+    // a dense key to id table avoids a binary search in the sequence index for every edge
+    keyToId = createKeyToIdLookup(seqDbr, maxKey);
+
+    std::vector<unsigned int> bucketStart;
+    const size_t bucketCount = computeBuckets(bucketStart);
+    Debug(Debug::INFO) << "Write edges into " << bucketCount << " bucket(s).\n";
+    std::vector<std::string> bucketFiles;
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+        bucketFiles.push_back(elementFile + "_bucket_" + SSTR(bucket));
+    }
+    writeBuckets(bucketStart, bucketFiles);
+    delete[] keyToId;
+    keyToId = NULL;
+
+    Debug(Debug::INFO) << "\nSymmetrize and sort edges.\n";
+    writeRows(bucketFiles);
+    mapFiles();
+    Debug(Debug::INFO) << "Graph with " << elementCount << " edges. Time for read in: " << timer.lap() << "\n";
+}
+
+size_t ClusteringGraph::computeBuckets(std::vector<unsigned int> &bucketStart) {
+    size_t *edgeCount = new(std::nothrow) size_t[dbSize];
+    Util::checkAllocation(edgeCount, "Could not allocate edgeCount memory in ClusteringGraph::computeBuckets");
+#pragma omp parallel for schedule(dynamic, 1000)
+    for (size_t i = 0; i < dbSize; i++) {
+        const size_t alnId = alnDbr->getId(seqDbr->getDbKey(i));
+        if (alnId == UINT_MAX) {
+            edgeCount[i] = 0;
+            continue;
+        }
+        edgeCount[i] = Util::countLines(alnDbr->getData(alnId), alnDbr->getSeqLens(alnId));
+    }
+
+    // every edge is stored twice (forward and reverse) and the sort needs some room
+    // so we assume that the reverse edges distribute similar to the forward edges
+    const size_t bucketBytes = std::max(memoryLimit / 2, static_cast<size_t>(1));
+    bucketStart.push_back(0);
+    size_t bytes = 0;
+    for (size_t i = 0; i < dbSize; i++) {
+        const size_t rowBytes = 2 * edgeCount[i] * sizeof(Edge);
+        if (bytes > 0 && bytes + rowBytes > bucketBytes) {
+            bucketStart.push_back(static_cast<unsigned int>(i));
+            bytes = 0;
+        }
+        bytes += rowBytes;
+    }
+    bucketStart.push_back(static_cast<unsigned int>(dbSize));
+    delete[] edgeCount;
+    return bucketStart.size() - 1;
+}
+
+size_t ClusteringGraph::computeBucketsPerPass(size_t bucketCount, size_t bufferSize) {
+    size_t threads = 1;
+#ifdef OPENMP
+    threads = static_cast<size_t>(omp_get_max_threads());
+#endif
+    // every thread keeps an edge buffer per bucket of the pass, they share the memory limit with the sort of a bucket
+    const size_t bufferBytes = threads * bufferSize * sizeof(Edge);
+    size_t bucketsPerPass = std::max(memoryLimit / 2 / bufferBytes, static_cast<size_t>(1));
+
+    // leave some file descriptors for the databases
+    const size_t reservedFiles = 64;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        const size_t maxFiles = static_cast<size_t>(limit.rlim_cur);
+        bucketsPerPass = std::min(bucketsPerPass, (maxFiles > reservedFiles + 1) ? maxFiles - reservedFiles : static_cast<size_t>(1));
+    }
+    return std::min(bucketsPerPass, bucketCount);
+}
+
+void ClusteringGraph::writeBuckets(const std::vector<unsigned int> &bucketStart,
+                                   const std::vector<std::string> &bucketFiles) {
+    const size_t bucketCount = bucketFiles.size();
+    const size_t BUFFER_SIZE = 4096;
+    // the alignment database is read once for every pass, each pass writes only a range of buckets
+    const size_t bucketsPerPass = computeBucketsPerPass(bucketCount, BUFFER_SIZE);
+    const size_t passes = (bucketCount + bucketsPerPass - 1) / bucketsPerPass;
+    if (passes > 1) {
+        Debug(Debug::INFO) << "Write " << bucketsPerPass << " bucket(s) per pass in " << passes << " passes.\n";
+    }
+    for (size_t pass = 0; pass < passes; pass++) {
+        const size_t firstBucket = pass * bucketsPerPass;
+        const size_t lastBucket = std::min(firstBucket + bucketsPerPass, bucketCount);
+        writeBucketRange(bucketStart, bucketFiles, firstBucket, lastBucket, BUFFER_SIZE);
+    }
+}
+
+void ClusteringGraph::writeBucketRange(const std::vector<unsigned int> &bucketStart,
+                                       const std::vector<std::string> &bucketFiles,
+                                       size_t firstBucket, size_t lastBucket, size_t bufferSize) {
+    const size_t passBuckets = lastBucket - firstBucket;
+    FILE **files = new FILE*[passBuckets];
+    for (size_t bucket = 0; bucket < passBuckets; bucket++) {
+        files[bucket] = FileUtil::openFileOrDie(bucketFiles[firstBucket + bucket].c_str(), "wb", false);
+    }
+
+    const size_t flushSize = 1000000;
+    size_t iterations = static_cast<size_t>(ceil(static_cast<double>(dbSize) / static_cast<double>(flushSize)));
+    for (size_t it = 0; it < iterations; it++) {
+        size_t start = it * flushSize;
+        size_t bucketSize = std::min(dbSize - (it * flushSize), flushSize);
+#pragma omp parallel
+        {
+            std::vector<std::vector<Edge> > buffers(passBuckets);
+#pragma omp for schedule(dynamic, 100)
+            for (size_t i = start; i < (start + bucketSize); i++) {
+                Debug::printProgress(i);
+                // seqDbr is descending sorted by length
+                // the assumption is that clustering is B -> B (not A -> B)
+                const unsigned int clusterKey = seqDbr->getDbKey(i);
+                char *data = alnDbr->getDataByDBKey(clusterKey);
+                if (*data == '\0') { // check if file contains entry
+                    if (firstBucket == 0) {
+                        Debug(Debug::ERROR) << "ERROR: Sequence " << i
+                                            << " does not contain any sequence for key " << clusterKey
+                                            << "!\n";
+                    }
+                    continue;
+                }
+                const size_t fromBucket = std::upper_bound(bucketStart.begin(), bucketStart.end(), i) - bucketStart.begin() - 1;
+                unsigned int rank = 0;
+                while (*data != '\0') {
+                    const unsigned int key = Util::fast_atoi<unsigned int>(data);
+                    const unsigned int currElement = (key <= maxKey) ? keyToId[key] : UINT_MAX;
+                    if (currElement == UINT_MAX) {
+                        char dbKey[255 + 1];
+                        Util::parseKey(data, dbKey);
+                        Debug(Debug::ERROR) << "ERROR: Element " << dbKey
+                                            << " contained in some alignment list, but not contained in the sequence database!\n";
+                        EXIT(EXIT_FAILURE);
+                    }
+                    //column 1 = alignment score, column 2 = sequence identity
+                    char *column = data;
+                    const int columnNumber = (scoretype == Parameters::APC_ALIGNMENTSCORE) ? 1 : 2;
+                    for (int col = 0; col < columnNumber && *column != '\n'; col++) {
+                        column += Util::skipNoneWhitespace(column);
+                        column += Util::skipWhitespace(column);
+                    }
+                    unsigned short score = 0;
+                    if (*column != '\n' && *column != '\0') {
+                        score = (scoretype == Parameters::APC_ALIGNMENTSCORE)
+                                ? static_cast<unsigned short>(atof(column))
+                                : static_cast<unsigned short>(atof(column) * 1000.0f);
+                    }
+
+                    Edge edge;
+                    if (fromBucket >= firstBucket && fromBucket < lastBucket) {
+                        edge.from = static_cast<unsigned int>(i);
+                        edge.to = currElement;
+                        edge.rank = rank;
+                        edge.score = score;
+                        writeEdge(buffers[fromBucket - firstBucket], files[fromBucket - firstBucket], edge, bufferSize);
+                    }
+
+                    // reverse edge, dropped later if the alignment result of currElement contains i
+                    const size_t toBucket = std::upper_bound(bucketStart.begin(), bucketStart.end(), currElement) - bucketStart.begin() - 1;
+                    if (toBucket >= firstBucket && toBucket < lastBucket) {
+                        edge.from = currElement;
+                        edge.to = static_cast<unsigned int>(i);
+                        edge.rank = UINT_MAX;
+                        edge.score = score;
+                        writeEdge(buffers[toBucket - firstBucket], files[toBucket - firstBucket], edge, bufferSize);
+                    }
+                    rank++;
+                    data = Util::skipLine(data);
+                }
+            }
+            for (size_t bucket = 0; bucket < passBuckets; bucket++) {
+                if (buffers[bucket].size() > 0) {
+#pragma omp critical
+                    fwrite(buffers[bucket].data(), sizeof(Edge), buffers[bucket].size(), files[bucket]);
+                    buffers[bucket].clear();
+                }
+            }
+        }
+        alnDbr->remapData();
+    }
+
+    for (size_t bucket = 0; bucket < passBuckets; bucket++) {
+        fclose(files[bucket]);
+    }
+    delete[] files;
+}
+
+void ClusteringGraph::writeEdge(std::vector<Edge> &buffer, FILE *file, const Edge &edge, size_t bufferSize) {
+    buffer.push_back(edge);
+    if (buffer.size() >= bufferSize) {
+#pragma omp critical
+        fwrite(buffer.data(), sizeof(Edge), buffer.size(), file);
+        buffer.clear();
+    }
+}
+
+void ClusteringGraph::writeRows(const std::vector<std::string> &bucketFiles) {
+    size_t *degrees = new(std::nothrow) size_t[dbSize + 1];
+    Util::checkAllocation(degrees, "Could not allocate degrees memory in ClusteringGraph::writeRows");
+    std::fill_n(degrees, dbSize + 1, 0);
+
+    FILE *elementOut = FileUtil::openFileOrDie(elementFile.c_str(), "wb", false);
+    FILE *scoreOut = FileUtil::openFileOrDie(scoreFile.c_str(), "wb", false);
+    const size_t BUFFER_SIZE = 4096;
+    unsigned int elementBuffer[BUFFER_SIZE];
+    unsigned short scoreBuffer[BUFFER_SIZE];
+    for (size_t bucket = 0; bucket < bucketFiles.size(); bucket++) {
+        const size_t edgeCount = FileUtil::getFileSize(bucketFiles[bucket]) / sizeof(Edge);
+        Edge *edges = new(std::nothrow) Edge[std::max(edgeCount, static_cast<size_t>(1))];
+        Util::checkAllocation(edges, "Could not allocate edges memory in ClusteringGraph::writeRows");
+        FILE *in = FileUtil::openFileOrDie(bucketFiles[bucket].c_str(), "rb", true);
+        if (fread(edges, sizeof(Edge), edgeCount, in) != edgeCount) {
+            Debug(Debug::ERROR) << "Could not read " << bucketFiles[bucket] << "!\n";
+            EXIT(EXIT_FAILURE);
+        }
+        fclose(in);
+        FileUtil::deleteFile(bucketFiles[bucket]);
+
+        omptl::sort(edges, edges + edgeCount, Edge::compareByFromAndTo);
+        // keep all edges of the alignment result and add a reverse edge only if it is missing
+        size_t writePos = 0;
+        size_t pos = 0;
+        while (pos < edgeCount) {
+            size_t end = pos + 1;
+            while (end < edgeCount && edges[end].from == edges[pos].from && edges[end].to == edges[pos].to) {
+                end++;
+            }
+            if (edges[pos].rank != UINT_MAX) {
+                for (size_t i = pos; i < end && edges[i].rank != UINT_MAX; i++) {
+                    edges[writePos++] = edges[i];
+                }
+            } else {
+                edges[writePos++] = edges[pos];
+            }
+            pos = end;
+        }
+        omptl::sort(edges, edges + writePos, Edge::compareByFromAndRank);
+
+        size_t bufferPos = 0;
+        for (size_t i = 0; i < writePos; i++) {
+            degrees[edges[i].from]++;
+            elementBuffer[bufferPos] = edges[i].to;
+            scoreBuffer[bufferPos] = edges[i].score;
+            bufferPos++;
+            if (bufferPos == BUFFER_SIZE) {
+                fwrite(elementBuffer, sizeof(unsigned int), bufferPos, elementOut);
+                fwrite(scoreBuffer, sizeof(unsigned short), bufferPos, scoreOut);
+                bufferPos = 0;
+            }
+        }
+        fwrite(elementBuffer, sizeof(unsigned int), bufferPos, elementOut);
+        fwrite(scoreBuffer, sizeof(unsigned short), bufferPos, scoreOut);
+        elementCount += writePos;
+        delete[] edges;
+    }
+    fclose(elementOut);
+    fclose(scoreOut);
+
+    for (size_t i = 0; i < dbSize; i++) {
+        maxDegree = std::max(maxDegree, degrees[i]);
+    }
+    AlignmentSymmetry::computeOffsetFromCounts(degrees, dbSize);
+    FILE *offsetOut = FileUtil::openFileOrDie(offsetFile.c_str(), "wb", false);
+    fwrite(degrees, sizeof(size_t), dbSize + 1, offsetOut);
+    fclose(offsetOut);
+    delete[] degrees;
+}
+
+void ClusteringGraph::mapFiles() {
+    FILE *file = FileUtil::openFileOrDie(offsetFile.c_str(), "r", true);
+    offsets = (size_t *) FileUtil::mmapFile(file, &offsetsSize);
+    fclose(file);
+    // mmap does not accept empty files
+    if (elementCount > 0) {
+        file = FileUtil::openFileOrDie(elementFile.c_str(), "r", true);
+        elements = (unsigned int *) FileUtil::mmapFile(file, &elementsSize);
+        fclose(file);
+        file = FileUtil::openFileOrDie(scoreFile.c_str(), "r", true);
+        scores = (unsigned short *) FileUtil::mmapFile(file, &scoresSize);
+        fclose(file);
+    }
+}
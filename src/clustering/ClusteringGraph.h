@@ -0,0 +1,141 @@
+#ifndef MMSEQS_CLUSTERINGGRAPH_H
+#define MMSEQS_CLUSTERINGGRAPH_H
+
+// Symmetric clustering graph in compressed sparse row (CSR) format.
+// The alignment database is streamed once: every edge is written (with sequence ids already
+// mapped and scores as 16-bit) together with its reverse edge into on-disk buckets of consecutive
+// set ids. Each bucket is then sorted on its own (external bucket sort), duplicated reverse
+// edges are removed and the rows are appended to the CSR files, which are mmaped for clustering.
+// Only one bucket has to fit into memory at a time. If the edge buffers of all buckets exceed the memory
+// limit or the buckets exceed the open file limit, the alignment database is streamed once per range of buckets.
+//
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+
+#include "DBReader.h"
+
+class ClusteringGraph {
+public:
+    struct __attribute__((__packed__)) Edge {
+        unsigned int from;
+        unsigned int to;
+        // position of the edge in the alignment result, UINT_MAX for added reverse edges
+        unsigned int rank;
+        unsigned short score;
+
+        static bool compareByFromAndTo(const Edge &first, const Edge &second) {
+            if (first.from < second.from)
+                return true;
+            if (second.from < first.from)
+                return false;
+            if (first.to < second.to)
+                return true;
+            if (second.to < first.to)
+                return false;
+            if (first.rank < second.rank)
+                return true;
+            return false;
+        }
+
+        // reconstructs the initial order: alignment result order, followed by the added links
+        static bool compareByFromAndRank(const Edge &first, const Edge &second) {
+            if (first.from < second.from)
+                return true;
+            if (second.from < first.from)
+                return false;
+            if (first.rank < second.rank)
+                return true;
+            if (second.rank < first.rank)
+                return false;
+            if (first.to < second.to)
+                return true;
+            return false;
+        }
+    };
+
+    ClusteringGraph(DBReader<unsigned int> *seqDbr, DBReader<unsigned int> *alnDbr,
+                    const std::string &graphPrefix, int scoretype, size_t memoryLimit);
+
+    ~ClusteringGraph();
+
+    void build();
+
+    size_t getSize() const {
+        return dbSize;
+    }
+
+    size_t getElementCount() const {
+        return elementCount;
+    }
+
+    size_t getMaxDegree() const {
+        return maxDegree;
+    }
+
+    size_t getDegree(size_t id) const {
+        return offsets[id + 1] - offsets[id];
+    }
+
+    const unsigned int *getElements(size_t id) const {
+        return elements + offsets[id];
+    }
+
+    const unsigned short *getScores(size_t id) const {
+        return scores + offsets[id];
+    }
+
+    const size_t *getOffsets() const {
+        return offsets;
+    }
+
+    // dense table that maps database keys to the local ids of seqDbr, UINT_MAX for missing keys
+    static unsigned int *createKeyToIdLookup(DBReader<unsigned int> *seqDbr, unsigned int &maxKey);
+
+private:
+    DBReader<unsigned int> *seqDbr;
+    DBReader<unsigned int> *alnDbr;
+
+    std::string offsetFile;
+    std::string elementFile;
+    std::string scoreFile;
+
+    int scoretype;
+    size_t memoryLimit;
+
+    size_t dbSize;
+    size_t elementCount;
+    size_t maxDegree;
+
+    size_t *offsets;
+    unsigned int *elements;
+    unsigned short *scores;
+
+    // maps database keys to the local (length sorted) ids of seqDbr
+    unsigned int *keyToId;
+    unsigned int maxKey;
+
+    size_t offsetsSize;
+    size_t elementsSize;
+    size_t scoresSize;
+
+    size_t computeBuckets(std::vector<unsigned int> &bucketStart);
+
+    void writeBuckets(const std::vector<unsigned int> &bucketStart, const std::vector<std::string> &bucketFiles);
+
+    // number of buckets that can be written in one pass over the alignment database
+    size_t computeBucketsPerPass(size_t bucketCount, size_t bufferSize);
+
+    void writeBucketRange(const std::vector<unsigned int> &bucketStart, const std::vector<std::string> &bucketFiles,
+                          size_t firstBucket, size_t lastBucket, size_t bufferSize);
+
+    static void writeEdge(std::vector<Edge> &buffer, FILE *file, const Edge &edge, size_t bufferSize);
+
+    void writeRows(const std::vector<std::string> &bucketFiles);
+
+    void mapFiles();
+};
+
+#endif //MMSEQS_CLUSTERINGGRAPH_H
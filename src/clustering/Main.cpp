@@ -2,6 +2,7 @@
 #include "Clustering.h"
 #include "Parameters.h"
 #include "Debug.h"
+#include "Util.h"
 
 #ifdef OPENMP
 #include <omp.h>
@@ -15,9 +16,15 @@ int clust(int argc, const char **argv, const Command& command) {
 #ifdef OPENMP
     omp_set_num_threads(par.threads);
 #endif
+    size_t memoryLimit;
+    if (par.splitMemoryLimit > 0) {
+        memoryLimit = static_cast<size_t>(par.splitMemoryLimit) * 1024;
+    } else {
+        memoryLimit = static_cast<size_t>(Util::getTotalSystemMemory() * 0.9);
+    }
     Clustering* clu = new Clustering(par.db1, par.db1Index, par.db2, par.db2Index,
                                      par.db3, par.db3Index, par.maxIteration,
-                                     par.similarityScoreType, par.threads);
+                                     par.similarityScoreType, par.parallelSetCover, par.threads, memoryLimit);
 
     clu->run(par.clusteringMode);
 
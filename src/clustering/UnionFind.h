@@ -0,0 +1,82 @@
+#ifndef MMSEQS_UNIONFIND_H
+#define MMSEQS_UNIONFIND_H
+
+// Lock-free union-find over sequence ids.
+// Roots are linked below the root with the higher priority, so the final root of every component
+// is its element with the highest priority, independent of the order of the unite calls.
+// Without a priority table the smaller id (longer sequence in a length sorted DB) wins.
+//
+
+#include <cstddef>
+#include <new>
+
+#include "Util.h"
+
+class UnionFind {
+public:
+    UnionFind(size_t size, const unsigned int *priority = NULL) : size(size), priority(priority) {
+        parent = new(std::nothrow) unsigned int[size];
+        Util::checkAllocation(parent, "Could not allocate parent memory in UnionFind");
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < size; i++) {
+            parent[i] = static_cast<unsigned int>(i);
+        }
+    }
+
+    ~UnionFind() {
+        delete[] parent;
+    }
+
+    unsigned int find(unsigned int x) {
+        while (true) {
+            const unsigned int p = __atomic_load_n(&parent[x], __ATOMIC_RELAXED);
+            if (p == x) {
+                return x;
+            }
+            const unsigned int gp = __atomic_load_n(&parent[p], __ATOMIC_RELAXED);
+            if (gp == p) {
+                return p;
+            }
+            // path halving, it does not matter if another thread was faster
+            __sync_bool_compare_and_swap(&parent[x], p, gp);
+            x = gp;
+        }
+    }
+
+    void unite(unsigned int a, unsigned int b) {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) {
+                return;
+            }
+            if (hasHigherPriority(b, a)) {
+                const unsigned int tmp = a;
+                a = b;
+                b = tmp;
+            }
+            // b might not be a root anymore, try again in this case
+            if (__sync_bool_compare_and_swap(&parent[b], b, a)) {
+                return;
+            }
+        }
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    size_t size;
+    const unsigned int *priority;
+    unsigned int *parent;
+
+    bool hasHigherPriority(unsigned int a, unsigned int b) const {
+        if (priority == NULL) {
+            return a < b;
+        }
+        return (priority[a] > priority[b]) || (priority[a] == priority[b] && a < b);
+    }
+};
+
+#endif //MMSEQS_UNIONFIND_H
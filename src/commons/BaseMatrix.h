@@ -73,29 +73,40 @@ public:
     ProbabilityMatrix(BaseMatrix &matrix) : alphabetSize(matrix.alphabetSize) {
         probMatrix = new double*[matrix.alphabetSize];
         probMatrixPointers = new const double*[matrix.alphabetSize];
+        probMatrixFloat = new float*[matrix.alphabetSize];
+        probMatrixFloatPointers = new const float*[matrix.alphabetSize];
         std::fill_n(hardMaskTable, 256, matrix.aa2int[(int) 'X']);
         for (int i = 0; i < matrix.alphabetSize; ++i) {
             probMatrix[i] = new double[matrix.alphabetSize];
             probMatrixPointers[i] = probMatrix[i];
+            probMatrixFloat[i] = new float[matrix.alphabetSize];
+            probMatrixFloatPointers[i] = probMatrixFloat[i];
             for (int j = 0; j < matrix.alphabetSize; ++j) {
                 probMatrix[i][j] = matrix.probMatrix[i][j] / (matrix.pBack[i] * matrix.pBack[j]);
+                probMatrixFloat[i][j] = static_cast<float>(probMatrix[i][j]);
             }
         }
     }
     ~ProbabilityMatrix() {
         for (int i = 0; i < alphabetSize; ++i) {
             delete[] probMatrix[i];
+            delete[] probMatrixFloat[i];
         }
         delete[] probMatrix;
         delete[] probMatrixPointers;
+        delete[] probMatrixFloat;
+        delete[] probMatrixFloatPointers;
     }
 
     char hardMaskTable[256];
     const double **probMatrixPointers;
+    // single precision copy for the SIMD tantan masking
+    const float **probMatrixFloatPointers;
 
 private:
     const int alphabetSize;
     double **probMatrix;
+    float **probMatrixFloat;
 
 };
 #endif
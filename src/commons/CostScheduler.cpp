@@ -0,0 +1,62 @@
+#include "CostScheduler.h"
+#include "Debug.h"
+
+#include <algorithm>
+
+CostScheduler::CostScheduler(size_t from, size_t size, unsigned int threads) : from(from), threadTimes(threads) {
+    order.reserve(size);
+    for (size_t id = from; id < from + size; id++) {
+        order.push_back(std::make_pair(static_cast<size_t>(0), id));
+    }
+    for (size_t i = 0; i < threadTimes.size(); i++) {
+        threadTimes[i].entries = 0;
+        threadTimes[i].lastDone = 0.0;
+    }
+    gettimeofday(&start, NULL);
+}
+
+bool CostScheduler::compareByCost(const std::pair<size_t, size_t> &first, const std::pair<size_t, size_t> &second) {
+    if (first.first > second.first) {
+        return true;
+    }
+    if (second.first > first.first) {
+        return false;
+    }
+    return first.second < second.second;
+}
+
+void CostScheduler::sortByCost(size_t blockSize) {
+    if (blockSize == 0) {
+        blockSize = order.size();
+    }
+    for (size_t block = 0; block < order.size(); block += blockSize) {
+        const size_t blockEnd = std::min(order.size(), block + blockSize);
+        std::sort(order.begin() + block, order.begin() + blockEnd, compareByCost);
+    }
+    gettimeofday(&start, NULL);
+}
+
+void CostScheduler::entryDone(unsigned int thread_idx) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    threadTimes[thread_idx].entries++;
+    threadTimes[thread_idx].lastDone = (now.tv_sec - start.tv_sec) + 1e-6 * (now.tv_usec - start.tv_usec);
+}
+
+void CostScheduler::printThreadTimes() {
+    if (threadTimes.size() < 2) {
+        return;
+    }
+    double firstDone = threadTimes[0].lastDone;
+    double lastDone = threadTimes[0].lastDone;
+    double sumDone = 0.0;
+    Debug(Debug::INFO + 1) << "Thread\tEntries\tLast entry done (s)\n";
+    for (size_t i = 0; i < threadTimes.size(); i++) {
+        Debug(Debug::INFO + 1) << i << "\t" << threadTimes[i].entries << "\t" << threadTimes[i].lastDone << "\n";
+        firstDone = std::min(firstDone, threadTimes[i].lastDone);
+        lastDone = std::max(lastDone, threadTimes[i].lastDone);
+        sumDone += threadTimes[i].lastDone;
+    }
+    Debug(Debug::INFO) << "Thread busy time min/mean/max: " << firstDone << "s/"
+                       << (sumDone / threadTimes.size()) << "s/" << lastDone << "s\n";
+}
@@ -0,0 +1,58 @@
+#ifndef MMSEQS_COSTSCHEDULER_H
+#define MMSEQS_COSTSCHEDULER_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <sys/time.h>
+
+// Orders the entries of a database range by an estimated cost, the most expensive first.
+// A dynamically scheduled loop over getId(i) then does not end with a few long entries on one thread.
+// Each module provides its own cost model through setCost.
+class CostScheduler {
+public:
+    CostScheduler(size_t from, size_t size, unsigned int threads);
+
+    // cost of the entry with the database id, all ids of the range start with cost 0
+    void setCost(size_t id, size_t cost) {
+        order[id - from].first = cost;
+    }
+
+    // sorts by decreasing cost, equal costs stay in id order
+    // entries are only moved within blocks of blockSize ids, e.g. for databases that are remapped in chunks
+    void sortByCost(size_t blockSize);
+
+    void sortByCost() {
+        sortByCost(order.size());
+    }
+
+    // database id of the i-th entry of the range in processing order
+    size_t getId(size_t i) const {
+        return order[i].second;
+    }
+
+    // called by a thread after it finished an entry
+    void entryDone(unsigned int thread_idx);
+
+    // prints the minimum, mean and maximum time until the threads finished their last entry
+    // the entries and times of every thread are only printed with verbosity 4
+    void printThreadTimes();
+
+private:
+    const size_t from;
+    // cost and id of every entry of the range
+    std::vector<std::pair<size_t, size_t> > order;
+
+    struct ThreadTime {
+        size_t entries;
+        double lastDone;
+        // keeps the counters of different threads in different cache lines
+        char padding[64 - sizeof(size_t) - sizeof(double)];
+    };
+    std::vector<ThreadTime> threadTimes;
+    struct timeval start;
+
+    static bool compareByCost(const std::pair<size_t, size_t> &first, const std::pair<size_t, size_t> &second);
+};
+
+#endif
@@ -22,7 +22,7 @@ DBReader<T>::DBReader(const char* dataFileName_, const char* indexFileName_, int
         data(NULL), dataMode(dataMode), dataFileName(strdup(dataFileName_)),
         indexFileName(strdup(indexFileName_)), size(0), dataSize(0), aaDbSize(0), lastKey(T()), closed(1), dbtype(-1),
         index(NULL), seqLens(NULL), id2local(NULL), local2id(NULL),
-        dataMapped(false), accessType(0), externalData(false), didMlock(false)
+        dataMapped(false), accessType(0), externalData(false), didMlock(false), didPreload(false)
 {}
 
 template <typename T>
@@ -30,7 +30,7 @@ DBReader<T>::DBReader(DBReader<T>::Index *index, unsigned int *seqLens, size_t s
         data(NULL), dataMode(USE_INDEX), dataFileName(NULL), indexFileName(NULL),
         size(size), dataSize(0), aaDbSize(aaDbSize), lastKey(lastKey), closed(1), dbtype(-1),
         index(index), seqLens(seqLens), id2local(NULL), local2id(NULL),
-        dataMapped(false), accessType(NOSORT), externalData(true), didMlock(false)
+        dataMapped(false), accessType(NOSORT), externalData(true), didMlock(false), didPreload(false)
 {}
 
 template <typename T>
@@ -49,6 +49,7 @@ template <typename T>
 void DBReader<T>::readMmapedDataInMemory(){
     if ((dataMode & USE_DATA) && (dataMode & USE_FREAD) == 0) {
         magicBytes = Util::touchMemory(data, dataSize);
+        didPreload = true;
     }
 }
 
@@ -393,6 +394,54 @@ void DBReader<T>::touchData(size_t id) {
     }
 }
 
+template <typename T>
+void DBReader<T>::prefetchData(size_t from, size_t to) {
+    adviseData(from, to, MADV_WILLNEED);
+}
+
+template <typename T>
+void DBReader<T>::releaseData(size_t from, size_t to) {
+    // private writable mappings would lose their changes
+    // preloaded or locked data is expected to stay in memory
+    if ((dataMode & USE_WRITABLE) == 0 && didPreload == false && didMlock == false) {
+        adviseData(from, to, MADV_DONTNEED);
+    }
+}
+
+template <typename T>
+void DBReader<T>::adviseData(size_t from, size_t to, int advice) {
+    if ((dataMode & USE_DATA) == 0 || (dataMode & USE_FREAD) != 0 || dataMapped == false) {
+        return;
+    }
+    to = std::min(to, size);
+    if (from >= to) {
+        return;
+    }
+    size_t start = SIZE_MAX;
+    size_t end = 0;
+    for (size_t id = from; id < to; id++) {
+        size_t offset = static_cast<size_t>(getData(id) - data);
+        start = std::min(start, offset);
+        end = std::max(end, offset + getSeqLens(id));
+    }
+    end = std::min(end, dataSize);
+    // madvise needs a page aligned start
+    const size_t pageSize = Util::getPageSize();
+    if (advice == MADV_DONTNEED) {
+        // only release pages that lie completely in the range, the first and last page
+        // can be shared with entries that other threads still read
+        start = ((start + pageSize - 1) / pageSize) * pageSize;
+        if (end < dataSize) {
+            end = (end / pageSize) * pageSize;
+        }
+    } else {
+        start = (start / pageSize) * pageSize;
+    }
+    if (start < end) {
+        madvise(data + start, end - start, advice);
+    }
+}
+
 template <typename T> char* DBReader<T>::getDataByDBKey(T dbKey) {
     size_t id = getId(dbKey);
     return (id != UINT_MAX) ? data + index[id].offset : NULL;
@@ -520,6 +569,7 @@ template <typename T> void DBReader<T>::unmapData() {
             munlock(data, dataSize);
             didMlock = false;
         }
+        didPreload = false;
 
         if ((dataMode & USE_FREAD) == 0) {
             if(munmap(data, dataSize) < 0){
@@ -44,6 +44,13 @@ public:
 
     void touchData(size_t id);
 
+    // asynchronously reads ahead the data of the entries [from, to)
+    void prefetchData(size_t from, size_t to);
+
+    // releases the mapped pages that only hold entries of [from, to), they are read again if accessed later
+    // does nothing if the data was preloaded with readMmapedDataInMemory or locked with mlock
+    void releaseData(size_t from, size_t to);
+
     char* getDataByDBKey(T key);
 
     size_t getSize();
@@ -195,6 +202,8 @@ private:
 
     void checkClosed();
 
+    void adviseData(size_t from, size_t to, int advice);
+
     char* data;
 
     int dataMode;
@@ -228,6 +237,8 @@ private:
 
     bool didMlock;
 
+    bool didPreload;
+
     // needed to prevent the compiler from optimizing away the loop
     char magicBytes;
 
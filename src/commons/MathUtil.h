@@ -124,9 +124,13 @@ public:
 
     // Compute the sum of bits of one or two integers
     static inline int popCount(int i) {
+#ifdef __GNUC__
+        return __builtin_popcount(static_cast<unsigned int>(i));
+#else
         i = i - ((i >> 1) & 0x55555555);
         i = (i & 0x33333333) + ((i >> 2) & 0x33333333);
         return (((i + (i >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
     }
 
     static inline float getCoverage(size_t start, size_t end, size_t length) {
@@ -61,16 +61,19 @@ Parameters::Parameters():
         PARAM_MIN_SEQ_ID(PARAM_MIN_SEQ_ID_ID,"--min-seq-id", "Seq. Id Threshold","list matches above this sequence identity (for clustering) [0.0,1.0]",typeid(float), (void *) &seqIdThr, "^0(\\.[0-9]+)?|1(\\.0+)?$", MMseqsParameter::COMMAND_ALIGN),
 	    PARAM_SCORE_BIAS(PARAM_SCORE_BIAS_ID,"--score-bias", "Score bias", "Score bias when computing the SW alignment (in bits)",typeid(float), (void *) &scoreBias, "^-?[0-9]*(\\.[0-9]+)?$", MMseqsParameter::COMMAND_ALIGN|MMseqsParameter::COMMAND_EXPERT),
         PARAM_ALT_ALIGNMENT(PARAM_ALT_ALIGNMENT_ID,"--alt-ali", "Alternative alignments","Show up to this many alternative alignments",typeid(int), (void *) &altAlignment, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_ALIGN),
+        PARAM_BAND_WIDTH(PARAM_BAND_WIDTH_ID,"--band-width", "Band width","Align protein hits in a band of this many diagonals around the prefilter diagonal, the band is widened if the alignment reaches its border (0: align full matrix)",typeid(int), (void *) &bandWidth, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_ALIGN|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_WRITE_EDGES(PARAM_WRITE_EDGES_ID,"--write-edges", "Write edges","Also write the accepted target keys of every query as binary database <resultDB>_edges, it is read by clust --cluster-mode 3 instead of the text result",typeid(bool), (void *) &writeEdges, "", MMseqsParameter::COMMAND_ALIGN|MMseqsParameter::COMMAND_EXPERT),
 
         // clustering
-        PARAM_CLUSTER_MODE(PARAM_CLUSTER_MODE_ID,"--cluster-mode", "Cluster mode", "0: Setcover, 1: connected component, 2: Greedy clustering by sequence length  3: Greedy clustering by sequence length (low mem)",typeid(int), (void *) &clusteringMode, "[0-3]{1}$", MMseqsParameter::COMMAND_CLUST),
+        PARAM_CLUSTER_MODE(PARAM_CLUSTER_MODE_ID,"--cluster-mode", "Cluster mode", "0: Setcover, 1: connected component, 2: Greedy clustering by sequence length  3: Greedy clustering by sequence length (low mem) 4: connected component (low mem, no depth limit)",typeid(int), (void *) &clusteringMode, "[0-4]{1}$", MMseqsParameter::COMMAND_CLUST),
         PARAM_CLUSTER_STEPS(PARAM_CLUSTER_STEPS_ID,"--cluster-steps", "Cascaded clustering steps", "cascaded clustering steps from 1 to -s",typeid(int), (void *) &clusterSteps, "^[1-9]{1}$", MMseqsParameter::COMMAND_CLUST|MMseqsParameter::COMMAND_EXPERT),
         PARAM_CASCADED(PARAM_CASCADED_ID,"--single-step-clustering", "Single step clustering", "switches from cascaded to simple clustering workflow",typeid(bool), (void *) &cascaded, "", MMseqsParameter::COMMAND_CLUST),
         // affinity clustering
         PARAM_MAXITERATIONS(PARAM_MAXITERATIONS_ID,"--max-iterations", "Max depth connected component", "maximum depth of breadth first search in connected component",typeid(int), (void *) &maxIteration,  "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUST|MMseqsParameter::COMMAND_EXPERT),
         PARAM_SIMILARITYSCORE(PARAM_SIMILARITYSCORE_ID,"--similarity-type", "Similarity type", "type of score used for clustering [1:2]. 1=alignment score. 2=sequence identity ",typeid(int),(void *) &similarityScoreType,  "^[1-2]{1}$", MMseqsParameter::COMMAND_CLUST|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_PARALLEL_SET_COVER(PARAM_PARALLEL_SET_COVER_ID,"--parallel-set-cover", "Parallel set cover", "run set cover (cluster mode 0) in parallel rounds. Ties between equally large sets are broken by sequence length, so representatives can differ from the sequential set cover",typeid(bool),(void *) &parallelSetCover, "", MMseqsParameter::COMMAND_CLUST|MMseqsParameter::COMMAND_EXPERT),
         // logging
-        PARAM_V(PARAM_V_ID,"-v", "Verbosity","verbosity level: 0=nothing, 1: +errors, 2: +warnings, 3: +info",typeid(int), (void *) &verbosity, "^[0-3]{1}$", MMseqsParameter::COMMAND_COMMON),
+        PARAM_V(PARAM_V_ID,"-v", "Verbosity","verbosity level: 0=nothing, 1: +errors, 2: +warnings, 3: +info, 4: +per-thread timings",typeid(int), (void *) &verbosity, "^[0-4]{1}$", MMseqsParameter::COMMAND_COMMON),
         // create profile (HMM)
         PARAM_PROFILE_TYPE(PARAM_PROFILE_TYPE_ID,"--profile-type", "Profile type", "0: HMM (HHsuite) 1: PSSM or 2: HMMER3",typeid(int),(void *) &profileMode,  "^[0-2]{1}$"),
         // convertalignments
@@ -121,6 +124,10 @@ Parameters::Parameters():
         PARAM_INCLUDE_ONLY_EXTENDABLE(PARAM_INCLUDE_ONLY_EXTENDABLE_ID, "--include-only-extendable", "Include only extendable", "Include only extendable", typeid(bool), (void*) &includeOnlyExtendable, "", MMseqsParameter::COMMAND_CLUSTLINEAR),
         PARAM_SKIP_N_REPEAT_KMER(PARAM_SKIP_N_REPEAT_KMER_ID, "--skip-n-repeat-kmer", "Skip sequence with n repeating k-mers", "Skip sequence with >= n exact repeating k-mers", typeid(int), (void*) &skipNRepeatKmer, "^[0-9]{1}[0-9]*", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
         PARAM_HASH_SHIFT(PARAM_HASH_SHIFT_ID, "--hash-shift", "Shift hash", "Shift k-mer hash", typeid(int), (void*) &hashShift, "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_KMER_SELECT_MODE(PARAM_KMER_SELECT_MODE_ID, "--kmer-select-mode", "K-mer selection mode", "0: k-mers with the lowest hash of each sequence, 1: window minimizers, 2: open syncmers (at most --kmer-per-seq k-mers with the lowest hash are kept)", typeid(int), (void*) &kmerSelectMode, "^[0-2]{1}$", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_KMER_WINDOW(PARAM_KMER_WINDOW_ID, "--kmer-window", "K-mer window", "Expected distance between selected k-mers of --kmer-select-mode 1 and 2, at most the k-mer length (minimizer window size, syncmers use sub-k-mers of length k - window + 1)", typeid(int), (void*) &kmerWindow, "^[1-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_KMER_RESULT_MODE(PARAM_KMER_RESULT_MODE_ID, "--kmer-result-mode", "K-mer result mode", "0: text result with the first diagonal of each pair, 1: text result with the diagonal sharing the most k-mers, 2: binary edge list with the diagonal sharing the most k-mers (kmermatcher and rescorediagonal only)", typeid(int), (void*) &kmerResultMode, "^[0-2]{1}$", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
+        PARAM_KMER_MAX_MEMBERS(PARAM_KMER_MAX_MEMBERS_ID, "--kmer-max-members", "Max members per rep.", "Keep only the members sharing the most k-mers with their rep. sequence (0: keep all members)", typeid(int), (void*) &kmerMaxMembers, "^[0-9]{1}[0-9]*$", MMseqsParameter::COMMAND_CLUSTLINEAR|MMseqsParameter::COMMAND_EXPERT),
         // workflow
         PARAM_RUNNER(PARAM_RUNNER_ID, "--mpi-runner", "Sets the MPI runner","use MPI on compute grid with this MPI command (e.g. \"mpirun -np 42\")",typeid(std::string),(void *) &runner, "", MMseqsParameter::COMMAND_EXPERT),
         // search workflow
@@ -222,6 +229,9 @@ Parameters::Parameters():
     align.push_back(PARAM_MAX_SEQS);
     align.push_back(PARAM_NO_COMP_BIAS_CORR);
     align.push_back(PARAM_REALIGN);
+    align.push_back(PARAM_BAND_WIDTH);
+    align.push_back(PARAM_WRITE_EDGES);
+    align.push_back(PARAM_DIAGONAL_SCORING);
     align.push_back(PARAM_MAX_REJECTED);
     align.push_back(PARAM_MAX_ACCEPT);
     align.push_back(PARAM_INCLUDE_IDENTITY);
@@ -272,6 +282,8 @@ Parameters::Parameters():
     clust.push_back(PARAM_CLUSTER_MODE);
     clust.push_back(PARAM_MAXITERATIONS);
     clust.push_back(PARAM_SIMILARITYSCORE);
+    clust.push_back(PARAM_PARALLEL_SET_COVER);
+    clust.push_back(PARAM_SPLIT_MEMORY_LIMIT);
     clust.push_back(PARAM_THREADS);
     clust.push_back(PARAM_V);
 
@@ -290,6 +302,8 @@ Parameters::Parameters():
     rescorediagonal.push_back(PARAM_INCLUDE_IDENTITY);
     rescorediagonal.push_back(PARAM_SORT_RESULTS);
     rescorediagonal.push_back(PARAM_GLOBAL_ALIGNMENT);
+    rescorediagonal.push_back(PARAM_KMER_RESULT_MODE);
+    rescorediagonal.push_back(PARAM_WRITE_EDGES);
     rescorediagonal.push_back(PARAM_NO_PRELOAD);
     rescorediagonal.push_back(PARAM_THREADS);
     rescorediagonal.push_back(PARAM_V);
@@ -505,6 +519,13 @@ Parameters::Parameters():
     gff2ffindex.push_back(PARAM_ID_OFFSET);
     gff2ffindex.push_back(PARAM_V);
 
+    // maskdb
+    maskdb.push_back(PARAM_SUB_MAT);
+    maskdb.push_back(PARAM_ALPH_SIZE);
+    maskdb.push_back(PARAM_MAX_SEQ_LEN);
+    maskdb.push_back(PARAM_THREADS);
+    maskdb.push_back(PARAM_V);
+
 
     // translate nucleotide
     translatenucs.push_back(PARAM_TRANSLATION_TABLE);
@@ -597,12 +618,38 @@ Parameters::Parameters():
     kmermatcher.push_back(PARAM_C);
     kmermatcher.push_back(PARAM_MAX_SEQ_LEN);
     kmermatcher.push_back(PARAM_HASH_SHIFT);
+    kmermatcher.push_back(PARAM_KMER_SELECT_MODE);
+    kmermatcher.push_back(PARAM_KMER_WINDOW);
+    kmermatcher.push_back(PARAM_KMER_RESULT_MODE);
+    kmermatcher.push_back(PARAM_KMER_MAX_MEMBERS);
     kmermatcher.push_back(PARAM_SPLIT_MEMORY_LIMIT);
     kmermatcher.push_back(PARAM_INCLUDE_ONLY_EXTENDABLE);
     kmermatcher.push_back(PARAM_SKIP_N_REPEAT_KMER);
     kmermatcher.push_back(PARAM_THREADS);
     kmermatcher.push_back(PARAM_V);
 
+    // kmerprecluster
+    kmerprecluster.push_back(PARAM_SUB_MAT);
+    kmerprecluster.push_back(PARAM_ALPH_SIZE);
+    kmerprecluster.push_back(PARAM_MIN_SEQ_ID);
+    kmerprecluster.push_back(PARAM_SEQ_ID_MODE);
+    kmerprecluster.push_back(PARAM_KMER_PER_SEQ);
+    kmerprecluster.push_back(PARAM_MASK_RESIDUES);
+    kmerprecluster.push_back(PARAM_COV_MODE);
+    kmerprecluster.push_back(PARAM_K);
+    kmerprecluster.push_back(PARAM_C);
+    kmerprecluster.push_back(PARAM_MAX_SEQ_LEN);
+    kmerprecluster.push_back(PARAM_HASH_SHIFT);
+    kmerprecluster.push_back(PARAM_KMER_SELECT_MODE);
+    kmerprecluster.push_back(PARAM_KMER_WINDOW);
+    kmerprecluster.push_back(PARAM_SPLIT_MEMORY_LIMIT);
+    kmerprecluster.push_back(PARAM_INCLUDE_ONLY_EXTENDABLE);
+    kmerprecluster.push_back(PARAM_SKIP_N_REPEAT_KMER);
+    kmerprecluster.push_back(PARAM_KMER_RESULT_MODE);
+    kmerprecluster.push_back(PARAM_KMER_MAX_MEMBERS);
+    kmerprecluster.push_back(PARAM_THREADS);
+    kmerprecluster.push_back(PARAM_V);
+
 
     // mergedbs
     mergedbs.push_back(PARAM_MERGE_PREFIXES);
@@ -1214,6 +1261,8 @@ void Parameters::setDefaults() {
     maxAccept   = INT_MAX;
     seqIdThr = 0.0;
     altAlignment = 0;
+    bandWidth = 0;
+    writeEdges = false;
     addBacktrace = false;
     realign = false;
     clusteringMode = SET_COVER;
@@ -1226,6 +1275,7 @@ void Parameters::setDefaults() {
     // affinity clustering
     maxIteration=1000;
     similarityScoreType=APC_SEQID;
+    parallelSetCover=false;
 
     // workflow
     const char *runnerEnv = getenv("RUNNER");
@@ -1376,6 +1426,10 @@ void Parameters::setDefaults() {
     includeOnlyExtendable = false;
     skipNRepeatKmer = 0;
     hashShift = 5;
+    kmerSelectMode = KMER_SELECT_LOWEST_HASH;
+    kmerWindow = 10;
+    kmerResultMode = KMER_RESULT_FIRST_DIAGONAL;
+    kmerMaxMembers = 0;
 
     // result2stats
     stat = "";
@@ -70,6 +70,7 @@ public:
     static const int CONNECTED_COMPONENT = 1;
     static const int GREEDY = 2;
     static const int GREEDY_MEM = 3;
+    static const int CONNECTED_COMPONENT_MEM = 4;
 
     // clustering
     static const int APC_ALIGNMENTSCORE=1;
@@ -127,6 +128,16 @@ public:
     static const int RESCORE_MODE_SUBSTITUTION = 1;
     static const int RESCORE_MODE_ALIGNMENT = 2;
 
+    // kmermatcher k-mer selection
+    static const int KMER_SELECT_LOWEST_HASH = 0;
+    static const int KMER_SELECT_MINIMIZER = 1;
+    static const int KMER_SELECT_SYNCMER = 2;
+
+    // kmermatcher result
+    static const int KMER_RESULT_FIRST_DIAGONAL = 0;
+    static const int KMER_RESULT_BEST_DIAGONAL = 1;
+    static const int KMER_RESULT_EDGE_LIST = 2;
+
     // header type
     static const int HEADER_TYPE_UNICLUST = 1;
     static const int HEADER_TYPE_METACLUST = 2;
@@ -216,6 +227,8 @@ public:
     int    maxRejected;                  // after n sequences that are above eval stop
     int    maxAccept;                    // after n accepted sequences stop
     int    altAlignment;                 // show up to this many alternative alignments
+    int    bandWidth;                    // align protein hits in a band around the prefilter diagonal (0: full matrix)
+    bool   writeEdges;                   // write the accepted target keys as binary database <resultDB>_edges
     float  seqIdThr;                     // sequence identity threshold for acceptance
     bool   addBacktrace;                 // store backtrace string (M=Match, D=deletion, I=insertion)
     bool   realign;                      // realign hit with more conservative score
@@ -240,6 +253,7 @@ public:
     //CLUSTERING
     int maxIteration;                   // Maximum depth of breadth first search in connected component
     int similarityScoreType;            // Type of score to use for reassignment 1=alignment score. 2=coverage 3=sequence identity 4=E-value 5= Score per Column
+    bool parallelSetCover;              // Set cover in parallel rounds, ties broken by sequence length
 
     //extractorfs
     int orfMinLength;
@@ -311,6 +325,10 @@ public:
     bool includeOnlyExtendable;
     int skipNRepeatKmer;
     int hashShift;
+    int kmerSelectMode;
+    int kmerWindow;
+    int kmerResultMode;
+    int kmerMaxMembers;
 
     // indexdb
     bool includeHeader;
@@ -463,6 +481,8 @@ public:
     PARAMETER(PARAM_MIN_SEQ_ID)
     PARAMETER(PARAM_SCORE_BIAS)
     PARAMETER(PARAM_ALT_ALIGNMENT)
+    PARAMETER(PARAM_BAND_WIDTH)
+    PARAMETER(PARAM_WRITE_EDGES)
     std::vector<MMseqsParameter> align;
 
     // clustering
@@ -473,6 +493,7 @@ public:
     // affinity clustering
     PARAMETER(PARAM_MAXITERATIONS)
     PARAMETER(PARAM_SIMILARITYSCORE)
+    PARAMETER(PARAM_PARALLEL_SET_COVER)
 
     // logging
     PARAMETER(PARAM_V)
@@ -537,6 +558,10 @@ public:
     PARAMETER(PARAM_INCLUDE_ONLY_EXTENDABLE)
     PARAMETER(PARAM_SKIP_N_REPEAT_KMER)
     PARAMETER(PARAM_HASH_SHIFT)
+    PARAMETER(PARAM_KMER_SELECT_MODE)
+    PARAMETER(PARAM_KMER_WINDOW)
+    PARAMETER(PARAM_KMER_RESULT_MODE)
+    PARAMETER(PARAM_KMER_MAX_MEMBERS)
 
     // workflow
     PARAMETER(PARAM_RUNNER)
@@ -670,8 +695,10 @@ public:
     std::vector<MMseqsParameter> convert2fasta;
     std::vector<MMseqsParameter> result2flat;
     std::vector<MMseqsParameter> gff2ffindex;
+    std::vector<MMseqsParameter> maskdb;
     std::vector<MMseqsParameter> clusthash;
     std::vector<MMseqsParameter> kmermatcher;
+    std::vector<MMseqsParameter> kmerprecluster;
     std::vector<MMseqsParameter> linclustworkflow;
     std::vector<MMseqsParameter> assemblerworkflow;
     std::vector<MMseqsParameter> easysearchworkflow;
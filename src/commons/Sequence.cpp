@@ -207,7 +207,7 @@ std::pair<const char *, unsigned int> Sequence::getSpacedPattern(bool spaced, un
     }
     char * pattern = new char[pair.second];
     memcpy(pattern, pair.first, pair.second * sizeof(char));
-    return std::make_pair<const char *, unsigned int>(pattern, static_cast<unsigned int>(pair.second));
+    return std::make_pair<const char *, unsigned int>((const char *) pattern, static_cast<unsigned int>(pair.second));
 }
 
 
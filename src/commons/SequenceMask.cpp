@@ -0,0 +1,131 @@
+#include "SequenceMask.h"
+#include "BaseMatrix.h"
+#include "FileUtil.h"
+#include "Util.h"
+#include "Debug.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+const double SequenceMask::repeatOffsetProbDecay[SequenceMask::MASK_TYPES] = { 0.9, 0.5 };
+const double SequenceMask::minMaskProb[SequenceMask::MASK_TYPES] = { 0.9, 0.5 };
+
+int SequenceMask::mask(char *seq, size_t seqLen, MaskType type, ProbabilityMatrix &probMatrix, tantan::Workspace &workspace) {
+    return tantan::maskSequences(seq, seq + seqLen,
+                                 50 /*options.maxCycleLength*/,
+                                 probMatrix.probMatrixFloatPointers,
+                                 0.005 /*options.repeatProb*/,
+                                 0.05 /*options.repeatEndProb*/,
+                                 repeatOffsetProbDecay[type],
+                                 minMaskProb[type],
+                                 probMatrix.hardMaskTable, workspace);
+}
+
+std::string SequenceMask::getSeqDbParams(const std::string &seqDb) {
+    std::ostringstream params;
+    const std::string files[2] = { seqDb, seqDb + ".index" };
+    for (size_t i = 0; i < 2; i++) {
+        struct stat st;
+        if (stat(files[i].c_str(), &st) != 0) {
+            return "";
+        }
+        params << st.st_size << "\t" << st.st_mtime << "\t";
+    }
+    return params.str();
+}
+
+std::string SequenceMask::getTypeParams(MaskType type, BaseMatrix &subMat) {
+    // tantan only uses the probabilities, they do not depend on the bit factor of the scores
+    size_t matrixHash = Util::hash(reinterpret_cast<const unsigned char *>(subMat.pBack), subMat.alphabetSize * sizeof(double));
+    for (int i = 0; i < subMat.alphabetSize; i++) {
+        matrixHash = matrixHash * 31
+                     + Util::hash(reinterpret_cast<const unsigned char *>(subMat.probMatrix[i]), subMat.alphabetSize * sizeof(double));
+    }
+    std::ostringstream params;
+    params << type << "\t" << subMat.matrixName << "\t" << subMat.alphabetSize << "\t" << matrixHash
+           << "\t" << repeatOffsetProbDecay[type] << "\t" << minMaskProb[type];
+    return params.str();
+}
+
+void SequenceMask::writeParams(const std::string &seqDb, BaseMatrix **subMat) {
+    std::string params = getSeqDbParams(seqDb) + "\n";
+    for (int type = 0; type < MASK_TYPES; type++) {
+        params += getTypeParams(static_cast<MaskType>(type), *subMat[type]) + "\n";
+    }
+    FileUtil::writeFile(getParamsFileName(seqDb), reinterpret_cast<const unsigned char *>(params.c_str()), params.size());
+}
+
+DBReader<unsigned int> *SequenceMask::openMaskDb(const std::string &seqDb, MaskType type, BaseMatrix &subMat) {
+    std::string maskDb = getMaskDbName(seqDb);
+    std::string maskDbIndex = maskDb + ".index";
+    std::string paramsFile = getParamsFileName(seqDb);
+    if (FileUtil::fileExists(maskDb.c_str()) == false || FileUtil::fileExists(maskDbIndex.c_str()) == false
+        || FileUtil::fileExists(paramsFile.c_str()) == false) {
+        return NULL;
+    }
+    std::ifstream params(paramsFile.c_str());
+    std::string seqDbParams;
+    std::string typeParams;
+    std::getline(params, seqDbParams);
+    for (int i = 0; i <= type; i++) {
+        std::getline(params, typeParams);
+    }
+    if (params.fail() || seqDbParams != getSeqDbParams(seqDb) || typeParams != getTypeParams(type, subMat)) {
+        Debug(Debug::WARNING) << "Ignoring " << maskDb << ", it was computed for a different database, matrix or masking settings\n";
+        return NULL;
+    }
+    DBReader<unsigned int> *maskDbr = new DBReader<unsigned int>(maskDb.c_str(), maskDbIndex.c_str());
+    maskDbr->open(DBReader<unsigned int>::NOSORT);
+    return maskDbr;
+}
+
+void SequenceMask::closeMaskDb(DBReader<unsigned int> *maskDbr) {
+    if (maskDbr != NULL) {
+        maskDbr->close();
+        delete maskDbr;
+    }
+}
+
+const unsigned char *SequenceMask::getBitmask(DBReader<unsigned int> *maskDbr, unsigned int key, size_t seqLen,
+                                              MaskType type, int alphabetSize) {
+    size_t id = maskDbr->getId(key);
+    if (id == UINT_MAX) {
+        return NULL;
+    }
+    // entry length includes the null byte
+    if (maskDbr->getSeqLens(id) != getEntrySize(seqLen) + 1) {
+        return NULL;
+    }
+    const unsigned char *part = reinterpret_cast<const unsigned char *>(maskDbr->getData(id))
+                                + type * (1 + getBitmaskSize(seqLen));
+    if (part[0] != alphabetSize) {
+        return NULL;
+    }
+    return part + 1;
+}
+
+void SequenceMask::setBitmask(unsigned char *entry, size_t seqLen, MaskType type, int alphabetSize,
+                              const char *maskedSeq, char maskLetter) {
+    unsigned char *part = entry + type * (1 + getBitmaskSize(seqLen));
+    part[0] = static_cast<unsigned char>(alphabetSize);
+    unsigned char *bitmask = part + 1;
+    memset(bitmask, 0, getBitmaskSize(seqLen));
+    for (size_t pos = 0; pos < seqLen; pos++) {
+        if (maskedSeq[pos] == maskLetter) {
+            bitmask[pos / 8] |= static_cast<unsigned char>(1 << (pos % 8));
+        }
+    }
+}
+
+size_t SequenceMask::applyBitmask(int *seq, size_t seqLen, const unsigned char *bitmask, int maskLetter) {
+    size_t masked = 0;
+    for (size_t pos = 0; pos < seqLen; pos++) {
+        if ((bitmask[pos / 8] & (1 << (pos % 8))) && seq[pos] != maskLetter) {
+            seq[pos] = maskLetter;
+            masked++;
+        }
+    }
+    return masked;
+}
@@ -0,0 +1,80 @@
+#ifndef MMSEQS_SEQUENCEMASK_H
+#define MMSEQS_SEQUENCEMASK_H
+
+// Cache of tantan masked residues, written by maskdb to <sequenceDB>_mask.
+// The entries are keyed like the sequence DB. Every entry holds one part per
+// mask type: the alphabet size of the matrix used for masking (1 byte) and a
+// bitmask of ceil(L / 8) bytes, bit (pos % 8) of byte (pos / 8) is set if the
+// residue at pos is masked.
+// maskdb also writes <sequenceDB>_mask.params. Its first line holds the size and
+// modification time of the sequence DB data and index, the following line of every
+// mask type holds the matrix and the tantan settings used for masking.
+// The prefilter index builder and kmermatcher read the cache if it exists and
+// matches their sequence DB, matrix and settings, and mask the sequence themselves otherwise.
+
+#include <string>
+
+#include "DBReader.h"
+#include "tantan.h"
+
+class BaseMatrix;
+class ProbabilityMatrix;
+
+class SequenceMask {
+public:
+    enum MaskType {
+        // masking of the prefilter index table
+        PREFILTER = 0,
+        // masking of the linclust k-mer matcher
+        KMERMATCHER = 1,
+        MASK_TYPES = 2
+    };
+
+    static std::string getMaskDbName(const std::string &seqDb) {
+        return seqDb + "_mask";
+    }
+
+    static std::string getParamsFileName(const std::string &seqDb) {
+        return getMaskDbName(seqDb) + ".params";
+    }
+
+    static size_t getBitmaskSize(size_t seqLen) {
+        return (seqLen + 7) / 8;
+    }
+
+    static size_t getEntrySize(size_t seqLen) {
+        return MASK_TYPES * (1 + getBitmaskSize(seqLen));
+    }
+
+    // masks seq in place with the tantan settings of the mask type
+    static int mask(char *seq, size_t seqLen, MaskType type, ProbabilityMatrix &probMatrix, tantan::Workspace &workspace);
+
+    // writes the params file of the mask DB of seqDb, subMat holds the matrix of every mask type
+    static void writeParams(const std::string &seqDb, BaseMatrix **subMat);
+
+    // opens the mask DB of the sequence DB, returns NULL if there is none or if it was
+    // computed for a different sequence DB, matrix or tantan settings of the mask type
+    static DBReader<unsigned int> *openMaskDb(const std::string &seqDb, MaskType type, BaseMatrix &subMat);
+    static void closeMaskDb(DBReader<unsigned int> *maskDbr);
+
+    // returns NULL if the mask DB has no entry for key or it does not match the sequence length or alphabet size
+    static const unsigned char *getBitmask(DBReader<unsigned int> *maskDbr, unsigned int key, size_t seqLen,
+                                           MaskType type, int alphabetSize);
+
+    // fills the part of the mask type in entry, the residues in maskedSeq equal to maskLetter are masked
+    static void setBitmask(unsigned char *entry, size_t seqLen, MaskType type, int alphabetSize,
+                           const char *maskedSeq, char maskLetter);
+
+    // replaces the masked residues by maskLetter and returns the number of residues that were changed
+    static size_t applyBitmask(int *seq, size_t seqLen, const unsigned char *bitmask, int maskLetter);
+
+private:
+    // tantan settings that differ between the mask types
+    static const double repeatOffsetProbDecay[MASK_TYPES];
+    static const double minMaskProb[MASK_TYPES];
+
+    static std::string getSeqDbParams(const std::string &seqDb);
+    static std::string getTypeParams(MaskType type, BaseMatrix &subMat);
+};
+
+#endif //MMSEQS_SEQUENCEMASK_H
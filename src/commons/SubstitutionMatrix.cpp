@@ -101,8 +101,18 @@ bool SubstitutionMatrix::estimateLambdaAndBackground(const double **scoreMatrix,
 void SubstitutionMatrix::calcLocalAaBiasCorrection(const BaseMatrix *m,
                                                    const int *int_sequence,
                                                    const int N,
-                                                   float *compositionBias) {
+                                                   float *compositionBias,
+                                                   float *backgroundScore) {
     const int windowSize = 40;
+    // positive score for the background score distribution, it only depends on the amino acid
+    // and is computed once per amino acid instead of once per position
+    for (int aa = 0; aa < m->alphabetSize; aa++) {
+        float score = 0.0f;
+        for (int a = 0; a < m->alphabetSize; a++) {
+            score += m->pBack[a] * static_cast<float>(m->subMatrix[aa][a]);
+        }
+        backgroundScore[aa] = score;
+    }
     for (int i = 0; i < N; i++) {
         const int minPos = std::max(0, (i - windowSize / 2));
         const int maxPos = std::min(N, (i + windowSize / 2));
@@ -120,10 +130,7 @@ void SubstitutionMatrix::calcLocalAaBiasCorrection(const BaseMatrix *m,
         float deltaS_i = (float) sumSubScores;
         // negative avg.
         deltaS_i /= -1.0 * static_cast<float>(windowLength);
-        // positive score for the background score distribution for i
-        for (int a = 0; a < m->alphabetSize; a++) {
-            deltaS_i += m->pBack[a] * static_cast<float>(subMat[a]);
-        }
+        deltaS_i += backgroundScore[int_sequence[i]];
         compositionBias[i] = deltaS_i;
 //        std::cout << i << " " << compositionBias[i] << std::endl;
     }
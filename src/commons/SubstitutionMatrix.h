@@ -23,7 +23,11 @@ class SubstitutionMatrix: public BaseMatrix {
     
         virtual double getBackgroundProb(size_t aa_index) { return pBack[aa_index]; }
 
-        static void calcLocalAaBiasCorrection(const BaseMatrix *m ,const int *int_sequence, const int N, float *compositionBias);
+        // backgroundScore is a caller owned buffer of m->alphabetSize floats.
+        // The background score of each amino acid is summed before it is added to the window average,
+        // so the bias can differ in the last bits from adding it term by term (see TestCompositionBias).
+        static void calcLocalAaBiasCorrection(const BaseMatrix *m ,const int *int_sequence, const int N,
+                                              float *compositionBias, float *backgroundScore);
         static void calcProfileProfileLocalAaBiasCorrection(short *profileScores,
                                                 const size_t profileAASize,
                                                 const int N,
@@ -1,6 +1,7 @@
 // Copyright 2010 Martin C. Frith
 
 #include "tantan.h"
+#include "simd.h"
 
 #include <algorithm>  // fill, max
 #include <cassert>
@@ -392,4 +393,213 @@ namespace tantan {
         return masked;
     }
 
+
+    Workspace::Workspace(size_t maxSeqLen, int maxRepeatOffset) :
+            maxSeqLen(0), maxRepeatOffset(0),
+            foregroundProbs(NULL), emissionProbs(NULL), backgroundToForeground(NULL),
+            scaleFactors(NULL), probabilities(NULL) {
+        reserve(maxSeqLen, maxRepeatOffset);
+    }
+
+    Workspace::~Workspace() {
+        release();
+    }
+
+    void Workspace::reserve(size_t seqLen, int repeatOffset) {
+        if (foregroundProbs != NULL && seqLen <= maxSeqLen && repeatOffset <= maxRepeatOffset) {
+            return;
+        }
+        release();
+        maxSeqLen = std::max(seqLen, maxSeqLen);
+        maxRepeatOffset = std::max(repeatOffset, maxRepeatOffset);
+        allocate();
+    }
+
+    void Workspace::allocate() {
+        const size_t offsetCount = ((maxRepeatOffset + VECSIZE_FLOAT - 1) / VECSIZE_FLOAT) * VECSIZE_FLOAT;
+        foregroundProbs = (float *) mem_align(ALIGN_FLOAT, offsetCount * sizeof(float));
+        emissionProbs = (float *) mem_align(ALIGN_FLOAT, offsetCount * sizeof(float));
+        backgroundToForeground = (float *) mem_align(ALIGN_FLOAT, offsetCount * sizeof(float));
+        scaleFactors = new float[maxSeqLen / Tantan::scaleStepSize + 1];
+        probabilities = new float[maxSeqLen + 1];
+    }
+
+    void Workspace::release() {
+        free(foregroundProbs);
+        free(emissionProbs);
+        free(backgroundToForeground);
+        delete[] scaleFactors;
+        delete[] probabilities;
+        foregroundProbs = NULL;
+        emissionProbs = NULL;
+        backgroundToForeground = NULL;
+        scaleFactors = NULL;
+        probabilities = NULL;
+    }
+
+    static inline float horizontalSum(simd_float v) {
+        float __attribute__((aligned(ALIGN_FLOAT))) tmp[VECSIZE_FLOAT];
+        simdf32_store(tmp, v);
+        float sum = 0;
+        for (int i = 0; i < VECSIZE_FLOAT; i++) {
+            sum += tmp[i];
+        }
+        return sum;
+    }
+
+    // likelihood ratios of the letter at seqPtr and the letters 1 to maxRepeatOffset before it
+    static inline void fillEmissionProbs(const char *seqBeg, const char *seqPtr, int maxRepeatOffset,
+                                         const const_float_ptr *likelihoodRatioMatrix, float *emissionProbs) {
+        const float *lrRow = likelihoodRatioMatrix[static_cast<int>(*seqPtr)];
+        const int offsetCount = std::min(static_cast<int>(seqPtr - seqBeg), maxRepeatOffset);
+        for (int i = 0; i < offsetCount; i++) {
+            emissionProbs[i] = lrRow[static_cast<int>(*(seqPtr - 1 - i))];
+        }
+        for (int i = offsetCount; i < maxRepeatOffset; i++) {
+            emissionProbs[i] = 0;
+        }
+    }
+
+    // Same forward-backward algorithm as Tantan::calcRepeatProbs without gaps.
+    // The transitions and emissions of all offsets are computed in one SIMD pass per letter.
+    // The background to foreground transitions of the offsets i are b2fFirst * repeatOffsetProbDecay^i,
+    // so the backward sum over the foreground states becomes a dot product.
+    static void calcRepeatProbsFloat(const char *seqBeg,
+                                     const char *seqEnd,
+                                     int maxRepeatOffset,
+                                     const const_float_ptr *likelihoodRatioMatrix,
+                                     double repeatProb,
+                                     double repeatEndProb,
+                                     double repeatOffsetProbDecay,
+                                     float *letterProbs,
+                                     Workspace &workspace) {
+        assert(maxRepeatOffset > 0);
+        assert(repeatProb >= 0 && repeatProb < 1);
+        assert(repeatEndProb >= 0 && repeatEndProb <= 1);
+        assert(repeatOffsetProbDecay > 0 && repeatOffsetProbDecay <= 1);
+
+        const int seqLen = static_cast<int>(seqEnd - seqBeg);
+        workspace.reserve(seqLen, maxRepeatOffset);
+        const int offsetCount = ((maxRepeatOffset + VECSIZE_FLOAT - 1) / VECSIZE_FLOAT) * VECSIZE_FLOAT;
+        float *foregroundProbs = workspace.foregroundProbs;
+        float *emissionProbs = workspace.emissionProbs;
+        float *b2f = workspace.backgroundToForeground;
+        float *scaleFactors = workspace.scaleFactors;
+
+        const float b2b = 1 - repeatProb;
+        const float f2b = repeatEndProb;
+        const float f2f0 = 1 - repeatEndProb;
+        double b2fCurrent = repeatProb * firstRepeatOffsetProb(repeatOffsetProbDecay, maxRepeatOffset);
+        for (int i = 0; i < maxRepeatOffset; i++) {
+            b2f[i] = static_cast<float>(b2fCurrent);
+            b2fCurrent *= repeatOffsetProbDecay;
+        }
+        // padding lanes never emit, so they stay zero in the forward pass
+        // and do not contribute in the backward pass
+        for (int i = maxRepeatOffset; i < offsetCount; i++) {
+            b2f[i] = 0;
+            emissionProbs[i] = 0;
+        }
+
+        const simd_float f2f0Vec = simdf32_set(f2f0);
+
+        // forward algorithm
+        float backgroundProb = 1.0f;
+        std::fill(foregroundProbs, foregroundProbs + offsetCount, 0.0f);
+        for (int pos = 0; pos < seqLen; pos++) {
+            fillEmissionProbs(seqBeg, seqBeg + pos, maxRepeatOffset, likelihoodRatioMatrix, emissionProbs);
+            const simd_float backgroundVec = simdf32_set(backgroundProb);
+            simd_float fromForeground = simdf32_setzero(0);
+            for (int i = 0; i < offsetCount; i += VECSIZE_FLOAT) {
+                const simd_float f = simdf32_load(foregroundProbs + i);
+                fromForeground = simdf32_add(fromForeground, f);
+                const simd_float transition = simdf32_add(simdf32_mul(backgroundVec, simdf32_load(b2f + i)),
+                                                          simdf32_mul(f, f2f0Vec));
+                simdf32_store(foregroundProbs + i, simdf32_mul(transition, simdf32_load(emissionProbs + i)));
+            }
+            backgroundProb = backgroundProb * b2b + horizontalSum(fromForeground) * f2b;
+
+            if (pos % Tantan::scaleStepSize == Tantan::scaleStepSize - 1) {
+                assert(backgroundProb > 0);
+                const float scale = 1 / backgroundProb;
+                scaleFactors[pos / Tantan::scaleStepSize] = scale;
+                backgroundProb *= scale;
+                const simd_float scaleVec = simdf32_set(scale);
+                for (int i = 0; i < offsetCount; i += VECSIZE_FLOAT) {
+                    simdf32_store(foregroundProbs + i, simdf32_mul(simdf32_load(foregroundProbs + i), scaleVec));
+                }
+            }
+            letterProbs[pos] = backgroundProb;
+        }
+
+        simd_float foregroundSum = simdf32_setzero(0);
+        for (int i = 0; i < offsetCount; i += VECSIZE_FLOAT) {
+            foregroundSum = simdf32_add(foregroundSum, simdf32_load(foregroundProbs + i));
+        }
+        const double z = backgroundProb * b2b + horizontalSum(foregroundSum) * f2b;
+        assert(z > 0);
+
+        // backward algorithm
+        backgroundProb = b2b;
+        std::fill(foregroundProbs, foregroundProbs + maxRepeatOffset, f2b);
+        std::fill(foregroundProbs + maxRepeatOffset, foregroundProbs + offsetCount, 0.0f);
+        for (int pos = seqLen - 1; pos >= 0; pos--) {
+            const double nonRepeatProb = letterProbs[pos] * static_cast<double>(backgroundProb) / z;
+            letterProbs[pos] = 1 - static_cast<float>(nonRepeatProb);
+
+            if (pos % Tantan::scaleStepSize == Tantan::scaleStepSize - 1) {
+                const float scale = scaleFactors[pos / Tantan::scaleStepSize];
+                backgroundProb *= scale;
+                const simd_float scaleVec = simdf32_set(scale);
+                for (int i = 0; i < offsetCount; i += VECSIZE_FLOAT) {
+                    simdf32_store(foregroundProbs + i, simdf32_mul(simdf32_load(foregroundProbs + i), scaleVec));
+                }
+            }
+
+            fillEmissionProbs(seqBeg, seqBeg + pos, maxRepeatOffset, likelihoodRatioMatrix, emissionProbs);
+            const simd_float toBackground = simdf32_set(f2b * backgroundProb);
+            simd_float toForeground = simdf32_setzero(0);
+            for (int i = 0; i < offsetCount; i += VECSIZE_FLOAT) {
+                const simd_float f = simdf32_mul(simdf32_load(foregroundProbs + i), simdf32_load(emissionProbs + i));
+                toForeground = simdf32_add(toForeground, simdf32_mul(f, simdf32_load(b2f + i)));
+                simdf32_store(foregroundProbs + i, simdf32_add(toBackground, simdf32_mul(f, f2f0Vec)));
+            }
+            backgroundProb = b2b * backgroundProb + horizontalSum(toForeground);
+        }
+    }
+
+    int maskSequences(char *seqBeg,
+                      char *seqEnd,
+                      int maxRepeatOffset,
+                      const const_float_ptr *likelihoodRatioMatrix,
+                      double repeatProb,
+                      double repeatEndProb,
+                      double repeatOffsetProbDecay,
+                      double minMaskProb,
+                      const char *maskTable,
+                      Workspace &workspace) {
+        workspace.reserve(seqEnd - seqBeg, maxRepeatOffset);
+        float *probabilities = workspace.probabilities;
+
+        getProbabilities(seqBeg, seqEnd, maxRepeatOffset,
+                         likelihoodRatioMatrix, repeatProb, repeatEndProb,
+                         repeatOffsetProbDecay, probabilities, workspace);
+
+        return maskProbableLetters(seqBeg, seqEnd, probabilities, minMaskProb, maskTable);
+    }
+
+    void getProbabilities(const char *seqBeg,
+                          const char *seqEnd,
+                          int maxRepeatOffset,
+                          const const_float_ptr *likelihoodRatioMatrix,
+                          double repeatProb,
+                          double repeatEndProb,
+                          double repeatOffsetProbDecay,
+                          float *probabilities,
+                          Workspace &workspace) {
+        calcRepeatProbsFloat(seqBeg, seqEnd, maxRepeatOffset, likelihoodRatioMatrix,
+                             repeatProb, repeatEndProb, repeatOffsetProbDecay,
+                             probabilities, workspace);
+    }
+
 }
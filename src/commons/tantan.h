@@ -62,9 +62,12 @@
 #ifndef TANTAN_HH
 #define TANTAN_HH
 
+#include <cstddef>
+
 namespace tantan {
 
 typedef const double *const_double_ptr;
+typedef const float *const_float_ptr;
 
 int maskSequences(char *seqBeg,
                    char *seqEnd,
@@ -102,6 +105,60 @@ int maskProbableLetters(char *seqBeg,
                          double minMaskProb,
                          const char *maskTable);
 
+// Preallocated buffers for the single precision routines below.
+// Create one workspace per thread and reuse it for all sequences,
+// it grows if a sequence is longer than maxSeqLen.
+
+class Workspace {
+public:
+    Workspace(size_t maxSeqLen, int maxRepeatOffset);
+    ~Workspace();
+
+    void reserve(size_t seqLen, int maxRepeatOffset);
+
+    // capacity of the buffers
+    size_t maxSeqLen;
+    int maxRepeatOffset;
+
+    float *foregroundProbs;
+    float *emissionProbs;
+    float *backgroundToForeground;
+    float *scaleFactors;
+    float *probabilities;
+
+private:
+    void allocate();
+    void release();
+};
+
+// Single precision SIMD variants of maskSequences and getProbabilities
+// for the model without insertions and deletions (firstGapProb = 0).
+// The likelihoodRatioMatrix has the same layout as above, but float
+// entries.  The probabilities agree with the double precision routines
+// up to rounding errors, so only letters with a probability very close
+// to minMaskProb can be masked differently.
+
+int maskSequences(char *seqBeg,
+                  char *seqEnd,
+                  int maxRepeatOffset,
+                  const const_float_ptr *likelihoodRatioMatrix,
+                  double repeatProb,
+                  double repeatEndProb,
+                  double repeatOffsetProbDecay,
+                  double minMaskProb,
+                  const char *maskTable,
+                  Workspace &workspace);
+
+void getProbabilities(const char *seqBeg,
+                      const char *seqEnd,
+                      int maxRepeatOffset,
+                      const const_float_ptr *likelihoodRatioMatrix,
+                      double repeatProb,
+                      double repeatEndProb,
+                      double repeatOffsetProbDecay,
+                      float *probabilities,
+                      Workspace &workspace);
+
 }
 
 #endif
@@ -1,3 +1,4 @@
+#include "kmermatcher.h"
 #include "Indexer.h"
 #include "ReducedMatrix.h"
 #include "DBWriter.h"
@@ -15,7 +16,9 @@
 #include "FileUtil.h"
 #include "Timer.h"
 #include "tantan.h"
+#include "SequenceMask.h"
 
+#include <climits>
 #include <limits>
 #include <string>
 #include <vector>
@@ -30,73 +33,14 @@
 #ifndef SIZE_T_MAX
 #define SIZE_T_MAX ((size_t) -1)
 #endif
-struct KmerPosition {
-    size_t kmer;
-    unsigned int id;
-    unsigned short seqLen;
-    short pos;
-    KmerPosition(){}
-    KmerPosition(size_t kmer, unsigned int id, unsigned short seqLen, short pos):
-            kmer(kmer), id(id), seqLen(seqLen), pos(pos) {}
-    static bool compareRepSequenceAndIdAndPos(const KmerPosition &first, const KmerPosition &second){
-        if(first.kmer < second.kmer )
-            return true;
-        if(second.kmer < first.kmer )
-            return false;
-        if(first.seqLen > second.seqLen )
-            return true;
-        if(second.seqLen > first.seqLen )
-            return false;
-        if(first.id < second.id )
-            return true;
-        if(second.id < first.id )
-            return false;
-        if(first.pos < second.pos )
-            return true;
-        if(second.pos < first.pos )
-            return false;
-        return false;
-    }
-
-    static bool compareRepSequenceAndIdAndDiag(const KmerPosition &first, const KmerPosition &second){
-        if(first.kmer < second.kmer)
-            return true;
-        if(second.kmer < first.kmer)
-            return false;
-        if(first.id < second.id)
-            return true;
-        if(second.id < first.id)
-            return false;
-
-        //        const short firstDiag  = (first.pos < 0)  ? -first.pos : first.pos;
-        //        const short secondDiag = (second.pos  < 0) ? -second.pos : second.pos;
-        if(first.pos < second.pos)
-            return true;
-        if(second.pos < first.pos)
-            return false;
-        return false;
-    }
-};
-
+// entry of the split files, each rep. sequence starts with an entry holding its id
+// and ends with an UINT_MAX entry, count is the number of k-mers on the diagonal
 struct __attribute__((__packed__)) KmerEntry {
     unsigned int seqId;
     short diagonal;
+    unsigned short count;
 };
 
-void mergeKmerFilesAndOutput(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
-                             std::vector<std::string> tmpFiles, std::vector<char> &repSequence,
-                             int covMode, float covThr) ;
-
-void setKmerLengthAndAlphabet(Parameters &parameters, size_t aaDbSize, int seqType);
-
-void writeKmersToDisk(std::string tmpFile, KmerPosition *kmers, size_t totalKmers);
-
-void writeKmerMatcherResult(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
-                            KmerPosition *hashSeqPair, size_t totalKmers,
-                            std::vector<char> &repSequence, int covMode, float covThr,
-                            size_t threads);
-
-
 #define RoL(val, numbits) (val << numbits) ^ (val >> (32 - numbits))
 unsigned circ_hash(const int * x, unsigned length, const unsigned rol){
     short unsigned RAND[21] = {0x4567, 0x23c6, 0x9869, 0x4873, 0xdc51, 0x5cff, 0x944a, 0x58ec, 0x1f29, 0x7ccd, 0x58ba, 0xd7ab, 0x41f2, 0x1efb, 0xa9e3, 0xe146, 0x007c, 0x62c2, 0x0854, 0x27f8, 0x231b};
@@ -120,76 +64,193 @@ unsigned circ_hash_next(const int * x, unsigned length, int x_first, short unsig
 #undef RoL
 
 
+struct SequencePosition{
+    short score;
+    size_t kmer;
+    unsigned int pos;
+    static bool compareByScore(const SequencePosition &first, const SequencePosition &second){
+        if(first.score < second.score)
+            return true;
+        if(second.score < first.score)
+            return false;
+        if(first.kmer < second.kmer)
+            return true;
+        if(second.kmer < first.kmer)
+            return false;
+        // same order as the stable sort by score and k-mer
+        if(first.pos < second.pos)
+            return true;
+        return false;
+    }
+
+    // k-mers containing X (kmer == SIZE_T_MAX) are larger than all others
+    static bool compareByScoreWithoutX(const SequencePosition &first, const SequencePosition &second){
+        const bool firstHasX = (first.kmer == SIZE_T_MAX);
+        const bool secondHasX = (second.kmer == SIZE_T_MAX);
+        if(firstHasX != secondHasX)
+            return secondHasX;
+        return compareByScore(first, second);
+    }
+};
+
+// Keeps the k-mer with the lowest hash of each window of consecutive k-mers (minimizers).
+// kmers has to contain all k-mers of the sequence ordered by position.
+// Returns the number of minimizers, which are moved to the front of kmers.
+static size_t selectMinimizers(SequencePosition *kmers, size_t kmerCount, size_t window, unsigned int *deque) {
+    size_t head = 0;
+    size_t tail = 0;
+    size_t selected = 0;
+    size_t lastMinimizer = SIZE_T_MAX;
+    for (size_t i = 0; i < kmerCount; i++) {
+        // the deque holds the candidates of the current window with increasing hashes
+        while (tail > head && SequencePosition::compareByScoreWithoutX(kmers[i], kmers[deque[tail - 1]])) {
+            tail--;
+        }
+        deque[tail++] = i;
+        if (deque[head] + window <= i) {
+            head++;
+        }
+        // a sequence shorter than the window has a single window
+        if (i + 1 < window && i + 1 < kmerCount) {
+            continue;
+        }
+        const size_t minimizer = deque[head];
+        if (minimizer != lastMinimizer && kmers[minimizer].kmer != SIZE_T_MAX) {
+            // minimizer positions do not decrease, so the array can be compacted in place
+            kmers[selected++] = kmers[minimizer];
+        }
+        lastMinimizer = minimizer;
+    }
+    return selected;
+}
+
+// Keeps the open syncmers: k-mers whose first sub-k-mer (s-mer) has the lowest hash of all their s-mers.
+// The s-mer length is k - window + 1 so every window-th k-mer is expected to be selected.
+// kmers has to contain all k-mers of the sequence ordered by position.
+// Returns the number of syncmers, which are moved to the front of kmers.
+static size_t selectOpenSyncmers(SequencePosition *kmers, size_t kmerCount, const int *seq, size_t seqLen,
+                                 size_t kmerSize, size_t window, unsigned int rol,
+                                 unsigned short *smerHash, unsigned int *deque) {
+    if (kmerCount == 0) {
+        return 0;
+    }
+    const size_t smerSize = kmerSize - window + 1;
+    const size_t smerCount = seqLen - smerSize + 1;
+    smerHash[0] = circ_hash(seq, smerSize, rol);
+    for (size_t pos = 1; pos < smerCount; pos++) {
+        smerHash[pos] = circ_hash_next(seq + pos, smerSize, seq[pos - 1], smerHash[pos - 1], rol);
+    }
+    size_t head = 0;
+    size_t tail = 0;
+    size_t selected = 0;
+    for (size_t smerPos = 0; smerPos < smerCount; smerPos++) {
+        // ties keep the leftmost s-mer
+        while (tail > head && smerHash[deque[tail - 1]] > smerHash[smerPos]) {
+            tail--;
+        }
+        deque[tail++] = smerPos;
+        if (smerPos + 1 < window) {
+            continue;
+        }
+        // k-mer that covers the s-mers kmerPos to smerPos
+        const size_t kmerPos = smerPos + 1 - window;
+        while (deque[head] < kmerPos) {
+            head++;
+        }
+        if (deque[head] == kmerPos && kmers[kmerPos].kmer != SIZE_T_MAX) {
+            kmers[selected++] = kmers[kmerPos];
+        }
+    }
+    return selected;
+}
+
 size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int> &seqDbr,
                              Parameters & par, BaseMatrix * subMat,
                              size_t KMER_SIZE, size_t chooseTopKmer,
-                             size_t splits, size_t split){
+                             size_t splits, size_t split, KmerSplitWriter *splitWriter){
     size_t offset = 0;
     int querySeqType  =  seqDbr.getDbtype();
     ProbabilityMatrix *probMatrix = NULL;
+    // masked residues precomputed by maskdb
+    DBReader<unsigned int> *maskDbr = NULL;
     if (par.maskMode == 1) {
         probMatrix = new ProbabilityMatrix(*subMat);
+        maskDbr = SequenceMask::openMaskDb(seqDbr.getDataFileName(), SequenceMask::KMERMATCHER, *subMat);
     }
 
-    struct SequencePosition{
-        short score;
-        size_t kmer;
-        unsigned int pos;
-        static bool compareByScore(const SequencePosition &first, const SequencePosition &second){
-            if(first.score < second.score)
-                return true;
-            if(second.score < first.score)
-                return false;
-            if(first.kmer < second.kmer)
-                return true;
-            if(second.kmer < first.kmer)
-                return false;
-
-            return false;
-        }
-    };
+    // Threads pull chunks of consecutive sequences. Each thread reads ahead the chunk it
+    // will likely pull next and releases the pages of the chunks it consumed, so the mapped
+    // memory stays bounded without synchronizing the threads.
+    const size_t chunkSize = 1024;
+    const size_t chunkCount = (seqDbr.getSize() + chunkSize - 1) / chunkSize;
+    size_t nextChunk = 0;
 #pragma omp parallel
     {
         Sequence seq(par.maxSeqLen, querySeqType, subMat, KMER_SIZE, false, false);
         Indexer idxer(subMat->alphabetSize, KMER_SIZE);
         char * charSequence = new char[par.maxSeqLen];
+        tantan::Workspace * tantanWorkspace = NULL;
+        if (par.maskMode == 1) {
+            tantanWorkspace = new tantan::Workspace(par.maxSeqLen, 50);
+        }
         const unsigned int BUFFER_SIZE = 1024;
         size_t bufferPos = 0;
         KmerPosition * threadKmerBuffer = new KmerPosition[BUFFER_SIZE];
         SequencePosition * kmers = new SequencePosition[par.maxSeqLen+1];
+        // minimizers and syncmers are selected from all k-mers of a sequence
+        const bool keepAllKmers = (par.kmerSelectMode != Parameters::KMER_SELECT_LOWEST_HASH);
+        const size_t window = std::min(static_cast<size_t>(std::max(par.kmerWindow, 1)), KMER_SIZE);
+        unsigned int * windowDeque = NULL;
+        unsigned short * smerHash = NULL;
+        if (keepAllKmers) {
+            windowDeque = new unsigned int[par.maxSeqLen+1];
+            smerHash = new unsigned short[par.maxSeqLen+1];
+        }
         int highestSeq[32];
         for(size_t i = 0; i<KMER_SIZE;i++){
             highestSeq[i]=subMat->alphabetSize-1;
         }
         size_t highestPossibleIndex = idxer.int2index(highestSeq);
-        const size_t flushSize = 100000000;
-        size_t iterations = static_cast<size_t>(ceil(static_cast<double>(seqDbr.getSize()) / static_cast<double>(flushSize)));
-        for (size_t i = 0; i < iterations; i++) {
-            size_t start = (i * flushSize);
-            size_t bucketSize = std::min(seqDbr.getSize() - (i * flushSize), flushSize);
-
-#pragma omp for schedule(dynamic, 100)
-            for (size_t id = start; id < (start + bucketSize); id++) {
+        const int xIndex = subMat->aa2int[(int) 'X'];
+        size_t threadCount = 1;
+        size_t thread_idx = 0;
+#ifdef OPENMP
+        threadCount = static_cast<size_t>(omp_get_num_threads());
+        thread_idx = static_cast<size_t>(omp_get_thread_num());
+#endif
+        while (true) {
+            const size_t chunk = __sync_fetch_and_add(&nextChunk, 1);
+            if (chunk >= chunkCount) {
+                break;
+            }
+            const size_t start = chunk * chunkSize;
+            const size_t end = std::min(start + chunkSize, seqDbr.getSize());
+            // the other threads pull the chunks in between
+            const size_t prefetchStart = (chunk + threadCount) * chunkSize;
+            seqDbr.prefetchData(prefetchStart, prefetchStart + chunkSize);
+
+            for (size_t id = start; id < end; id++) {
                 Debug::printProgress(id);
                 seq.mapSequence(id, id, seqDbr.getData(id));
                 size_t seqHash = highestPossibleIndex + static_cast<unsigned int>(Util::hash(seq.int_sequence, seq.L));
 
                 // mask using tantan
                 if (par.maskMode == 1) {
-                    for (int i = 0; i < seq.L; i++) {
-                        charSequence[i] = (char) seq.int_sequence[i];
+                    const unsigned char *bitmask = NULL;
+                    if (maskDbr != NULL) {
+                        bitmask = SequenceMask::getBitmask(maskDbr, seqDbr.getDbKey(id), seq.L,
+                                                             SequenceMask::KMERMATCHER, subMat->alphabetSize);
                     }
-                    tantan::maskSequences(charSequence,
-                                          charSequence + seq.L,
-                                          50 /*options.maxCycleLength*/,
-                                          probMatrix->probMatrixPointers,
-                                          0.005 /*options.repeatProb*/,
-                                          0.05 /*options.repeatEndProb*/,
-                                          0.5 /*options.repeatOffsetProbDecay*/,
-                                          0, 0,
-                                          0.5 /*options.minMaskProb*/, probMatrix->hardMaskTable);
-                    for (int i = 0; i < seq.L; i++) {
-                        seq.int_sequence[i] = charSequence[i];
+                    if (bitmask != NULL) {
+                        SequenceMask::applyBitmask(seq.int_sequence, seq.L, bitmask, xIndex);
+                    } else {
+                        for (int i = 0; i < seq.L; i++) {
+                            charSequence[i] = (char) seq.int_sequence[i];
+                        }
+                        SequenceMask::mask(charSequence, seq.L, SequenceMask::KMERMATCHER, *probMatrix, *tantanWorkspace);
+                        for (int i = 0; i < seq.L; i++) {
+                            seq.int_sequence[i] = charSequence[i];
+                        }
                     }
                 }
 
@@ -197,33 +258,56 @@ size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int>
                 unsigned int seqId = seq.getId();
                 unsigned short prevHash = 0;
                 unsigned int prevFirstRes = 0;
+                // the k-mers are consecutive, so the hash, the X count and the k-mer index
+                // are updated by the residue that leaves and the residue that enters the window
+                int xCount = 0;
+                size_t kmerIdx = 0;
                 if (seq.hasNextKmer()) {
                     const int *kmer = seq.nextKmer();
                     prevHash = circ_hash(kmer, KMER_SIZE, par.hashShift);
                     prevFirstRes = kmer[0];
+                    for (size_t kpos = 0; kpos < KMER_SIZE; kpos++) {
+                        xCount += (kmer[kpos] == xIndex);
+                    }
+                    kmerIdx = idxer.int2index(kmer, 0, KMER_SIZE);
+                    if (keepAllKmers) {
+                        (kmers + seqKmerCount)->score = prevHash;
+                        (kmers + seqKmerCount)->kmer = (xCount > 0) ? SIZE_T_MAX : kmerIdx;
+                        (kmers + seqKmerCount)->pos = seq.getCurrentPosition();
+                        seqKmerCount++;
+                    }
                 }
                 while (seq.hasNextKmer()) {
                     const int *kmer = seq.nextKmer();
                     //float kmerScore = 1.0;
                     prevHash = circ_hash_next(kmer, KMER_SIZE, prevFirstRes, prevHash, par.hashShift);
+                    xCount += (kmer[KMER_SIZE - 1] == xIndex) - (static_cast<int>(prevFirstRes) == xIndex);
+                    kmerIdx = idxer.getNextKmerIndex(kmer, KMER_SIZE);
                     prevFirstRes = kmer[0];
-                    size_t xCount = 0;
-                    for (size_t kpos = 0; kpos < KMER_SIZE; kpos++) {
-                        xCount += (kmer[kpos] == subMat->aa2int[(int) 'X']);
-                    }
-                    if (xCount > 0) {
+                    if (xCount > 0 && keepAllKmers == false) {
                         continue;
                     }
                     (kmers + seqKmerCount)->score = prevHash;
-                    size_t kmerIdx = idxer.int2index(kmer, 0, KMER_SIZE);
-                    (kmers + seqKmerCount)->kmer = kmerIdx;
+                    (kmers + seqKmerCount)->kmer = (xCount > 0) ? SIZE_T_MAX : kmerIdx;
                     (kmers + seqKmerCount)->pos = seq.getCurrentPosition();
                     seqKmerCount++;
                 }
-                if (seqKmerCount > 1) {
-                    std::stable_sort(kmers, kmers + seqKmerCount, SequencePosition::compareByScore);
+                if (par.kmerSelectMode == Parameters::KMER_SELECT_MINIMIZER) {
+                    seqKmerCount = selectMinimizers(kmers, seqKmerCount, window, windowDeque);
+                } else if (par.kmerSelectMode == Parameters::KMER_SELECT_SYNCMER) {
+                    seqKmerCount = selectOpenSyncmers(kmers, seqKmerCount, seq.int_sequence, seq.L,
+                                                      KMER_SIZE, window, par.hashShift, smerHash, windowDeque);
                 }
                 size_t kmerConsidered = std::min(static_cast<int>(chooseTopKmer - 1), seqKmerCount);
+                if (par.skipNRepeatKmer == 0) {
+                    // only the set of the lowest hashes is needed, a selection is enough
+                    if (kmerConsidered > 0 && static_cast<int>(kmerConsidered) < seqKmerCount) {
+                        std::nth_element(kmers, kmers + kmerConsidered, kmers + seqKmerCount, SequencePosition::compareByScore);
+                    }
+                } else if (seqKmerCount > 1) {
+                    // the repeat check needs all k-mers in order
+                    std::stable_sort(kmers, kmers + seqKmerCount, SequencePosition::compareByScore);
+                }
                 if(par.skipNRepeatKmer > 0 ){
                     size_t prevKmer = SIZE_T_MAX;
                     kmers[seqKmerCount].kmer=SIZE_T_MAX;
@@ -240,7 +324,9 @@ size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int>
                 }
 
                 // add k-mer to represent the identity
-                if (seqHash%splits == split) {
+                if (splitWriter != NULL) {
+                    splitWriter->add(thread_idx, seqHash % splits, KmerPosition(seqHash, seqId, seq.L, 0));
+                } else if (seqHash%splits == split) {
                     threadKmerBuffer[bufferPos].kmer = seqHash;
                     threadKmerBuffer[bufferPos].id = seqId;
                     threadKmerBuffer[bufferPos].pos = 0;
@@ -254,6 +340,11 @@ size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int>
                 }
                 for (size_t topKmer = 0; topKmer < kmerConsidered; topKmer++) {
                     size_t splitIdx = (kmers + topKmer)->kmer % splits;
+                    if (splitWriter != NULL) {
+                        splitWriter->add(thread_idx, splitIdx,
+                                         KmerPosition((kmers + topKmer)->kmer, seqId, seq.L, (kmers + topKmer)->pos));
+                        continue;
+                    }
                     if (splitIdx != split) {
                         continue;
                     }
@@ -270,29 +361,35 @@ size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int>
                     }
                 }
             }
-#pragma omp barrier
-            unsigned int thread_idx = 0;
-#ifdef OPENMP
-            thread_idx = static_cast<unsigned int>(omp_get_thread_num());
-#endif
-            if (thread_idx == 0) {
-                seqDbr.remapData();
-            }
-#pragma omp barrier
+            seqDbr.releaseData(start, end);
         }
 
         if(bufferPos > 0){
             size_t writeOffset = __sync_fetch_and_add(&offset, bufferPos);
             memcpy(hashSeqPair+writeOffset, threadKmerBuffer, sizeof(KmerPosition) * bufferPos);
         }
+        if (splitWriter != NULL) {
+            splitWriter->flush(thread_idx);
+        }
         delete [] kmers;
+        if (windowDeque != NULL) {
+            delete [] windowDeque;
+            delete [] smerHash;
+        }
         delete [] charSequence;
+        if (tantanWorkspace != NULL) {
+            delete tantanWorkspace;
+        }
         delete [] threadKmerBuffer;
     }
 
     if (probMatrix != NULL) {
         delete probMatrix;
     }
+    SequenceMask::closeMaskDb(maskDbr);
+    if (splitWriter != NULL) {
+        return splitWriter->getTotalCount();
+    }
     return offset;
 }
 
@@ -318,8 +415,13 @@ KmerPosition * doComputation(size_t totalKmers, size_t split, size_t splits, std
         seqDbr.unmapData();
     }
     Debug(Debug::INFO) << "Done." << "\n";
+    return assignRepSequence(hashSeqPair, elementsToSort, splits, splitFile, par);
+}
+
+KmerPosition * assignRepSequence(KmerPosition * hashSeqPair, size_t elementsToSort, size_t splits,
+                                 std::string splitFile, Parameters & par) {
+    Timer timer;
     Debug(Debug::INFO) << "Sort kmer ... ";
-    timer.reset();
     omptl::sort(hashSeqPair, hashSeqPair + elementsToSort, KmerPosition::compareRepSequenceAndIdAndPos);
     //kx::radix_sort(hashSeqPair, hashSeqPair + elementsToSort, KmerComparision());
     Debug(Debug::INFO) << "Done." << "\n";
@@ -334,7 +436,7 @@ KmerPosition * doComputation(size_t totalKmers, size_t split, size_t splits, std
         size_t prevSetSize = 0;
         size_t queryLen;
         unsigned int repSeq_i_pos = hashSeqPair[0].pos;
-        for (size_t elementIdx = 0; elementIdx < splitKmerCount+1; elementIdx++) {
+        for (size_t elementIdx = 0; elementIdx < elementsToSort + 1; elementIdx++) {
             if (prevHash != hashSeqPair[elementIdx].kmer) {
                 for (size_t i = prevHashStart; i < elementIdx; i++) {
                     size_t rId =  (hashSeqPair[i].kmer != SIZE_T_MAX) ? ((prevSetSize == 1) ? SIZE_T_MAX
@@ -383,6 +485,124 @@ KmerPosition * doComputation(size_t totalKmers, size_t split, size_t splits, std
     return hashSeqPair;
 }
 
+KmerSplitWriter::KmerSplitWriter(const std::string &prefix, size_t splits, size_t threads)
+        : prefix(prefix), splits(splits) {
+    for (size_t split = 0; split < splits; split++) {
+        std::string fileName = getFileName(split);
+        FILE *file = fopen(fileName.c_str(), "wb");
+        if (file == NULL) {
+            perror(fileName.c_str());
+            EXIT(EXIT_FAILURE);
+        }
+        files.push_back(file);
+        counts.push_back(0);
+    }
+    for (size_t i = 0; i < threads * splits; i++) {
+        KmerPosition *buffer = new(std::nothrow) KmerPosition[BUFFER_SIZE];
+        Util::checkAllocation(buffer, "Could not allocate memory for the split buffers");
+        buffers.push_back(buffer);
+        bufferPos.push_back(0);
+    }
+}
+
+KmerSplitWriter::~KmerSplitWriter() {
+    close();
+    for (size_t i = 0; i < buffers.size(); i++) {
+        delete[] buffers[i];
+    }
+}
+
+void KmerSplitWriter::flushBuffer(size_t bufferIdx) {
+    const size_t split = bufferIdx % splits;
+    // a single fwrite call is thread safe, the k-mers of a buffer stay together
+    if (fwrite(buffers[bufferIdx], sizeof(KmerPosition), bufferPos[bufferIdx], files[split]) != bufferPos[bufferIdx]) {
+        Debug(Debug::ERROR) << "Could not write to " << getFileName(split) << "\n";
+        EXIT(EXIT_FAILURE);
+    }
+    __sync_fetch_and_add(&counts[split], bufferPos[bufferIdx]);
+    bufferPos[bufferIdx] = 0;
+}
+
+void KmerSplitWriter::flush(size_t thread) {
+    for (size_t split = 0; split < splits; split++) {
+        if (bufferPos[thread * splits + split] > 0) {
+            flushBuffer(thread * splits + split);
+        }
+    }
+}
+
+void KmerSplitWriter::close() {
+    for (size_t split = 0; split < files.size(); split++) {
+        if (files[split] != NULL) {
+            fclose(files[split]);
+            files[split] = NULL;
+        }
+    }
+}
+
+std::string KmerSplitWriter::getFileName(size_t split) const {
+    return prefix + "_bucket_" + SSTR(split);
+}
+
+size_t KmerSplitWriter::getTotalCount() const {
+    size_t total = 0;
+    for (size_t split = 0; split < counts.size(); split++) {
+        total += counts[split];
+    }
+    return total;
+}
+
+std::vector<std::string> computeSplitsSinglePass(size_t splits, const std::string &prefix,
+                                                 DBReader<unsigned int> & seqDbr, Parameters & par, BaseMatrix * subMat,
+                                                 size_t KMER_SIZE, size_t chooseTopKmer, size_t memoryLimit) {
+    Debug(Debug::INFO) << "Generate k-mers list of all " << splits << " splits\n";
+    Timer timer;
+    size_t threads = 1;
+#ifdef OPENMP
+    threads = static_cast<size_t>(omp_get_max_threads());
+#endif
+    KmerSplitWriter splitWriter(prefix, splits, threads);
+    size_t totalKmers = fillKmerPositionArray(NULL, seqDbr, par, subMat, KMER_SIZE, chooseTopKmer, splits, 0, &splitWriter);
+    splitWriter.close();
+    Debug(Debug::INFO) << "\nTime for fill: " << timer.lap() << "\n";
+    Debug(Debug::INFO) << "Scattered " << totalKmers << " k-mers\n";
+
+    size_t maxSplitSize = 0;
+    for (size_t split = 0; split < splits; split++) {
+        maxSplitSize = std::max(maxSplitSize, (splitWriter.getCount(split) + 1) * sizeof(KmerPosition));
+    }
+    // splits that are processed at the same time sort with one thread each
+    size_t parallelSplits = std::max(static_cast<size_t>(1), memoryLimit / std::max(maxSplitSize, static_cast<size_t>(1)));
+    parallelSplits = std::min(parallelSplits, std::min(splits, static_cast<size_t>(par.threads)));
+    Debug(Debug::INFO) << "Sort " << parallelSplits << " splits in parallel\n";
+
+    std::vector<std::string> splitFiles;
+    for (size_t split = 0; split < splits; split++) {
+        splitFiles.push_back(prefix + "_split_" + SSTR(split));
+    }
+#pragma omp parallel for schedule(dynamic, 1) num_threads(parallelSplits) if(parallelSplits > 1)
+    for (size_t split = 0; split < splits; split++) {
+        const size_t count = splitWriter.getCount(split);
+        KmerPosition *hashSeqPair = new(std::nothrow) KmerPosition[count + 1];
+        Util::checkAllocation(hashSeqPair, "Could not allocate memory");
+        std::string bucketFile = splitWriter.getFileName(split);
+        FILE *file = fopen(bucketFile.c_str(), "rb");
+        if (file == NULL) {
+            perror(bucketFile.c_str());
+            EXIT(EXIT_FAILURE);
+        }
+        if (fread(hashSeqPair, sizeof(KmerPosition), count, file) != count) {
+            Debug(Debug::ERROR) << "Could not read " << bucketFile << "\n";
+            EXIT(EXIT_FAILURE);
+        }
+        fclose(file);
+        FileUtil::deleteFile(bucketFile);
+        hashSeqPair[count].kmer = SIZE_T_MAX;
+        assignRepSequence(hashSeqPair, count, splits, splitFiles[split], par);
+    }
+    return splitFiles;
+}
+
 void setLinearFilterDefault(Parameters *p) {
     p->spacedKmer = false;
     p->covThr = 0.8;
@@ -491,48 +711,33 @@ int kmermatcher(int argc, const char **argv, const Command &command) {
         }
     }
 #else
-    for(size_t split = 0; split < splits; split++) {
-        std::string splitFileName = par.db2 + "_split_" +SSTR(split);
-        hashSeqPair = doComputation(totalKmers, split, splits, splitFileName, seqDbr, par, subMat, KMER_SIZE, chooseTopKmer);
-        splitFiles.push_back(splitFileName);
+    if (splits > 1) {
+        splitFiles = computeSplitsSinglePass(splits, par.db2, seqDbr, par, subMat, KMER_SIZE, chooseTopKmer, memoryLimit);
+    } else {
+        hashSeqPair = doComputation(totalKmers, 0, splits, par.db2 + "_split_0", seqDbr, par, subMat, KMER_SIZE, chooseTopKmer);
     }
 #endif
     if(mpiRank == 0){
         std::vector<char> repSequence(seqDbr.getSize());
         std::fill(repSequence.begin(), repSequence.end(), false);
         // write result
-        DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), par.threads);
+        const size_t writerMode = (par.kmerResultMode == Parameters::KMER_RESULT_EDGE_LIST) ? DBWriter::BINARY_MODE : DBWriter::ASCII_MODE;
+        DBWriter dbw(par.db2.c_str(), par.db2Index.c_str(), par.threads, writerMode);
         dbw.open();
 
         Timer timer;
         if(splits > 1) {
             std::cout << "How many splits: " << splits<<std::endl;
             seqDbr.unmapData();
-            mergeKmerFilesAndOutput(seqDbr, dbw, splitFiles, repSequence, par.covMode, par.cov);
+            mergeKmerFilesAndOutput(seqDbr, dbw, splitFiles, repSequence, par.covMode, par.cov,
+                                    par.kmerResultMode, par.kmerMaxMembers);
         } else {
-            writeKmerMatcherResult(seqDbr, dbw, hashSeqPair, totalKmers, repSequence, par.covMode, par.cov, par.threads);
+            writeKmerMatcherResult(seqDbr, dbw, hashSeqPair, totalKmers, repSequence, par.covMode, par.cov, par.threads,
+                                   par.kmerResultMode, par.kmerMaxMembers);
         }
         Debug(Debug::INFO) << "Time for fill: " << timer.lap() << "\n";
         // add missing entries to the result (needed for clustering)
-
-        {
-#pragma omp parallel for
-            for (size_t id = 0; id < seqDbr.getSize(); id++) {
-                char buffer[100];
-                int thread_idx = 0;
-#ifdef OPENMP
-                thread_idx = omp_get_thread_num();
-#endif
-                if (repSequence[id] == false) {
-                    hit_t h;
-                    h.pScore = 0;
-                    h.diagonal = 0;
-                    h.seqId = seqDbr.getDbKey(id);
-                    int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-                    dbw.writeData(buffer, len, seqDbr.getDbKey(id), thread_idx);
-                }
-            }
-        }
+        writeMissingEntries(seqDbr, dbw, repSequence, par.kmerResultMode);
         dbw.close();
 
     }
@@ -546,10 +751,188 @@ int kmermatcher(int argc, const char **argv, const Command &command) {
     return EXIT_SUCCESS;
 }
 
+void writeMissingEntries(DBReader<unsigned int> &seqDbr, DBWriter &dbw, std::vector<char> &repSequence, int resultMode) {
+#pragma omp parallel for
+    for (size_t id = 0; id < seqDbr.getSize(); id++) {
+        char buffer[100];
+        int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = omp_get_thread_num();
+#endif
+        if (repSequence[id] == false) {
+            if (resultMode == Parameters::KMER_RESULT_EDGE_LIST) {
+                KmerEdge edge(seqDbr.getDbKey(id), 0, 0);
+                dbw.writeData((const char *) &edge, sizeof(KmerEdge), seqDbr.getDbKey(id), thread_idx);
+                continue;
+            }
+            hit_t h;
+            h.pScore = 0;
+            h.diagonal = 0;
+            h.seqId = seqDbr.getDbKey(id);
+            int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
+            dbw.writeData(buffer, len, seqDbr.getDbKey(id), thread_idx);
+        }
+    }
+}
+
+// Collects the k-mer matches of one rep. sequence and writes its result entry.
+// Matches have to be added sorted by member and diagonal, the k-mer count of repeated
+// (member, diagonal) pairs is summed up. Only one diagonal is kept per member: the first one
+// or the one with the most k-mers. With maxMembers > 0 only the members sharing the most
+// k-mers with the rep. sequence are kept (streaming top-k).
+class RepResultWriter {
+public:
+    RepResultWriter(DBReader<unsigned int> &seqDbr, DBWriter &dbw, std::vector<char> &repSequence,
+                    int resultMode, size_t maxMembers, int covMode, float covThr, unsigned int thread)
+            : seqDbr(seqDbr), dbw(dbw), repSequence(repSequence), resultMode(resultMode), maxMembers(maxMembers),
+              covMode(covMode), covThr(covThr), thread(thread), repSeqId(SIZE_T_MAX), repLen(0),
+              currentDiagonal(0), currentDiagonalCount(0) {
+        current.id = UINT_MAX;
+        resultBuffer.reserve(1024 * 1024);
+    }
+
+    void startRep(size_t repSeqId, unsigned int repLen) {
+        this->repSeqId = repSeqId;
+        this->repLen = repLen;
+        members.clear();
+        current.id = UINT_MAX;
+    }
+
+    void addMatch(unsigned int targetId, unsigned int targetLen, short diagonal, unsigned int kmerCount) {
+        if (targetId == current.id && diagonal == currentDiagonal) {
+            currentDiagonalCount += kmerCount;
+            return;
+        }
+        finishDiagonal();
+        if (targetId != current.id) {
+            finishMember();
+            current.id = targetId;
+            current.length = targetLen;
+            current.diagonal = diagonal;
+            current.bestCount = 0;
+            current.kmerCount = 0;
+        }
+        currentDiagonal = diagonal;
+        currentDiagonalCount = kmerCount;
+    }
+
+    void finishRep() {
+        finishDiagonal();
+        finishMember();
+        if (repSeqId == SIZE_T_MAX) {
+            return;
+        }
+        const size_t repSeqId = this->repSeqId;
+        this->repSeqId = SIZE_T_MAX;
+        if (members.empty()) {
+            repSequence[repSeqId] = false;
+            return;
+        }
+        repSequence[repSeqId] = true;
+        if (maxMembers > 0) {
+            // the heap order is not needed anymore, keep the member order of the unlimited result
+            std::sort(members.begin(), members.end(), Member::compareById);
+        }
+        const unsigned int repKey = seqDbr.getDbKey(repSeqId);
+        resultBuffer.clear();
+        appendHit(repKey, 0, 0);
+        for (size_t i = 0; i < members.size(); i++) {
+            appendHit(seqDbr.getDbKey(members[i].id), members[i].diagonal, members[i].kmerCount);
+        }
+        dbw.writeData(resultBuffer.c_str(), resultBuffer.length(), repKey, thread);
+    }
+
+private:
+    struct Member {
+        unsigned int id;
+        unsigned int length;
+        short diagonal;
+        unsigned int bestCount;
+        unsigned int kmerCount;
+
+        static bool compareById(const Member &first, const Member &second) {
+            return first.id < second.id;
+        }
+
+        // heap order, the worst kept member is on top
+        static bool compareByKmerCount(const Member &first, const Member &second) {
+            if (first.kmerCount != second.kmerCount) {
+                return first.kmerCount > second.kmerCount;
+            }
+            return first.id < second.id;
+        }
+    };
+
+    DBReader<unsigned int> &seqDbr;
+    DBWriter &dbw;
+    std::vector<char> &repSequence;
+    const int resultMode;
+    const size_t maxMembers;
+    const int covMode;
+    const float covThr;
+    const unsigned int thread;
+
+    size_t repSeqId;
+    unsigned int repLen;
+    Member current;
+    short currentDiagonal;
+    unsigned int currentDiagonalCount;
+    std::vector<Member> members;
+    std::string resultBuffer;
+
+    void finishDiagonal() {
+        if (current.id == UINT_MAX) {
+            return;
+        }
+        current.kmerCount += currentDiagonalCount;
+        // ties keep the first diagonal
+        if (resultMode != Parameters::KMER_RESULT_FIRST_DIAGONAL && currentDiagonalCount > current.bestCount) {
+            current.diagonal = currentDiagonal;
+            current.bestCount = currentDiagonalCount;
+        }
+        currentDiagonalCount = 0;
+    }
+
+    void finishMember() {
+        if (current.id == UINT_MAX) {
+            return;
+        }
+        const bool isAccepted = current.id != repSeqId
+                                && Util::canBeCovered(covThr, covMode, static_cast<float>(repLen),
+                                                      static_cast<float>(current.length));
+        if (isAccepted && (maxMembers == 0 || members.size() < maxMembers)) {
+            members.push_back(current);
+            if (maxMembers > 0) {
+                std::push_heap(members.begin(), members.end(), Member::compareByKmerCount);
+            }
+        } else if (isAccepted && Member::compareByKmerCount(current, members.front())) {
+            std::pop_heap(members.begin(), members.end(), Member::compareByKmerCount);
+            members.back() = current;
+            std::push_heap(members.begin(), members.end(), Member::compareByKmerCount);
+        }
+        current.id = UINT_MAX;
+    }
+
+    void appendHit(unsigned int key, short diagonal, unsigned int kmerCount) {
+        if (resultMode == Parameters::KMER_RESULT_EDGE_LIST) {
+            KmerEdge edge(key, diagonal, static_cast<unsigned short>(std::min(kmerCount, static_cast<unsigned int>(USHRT_MAX))));
+            resultBuffer.append((const char *) &edge, sizeof(KmerEdge));
+            return;
+        }
+        char buffer[100];
+        hit_t h;
+        h.seqId = key;
+        h.pScore = 0;
+        h.diagonal = diagonal;
+        int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
+        resultBuffer.append(buffer, len);
+    }
+};
+
 void writeKmerMatcherResult(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
                             KmerPosition *hashSeqPair, size_t totalKmers,
                             std::vector<char> &repSequence, int covMode, float covThr,
-                            size_t threads) {
+                            size_t threads, int resultMode, size_t maxMembers) {
     std::vector<size_t> threadOffsets;
     size_t splitSize = totalKmers/threads;
     threadOffsets.push_back(0);
@@ -565,68 +948,17 @@ void writeKmerMatcherResult(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
     threadOffsets.push_back(totalKmers);
 #pragma omp parallel for schedule(dynamic, 1)
     for(size_t thread = 0; thread < threads; thread++){
-        std::string prefResultsOutString;
-        prefResultsOutString.reserve(100000000);
-        char buffer[100];
-        size_t lastTargetId = SIZE_T_MAX;
-        unsigned int writeSets = 0;
-        unsigned int queryLength = 0;
-        size_t kmerPos=0;
+        RepResultWriter resultWriter(seqDbr, dbw, repSequence, resultMode, maxMembers, covMode, covThr, thread);
         size_t repSeqId = SIZE_T_MAX;
-        for(kmerPos = threadOffsets[thread]; kmerPos < threadOffsets[thread+1] && hashSeqPair[kmerPos].kmer != SIZE_T_MAX; kmerPos++){
+        for(size_t kmerPos = threadOffsets[thread]; kmerPos < threadOffsets[thread+1] && hashSeqPair[kmerPos].kmer != SIZE_T_MAX; kmerPos++){
             if(repSeqId != hashSeqPair[kmerPos].kmer) {
-                if (writeSets > 0) {
-                    repSequence[repSeqId] = true;
-                    dbw.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), seqDbr.getDbKey(repSeqId), thread);
-                }else{
-                    if(repSeqId != SIZE_T_MAX) {
-                        repSequence[repSeqId] = false;
-                    }
-                }
-                lastTargetId = SIZE_T_MAX;
-                prefResultsOutString.clear();
+                resultWriter.finishRep();
                 repSeqId = hashSeqPair[kmerPos].kmer;
-                queryLength = hashSeqPair[kmerPos].seqLen;
-                hit_t h;
-                h.seqId = seqDbr.getDbKey(repSeqId);
-                h.pScore = 0;
-                h.diagonal = 0;
-                int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-                // TODO: error handling for len
-                prefResultsOutString.append(buffer, len);
-            }
-            unsigned int targetId = hashSeqPair[kmerPos].id;
-            unsigned int targetLength = hashSeqPair[kmerPos].seqLen;
-            unsigned short diagonal = hashSeqPair[kmerPos].pos;
-            // remove similar double sequence hit
-            if(targetId != repSeqId && lastTargetId != targetId ){
-                if(Util::canBeCovered(covThr, covMode,
-                                      static_cast<float>(queryLength),
-                                      static_cast<float>(targetLength)) == false){
-                    lastTargetId = targetId;
-                    continue;
-                }
-            }else{
-                lastTargetId = targetId;
-                continue;
-            }
-            hit_t h;
-            h.seqId = seqDbr.getDbKey(targetId);
-            h.pScore = 0;
-            h.diagonal = diagonal;
-            int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-            prefResultsOutString.append(buffer, len);
-            lastTargetId = targetId;
-            writeSets++;
-        }
-        if (writeSets > 0) {
-            repSequence[repSeqId] = true;
-            dbw.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), seqDbr.getDbKey(repSeqId), thread);
-        }else{
-            if(repSeqId != SIZE_T_MAX) {
-                repSequence[repSeqId] = false;
+                resultWriter.startRep(repSeqId, hashSeqPair[kmerPos].seqLen);
             }
+            resultWriter.addMatch(hashSeqPair[kmerPos].id, hashSeqPair[kmerPos].seqLen, hashSeqPair[kmerPos].pos, 1);
         }
+        resultWriter.finishRep();
     }
 }
 
@@ -634,10 +966,11 @@ struct FileKmerPosition {
     size_t repSeq;
     unsigned int id;
     short pos;
+    unsigned short count;
     unsigned int file;
     FileKmerPosition(){}
-    FileKmerPosition(size_t repSeq, unsigned int id,short pos, unsigned int file):
-            repSeq(repSeq), id(id), pos(pos), file(file) {}
+    FileKmerPosition(size_t repSeq, unsigned int id, short pos, unsigned short count, unsigned int file):
+            repSeq(repSeq), id(id), pos(pos), count(count), file(file) {}
 };
 
 class CompareResultBySeqId {
@@ -667,19 +1000,20 @@ size_t queueNextEntry(KmerPositionQueue &queue, int file, size_t offsetPos, Kmer
         return offsetPos;
     }
     unsigned int repSeqId = entries[offsetPos].seqId;
-    size_t pos = 0;
+    size_t pos = 1;
     while(entries[offsetPos + pos].seqId != UINT_MAX){
-        queue.push(FileKmerPosition(repSeqId, entries[offsetPos+pos].seqId,  entries[offsetPos+pos].diagonal, file));
+        queue.push(FileKmerPosition(repSeqId, entries[offsetPos+pos].seqId, entries[offsetPos+pos].diagonal,
+                                    entries[offsetPos+pos].count, file));
         pos++;
     }
-    queue.push(FileKmerPosition(repSeqId, UINT_MAX, 0, file));
+    queue.push(FileKmerPosition(repSeqId, UINT_MAX, 0, 0, file));
     pos++;
     return offsetPos+pos;
 }
 
 void mergeKmerFilesAndOutput(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
                              std::vector<std::string> tmpFiles, std::vector<char> &repSequence,
-                             int covMode, float covThr) {
+                             int covMode, float covThr, int resultMode, size_t maxMembers) {
     Debug(Debug::INFO) << "Merge splits ... ";
 
     const int fileCnt = tmpFiles.size();
@@ -701,65 +1035,26 @@ void mergeKmerFilesAndOutput(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
     for(int file = 0; file < fileCnt; file++ ){
         offsetPos[file]=queueNextEntry(queue, file, 0, entries[file], entrySizes[file]);
     }
-    std::string prefResultsOutString;
-    prefResultsOutString.reserve(100000000);
-    char buffer[100];
-    FileKmerPosition filePrevsKmerPos;
-    filePrevsKmerPos.id = UINT_MAX;
-    FileKmerPosition res;
-    size_t queryLength;
-    if(queue.empty() == false){
-        res = queue.top();
-        hit_t h;
-        h.seqId = seqDbr.getDbKey(res.repSeq);
-        h.pScore = 0;
-        h.diagonal = 0;
-        int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-        prefResultsOutString.append(buffer, len);
-        queryLength = seqDbr.getSeqLens(res.repSeq);
-    }
+    RepResultWriter resultWriter(seqDbr, dbw, repSequence, resultMode, maxMembers, covMode, covThr, 0);
+    size_t repSeqId = SIZE_T_MAX;
     while(queue.empty() == false) {
-        res = queue.top();
+        FileKmerPosition res = queue.top();
         queue.pop();
-        if(res.id==UINT_MAX){
+        if(res.id == UINT_MAX){
             offsetPos[res.file] = queueNextEntry(queue, res.file, offsetPos[res.file],
                                                  entries[res.file], entrySizes[res.file]);
-            dbw.writeData(prefResultsOutString.c_str(), prefResultsOutString.length(), seqDbr.getDbKey(res.repSeq), 0);
-            repSequence[res.repSeq]=true;
-            prefResultsOutString.clear();
-            // skipe UINT MAX entries
-            while(queue.empty() == false && queue.top().id==UINT_MAX){
-                res = queue.top();
-                queue.pop();
-                offsetPos[res.file] = queueNextEntry(queue, res.file, offsetPos[res.file],
-                                                     entries[res.file], entrySizes[res.file]);
-            }
-            if(queue.empty() == false){
-                res = queue.top();
-                hit_t h;
-                h.seqId = seqDbr.getDbKey(res.repSeq);
-                h.pScore = 0;
-                h.diagonal = 0;
-                int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-                prefResultsOutString.append(buffer, len);
-                queryLength = seqDbr.getSeqLens(res.repSeq);
+            // all files end the rep. sequence after its last member, write it at the first end
+            if(res.repSeq == repSeqId){
+                resultWriter.finishRep();
+                repSeqId = SIZE_T_MAX;
             }
+            continue;
         }
-        // if its not a duplicate
-        if(filePrevsKmerPos.id != res.id && res.repSeq != res.id && res.id!=UINT_MAX){
-            unsigned int targetLength = seqDbr.getSeqLens(res.id);
-            if(Util::canBeCovered(covThr, covMode,
-                                  static_cast<float>(queryLength),
-                                  static_cast<float>(targetLength)) == true){
-                hit_t h;
-                h.seqId = seqDbr.getDbKey(res.id);
-                h.pScore = 0;
-                h.diagonal = res.pos;
-                int len = QueryMatcher::prefilterHitToBuffer(buffer, h);
-                prefResultsOutString.append(buffer, len);
-            }
+        if(res.repSeq != repSeqId){
+            repSeqId = res.repSeq;
+            resultWriter.startRep(repSeqId, seqDbr.getSeqLens(repSeqId));
         }
-        filePrevsKmerPos = res;
+        resultWriter.addMatch(res.id, seqDbr.getSeqLens(res.id), res.pos, res.count);
     }
     for(size_t file = 0; file < tmpFiles.size(); file++) {
         fclose(files[file]);
@@ -781,10 +1076,8 @@ void mergeKmerFilesAndOutput(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
 
 void writeKmersToDisk(std::string tmpFile, KmerPosition *hashSeqPair, size_t totalKmers) {
     size_t repSeqId = SIZE_T_MAX;
-    size_t lastTargetId = SIZE_T_MAX;
     FILE* filePtr = fopen(tmpFile.c_str(), "wb");
     if(filePtr == NULL) { perror(tmpFile.c_str()); EXIT(EXIT_FAILURE); }
-    unsigned int writeSets = 0;
     const size_t BUFFER_SIZE = 2048;
     size_t bufferPos = 0;
     size_t elemenetCnt = 0;
@@ -792,44 +1085,48 @@ void writeKmersToDisk(std::string tmpFile, KmerPosition *hashSeqPair, size_t tot
     KmerEntry nullEntry;
     nullEntry.seqId=UINT_MAX;
     nullEntry.diagonal=0;
+    nullEntry.count=0;
     for(size_t kmerPos = 0; kmerPos < totalKmers && hashSeqPair[kmerPos].kmer != SIZE_T_MAX; kmerPos++){
         if(repSeqId != hashSeqPair[kmerPos].kmer) {
-            if (writeSets > 0 && elemenetCnt > 0) {
+            if (elemenetCnt > 0) {
                 if(bufferPos > 0){
                     fwrite(writeBuffer, sizeof(KmerEntry), bufferPos, filePtr);
                 }
                 fwrite(&nullEntry, sizeof(KmerEntry), 1, filePtr);
             }
-            lastTargetId = SIZE_T_MAX;
             bufferPos=0;
             elemenetCnt=0;
             repSeqId = hashSeqPair[kmerPos].kmer;
             writeBuffer[bufferPos].seqId = repSeqId;
             writeBuffer[bufferPos].diagonal = 0;
+            writeBuffer[bufferPos].count = 0;
             bufferPos++;
         }
         unsigned int targetId = hashSeqPair[kmerPos].id;
-        unsigned short diagonal = hashSeqPair[kmerPos].pos;
-        // remove similar double sequence hit
-        if(targetId != repSeqId && lastTargetId != targetId ){
-            ;
-        }else{
-            lastTargetId = targetId;
+        short diagonal = hashSeqPair[kmerPos].pos;
+        if(targetId == repSeqId){
             continue;
         }
+        // repeated k-mer matches on the same diagonal are counted
+        if(bufferPos > 1 && writeBuffer[bufferPos - 1].seqId == targetId && writeBuffer[bufferPos - 1].diagonal == diagonal
+           && writeBuffer[bufferPos - 1].count < USHRT_MAX){
+            writeBuffer[bufferPos - 1].count++;
+            continue;
+        }
+        if(bufferPos >= BUFFER_SIZE){
+            fwrite(writeBuffer, sizeof(KmerEntry), bufferPos, filePtr);
+            bufferPos=0;
+        }
         elemenetCnt++;
         writeBuffer[bufferPos].seqId = targetId;
         writeBuffer[bufferPos].diagonal = diagonal;
+        writeBuffer[bufferPos].count = 1;
         bufferPos++;
-        if(bufferPos >= BUFFER_SIZE){
+    }
+    if (elemenetCnt > 0) {
+        if(bufferPos > 0){
             fwrite(writeBuffer, sizeof(KmerEntry), bufferPos, filePtr);
-            bufferPos=0;
         }
-        lastTargetId = targetId;
-        writeSets++;
-    }
-    if (writeSets > 0 && elemenetCnt > 0 && bufferPos > 0) {
-        fwrite(writeBuffer, sizeof(KmerEntry), bufferPos, filePtr);
         fwrite(&nullEntry,  sizeof(KmerEntry), 1, filePtr);
     }
     fclose(filePtr);
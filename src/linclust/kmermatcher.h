@@ -0,0 +1,183 @@
+#ifndef MMSEQS_KMERMATCHER_H
+#define MMSEQS_KMERMATCHER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Parameters.h"
+#include "BaseMatrix.h"
+#include "QueryMatcher.h"
+
+struct KmerPosition {
+    size_t kmer;
+    unsigned int id;
+    unsigned short seqLen;
+    short pos;
+    KmerPosition(){}
+    KmerPosition(size_t kmer, unsigned int id, unsigned short seqLen, short pos):
+            kmer(kmer), id(id), seqLen(seqLen), pos(pos) {}
+    static bool compareRepSequenceAndIdAndPos(const KmerPosition &first, const KmerPosition &second){
+        if(first.kmer < second.kmer )
+            return true;
+        if(second.kmer < first.kmer )
+            return false;
+        if(first.seqLen > second.seqLen )
+            return true;
+        if(second.seqLen > first.seqLen )
+            return false;
+        if(first.id < second.id )
+            return true;
+        if(second.id < first.id )
+            return false;
+        if(first.pos < second.pos )
+            return true;
+        if(second.pos < first.pos )
+            return false;
+        return false;
+    }
+
+    static bool compareRepSequenceAndIdAndDiag(const KmerPosition &first, const KmerPosition &second){
+        if(first.kmer < second.kmer)
+            return true;
+        if(second.kmer < first.kmer)
+            return false;
+        if(first.id < second.id)
+            return true;
+        if(second.id < first.id)
+            return false;
+
+        //        const short firstDiag  = (first.pos < 0)  ? -first.pos : first.pos;
+        //        const short secondDiag = (second.pos  < 0) ? -second.pos : second.pos;
+        if(first.pos < second.pos)
+            return true;
+        if(second.pos < first.pos)
+            return false;
+        return false;
+    }
+};
+
+// entry of the binary edge list written with --kmer-result-mode 2,
+// every result entry starts with the rep. sequence itself
+struct __attribute__((__packed__)) KmerEdge {
+    unsigned int seqId;
+    short diagonal;
+    unsigned short kmerCount;
+    KmerEdge(){}
+    KmerEdge(unsigned int seqId, short diagonal, unsigned short kmerCount):
+            seqId(seqId), diagonal(diagonal), kmerCount(kmerCount) {}
+
+    // dataLength includes the terminating null byte of the DB entry
+    static void parseEdges(const char *data, size_t dataLength, std::vector<hit_t> &hits) {
+        const size_t edgeCount = (dataLength > 0) ? (dataLength - 1) / sizeof(KmerEdge) : 0;
+        const KmerEdge *edges = reinterpret_cast<const KmerEdge *>(data);
+        for (size_t i = 0; i < edgeCount; i++) {
+            hit_t hit;
+            hit.seqId = edges[i].seqId;
+            hit.pScore = 0;
+            hit.diagonal = edges[i].diagonal;
+            hits.push_back(hit);
+        }
+    }
+};
+
+void setLinearFilterDefault(Parameters *p);
+
+void setKmerLengthAndAlphabet(Parameters &parameters, size_t aaDbSize, int seqType);
+
+size_t computeKmerCount(DBReader<unsigned int> &reader, size_t KMER_SIZE, size_t chooseTopKmer);
+
+size_t computeMemoryNeededLinearfilter(size_t totalKmer);
+
+// Scatters the k-mers of all splits into one bucket file per split,
+// so that all splits are generated in a single pass over the sequence DB.
+class KmerSplitWriter {
+public:
+    KmerSplitWriter(const std::string &prefix, size_t splits, size_t threads);
+    ~KmerSplitWriter();
+
+    void add(size_t thread, size_t split, const KmerPosition &kmer) {
+        const size_t bufferIdx = thread * splits + split;
+        buffers[bufferIdx][bufferPos[bufferIdx]] = kmer;
+        bufferPos[bufferIdx]++;
+        if (bufferPos[bufferIdx] >= BUFFER_SIZE) {
+            flushBuffer(bufferIdx);
+        }
+    }
+
+    // writes the remaining k-mers of the thread
+    void flush(size_t thread);
+
+    void close();
+
+    std::string getFileName(size_t split) const;
+
+    size_t getCount(size_t split) const {
+        return counts[split];
+    }
+
+    size_t getTotalCount() const;
+
+private:
+    static const size_t BUFFER_SIZE = 1024;
+
+    std::string prefix;
+    size_t splits;
+    std::vector<FILE *> files;
+    std::vector<size_t> counts;
+    std::vector<KmerPosition *> buffers;
+    std::vector<size_t> bufferPos;
+
+    void flushBuffer(size_t bufferIdx);
+};
+
+// fills the chooseTopKmer - 1 k-mers with the lowest hash of every sequence (and one k-mer for the identity)
+// that belong to the given split, returns the number of written entries
+// if a splitWriter is given, the k-mers of all splits are scattered to it instead
+size_t fillKmerPositionArray(KmerPosition * hashSeqPair, DBReader<unsigned int> &seqDbr,
+                             Parameters & par, BaseMatrix * subMat,
+                             size_t KMER_SIZE, size_t chooseTopKmer,
+                             size_t splits, size_t split, KmerSplitWriter *splitWriter = NULL);
+
+// returns the k-mer matches sorted by rep. sequence (stored in kmer) if splits == 1
+// otherwise they are written to splitFile and NULL is returned
+KmerPosition * doComputation(size_t totalKmers, size_t split, size_t splits, std::string splitFile,
+                             DBReader<unsigned int> & seqDbr, Parameters & par, BaseMatrix  * subMat,
+                             size_t KMER_SIZE, size_t chooseTopKmer);
+
+// sorts the k-mers of a split by k-mer, assigns the rep. sequence of each k-mer
+// and sorts the matches by rep. sequence. The result is returned if splits == 1,
+// otherwise it is written to splitFile, hashSeqPair is deleted and NULL is returned.
+// hashSeqPair[elementsToSort].kmer has to be SIZE_MAX.
+KmerPosition * assignRepSequence(KmerPosition * hashSeqPair, size_t elementsToSort, size_t splits,
+                                 std::string splitFile, Parameters & par);
+
+// generates the sorted split files of all splits with a single pass over the sequence DB,
+// splits are processed in parallel if more than one fits into memoryLimit
+std::vector<std::string> computeSplitsSinglePass(size_t splits, const std::string &prefix,
+                                                 DBReader<unsigned int> & seqDbr, Parameters & par, BaseMatrix * subMat,
+                                                 size_t KMER_SIZE, size_t chooseTopKmer, size_t memoryLimit);
+
+// the result entries keep one diagonal per member, the first one or the one with the most k-mers (resultMode),
+// and at most maxMembers members sharing the most k-mers with the rep. sequence (0: all members)
+void mergeKmerFilesAndOutput(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
+                             std::vector<std::string> tmpFiles, std::vector<char> &repSequence,
+                             int covMode, float covThr,
+                             int resultMode = Parameters::KMER_RESULT_FIRST_DIAGONAL, size_t maxMembers = 0);
+
+void writeKmersToDisk(std::string tmpFile, KmerPosition *kmers, size_t totalKmers);
+
+void writeKmerMatcherResult(DBReader<unsigned int> & seqDbr, DBWriter & dbw,
+                            KmerPosition *hashSeqPair, size_t totalKmers,
+                            std::vector<char> &repSequence, int covMode, float covThr,
+                            size_t threads,
+                            int resultMode = Parameters::KMER_RESULT_FIRST_DIAGONAL, size_t maxMembers = 0);
+
+// writes an entry containing only the sequence itself for all sequences that are no rep. sequence
+void writeMissingEntries(DBReader<unsigned int> &seqDbr, DBWriter &dbw, std::vector<char> &repSequence,
+                         int resultMode = Parameters::KMER_RESULT_FIRST_DIAGONAL);
+
+#endif //MMSEQS_KMERMATCHER_H
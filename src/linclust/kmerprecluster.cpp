@@ -0,0 +1,297 @@
+// Fused linclust pre-clustering: kmermatcher, Hamming distance rescoring (rescorediagonal --rescore-mode 0)
+// and greedy clustering (clust --cluster-mode 3) in one process.
+// The k-mer matches stay in memory sorted by rep. sequence, every rep. sequence - member diagonal is scored
+// directly and accepted edges are merged into the cluster assignment, so neither the rescored
+// prefilter DB has to be written nor the prefilter DB has to be read again.
+// The prefilter DB is still written since the later linclust steps use it.
+// Only the greedy low memory mode is fused: the rep. sequence of a member is the minimum over all accepted
+// edges, which can be merged edge by edge in any order. Set cover and connected component need the degree of
+// every set or the whole graph before the first decision, so the rescored edges would have to be written and
+// read again by ClusteringGraph anyway. These modes keep the separate rescorediagonal and clust steps.
+// The k-mer splits are not distributed over MPI ranks, only the master rank does the work.
+#include "kmermatcher.h"
+#include "Clustering.h"
+#include "ClusteringAlgorithms.h"
+#include "DistanceCalculator.h"
+#include "SubstitutionMatrix.h"
+#include "ReducedMatrix.h"
+#include "NucleotideMatrix.h"
+#include "QueryMatcher.h"
+#include "Util.h"
+#include "Debug.h"
+#include "Timer.h"
+#include "MMseqsMPI.h"
+
+#include <limits>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+#ifndef SIZE_T_MAX
+#define SIZE_T_MAX ((size_t) -1)
+#endif
+
+// same acceptance criteria as doRescorediagonal with RESCORE_MODE_HAMMING
+static bool isAcceptedHammingHit(DBReader<unsigned int> &seqDbr, int covMode, int seqIdMode,
+                                 float covThr, float seqIdThr,
+                                 unsigned int queryId, unsigned int targetId, short diagonal) {
+    char *querySeq = seqDbr.getData(queryId);
+    char *targetSeq = seqDbr.getData(targetId);
+    // -2 because of \n\0 in sequenceDB
+    int queryLen = std::max(0, static_cast<int>(seqDbr.getSeqLens(queryId)) - 2);
+    int dbLen = std::max(0, static_cast<int>(seqDbr.getSeqLens(targetId)) - 2);
+    if (Util::canBeCovered(covThr, covMode, static_cast<float>(queryLen), static_cast<float>(dbLen)) == false) {
+        return false;
+    }
+    unsigned short distanceToDiagonal = abs(diagonal);
+    unsigned int diagonalLen = 0;
+    unsigned int distance = 0;
+    if (diagonal >= 0 && distanceToDiagonal < queryLen) {
+        diagonalLen = std::min(dbLen, queryLen - distanceToDiagonal);
+        distance = DistanceCalculator::computeHammingDistance(querySeq + distanceToDiagonal, targetSeq, diagonalLen);
+    } else if (diagonal < 0 && distanceToDiagonal < dbLen) {
+        diagonalLen = std::min(dbLen - distanceToDiagonal, queryLen);
+        distance = DistanceCalculator::computeHammingDistance(querySeq, targetSeq + distanceToDiagonal, diagonalLen);
+    }
+    float targetCov = static_cast<float>(diagonalLen) / static_cast<float>(dbLen);
+    float queryCov = static_cast<float>(diagonalLen) / static_cast<float>(queryLen);
+    int idCnt = (static_cast<float>(diagonalLen) - static_cast<float>(distance));
+    double seqId = Util::computeSeqId(seqIdMode, idCnt, queryLen, dbLen, diagonalLen);
+    bool hasCov = Util::hasCoverage(covThr, covMode, queryCov, targetCov);
+    bool hasSeqId = seqId >= (seqIdThr - std::numeric_limits<float>::epsilon());
+    return hasCov && hasSeqId;
+}
+
+// greedy low memory clustering: every member joins the longest (smallest length sorted id) rep. sequence
+static inline void assignToRepresentative(unsigned int *assignedcluster, unsigned int member, unsigned int rep) {
+    unsigned int targetId;
+    __atomic_load(&assignedcluster[member], &targetId, __ATOMIC_RELAXED);
+    do {
+        if (targetId <= rep) break;
+    } while (!__atomic_compare_exchange(&assignedcluster[member], &targetId, &rep, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void rescoreKmerMatches(DBReader<unsigned int> &seqDbr, Parameters &par, float covThr, float seqIdThr,
+                               KmerPosition *hashSeqPair, size_t totalKmers,
+                               const unsigned int *lengthId, unsigned int *assignedcluster) {
+    // split at rep. sequence borders, one part per thread
+    const size_t threads = static_cast<size_t>(par.threads);
+    std::vector<size_t> threadOffsets;
+    size_t splitSize = totalKmers / threads;
+    threadOffsets.push_back(0);
+    for (size_t thread = 1; thread < threads; thread++) {
+        size_t pos = std::max(threadOffsets.back(), thread * splitSize);
+        while (pos > 0 && pos < totalKmers && hashSeqPair[pos].kmer == hashSeqPair[pos - 1].kmer) {
+            pos++;
+        }
+        threadOffsets.push_back(pos);
+    }
+    threadOffsets.push_back(totalKmers);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t thread = 0; thread < threads; thread++) {
+        size_t repSeqId = SIZE_T_MAX;
+        size_t lastTargetId = SIZE_T_MAX;
+        unsigned int queryLength = 0;
+        for (size_t kmerPos = threadOffsets[thread];
+             kmerPos < threadOffsets[thread + 1] && hashSeqPair[kmerPos].kmer != SIZE_T_MAX; kmerPos++) {
+            if (repSeqId != hashSeqPair[kmerPos].kmer) {
+                repSeqId = hashSeqPair[kmerPos].kmer;
+                queryLength = hashSeqPair[kmerPos].seqLen;
+                lastTargetId = SIZE_T_MAX;
+            }
+            unsigned int targetId = hashSeqPair[kmerPos].id;
+            // remove similar double sequence hit (same filter as writeKmerMatcherResult)
+            if (targetId == repSeqId || targetId == lastTargetId) {
+                lastTargetId = targetId;
+                continue;
+            }
+            lastTargetId = targetId;
+            if (Util::canBeCovered(par.cov, par.covMode, static_cast<float>(queryLength),
+                                   static_cast<float>(hashSeqPair[kmerPos].seqLen)) == false) {
+                continue;
+            }
+            if (isAcceptedHammingHit(seqDbr, par.covMode, par.seqIdMode, covThr, seqIdThr,
+                                     static_cast<unsigned int>(repSeqId), targetId, hashSeqPair[kmerPos].pos)) {
+                assignToRepresentative(assignedcluster, lengthId[targetId], lengthId[repSeqId]);
+            }
+        }
+    }
+}
+
+static void rescorePrefilterDB(DBReader<unsigned int> &seqDbr, Parameters &par, float covThr, float seqIdThr,
+                               const unsigned int *lengthId, unsigned int *assignedcluster) {
+    DBReader<unsigned int> prefDbr(par.db2.c_str(), par.db2Index.c_str());
+    prefDbr.open(DBReader<unsigned int>::LINEAR_ACCCESS);
+#pragma omp parallel for schedule(dynamic, 100)
+    for (size_t id = 0; id < prefDbr.getSize(); id++) {
+        Debug::printProgress(id);
+        unsigned int queryId = seqDbr.getId(prefDbr.getDbKey(id));
+        char *data = prefDbr.getData(id);
+        while (*data != '\0') {
+            hit_t hit = QueryMatcher::parsePrefilterHit(data);
+            unsigned int targetId = seqDbr.getId(hit.seqId);
+            if (targetId != queryId &&
+                isAcceptedHammingHit(seqDbr, par.covMode, par.seqIdMode, covThr, seqIdThr,
+                                     queryId, targetId, static_cast<short>(hit.diagonal))) {
+                assignToRepresentative(assignedcluster, lengthId[targetId], lengthId[queryId]);
+            }
+            data = Util::skipLine(data);
+        }
+    }
+    prefDbr.close();
+}
+
+int kmerprecluster(int argc, const char **argv, const Command &command) {
+    MMseqsMPI::init(argc, argv);
+    // the other ranks would compute the same result and write to the same files
+    if (MMseqsMPI::isMaster() == false) {
+        return EXIT_SUCCESS;
+    }
+
+    Parameters &par = Parameters::getInstance();
+    setLinearFilterDefault(&par);
+    par.parseParameters(argc, argv, command, 3, false, 0, MMseqsParameter::COMMAND_CLUSTLINEAR);
+
+    DBReader<unsigned int> seqDbr(par.db1.c_str(), par.db1Index.c_str());
+    seqDbr.open(DBReader<unsigned int>::NOSORT);
+    int querySeqType = seqDbr.getDbtype();
+
+    // the prefilter DB is parsed again by the later linclust steps, which needs the text result
+    if (par.kmerResultMode == Parameters::KMER_RESULT_EDGE_LIST) {
+        Debug(Debug::ERROR) << "The binary edge list (--kmer-result-mode 2) cannot be used with kmerprecluster.\n";
+        EXIT(EXIT_FAILURE);
+    }
+
+    setKmerLengthAndAlphabet(par, seqDbr.getAminoAcidDBSize(), querySeqType);
+    std::vector<MMseqsParameter>* params = command.params;
+    par.printParameters(command.cmd, argc, argv, *params);
+    Debug(Debug::INFO) << "Database type: " << seqDbr.getDbTypeName() << "\n";
+
+    BaseMatrix *subMat;
+    if (querySeqType == Sequence::NUCLEOTIDES) {
+        subMat = new NucleotideMatrix(par.scoringMatrixFile.c_str(), 1.0, 0.0);
+    } else {
+        if (par.alphabetSize == 21) {
+            subMat = new SubstitutionMatrix(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+        } else {
+            SubstitutionMatrix sMat(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+            subMat = new ReducedMatrix(sMat.probMatrix, sMat.subMatrixPseudoCounts, par.alphabetSize, 2.0);
+        }
+    }
+
+    const size_t KMER_SIZE = par.kmerSize;
+    size_t chooseTopKmer = par.kmersPerSequence;
+
+    size_t memoryLimit;
+    if (par.splitMemoryLimit > 0) {
+        memoryLimit = static_cast<size_t>(par.splitMemoryLimit) * 1024;
+    } else {
+        memoryLimit = static_cast<size_t>(Util::getTotalSystemMemory() * 0.9);
+    }
+    size_t totalKmers = computeKmerCount(seqDbr, KMER_SIZE, chooseTopKmer);
+    size_t totalSizeNeeded = computeMemoryNeededLinearfilter(totalKmers);
+    Debug(Debug::INFO) << "Needed memory (" << totalSizeNeeded << " byte) of total memory (" << memoryLimit << " byte)\n";
+    size_t splits = static_cast<size_t>(std::ceil(static_cast<float>(totalSizeNeeded) / memoryLimit));
+    if (splits > 1) {
+        // security buffer
+        splits += 1;
+    }
+    Debug(Debug::INFO) << "Process file into " << splits << " parts\n";
+
+    std::vector<std::string> splitFiles;
+    KmerPosition *hashSeqPair = NULL;
+    if (splits > 1) {
+        splitFiles = computeSplitsSinglePass(splits, par.db2, seqDbr, par, subMat, KMER_SIZE, chooseTopKmer, memoryLimit);
+    } else {
+        hashSeqPair = doComputation(totalKmers, 0, splits, par.db2 + "_split_0", seqDbr, par, subMat, KMER_SIZE, chooseTopKmer);
+    }
+    delete subMat;
+
+    Timer timer;
+    std::vector<char> repSequence(seqDbr.getSize());
+    std::fill(repSequence.begin(), repSequence.end(), false);
+    DBWriter prefWriter(par.db2.c_str(), par.db2Index.c_str(), par.threads);
+    prefWriter.open();
+    if (splits > 1) {
+        seqDbr.unmapData();
+        mergeKmerFilesAndOutput(seqDbr, prefWriter, splitFiles, repSequence, par.covMode, par.cov,
+                                par.kmerResultMode, par.kmerMaxMembers);
+    } else {
+        writeKmerMatcherResult(seqDbr, prefWriter, hashSeqPair, totalKmers, repSequence, par.covMode, par.cov, par.threads,
+                               par.kmerResultMode, par.kmerMaxMembers);
+    }
+    writeMissingEntries(seqDbr, prefWriter, repSequence, par.kmerResultMode);
+    prefWriter.close();
+    Debug(Debug::INFO) << "Time for writing the prefilter result: " << timer.lap() << "\n";
+
+    // the Hamming distance pre-clustering of linclust does not go below 0.5 seq. id and coverage
+    const float seqIdThr = std::max(0.5f, par.seqIdThr);
+    const float covThr = std::max(0.5f, par.covThr);
+
+    // clust works on length sorted ids, the smallest id in a cluster is its rep. sequence
+    DBReader<unsigned int> lengthDbr(par.db1.c_str(), par.db1Index.c_str(), DBReader<unsigned int>::USE_INDEX);
+    lengthDbr.open(DBReader<unsigned int>::SORT_BY_LENGTH);
+    const size_t dbSize = seqDbr.getSize();
+    unsigned int *lengthId = new(std::nothrow) unsigned int[dbSize];
+    Util::checkAllocation(lengthId, "Could not allocate lengthId memory in kmerprecluster");
+#pragma omp parallel for schedule(static)
+    for (size_t id = 0; id < dbSize; id++) {
+        lengthId[id] = static_cast<unsigned int>(lengthDbr.getId(seqDbr.getDbKey(id)));
+    }
+    unsigned int *assignedcluster = new(std::nothrow) unsigned int[dbSize];
+    Util::checkAllocation(assignedcluster, "Could not allocate assignedcluster memory in kmerprecluster");
+    std::fill_n(assignedcluster, dbSize, UINT_MAX);
+
+    Debug(Debug::INFO) << "Rescore diagonals with Hamming distance and cluster ...\n";
+    // the sequence data was unmapped after the k-mer computation
+    seqDbr.remapData();
+    // the in-memory matches keep the first diagonal of every member and all members,
+    // the best diagonal and the member limit are only applied while writing the prefilter DB
+    const bool useKmerMatches = par.kmerResultMode == Parameters::KMER_RESULT_FIRST_DIAGONAL && par.kmerMaxMembers == 0;
+    if (hashSeqPair != NULL && useKmerMatches) {
+        rescoreKmerMatches(seqDbr, par, covThr, seqIdThr, hashSeqPair, totalKmers, lengthId, assignedcluster);
+        delete [] hashSeqPair;
+    } else {
+        // the matches of multiple splits are only merged while writing the prefilter DB
+        if (hashSeqPair != NULL) {
+            delete [] hashSeqPair;
+        }
+        rescorePrefilterDB(seqDbr, par, covThr, seqIdThr, lengthId, assignedcluster);
+    }
+    delete [] lengthId;
+
+    // same as ClusteringAlgorithms::greedyIncrementalLowMem
+#pragma omp parallel for schedule(static)
+    for (size_t id = 0; id < dbSize; id++) {
+        if (assignedcluster[id] > id) {
+            assignedcluster[id] = static_cast<unsigned int>(id);
+        }
+    }
+    for (size_t id = 0; id < dbSize; ++id) {
+        unsigned int assignedClusterId = assignedcluster[id];
+        if (assignedcluster[assignedClusterId] != assignedClusterId) {
+            assignedcluster[assignedClusterId] = assignedClusterId;
+        }
+    }
+    std::pair<unsigned int, unsigned int> *assignment = ClusteringAlgorithms::sortByRepresentative(&lengthDbr, assignedcluster, dbSize);
+    delete [] assignedcluster;
+
+    DBWriter cluWriter(par.db3.c_str(), par.db3Index.c_str(), par.threads);
+    cluWriter.open();
+    size_t cluNum = Clustering::writeData(&cluWriter, &lengthDbr, assignment, dbSize, par.threads);
+    cluWriter.close();
+    delete [] assignment;
+    Debug(Debug::INFO) << "Time for rescoring and clustering: " << timer.lap() << "\n";
+    Debug(Debug::INFO) << "Number of clusters: " << cluNum << "\n";
+
+    lengthDbr.close();
+    seqDbr.close();
+    return EXIT_SUCCESS;
+}
+
+#undef SIZE_T_MAX
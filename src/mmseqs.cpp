@@ -221,6 +221,12 @@ std::vector<struct Command> commands = {
                 "Martin Steinegger <martin.steinegger@mpibpc.mpg.de> ",
                 "<i:sequenceDB> <o:prefDB>",
                 CITATION_MMSEQS2},
+        {"kmerprecluster",       kmerprecluster,       &par.kmerprecluster,         COMMAND_EXPERT,
+                "Finds exact $k$-mer matches and greedily pre-clusters them by Hamming distance in one step",
+                "Computes the same prefilter DB as kmermatcher. The diagonal of each k-mer match is rescored by Hamming distance like rescorediagonal --rescore-mode 0 (min. seq. id and coverage of at least 0.5) and the accepted matches are clustered like clust --cluster-mode 3, without writing and reading intermediate databases.",
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de> ",
+                "<i:sequenceDB> <o:prefDB> <o:clusterDB>",
+                CITATION_MMSEQS2},
         {"clusthash",            clusthash,            &par.clusthash,            COMMAND_EXPERT,
                 "Cluster sequences of same length and >90% sequence identity *in linear time*",
                 "Detects redundant sequences based on reduced alphabet hashing and hamming distance.",
@@ -428,6 +434,12 @@ std::vector<struct Command> commands = {
                 "Milot Mirdita <milot@mirdita.de>",
                 "<i:gff3File> <i:sequenceDB> <o:sequenceDB>",
                 CITATION_MMSEQS2},
+        {"maskdb",               maskdb,               &par.maskdb,               COMMAND_SPECIAL,
+                "Precompute the tantan low complexity masking of a sequence DB",
+                "Stores the masked residues as bitmasks in <sequenceDB>_mask. The prefilter index and kmermatcher read them instead of masking the sequences again.",
+                "Martin Steinegger <martin.steinegger@mpibpc.mpg.de>",
+                "<i:sequenceDB>",
+                CITATION_MMSEQS2},
         {"prefixid",             prefixid,             &par.prefixid,             COMMAND_SPECIAL,
                 "For each entry in a DB prepend the entry ID to the entry itself",
                 NULL,
@@ -1,5 +1,6 @@
 #include "IndexBuilder.h"
 #include "tantan.h"
+#include "SequenceMask.h"
 
 char* getScoreLookup(BaseMatrix &matrix) {
     char *idScoreLookup = NULL;
@@ -79,8 +80,12 @@ void IndexBuilder::fillDatabase(IndexTable *indexTable, SequenceLookup **maskedL
 
     // need to prune low scoring k-mers through masking
     ProbabilityMatrix *probMatrix = NULL;
+    // masked residues precomputed by maskdb
+    DBReader<unsigned int> *maskDbr = NULL;
+    const int maskLetter = subMat.aa2int[(int) 'X'];
     if (maskedLookup != NULL) {
         probMatrix = new ProbabilityMatrix(subMat);
+        maskDbr = SequenceMask::openMaskDb(dbr->getDataFileName(), SequenceMask::PREFILTER, subMat);
     }
 
     // identical scores for memory reduction code
@@ -104,6 +109,10 @@ void IndexBuilder::fillDatabase(IndexTable *indexTable, SequenceLookup **maskedL
 
         unsigned int *buffer = new unsigned int[seq->getMaxLen()];
         char *charSequence = new char[seq->getMaxLen()];
+        tantan::Workspace *tantanWorkspace = NULL;
+        if (maskedLookup != NULL) {
+            tantanWorkspace = new tantan::Workspace(seq->getMaxLen(), 50);
+        }
 
         #pragma omp for schedule(dynamic, 100) reduction(+:totalKmerCount, maskedResidues)
         for (size_t id = dbFrom; id < dbTo; id++) {
@@ -125,23 +134,22 @@ void IndexBuilder::fillDatabase(IndexTable *indexTable, SequenceLookup **maskedL
                     (*unmaskedLookup)->addSequence(s.int_sequence, s.L, id - dbFrom, info->sequenceOffsets[id - dbFrom]);
                 }
                 if (maskedLookup != NULL) {
-                    for (int i = 0; i < s.L; ++i) {
-                        charSequence[i] = (char) s.int_sequence[i];
+                    const unsigned char *bitmask = NULL;
+                    if (maskDbr != NULL) {
+                        bitmask = SequenceMask::getBitmask(maskDbr, qKey, s.L, SequenceMask::PREFILTER, subMat.alphabetSize);
                     }
-                    // s.print();
-                    maskedResidues += tantan::maskSequences(charSequence,
-                                                            charSequence + s.L,
-                                                            50 /*options.maxCycleLength*/,
-                                                            probMatrix->probMatrixPointers,
-                                                            0.005 /*options.repeatProb*/,
-                                                            0.05 /*options.repeatEndProb*/,
-                                                            0.9 /*options.repeatOffsetProbDecay*/,
-                                                            0, 0,
-                                                            0.9 /*options.minMaskProb*/,
-                                                            probMatrix->hardMaskTable);
-
-                    for (int i = 0; i < s.L; i++) {
-                        s.int_sequence[i] = charSequence[i];
+                    if (bitmask != NULL) {
+                        maskedResidues += SequenceMask::applyBitmask(s.int_sequence, s.L, bitmask, maskLetter);
+                    } else {
+                        for (int i = 0; i < s.L; ++i) {
+                            charSequence[i] = (char) s.int_sequence[i];
+                        }
+                        // s.print();
+                        maskedResidues += SequenceMask::mask(charSequence, s.L, SequenceMask::PREFILTER, *probMatrix, *tantanWorkspace);
+
+                        for (int i = 0; i < s.L; i++) {
+                            s.int_sequence[i] = charSequence[i];
+                        }
                     }
                     (*maskedLookup)->addSequence(s.int_sequence, s.L, id - dbFrom, info->sequenceOffsets[id - dbFrom]);
                 }
@@ -151,6 +159,9 @@ void IndexBuilder::fillDatabase(IndexTable *indexTable, SequenceLookup **maskedL
         }
 
         delete[] charSequence;
+        if (tantanWorkspace != NULL) {
+            delete tantanWorkspace;
+        }
         delete[] buffer;
 
         if (generator != NULL) {
@@ -161,6 +172,7 @@ void IndexBuilder::fillDatabase(IndexTable *indexTable, SequenceLookup **maskedL
     if(probMatrix != NULL) {
         delete probMatrix;
     }
+    SequenceMask::closeMaskDb(maskDbr);
 
     Debug(Debug::INFO) << "\nIndex table: Masked residues: " << maskedResidues << "\n";
     if(totalKmerCount == 0) {
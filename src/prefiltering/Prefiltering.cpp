@@ -7,6 +7,7 @@
 #include "FileUtil.h"
 #include "IndexBuilder.h"
 #include "Timer.h"
+#include "CostScheduler.h"
 
 namespace prefilter {
 #include "ExpOpt3_8_polished.cs32.lib.h"
@@ -708,6 +709,13 @@ bool Prefiltering::runSplit(DBReader<unsigned int>* qdbr, const std::string &res
     Debug(Debug::INFO) << "Target db start  " << (dbFrom + 1) << " to " << dbFrom + dbSize << "\n";
     EvalueComputation evaluer(tdbr->getAminoAcidDBSize(), subMat, 0, 0, false);
 
+    // the k-mer matching of a query grows with its length
+    CostScheduler scheduler(queryFrom, querySize, localThreads);
+    for (size_t id = queryFrom; id < queryFrom + querySize; id++) {
+        scheduler.setCost(id, qdbr->getSeqLens(id));
+    }
+    scheduler.sortByCost();
+
 #pragma omp parallel num_threads(localThreads)
     {
         unsigned int thread_idx = 0;
@@ -727,8 +735,9 @@ bool Prefiltering::runSplit(DBReader<unsigned int>* qdbr, const std::string &res
         }
 
 #pragma omp for schedule(dynamic, 10) reduction (+: kmersPerPos, resSize, dbMatches, doubleMatches, querySeqLenSum, diagonalOverflow)
-        for (size_t id = queryFrom; id < queryFrom + querySize; id++) {
-            Debug::printProgress(id);
+        for (size_t i = 0; i < querySize; i++) {
+            Debug::printProgress(i);
+            const size_t id = scheduler.getId(i);
             // get query sequence
             char *seqData = qdbr->getData(id);
             unsigned int qKey = qdbr->getDbKey(id);
@@ -760,8 +769,10 @@ bool Prefiltering::runSplit(DBReader<unsigned int>* qdbr, const std::string &res
             resSize += resultSize;
             realResSize += std::min(resultSize, maxResults);
             reslens[thread_idx]->emplace_back(resultSize);
+            scheduler.entryDone(thread_idx);
         } // step end
     }
+    scheduler.printThreadTimes();
 
     if (Debug::debugLevel >= Debug::INFO) {
         statistics_t stats(kmersPerPos / totalQueryDBSize,
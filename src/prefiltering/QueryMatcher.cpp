@@ -86,6 +86,7 @@ QueryMatcher::QueryMatcher(IndexTable *indexTable, SequenceLookup *sequenceLooku
         }
     }
     compositionBias = new float[maxSeqLen];
+    backgroundScore = new float[m->alphabetSize];
 }
 
 QueryMatcher::~QueryMatcher(){
@@ -100,6 +101,7 @@ QueryMatcher::~QueryMatcher(){
     }
     delete [] seqLens;
     delete [] compositionBias;
+    delete [] backgroundScore;
     if(ungappedAlignment != NULL){
         delete ungappedAlignment;
     }
@@ -130,7 +132,7 @@ std::pair<hit_t *, size_t> QueryMatcher::matchQuery (Sequence * querySeq, unsign
     // bias correction
     if(aaBiasCorrection == true){
         if(querySeq->getSeqType() == Sequence::AMINO_ACIDS) {
-            SubstitutionMatrix::calcLocalAaBiasCorrection(m, querySeq->int_sequence, querySeq->L, compositionBias);
+            SubstitutionMatrix::calcLocalAaBiasCorrection(m, querySeq->int_sequence, querySeq->L, compositionBias, backgroundScore);
         }else{
             memset(compositionBias, 0, sizeof(float) * querySeq->L);
         }
@@ -269,6 +269,7 @@ protected:
     size_t getDoubleDiagonalMatches();
 
     float *compositionBias;
+    float *backgroundScore;
 
     // diagonal scoring active
     bool diagonalScoring;
@@ -0,0 +1,121 @@
+// Compares SmithWaterman::ssw_align_banded with the full ssw_align for a diagonal inside and outside of the band.
+// The banded alignment has to return the same score, coordinates and cigar in both cases, since it falls back
+// to ssw_align if it scores below the minimum score derived from the prefilter. Like the prefilter, the test
+// takes the score of the best ungapped diagonal as the minimum score.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "StripedSmithWaterman.h"
+#include "SubstitutionMatrix.h"
+#include "EvalueComputation.h"
+#include "Sequence.h"
+#include "Parameters.h"
+
+const char* binary_name = "test_bandedsmithwaterman";
+
+static const char residues[] = "ACDEFGHIKLMNPQRSTVWY";
+
+static std::string randomSequence(size_t length) {
+    std::string seq;
+    for (size_t i = 0; i < length; i++) {
+        seq.push_back(residues[rand() % 20]);
+    }
+    return seq;
+}
+
+// substitutes about 20% of the residues and inserts or deletes a few short stretches
+static std::string mutateSequence(const std::string &seq) {
+    std::string mutated;
+    for (size_t i = 0; i < seq.size(); i++) {
+        const int r = rand() % 1000;
+        if (r < 2) {
+            mutated.append(randomSequence(1 + rand() % 3));
+        } else if (r < 4) {
+            i += rand() % 3;
+            continue;
+        }
+        mutated.push_back((rand() % 5 == 0) ? residues[rand() % 20] : seq[i]);
+    }
+    return mutated;
+}
+
+static std::vector<uint32_t> copyCigar(const s_align &aln) {
+    if (aln.cigar == NULL) {
+        return std::vector<uint32_t>();
+    }
+    return std::vector<uint32_t>(aln.cigar, aln.cigar + aln.cigarLen);
+}
+
+static void printAlignment(const char *name, const s_align &aln, const std::vector<uint32_t> &cigar) {
+    std::cout << name << ": score " << aln.score1
+              << " query " << aln.qStartPos1 << "-" << aln.qEndPos1
+              << " target " << aln.dbStartPos1 << "-" << aln.dbEndPos1
+              << " cigar ";
+    for (size_t i = 0; i < cigar.size(); i++) {
+        std::cout << SmithWaterman::cigar_int_to_len(cigar[i]) << SmithWaterman::cigar_int_to_op(cigar[i]);
+    }
+    std::cout << "\n";
+}
+
+static bool compareAlignments(const char *name, SmithWaterman &aligner, Sequence &dbSeq, int diagonal, int bandWidth,
+                              int gapOpen, int gapExtend, EvalueComputation &evaluer, int32_t maskLen) {
+    const int32_t minScore = aligner.ungapped_alignment(dbSeq.int_sequence, dbSeq.L);
+    s_align full = aligner.ssw_align(dbSeq.int_sequence, dbSeq.L, gapOpen, gapExtend, 2, 10000, &evaluer, 0, 0.0, maskLen);
+    std::vector<uint32_t> fullCigar = copyCigar(full);
+    s_align banded = aligner.ssw_align_banded(dbSeq.int_sequence, dbSeq.L, diagonal, bandWidth, gapOpen, gapExtend,
+                                              2, 10000, &evaluer, 0, 0.0, maskLen, minScore);
+    std::vector<uint32_t> bandedCigar = copyCigar(banded);
+
+    std::cout << name << " (diagonal " << diagonal << ", band width " << bandWidth << ")\n";
+    printAlignment("full", full, fullCigar);
+    printAlignment("banded", banded, bandedCigar);
+    const bool isSame = full.score1 == banded.score1
+                        && full.qStartPos1 == banded.qStartPos1 && full.qEndPos1 == banded.qEndPos1
+                        && full.dbStartPos1 == banded.dbStartPos1 && full.dbEndPos1 == banded.dbEndPos1
+                        && fullCigar == bandedCigar;
+    std::cout << (isSame ? "OK" : "FAILED") << "\n\n";
+    return isSame;
+}
+
+int main (int, const char**) {
+    srand(1);
+    Parameters &par = Parameters::getInstance();
+    SubstitutionMatrix subMat(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+    const int gapOpen = 11;
+    const int gapExtend = 1;
+    EvalueComputation evaluer(100000, &subMat, gapOpen, gapExtend, true);
+
+    int8_t *tinySubMat = new int8_t[subMat.alphabetSize * subMat.alphabetSize];
+    for (int i = 0; i < subMat.alphabetSize; i++) {
+        for (int j = 0; j < subMat.alphabetSize; j++) {
+            tinySubMat[i * subMat.alphabetSize + j] = static_cast<int8_t>(subMat.subMatrix[i][j]);
+        }
+    }
+
+    const std::string query = randomSequence(2000);
+    const std::string target = mutateSequence(query);
+    // the homologous part lies 400 diagonals away from diagonal 0
+    const std::string shiftedTarget = randomSequence(400) + target;
+
+    Sequence qSeq(10000, Sequence::AMINO_ACIDS, &subMat, 0, false, false);
+    qSeq.mapSequence(0, 0, query.c_str());
+    Sequence dbSeq(10000, Sequence::AMINO_ACIDS, &subMat, 0, false, false);
+
+    SmithWaterman aligner(10000, subMat.alphabetSize, false);
+    aligner.ssw_init(&qSeq, tinySubMat, &subMat, subMat.alphabetSize, 2);
+    const int32_t maskLen = qSeq.L / 2;
+
+    bool isSame = true;
+    dbSeq.mapSequence(1, 1, target.c_str());
+    isSame &= compareAlignments("in band", aligner, dbSeq, 0, 8, gapOpen, gapExtend, evaluer, maskLen);
+    dbSeq.mapSequence(2, 2, shiftedTarget.c_str());
+    isSame &= compareAlignments("off band", aligner, dbSeq, 0, 8, gapOpen, gapExtend, evaluer, maskLen);
+    // the prefilter stores the diagonal as unsigned short
+    isSame &= compareAlignments("in band (shifted)", aligner, dbSeq, static_cast<unsigned short>(-400), 8,
+                                gapOpen, gapExtend, evaluer, maskLen);
+
+    delete [] tinySubMat;
+    return isSame ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,6 +3,8 @@
 //
 
 #include <iostream>
+#include <cstdlib>
+#include <cmath>
 
 #include "SubstitutionMatrix.h"
 #include "Sequence.h"
@@ -10,9 +12,10 @@
 
 const char* binary_name = "test_compositionbias";
 
-void calcLocalAaBiasCorrection(Sequence* seq, SubstitutionMatrix * m){
+// adds the background score term by term to the window average, like calcLocalAaBiasCorrection did before
+// it summed the background score once per amino acid
+void calcLocalAaBiasCorrection(Sequence* seq, SubstitutionMatrix * m, float * composition){
     const int windowSize = 40;
-    short * composition = new short[seq->L];
     // calculate local amino acid bias
     for (int i = 0; i < seq->L; i++){
         const int minPos = std::max(0, (i - windowSize/2));
@@ -28,27 +31,18 @@ void calcLocalAaBiasCorrection(Sequence* seq, SubstitutionMatrix * m){
         deltaS_i /= -1.0 * _2d;
         // positive score for the background score distribution for i
         for (int a = 0; a < m->alphabetSize; a++){
-            deltaS_i += m->pBack[a] * subMat[a];
+            deltaS_i += m->pBack[a] * static_cast<float>(subMat[a]);
         }
         composition[i] = deltaS_i;
-        std::cout << i << ": "  << _2d << " "  << sumSubScores << " " << deltaS_i << std::endl;
     }
-
-    for (int i = 0; i < seq->L-6; i++) {
-        short score = 0;
-        for (int j = 0; j < 6; j++) {
-            score += composition[i+j];
-        }
-        std::cout << i << " : " << score << std::endl;
-    }
-
-        delete [] composition;
 }
 
+// rounding of the bias in SmithWaterman::createQueryProfile
+int roundBias(float bias) {
+    return static_cast<int>((bias < 0.0) ? bias - 0.5 : bias + 0.5);
+}
 
-
-int main (int argc, const char * argv[]) {
-
+int main (int, const char**) {
     const size_t kmer_size = 6;
 
     Parameters& par = Parameters::getInstance();
@@ -58,10 +52,38 @@ int main (int argc, const char * argv[]) {
 
     const char *ref = "MDDVKIERLKRLNEDVLEDLIEVYMRGYEGLEEYGGEGRDYARDYIKWCWKKAPDGFFVAKVGDRIVGFIVCDRDWYSRYEGKIVGAIHEFVVDKGWQGKGIGKKLLTKCLEFLGKYNDTIELWVGEKNFGAMRLYEKFGFKKVGKSGIWIRMVRRQLS";
     Sequence refSeq(10000, 0, &subMat, kmer_size, false, true);
-    refSeq.mapSequence(0, 0, ref);
+    float * composition = new float[10000];
+    float * expected = new float[10000];
+    float * backgroundScore = new float[subMat.alphabetSize];
 
+    // the bias is only used rounded to whole score units, the summation order may only change the last bits
+    const char residues[] = "ACDEFGHIKLMNPQRSTVWY";
+    std::string seq(ref);
+    srand(1);
+    size_t positions = 0;
+    size_t differentRounding = 0;
+    double maxDiff = 0.0;
+    for (size_t n = 0; n < 1000; n++) {
+        refSeq.mapSequence(n, n, seq.c_str());
+        SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, refSeq.int_sequence, refSeq.L, composition, backgroundScore);
+        calcLocalAaBiasCorrection(&refSeq, &subMat, expected);
+        for (int i = 0; i < refSeq.L; i++) {
+            maxDiff = std::max(maxDiff, static_cast<double>(std::fabs(composition[i] - expected[i])));
+            differentRounding += (roundBias(composition[i]) != roundBias(expected[i]));
+        }
+        positions += refSeq.L;
 
-    calcLocalAaBiasCorrection(&refSeq, &subMat);
+        seq.clear();
+        const size_t length = 20 + rand() % 2000;
+        for (size_t i = 0; i < length; i++) {
+            seq.push_back(residues[rand() % 20]);
+        }
+    }
+    std::cout << "Positions: " << positions << ", max. difference: " << maxDiff
+              << ", different rounded bias: " << differentRounding << std::endl;
 
-    return 0;
+    delete [] backgroundScore;
+    delete [] expected;
+    delete [] composition;
+    return (maxDiff < 1e-4) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
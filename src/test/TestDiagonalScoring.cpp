@@ -96,10 +96,11 @@ int main(int argc, char **argv)
 
 
     float * compositionBias = new float[10000];
+    float * backgroundScore = new float[subMat.alphabetSize];
     CounterResult hits[32];
     UngappedAlignment matcher(10000, &subMat, &lookup);
 
-    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s5.int_sequence, s5.L, compositionBias);
+    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s5.int_sequence, s5.L, compositionBias, backgroundScore);
     memset(compositionBias, 0.0, sizeof(float)*s5.L);
 //    std::cout << compositionBias[74] << std::endl;
 //    std::cout << compositionBias[79] << std::endl;
@@ -121,7 +122,7 @@ int main(int argc, char **argv)
 
 
 
-    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s1.int_sequence, s1.L, compositionBias);
+    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s1.int_sequence, s1.L, compositionBias, backgroundScore);
 
     hits[0].id = s1.getId();
     hits[0].diagonal = 0;
@@ -197,4 +198,5 @@ int main(int argc, char **argv)
     std::cout << ExtendedSubstitutionMatrix::calcScore(s1.int_sequence, s1.int_sequence,s1.L, subMat.subMatrix) << " " << (int)hits[0].count <<  std::endl;
 
     delete [] compositionBias;
+    delete [] backgroundScore;
 }
@@ -21,9 +21,121 @@ KSEQ_INIT(int, read)
 #include "DBWriter.h"
 
 #include "Parameters.h"
+#include "DistanceCalculator.h"
+#include "DiagonalRescorer.h"
+
+#include <sys/time.h>
 
 const char* binary_name = "test_diagonalscoringperformance";
 
+static double getSeconds(const struct timeval &start, const struct timeval &end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+// compares the batch rescoring of rescorediagonal against the per pair DistanceCalculator
+// targets are at most maxTargetLen residues long
+static void benchmarkDiagonalRescorer(const std::string &query, const std::string &scoringMatrixFile, size_t maxTargetLen) {
+    SubstitutionMatrix subMat(scoringMatrixFile.c_str(), 2.0, 0.0);
+    SubstitutionMatrix::FastMatrix fastMatrix = SubstitutionMatrix::createAsciiSubMat(subMat);
+    const char aa[] = "ACDEFGHIKLMNPQRSTVWYX";
+    const int queryLen = static_cast<int>(query.size());
+
+    // mutated copies of the query and random sequences on random diagonals
+    const size_t targetCount = 1000;
+    srand(1);
+    std::vector<std::string> targets;
+    std::vector<DiagonalRescorer::Hit> hits;
+    for (size_t i = 0; i < targetCount; i++) {
+        std::string target;
+        if (i % 2 == 0) {
+            target = query.substr(rand() % (queryLen / 2), maxTargetLen);
+            for (size_t pos = 0; pos < target.size(); pos++) {
+                if (rand() % 4 == 0) {
+                    target[pos] = aa[rand() % 21];
+                }
+            }
+        } else {
+            size_t len = 20 + rand() % (maxTargetLen - 19);
+            for (size_t pos = 0; pos < len; pos++) {
+                target.push_back(aa[rand() % 21]);
+            }
+        }
+        targets.push_back(target);
+    }
+    for (size_t i = 0; i < targetCount; i++) {
+        const int targetLen = static_cast<int>(targets[i].size());
+        short diagonal = static_cast<short>((rand() % (queryLen + targetLen)) - targetLen);
+        hits.emplace_back(targets[i].c_str(), targetLen, diagonal);
+    }
+
+    DiagonalRescorer rescorer(fastMatrix);
+    const int repeats = 200;
+    for (int mode = 0; mode < 4; mode++) {
+        std::vector<DistanceCalculator::LocalAlignment> expected(targetCount);
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < repeats; i++) {
+            for (size_t j = 0; j < targetCount; j++) {
+                const short diagonal = hits[j].diagonal;
+                const int distanceToDiagonal = abs(diagonal);
+                const int targetLen = hits[j].targetLen;
+                const char *querySeq = query.c_str();
+                const char *targetSeq = hits[j].targetSeq;
+                unsigned int diagonalLen = 0;
+                if (diagonal >= 0 && distanceToDiagonal < queryLen) {
+                    diagonalLen = std::min(targetLen, queryLen - distanceToDiagonal);
+                    querySeq += distanceToDiagonal;
+                } else if (diagonal < 0 && distanceToDiagonal < targetLen) {
+                    diagonalLen = std::min(targetLen - distanceToDiagonal, queryLen);
+                    targetSeq += distanceToDiagonal;
+                } else {
+                    expected[j] = DistanceCalculator::LocalAlignment(-1, -1, 0);
+                    continue;
+                }
+                if (mode == 0) {
+                    expected[j].score = DistanceCalculator::computeHammingDistance(querySeq, targetSeq, diagonalLen);
+                } else if (mode == 1 || mode == 2) {
+                    expected[j].score = DistanceCalculator::computeSubstitutionDistance(querySeq, targetSeq, diagonalLen,
+                                                                                        fastMatrix.matrix, mode == 2);
+                } else {
+                    expected[j] = DistanceCalculator::computeSubstitutionStartEndDistance(querySeq, targetSeq, diagonalLen,
+                                                                                          fastMatrix.matrix);
+                }
+            }
+        }
+        gettimeofday(&end, NULL);
+        double scalarTime = getSeconds(start, end);
+
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < repeats; i++) {
+            rescorer.setQuery(query.c_str(), queryLen);
+            if (mode == 0) {
+                rescorer.computeHammingDistance(hits.data(), hits.size());
+            } else if (mode == 1 || mode == 2) {
+                rescorer.computeSubstitutionDistance(hits.data(), hits.size(), mode == 2);
+            } else {
+                rescorer.computeSubstitutionStartEndDistance(hits.data(), hits.size());
+            }
+        }
+        gettimeofday(&end, NULL);
+        double batchTime = getSeconds(start, end);
+
+        size_t mismatches = 0;
+        for (size_t j = 0; j < targetCount; j++) {
+            mismatches += (hits[j].distance != expected[j].score);
+            if (mode == 3) {
+                mismatches += (hits[j].startPos != expected[j].startPos || hits[j].endPos != expected[j].endPos);
+            }
+        }
+        const char *modeNames[] = {"hamming", "local", "global", "local start/end"};
+        std::cout << "Rescore " << modeNames[mode] << " (targets up to " << maxTargetLen << "): per pair " << scalarTime << " s, batch " << batchTime
+                  << " s, mismatches " << mismatches << std::endl;
+    }
+
+    delete[] fastMatrix.matrix;
+    delete[] fastMatrix.matrixData;
+}
+
 int main(int argc, char **argv)
 {
 
@@ -45,6 +157,10 @@ int main(int argc, char **argv)
     Sequence s2(10000,  0, &subMat, kmer_size, true, false);
     s2.mapSequence(0,0,S2char);
 
+    benchmarkDiagonalRescorer(S1, par.scoringMatrixFile, 2019);
+    // short sequences like in linclust, the diagonals do not fill whole registers
+    benchmarkDiagonalRescorer(S1.substr(0, 60), par.scoringMatrixFile, 60);
+
     FILE *fasta_file = FileUtil::openFileOrDie("/Users/mad/Documents/databases/mmseqs_benchmark/benchmarks/clustering_benchmark/db/db_full.fas", "r", true);
     kseq_t *seq = kseq_init(fileno(fasta_file));
     size_t dbEntrySize = 0;
@@ -94,7 +210,8 @@ int main(int argc, char **argv)
     }
 
     float * compositionBias = new float[s1.L];
-    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s1.int_sequence, s1.L, compositionBias);
+    float * backgroundScore = new float[subMat.alphabetSize];
+    SubstitutionMatrix::calcLocalAaBiasCorrection(&subMat, s1.int_sequence, s1.L, compositionBias, backgroundScore);
 
 
 
@@ -127,4 +244,5 @@ int main(int argc, char **argv)
         std::cout << hits[i].id << "\t" << (int) hits[i].diagonal  << "\t" << (int)hits[i].count <<  std::endl;
     }
     delete [] compositionBias;
+    delete [] backgroundScore;
 }
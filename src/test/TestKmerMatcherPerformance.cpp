@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "kmermatcher.h"
+#include "SubstitutionMatrix.h"
+#include "ReducedMatrix.h"
+#include "Sequence.h"
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Parameters.h"
+#include "Util.h"
+
+#include <sys/time.h>
+
+const char* binary_name = "test_kmermatcherperformance";
+
+// measures the throughput of the k-mer selection of kmermatcher (fillKmerPositionArray)
+// usage: test_kmermatcherperformance [sequenceDB]
+// without a sequence DB random protein sequences are generated
+int main(int argc, char **argv) {
+    Parameters& par = Parameters::getInstance();
+    setLinearFilterDefault(&par);
+
+    std::string db;
+    if (argc > 1) {
+        db = argv[1];
+    } else {
+        db = "test_kmermatcherperformance_db";
+        const char aa[] = "ACDEFGHIKLMNPQRSTVWY";
+        const size_t seqCount = 20000;
+        DBWriter writer(db.c_str(), (db + ".index").c_str(), 1);
+        writer.open();
+        srand(1);
+        std::string seq;
+        for (size_t i = 0; i < seqCount; i++) {
+            size_t len = 100 + rand() % 1400;
+            seq.clear();
+            for (size_t pos = 0; pos < len; pos++) {
+                seq.push_back(aa[rand() % 20]);
+            }
+            seq.push_back('\n');
+            writer.writeData(seq.c_str(), seq.size(), i, 0);
+        }
+        writer.close(Sequence::AMINO_ACIDS);
+    }
+
+    DBReader<unsigned int> seqDbr(db.c_str(), (db + ".index").c_str());
+    seqDbr.open(DBReader<unsigned int>::NOSORT);
+    setKmerLengthAndAlphabet(par, seqDbr.getAminoAcidDBSize(), seqDbr.getDbtype());
+    SubstitutionMatrix sMat(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+    ReducedMatrix subMat(sMat.probMatrix, sMat.subMatrixPseudoCounts, par.alphabetSize, 2.0);
+
+    const size_t KMER_SIZE = par.kmerSize;
+    const size_t chooseTopKmer = par.kmersPerSequence;
+    const size_t totalKmers = computeKmerCount(seqDbr, KMER_SIZE, chooseTopKmer);
+    KmerPosition *hashSeqPair = new KmerPosition[totalKmers + 1];
+
+    const int repeats = 3;
+    size_t elements = 0;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < repeats; i++) {
+        elements = fillKmerPositionArray(hashSeqPair, seqDbr, par, &subMat, KMER_SIZE, chooseTopKmer, 1, 0);
+    }
+    gettimeofday(&end, NULL);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    std::cout << "\n" << seqDbr.getSize() << " sequences, k=" << KMER_SIZE << ", " << chooseTopKmer
+              << " k-mers per sequence, " << elements << " k-mers\n";
+    std::cout << "Fill time: " << seconds / repeats << " s, "
+              << static_cast<size_t>((seqDbr.getSize() * repeats) / seconds) << " sequences/s\n";
+
+    delete [] hashSeqPair;
+    seqDbr.close();
+    return EXIT_SUCCESS;
+}
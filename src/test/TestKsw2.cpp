@@ -314,10 +314,91 @@ void align(const char * qSeqAscii, uint8_t *qseq, uint8_t *qseqrev, const int qL
 }
 
 
+#ifdef AVX2
+static void encodeSequence(const char *seq, int len, uint8_t *encoded) {
+    uint8_t c[256];
+    memset(c, 4, 256);
+    c['A'] = c['a'] = 0; c['C'] = c['c'] = 1;
+    c['G'] = c['g'] = 2; c['T'] = c['t'] = 3;
+    for (int i = 0; i < len; ++i) {
+        encoded[i] = c[(uint8_t)seq[i]];
+    }
+}
+
+// runs ksw_extz2_avx2 and ksw_extz2_sse on the same input, returns true if score and cigar are identical
+static bool compareKernels(const uint8_t *qseq, int qLen, const uint8_t *tseq, int tLen,
+                           int w, int zdrop, int flag) {
+    const int8_t a = 2, b = -3;
+    const int8_t mat[25] = { a,b,b,b,0, b,a,b,b,0, b,b,a,b,0, b,b,b,a,0, 0,0,0,0,0 };
+    ksw_extz_t ezSse;
+    ksw_extz_t ezAvx2;
+    memset(&ezSse, 0, sizeof(ksw_extz_t));
+    memset(&ezAvx2, 0, sizeof(ksw_extz_t));
+    ksw_extz2_sse(0, qLen, qseq, tLen, tseq, 5, mat, 5, 1, w, zdrop, flag, &ezSse);
+    ksw_extz2_avx2(0, qLen, qseq, tLen, tseq, 5, mat, 5, 1, w, zdrop, flag, &ezAvx2);
+
+    bool isSame = ezSse.score == ezAvx2.score && ezSse.max == ezAvx2.max
+                  && ezSse.max_q == ezAvx2.max_q && ezSse.max_t == ezAvx2.max_t
+                  && ezSse.mqe == ezAvx2.mqe && ezSse.mte == ezAvx2.mte
+                  && ezSse.zdropped == ezAvx2.zdropped && ezSse.n_cigar == ezAvx2.n_cigar;
+    for (int i = 0; isSame && i < ezSse.n_cigar; ++i) {
+        isSame = ezSse.cigar[i] == ezAvx2.cigar[i];
+    }
+    if (isSame == false) {
+        printf("ksw_extz2_avx2 differs from ksw_extz2_sse (qlen %d, tlen %d, w %d, zdrop %d, flag %d)\n",
+               qLen, tLen, w, zdrop, flag);
+        printf("sse\t%d\t%d\t%d\t%d\t", ezSse.score, ezSse.max, ezSse.max_q, ezSse.max_t);
+        for (int i = 0; i < ezSse.n_cigar; ++i)
+            printf("%d%c", ezSse.cigar[i]>>4, "MID"[ezSse.cigar[i]&0xf]);
+        printf("\navx2\t%d\t%d\t%d\t%d\t", ezAvx2.score, ezAvx2.max, ezAvx2.max_q, ezAvx2.max_t);
+        for (int i = 0; i < ezAvx2.n_cigar; ++i)
+            printf("%d%c", ezAvx2.cigar[i]>>4, "MID"[ezAvx2.cigar[i]&0xf]);
+        printf("\n");
+    }
+    free(ezSse.cigar);
+    free(ezAvx2.cigar);
+    return isSame;
+}
+
+// compares the AVX2 and SSE kernel for global alignment, extension, banding, z-drop and score only mode
+static bool compareKsw2Kernels(int len, int cnt) {
+    const int flags[4] = { 0, KSW_EZ_EXTZ_ONLY, KSW_EZ_EXTZ_ONLY | KSW_EZ_RIGHT, KSW_EZ_SCORE_ONLY };
+    uint8_t *qseq = (uint8_t *)malloc(len);
+    uint8_t *tseq = (uint8_t *)malloc(len);
+    size_t failed = 0;
+    size_t total = 0;
+    for (int i = 0; i < cnt; i++) {
+        char *query = generate_random_sequence(len);
+        char *target = generate_mutated_sequence(query, len, 0.1, 0.1, 8);
+        encodeSequence(query, len, qseq);
+        encodeSequence(target, len, tseq);
+        // a shorter target makes the matrix non-square
+        const int tLen = (i % 2 == 0) ? len : len - len / 3;
+        for (size_t f = 0; f < 4; f++) {
+            failed += compareKernels(qseq, len, tseq, tLen, -1, -1, flags[f]) ? 0 : 1;
+            failed += compareKernels(qseq, len, tseq, tLen, 16, -1, flags[f]) ? 0 : 1;
+            failed += compareKernels(qseq, len, tseq, tLen, -1, 20, flags[f]) ? 0 : 1;
+            total += 3;
+        }
+        free(query);
+        free(target);
+    }
+    free(qseq);
+    free(tseq);
+    printf("ksw_extz2_avx2 vs ksw_extz2_sse: %zu of %zu alignments differ\n", failed, total);
+    return failed == 0;
+}
+#endif
+
 int main (int argc, const char * argv[]) {
     int64_t i;
     struct params p;
 
+    bool kernelsEqual = true;
+#ifdef AVX2
+    kernelsEqual = compareKsw2Kernels(1000, 100) && compareKsw2Kernels(77, 100);
+#endif
+
     /** set defaults */
     p.len = 1000;
     p.cnt = 1000;
@@ -499,7 +580,7 @@ int main (int argc, const char * argv[]) {
 
     delete queryObj;
     delete targetObj;
-    return 0;
+    return kernelsEqual ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 char * to_sequence(std::string str) {
@@ -0,0 +1,84 @@
+//  Benchmark of the pairwise identity filter of MsaFilter on a deep synthetic MSA
+//
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+
+#include "Parameters.h"
+#include "SubstitutionMatrix.h"
+#include "MultipleAlignment.h"
+#include "MsaFilter.h"
+
+const char* binary_name = "test_msafilter";
+
+static double getTime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + 1e-6 * now.tv_usec;
+}
+
+// mutated copies of a random center sequence with terminal gaps, identities spread between 20% and 100%
+static char **createMsa(int setSize, int length) {
+    char **msa = new char *[setSize];
+    for (int k = 0; k < setSize; ++k) {
+        msa[k] = MultipleAlignment::initX(length);
+    }
+    for (int pos = 0; pos < length; ++pos) {
+        msa[0][pos] = rand() % MultipleAlignment::NAA;
+    }
+    for (int k = 1; k < setSize; ++k) {
+        const int identity = 20 + rand() % 81;
+        const int start = (rand() % 4 == 0) ? rand() % (length / 2) : 0;
+        const int end = (rand() % 4 == 0) ? length / 2 + rand() % (length / 2) : length;
+        for (int pos = start; pos < end; ++pos) {
+            const int r = rand() % 100;
+            if (r >= identity + (100 - identity) / 10) {
+                msa[k][pos] = rand() % MultipleAlignment::NAA;
+            } else if (r >= identity) {
+                msa[k][pos] = MultipleAlignment::GAP;
+            } else {
+                msa[k][pos] = msa[0][pos];
+            }
+        }
+    }
+    return msa;
+}
+
+int main (int, const char**) {
+    Parameters& par = Parameters::getInstance();
+    SubstitutionMatrix subMat(par.scoringMatrixFile.c_str(), 2.0f, -0.2f);
+
+    const int setSize = 10000;
+    const int length = 500;
+    srand(1);
+    char **msa = createMsa(setSize, length);
+
+    MsaFilter filter(length, setSize, &subMat);
+    bool *kept = new bool[setSize];
+
+    // max-seq-id only, then with the default diff and qsc filters
+    const int ndiffs[2] = { 0, par.Ndiff };
+    const float qscs[2] = { -20.0f, par.qsc };
+    for (size_t run = 0; run < 2; ++run) {
+        size_t filteredSetSize = 0;
+        const double start = getTime();
+        filter.filter(setSize, length, static_cast<int>(par.cov * 100), static_cast<int>(par.qid * 100), qscs[run],
+                      static_cast<int>(par.filterMaxSeqId * 100), ndiffs[run], (const char **) msa, &filteredSetSize);
+        const double time = getTime() - start;
+        filter.getKept(kept, setSize);
+        size_t checksum = 0;
+        for (int k = 0; k < setSize; ++k) {
+            checksum = checksum * 31 + kept[k];
+        }
+        std::cout << "Ndiff " << ndiffs[run] << ": " << filteredSetSize << " of " << setSize << " sequences kept"
+                  << " (checksum " << checksum << ") in " << time * 1000 << " ms\n";
+    }
+
+    delete[] kept;
+    for (int k = 0; k < setSize; ++k) {
+        free(msa[k]);
+    }
+    delete[] msa;
+    return EXIT_SUCCESS;
+}
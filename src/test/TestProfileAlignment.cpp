@@ -837,7 +837,6 @@ int main (int argc, const char * argv[])
 //    double Kmn=(qL * seqDbSize * dbSeq->L);
     std::cout << exp(-(alignment.score1 * lambda)) << " " <<  dbSize * exp(-(alignment.score1 * lambda)) << std::endl;
     delete [] tinySubMat;
-    delete [] alignment.cigar;
     delete s;
     delete dbSeq;
     return 0;
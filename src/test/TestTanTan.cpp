@@ -5,6 +5,9 @@
 #include <iostream>
 #include <cstring>
 #include <math.h>
+#include <vector>
+#include <algorithm>
+#include <sys/time.h>
 #include "tantan.h"
 #include "SubstitutionMatrix.h"
 #include "Sequence.h"
@@ -12,7 +15,7 @@
 
 const char* binary_name = "test_tantan";
 
-int main (int argc, const char * argv[]) {
+int main (int, const char**) {
     const size_t kmer_size = 6;
 
     Parameters& par = Parameters::getInstance();
@@ -26,24 +29,32 @@ int main (int argc, const char * argv[]) {
     refSeq.mapSequence(0, 0, ref);
 
     char hardMaskTable[256];
-    std::fill_n(hardMaskTable, 256, subMat.aa2int['X']);
+    std::fill_n(hardMaskTable, 256, subMat.aa2int[(int)'X']);
     double probMatrix[21][21];
+    float probMatrixFloat[21][21];
 
     const double *probMatrixPointers[64];
+    const float *probMatrixFloatPointers[64];
 
     for (int i = 0; i < 21; ++i){
         probMatrixPointers[i] = probMatrix[i];
+        probMatrixFloatPointers[i] = probMatrixFloat[i];
         for(int j = 0; j < 21; ++j){
             probMatrix[i][j]  = exp(0.324032 * subMat.subMatrix[i][j]);
+            probMatrixFloat[i][j] = static_cast<float>(probMatrix[i][j]);
             //std::cout << probMatrix[i][j] << "\t";
         }
         //std::cout << std::endl;
     }
     char  refInt[100000];
+    char  refIntFloat[100000];
+    tantan::Workspace workspace(10000, 50);
 
-
-    for(size_t i = 0; i < 100000; i++){
-        for(size_t i = 0; i < refSeq.L; i++){
+    const size_t iterations = 100000;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for(size_t i = 0; i < iterations; i++){
+        for(int i = 0; i < refSeq.L; i++){
             refInt[i] = (char) refSeq.int_sequence[i];
         }
         tantan::maskSequences(refInt, refInt+len, 50 /*options.maxCycleLength*/,
@@ -53,11 +64,74 @@ int main (int argc, const char * argv[]) {
                               0, 0,
                               0.5 /*options.minMaskProb*/, hardMaskTable);
     }
-    for(size_t i = 0; i < refSeq.L; i++){
+    gettimeofday(&end, NULL);
+    double secDouble = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+
+    gettimeofday(&start, NULL);
+    for(size_t i = 0; i < iterations; i++){
+        for(int i = 0; i < refSeq.L; i++){
+            refIntFloat[i] = (char) refSeq.int_sequence[i];
+        }
+        tantan::maskSequences(refIntFloat, refIntFloat+len, 50 /*options.maxCycleLength*/,
+                              probMatrixFloatPointers,
+                              0.005 /*options.repeatProb*/, 0.05 /*options.repeatEndProb*/,
+                              0.9 /*options.repeatOffsetProbDecay*/,
+                              0.5 /*options.minMaskProb*/, hardMaskTable, workspace);
+    }
+    gettimeofday(&end, NULL);
+    double secFloat = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+
+    for(int i = 0; i < refSeq.L; i++){
 //        refInt[i] = (char) refSeq.int_sequence[i];
         std::cout << subMat.int2aa[(int)refInt[i]];
 
     }
     std::cout << std::endl;
+    for(int i = 0; i < refSeq.L; i++){
+        std::cout << subMat.int2aa[(int)refIntFloat[i]];
+    }
+    std::cout << std::endl;
+    std::cout << "Double: " << secDouble << " s, SIMD float: " << secFloat << " s, speedup: " << secDouble / secFloat << std::endl;
+
+    // compare the repeat probabilities on random sequences with planted tandem repeats
+    const size_t seqCount = 2000;
+    std::vector<float> probs(10000);
+    std::vector<float> probsFloat(10000);
+    std::string seq;
+    srand(1);
+    size_t residues = 0;
+    size_t differentDecisions = 0;
+    double maxDiff = 0;
+    for (size_t n = 0; n < seqCount; n++) {
+        seq.clear();
+        size_t seqLen = 50 + rand() % 950;
+        while (seq.size() < seqLen) {
+            if (rand() % 10 == 0) {
+                // tandem repeat of a short random unit
+                std::string unit;
+                size_t unitLen = 1 + rand() % 10;
+                for (size_t i = 0; i < unitLen; i++) {
+                    unit.push_back((char) (rand() % 20));
+                }
+                size_t copies = 2 + rand() % 8;
+                for (size_t i = 0; i < copies; i++) {
+                    seq.append(unit);
+                }
+            } else {
+                seq.push_back((char) (rand() % 20));
+            }
+        }
+        tantan::getProbabilities(seq.c_str(), seq.c_str() + seq.size(), 50, probMatrixPointers,
+                                 0.005, 0.05, 0.9, 0, 0, &probs[0]);
+        tantan::getProbabilities(seq.c_str(), seq.c_str() + seq.size(), 50, probMatrixFloatPointers,
+                                 0.005, 0.05, 0.9, &probsFloat[0], workspace);
+        for (size_t i = 0; i < seq.size(); i++) {
+            maxDiff = std::max(maxDiff, (double) fabs(probs[i] - probsFloat[i]));
+            differentDecisions += ((probs[i] >= 0.5) != (probsFloat[i] >= 0.5));
+        }
+        residues += seq.size();
+    }
+    std::cout << "Residues: " << residues << ", different masking decisions: " << differentDecisions
+              << ", max. probability difference: " << maxDiff << std::endl;
     return 0;
 }
@@ -10,6 +10,10 @@
 #include "ReducedMatrix.h"
 #include "ExtendedSubstitutionMatrix.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -22,6 +26,149 @@ void setAlignByKmerDefaults(Parameters *p) {
     p->alphabetSize = 21;
 }
 
+// Maps the k-mers of the query to their first position in the query.
+// It is built once per query and then looked up by every target of the query.
+// Small k-mer spaces are addressed directly. Larger ones, e.g. long nucleotide k-mers, use a hash table
+// sized by the query length instead of the k-mer space.
+class QueryKmerIndex {
+public:
+    static const unsigned int NOT_FOUND = UINT_MAX;
+
+    QueryKmerIndex(size_t kmerSpaceSize, size_t maxKmerCount) : keys(NULL), filledSize(0) {
+        isDirect = kmerSpaceSize <= MAX_DIRECT_SIZE;
+        if (isDirect) {
+            capacity = kmerSpaceSize;
+        } else {
+            capacity = 2;
+            while (capacity < LOAD_FACTOR_INVERSE * maxKmerCount) {
+                capacity *= 2;
+            }
+            setQueryLength(maxKmerCount);
+            keys = new(std::nothrow) size_t[capacity];
+            Util::checkAllocation(keys, "Could not allocate keys memory in QueryKmerIndex");
+        }
+        positions = new(std::nothrow) unsigned int[capacity];
+        Util::checkAllocation(positions, "Could not allocate positions memory in QueryKmerIndex");
+        filled = new(std::nothrow) size_t[maxKmerCount];
+        Util::checkAllocation(filled, "Could not allocate filled memory in QueryKmerIndex");
+        // NOT_FOUND has all bits set
+        memset(positions, 255, capacity * sizeof(unsigned int));
+    }
+
+    ~QueryKmerIndex() {
+        delete[] keys;
+        delete[] positions;
+        delete[] filled;
+    }
+
+    // only uses as many hash slots as needed for the query, so that small queries stay in the cache
+    void setQueryLength(size_t kmerCount) {
+        if (isDirect) {
+            return;
+        }
+        size_t activeCapacity = 2;
+        shift = 63;
+        while (activeCapacity < LOAD_FACTOR_INVERSE * kmerCount && activeCapacity < capacity) {
+            activeCapacity *= 2;
+            shift--;
+        }
+        mask = activeCapacity - 1;
+    }
+
+    // only the first position of a k-mer is kept
+    void insert(size_t kmer, unsigned int pos) {
+        size_t slot = isDirect ? kmer : findSlot(kmer);
+        if (positions[slot] == NOT_FOUND) {
+            if (isDirect == false) {
+                keys[slot] = kmer;
+            }
+            positions[slot] = pos;
+            filled[filledSize++] = slot;
+        }
+    }
+
+    unsigned int find(size_t kmer) const {
+        if (isDirect) {
+            return positions[kmer];
+        }
+        return positions[findSlot(kmer)];
+    }
+
+    // only resets the slots of the last query
+    void clear() {
+        for (size_t i = 0; i < filledSize; i++) {
+            positions[filled[i]] = NOT_FOUND;
+        }
+        filledSize = 0;
+    }
+
+private:
+    // 4 MB per thread
+    static const size_t MAX_DIRECT_SIZE = 1 << 20;
+    // most target k-mers are not in the query, a sparse table ends nearly all of these lookups at the first slot
+    static const size_t LOAD_FACTOR_INVERSE = 8;
+
+    bool isDirect;
+    size_t capacity;
+    size_t mask;
+    unsigned int shift;
+    size_t *keys;
+    unsigned int *positions;
+    size_t *filled;
+    size_t filledSize;
+
+    size_t findSlot(size_t kmer) const {
+        // fibonacci hashing, the high bits of the product depend on all bits of the k-mer
+        size_t slot = static_cast<size_t>((kmer * 0x9E3779B97F4A7C15ULL) >> shift);
+        while (positions[slot] != NOT_FOUND && keys[slot] != kmer) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+};
+
+// Fenwick tree for prefix maxima of chain scores, ties are resolved to the smaller stretche id
+class ChainScoreTree {
+public:
+    struct Entry {
+        int score;
+        size_t id;
+        Entry() : score(INT_MIN), id(SIZE_MAX) {}
+        Entry(int score, size_t id) : score(score), id(id) {}
+
+        bool isBetter(const Entry &other) const {
+            return score > other.score || (score == other.score && id < other.id);
+        }
+    };
+
+    void reset(size_t size) {
+        tree.assign(size + 1, Entry());
+    }
+
+    // pos is zero based
+    void update(size_t pos, const Entry &entry) {
+        for (size_t i = pos + 1; i < tree.size(); i += i & (~i + 1)) {
+            if (entry.isBetter(tree[i])) {
+                tree[i] = entry;
+            }
+        }
+    }
+
+    // best entry of the positions [0, end)
+    Entry query(size_t end) const {
+        Entry best;
+        for (size_t i = end; i > 0; i -= i & (~i + 1)) {
+            if (tree[i].isBetter(best)) {
+                best = tree[i];
+            }
+        }
+        return best;
+    }
+
+private:
+    std::vector<Entry> tree;
+};
+
 int alignbykmer(int argc, const char **argv, const Command &command) {
     Debug(Debug::INFO) << "Rescore diagonals.\n";
     Parameters &par = Parameters::getInstance();
@@ -51,6 +198,14 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
         }
     }
     ScoreMatrix * _2merSubMatrix =  ExtendedSubstitutionMatrix::calcScoreMatrix(*subMat, 2);
+    size_t kmerSpaceSize = 1;
+    for (int i = 0; i < par.kmerSize; i++) {
+        if (kmerSpaceSize > SIZE_MAX / subMat->alphabetSize) {
+            kmerSpaceSize = SIZE_MAX;
+            break;
+        }
+        kmerSpaceSize *= subMat->alphabetSize;
+    }
 
     Debug(Debug::INFO) << "Target  file: " << par.db2 << "\n";
     DBReader<unsigned int> *tdbr = NULL;
@@ -75,10 +230,10 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
     resultWriter.open();
 
     struct KmerPos {
-        unsigned short ij;
-        unsigned short i;
-        unsigned short j;
-        KmerPos(unsigned int ij, unsigned short i, unsigned short j):
+        unsigned int ij;
+        unsigned int i;
+        unsigned int j;
+        KmerPos(unsigned int ij, unsigned int i, unsigned int j):
                 ij(ij), i(i), j(j) {}
         KmerPos() {};
         // need for sorting the results
@@ -102,14 +257,14 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
 
 
     struct Stretche {
-        unsigned short i_start;
-        unsigned short i_end;
-        unsigned short j_start;
-        unsigned short j_end;
-        unsigned short kmerCnt;
-
-        Stretche(unsigned short i_start, unsigned short i_end,
-                 unsigned short j_start, unsigned short j_end, unsigned short kmerCnt):
+        unsigned int i_start;
+        unsigned int i_end;
+        unsigned int j_start;
+        unsigned int j_end;
+        unsigned int kmerCnt;
+
+        Stretche(unsigned int i_start, unsigned int i_end,
+                 unsigned int j_start, unsigned int j_end, unsigned int kmerCnt):
                 i_start(i_start), i_end(i_end), j_start(j_start), j_end(j_end), kmerCnt(kmerCnt) {}
         Stretche() {};
         // need for sorting the results
@@ -151,14 +306,16 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
             Sequence target(par.maxSeqLen, querySeqType, subMat, par.kmerSize, true, false);
             KmerGenerator kmerGenerator(par.kmerSize, subMat->alphabetSize, 70.0);
             kmerGenerator.setDivideStrategy(NULL, _2merSubMatrix);
-            size_t lookupSize = MathUtil::ipow<size_t>(par.alphabetSize, par.kmerSize);
-            unsigned short * queryPosLookup = new unsigned short[lookupSize];
-            memset(queryPosLookup, 255, lookupSize * sizeof(unsigned short) );
+            QueryKmerIndex queryKmerIndex(kmerSpaceSize, par.maxSeqLen);
 
             Indexer idxer(subMat->alphabetSize, par.kmerSize);
             KmerPos * kmerPosVec = new KmerPos[par.maxSeqLen];
             Stretche * stretcheVec = new Stretche[par.maxSeqLen];
             DpMatrixRow * dpMatrixRow = new DpMatrixRow[par.maxSeqLen];
+            // stretche ids ordered by their query end and the distinct target ends for the chaining
+            std::vector<std::pair<unsigned int, size_t> > stretcheByIEnd;
+            std::vector<unsigned int> stretcheJEnds;
+            ChainScoreTree chainScoreTree;
             int * scores = new int[par.maxSeqLen];
             std::string bt;
 
@@ -178,14 +335,11 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                 unsigned int queryId = qdbr->getId(dbr_res.getDbKey(id));
                 char *querySeq = qdbr->getData(queryId);
                 query.mapSequence(id, queryId, querySeq);
+                queryKmerIndex.setQueryLength(query.L);
 
                 while (query.hasNextKmer()) {
                     const int *kmer = query.nextKmer();
-                    unsigned short pos = query.getCurrentPosition();
-                    unsigned short kmerIdx = idxer.int2index(kmer);
-                    if (queryPosLookup[kmerIdx] == USHRT_MAX) {
-                        queryPosLookup[kmerIdx] = pos;
-                    }
+                    queryKmerIndex.insert(idxer.int2index(kmer), query.getCurrentPosition());
 //                    ScoreMatrix scoreMat = kmerGenerator.generateKmerList(kmer);
 //                    for (size_t pos = 0; pos <  scoreMat.elementSize; pos++) {
 //                        if (queryPosLookup[scoreMat.index[pos]] == USHRT_MAX) {
@@ -207,11 +361,10 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                     size_t kmerPosSize = 0;
                     while (target.hasNextKmer()) {
                         const int *kmer = target.nextKmer();
-                        unsigned short kmerIdx = idxer.int2index(kmer);
-                        if (queryPosLookup[kmerIdx] != USHRT_MAX) {
-                            unsigned short pos_j = target.getCurrentPosition();
-                            unsigned short pos_i = queryPosLookup[kmerIdx];
-                            unsigned short ij = pos_i - pos_j;
+                        unsigned int pos_i = queryKmerIndex.find(idxer.int2index(kmer));
+                        if (pos_i != QueryKmerIndex::NOT_FOUND) {
+                            unsigned int pos_j = target.getCurrentPosition();
+                            unsigned int ij = pos_i - pos_j;
                             kmerPosVec[kmerPosSize].ij = ij;
                             kmerPosVec[kmerPosSize].i  = pos_i;
                             kmerPosVec[kmerPosSize].j  = pos_j;
@@ -221,24 +374,24 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
 
 
                     std::sort(kmerPosVec, kmerPosVec + kmerPosSize, KmerPos::compareKmerPos);
-                    unsigned short region_min_i = USHRT_MAX;
-                    unsigned short region_max_i = 0;
-                    unsigned short region_min_j = USHRT_MAX;
-                    unsigned short region_max_j = 0;
-                    unsigned short region_max_kmer_cnt = 0;
+                    unsigned int region_min_i = UINT_MAX;
+                    unsigned int region_max_i = 0;
+                    unsigned int region_min_j = UINT_MAX;
+                    unsigned int region_max_j = 0;
+                    unsigned int region_max_kmer_cnt = 0;
                     size_t stretcheSize = 0;
                     if (kmerPosSize > 1) {
                         unsigned int prevDiagonal = UINT_MAX;
-                        unsigned short prev_i = 0;
-                        unsigned short prev_j = 0;
+                        unsigned int prev_i = 0;
+                        unsigned int prev_j = 0;
 
                         for (size_t kmerIdx = 0; kmerIdx < kmerPosSize; kmerIdx++) {
-                            unsigned int currDiagonal = static_cast<unsigned int>(kmerPosVec[kmerIdx].i) - static_cast<unsigned int>(kmerPosVec[kmerIdx].j);
-                            unsigned short curr_i = kmerPosVec[kmerIdx].i;
-                            unsigned short curr_j = kmerPosVec[kmerIdx].j;
+                            unsigned int currDiagonal = kmerPosVec[kmerIdx].ij;
+                            unsigned int curr_i = kmerPosVec[kmerIdx].i;
+                            unsigned int curr_j = kmerPosVec[kmerIdx].j;
                             unsigned int nextDiagonal = UINT_MAX;
                             if (kmerIdx < (kmerPosSize - 1)) {
-                                nextDiagonal = static_cast<unsigned int>(kmerPosVec[kmerIdx+1].i) - static_cast<unsigned int>(kmerPosVec[kmerIdx+1].j);
+                                nextDiagonal = kmerPosVec[kmerIdx+1].ij;
                             }
                             // skip single hits
                             if (currDiagonal != nextDiagonal && currDiagonal != prevDiagonal) {
@@ -269,9 +422,9 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                                 stretcheVec[stretcheSize].kmerCnt = region_max_kmer_cnt;
 
                                 stretcheSize++;
-                                region_min_i = USHRT_MAX;
+                                region_min_i = UINT_MAX;
                                 region_max_i = 0;
-                                region_min_j = USHRT_MAX;
+                                region_min_j = UINT_MAX;
                                 region_max_j = 0;
                                 region_max_kmer_cnt = 0;
                                 prev_i=0;
@@ -279,30 +432,54 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                             }
                         }
                     }
+                    if (stretcheSize == 0) {
+                        data = Util::skipLine(data);
+                        continue;
+                    }
                     // Do dynamic programming
+                    // A stretche can follow every stretche that ends before it starts in both sequences.
+                    // Stretches are visited by query start and a predecessor is added to the tree once its query end
+                    // lies before the current query start, the tree then returns the best chain over the target ends
+                    // before the current target start.
                     std::sort(stretcheVec, stretcheVec + stretcheSize, Stretche::compareStretche);
+                    stretcheByIEnd.resize(stretcheSize);
+                    stretcheJEnds.resize(stretcheSize);
                     for (size_t id = 0; id < stretcheSize; ++id) {
                         dpMatrixRow[id].prevPotentialId = id;
                         dpMatrixRow[id].pathScore = stretcheVec[id].kmerCnt;
+                        stretcheByIEnd[id] = std::make_pair(stretcheVec[id].i_end, id);
+                        stretcheJEnds[id] = stretcheVec[id].j_end;
                     }
+                    std::sort(stretcheByIEnd.begin(), stretcheByIEnd.end());
+                    std::sort(stretcheJEnds.begin(), stretcheJEnds.end());
+                    stretcheJEnds.erase(std::unique(stretcheJEnds.begin(), stretcheJEnds.end()), stretcheJEnds.end());
+                    chainScoreTree.reset(stretcheJEnds.size());
+
                     int bestPathScore = 0;
                     size_t lastPotentialExonInBestPath = 0;
+                    size_t nextPrevPotentialStretche = 0;
                     for (size_t currStretche = 0; currStretche < stretcheSize; ++currStretche) {
-                        for (size_t prevPotentialStretche = 0; prevPotentialStretche < currStretche; ++prevPotentialStretche) {
-                            // check the first one does not contain the second one:
-                            if (stretcheVec[currStretche].i_start > stretcheVec[prevPotentialStretche].i_end &&
-                                    stretcheVec[currStretche].j_start > stretcheVec[prevPotentialStretche].i_end) {
-                                int bestScorePathPrevIsLast = dpMatrixRow[prevPotentialStretche].pathScore;
-                                int distance =  -1;
-                                int costOfPrevToCurrTransition = distance;
-                                int currScore = stretcheVec[currStretche].kmerCnt;
-                                int currScoreWithPrev = bestScorePathPrevIsLast + costOfPrevToCurrTransition + currScore;
-
-                                // update row of currPotentialExon in case of improvement:
-                                if (currScoreWithPrev > dpMatrixRow[currStretche].pathScore) {
-                                    dpMatrixRow[currStretche].prevPotentialId = prevPotentialStretche;
-                                    dpMatrixRow[currStretche].pathScore = currScoreWithPrev;
-                                }
+                        while (nextPrevPotentialStretche < stretcheSize
+                               && stretcheByIEnd[nextPrevPotentialStretche].first < stretcheVec[currStretche].i_start) {
+                            const size_t prevPotentialStretche = stretcheByIEnd[nextPrevPotentialStretche].second;
+                            const size_t jEndRank = std::lower_bound(stretcheJEnds.begin(), stretcheJEnds.end(),
+                                                                     stretcheVec[prevPotentialStretche].j_end) - stretcheJEnds.begin();
+                            chainScoreTree.update(jEndRank, ChainScoreTree::Entry(dpMatrixRow[prevPotentialStretche].pathScore, prevPotentialStretche));
+                            nextPrevPotentialStretche++;
+                        }
+                        const size_t jStartRank = std::lower_bound(stretcheJEnds.begin(), stretcheJEnds.end(),
+                                                                   stretcheVec[currStretche].j_start) - stretcheJEnds.begin();
+                        const ChainScoreTree::Entry bestPrev = chainScoreTree.query(jStartRank);
+                        if (bestPrev.id != SIZE_MAX) {
+                            int distance =  -1;
+                            int costOfPrevToCurrTransition = distance;
+                            int currScore = stretcheVec[currStretche].kmerCnt;
+                            int currScoreWithPrev = bestPrev.score + costOfPrevToCurrTransition + currScore;
+
+                            // update row of currPotentialExon in case of improvement:
+                            if (currScoreWithPrev > dpMatrixRow[currStretche].pathScore) {
+                                dpMatrixRow[currStretche].prevPotentialId = bestPrev.id;
+                                dpMatrixRow[currStretche].pathScore = currScoreWithPrev;
                             }
                         }
 
@@ -340,7 +517,7 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
 //                        std::cout << std::endl;
 
                         for (int i = strechtPath[stretch].i_end, j = strechtPath[stretch].j_end;
-                             i < strechtPath[stretch - 1].i_start && j < strechtPath[stretch - 1].j_start; i++, j++) {
+                             i < static_cast<int>(strechtPath[stretch - 1].i_start) && j < static_cast<int>(strechtPath[stretch - 1].j_start); i++, j++) {
                             int curr = subMat->subMatrix[query.int_sequence[i]][target.int_sequence[j]];
                             score = curr + score;
 //                            score = (score < 0) ? 0 : score;
@@ -354,7 +531,7 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                         scores[pos] = 0;
                         score = 0;
                         for (int i = strechtPath[stretch - 1].i_start, j = strechtPath[stretch - 1].j_start;
-                             i > strechtPath[stretch].i_end && j > strechtPath[stretch].j_end; i--, j--) {
+                             i > static_cast<int>(strechtPath[stretch].i_end) && j > static_cast<int>(strechtPath[stretch].j_end); i--, j--) {
                             int curr = subMat->subMatrix[query.int_sequence[i]][target.int_sequence[j]];
                             score = curr + score;
 //                            score = (score < 0) ? 0 : score;
@@ -463,11 +640,11 @@ int alignbykmer(int argc, const char **argv, const Command &command) {
                     data = Util::skipLine(data);
                     bt.clear();
                 }
-                memset(queryPosLookup, 255, lookupSize * sizeof(unsigned short));
+                queryKmerIndex.clear();
                 resultWriter.writeEnd(qdbr->getDbKey(queryId), thread_idx, true);
             }
             delete [] kmerPosVec;
-            delete [] queryPosLookup;
+            delete [] stretcheVec;
             delete [] dpMatrixRow;
             delete [] scores;
         }
@@ -0,0 +1,129 @@
+#include "Debug.h"
+#include "Parameters.h"
+#include "DBReader.h"
+#include "DBWriter.h"
+#include "Sequence.h"
+#include "SubstitutionMatrix.h"
+#include "NucleotideMatrix.h"
+#include "ReducedMatrix.h"
+#include "SequenceMask.h"
+#include "kmermatcher.h"
+#include "tantan.h"
+#include "Util.h"
+#include "FileUtil.h"
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+int maskdb(int argc, const char **argv, const Command& command) {
+    Parameters& par = Parameters::getInstance();
+    // same alphabet defaults as kmermatcher
+    setLinearFilterDefault(&par);
+    par.parseParameters(argc, argv, command, 1);
+
+#ifdef OPENMP
+    omp_set_num_threads(par.threads);
+#endif
+
+    DBReader<unsigned int> reader(par.db1.c_str(), par.db1Index.c_str());
+    reader.open(DBReader<unsigned int>::NOSORT);
+    const int seqType = reader.getDbtype();
+    if (seqType == Sequence::HMM_PROFILE) {
+        Debug(Debug::ERROR) << "Profile databases cannot be masked.\n";
+        EXIT(EXIT_FAILURE);
+    }
+    setKmerLengthAndAlphabet(par, reader.getAminoAcidDBSize(), seqType);
+
+    // the prefilter masks with the full alphabet, kmermatcher with the reduced alphabet
+    BaseMatrix *subMat[SequenceMask::MASK_TYPES];
+    if (seqType == Sequence::NUCLEOTIDES) {
+        subMat[SequenceMask::PREFILTER] = new NucleotideMatrix(par.scoringMatrixFile.c_str(), 1.0, 0.0);
+        subMat[SequenceMask::KMERMATCHER] = new NucleotideMatrix(par.scoringMatrixFile.c_str(), 1.0, 0.0);
+    } else {
+        subMat[SequenceMask::PREFILTER] = new SubstitutionMatrix(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+        if (par.alphabetSize == 21) {
+            subMat[SequenceMask::KMERMATCHER] = new SubstitutionMatrix(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+        } else {
+            SubstitutionMatrix sMat(par.scoringMatrixFile.c_str(), 2.0, 0.0);
+            subMat[SequenceMask::KMERMATCHER] = new ReducedMatrix(sMat.probMatrix, sMat.subMatrixPseudoCounts, par.alphabetSize, 2.0);
+        }
+    }
+    ProbabilityMatrix *probMatrix[SequenceMask::MASK_TYPES];
+    for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+        probMatrix[type] = new ProbabilityMatrix(*subMat[type]);
+    }
+
+    std::string maskDb = SequenceMask::getMaskDbName(par.db1);
+    std::string maskDbIndex = maskDb + ".index";
+    // the cache is invalid until it is completely written
+    std::string paramsFile = SequenceMask::getParamsFileName(par.db1);
+    if (FileUtil::fileExists(paramsFile.c_str())) {
+        FileUtil::deleteFile(paramsFile);
+    }
+    DBWriter writer(maskDb.c_str(), maskDbIndex.c_str(), par.threads, DBWriter::BINARY_MODE);
+    writer.open();
+
+    size_t maskedResidues[SequenceMask::MASK_TYPES] = {0, 0};
+    size_t residues = 0;
+#pragma omp parallel
+    {
+        int thread_idx = 0;
+#ifdef OPENMP
+        thread_idx = omp_get_thread_num();
+#endif
+        Sequence *seq[SequenceMask::MASK_TYPES];
+        for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+            seq[type] = new Sequence(par.maxSeqLen, seqType, subMat[type], 0, false, false);
+        }
+        tantan::Workspace workspace(par.maxSeqLen, 50);
+        char *charSequence = new char[par.maxSeqLen];
+        unsigned char *entry = new unsigned char[SequenceMask::getEntrySize(par.maxSeqLen)];
+        size_t threadMasked[SequenceMask::MASK_TYPES] = {0, 0};
+
+#pragma omp for schedule(dynamic, 100) reduction(+:residues)
+        for (size_t id = 0; id < reader.getSize(); id++) {
+            Debug::printProgress(id);
+            unsigned int key = reader.getDbKey(id);
+            char *data = reader.getData(id);
+            size_t seqLen = 0;
+            for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+                Sequence &s = *seq[type];
+                s.mapSequence(id, key, data);
+                seqLen = s.L;
+                for (int i = 0; i < s.L; i++) {
+                    charSequence[i] = (char) s.int_sequence[i];
+                }
+                SequenceMask::MaskType maskType = static_cast<SequenceMask::MaskType>(type);
+                threadMasked[type] += SequenceMask::mask(charSequence, s.L, maskType, *probMatrix[type], workspace);
+                SequenceMask::setBitmask(entry, s.L, maskType, subMat[type]->alphabetSize,
+                                         charSequence, subMat[type]->aa2int[(int) 'X']);
+            }
+            writer.writeData((const char *) entry, SequenceMask::getEntrySize(seqLen), key, thread_idx);
+            residues += seqLen;
+        }
+
+#pragma omp critical
+        {
+            for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+                maskedResidues[type] += threadMasked[type];
+            }
+        }
+        delete[] entry;
+        delete[] charSequence;
+        for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+            delete seq[type];
+        }
+    }
+    writer.close();
+    reader.close();
+    SequenceMask::writeParams(par.db1, subMat);
+    for (int type = 0; type < SequenceMask::MASK_TYPES; type++) {
+        delete probMatrix[type];
+        delete subMat[type];
+    }
+
+    Debug(Debug::INFO) << "\nMasked residues: " << maskedResidues[SequenceMask::PREFILTER] << " of " << residues << " (prefilter), "
+                       << maskedResidues[SequenceMask::KMERMATCHER] << " (kmermatcher)\n";
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,7 @@
 #include "CompressedA3M.h"
 #include "Debug.h"
 #include "Util.h"
+#include "CostScheduler.h"
 
 #ifdef OPENMP
 #include <omp.h>
@@ -98,6 +99,17 @@ int result2msa(Parameters &par, const std::string &resultData, const std::string
     Debug(Debug::INFO) << "Query database type: " << qDbr.getDbTypeName() << "\n";
     Debug(Debug::INFO) << "Target database type: " << tDbr->getDbTypeName() << "\n";
     const bool isFiltering = par.filterMsa != 0;
+
+    // the MSA and its filtering grow with the query length times the number of result lines
+    CostScheduler scheduler(dbFrom, dbSize, par.threads);
+    for (size_t id = dbFrom; id < dbFrom + dbSize; id++) {
+        const size_t queryId = qDbr.getId(resultReader.getDbKey(id));
+        if (queryId != UINT_MAX) {
+            scheduler.setCost(id, qDbr.getSeqLens(queryId) * resultReader.getSeqLens(id));
+        }
+    }
+    scheduler.sortByCost();
+
 #pragma omp parallel
     {
         Matcher matcher(qDbr.getDbtype(), maxSequenceLength, &subMat, &evalueComputation, par.compBiasCorrection, Matcher::GAP_OPEN, Matcher::GAP_EXTEND);
@@ -114,8 +126,9 @@ int result2msa(Parameters &par, const std::string &resultData, const std::string
         }
 
 #pragma omp  for schedule(dynamic, 10)
-        for (size_t id = dbFrom; id < (dbFrom + dbSize); id++) {
-            Debug::printProgress(id);
+        for (size_t i = 0; i < dbSize; i++) {
+            Debug::printProgress(i);
+            const size_t id = scheduler.getId(i);
             unsigned int thread_idx = 0;
 #ifdef OPENMP
             thread_idx = (unsigned int) omp_get_thread_num();
@@ -126,6 +139,7 @@ int result2msa(Parameters &par, const std::string &resultData, const std::string
             char *seqData = qDbr.getDataByDBKey(queryKey);
             if (seqData == NULL) {
                 Debug(Debug::WARNING) << "Empty sequence " << id << ". Skipping.\n";
+                scheduler.entryDone(thread_idx);
                 continue;
             }
 
@@ -295,10 +309,12 @@ int result2msa(Parameters &par, const std::string &resultData, const std::string
                 Sequence *seq = *it;
                 delete seq;
             }
+            scheduler.entryDone(thread_idx);
         }
 
         delete[] kept;
     }
+    scheduler.printThreadTimes();
 
     // cleanup
     resultWriter.close();
@@ -9,6 +9,7 @@
 #include "Util.h"
 #include "PrefilteringIndexReader.h"
 #include "FileUtil.h"
+#include "CostScheduler.h"
 
 #include <string>
 #include <vector>
@@ -141,8 +142,22 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
     Debug(Debug::INFO) << "Target database type: " << DBReader<unsigned int>::getDbTypeName(targetSeqType) << "\n";
 
     const bool isFiltering = par.filterMsa != 0;
+    // sequence targets are written into the MSA straight from the alignment results,
+    // profiles need a Sequence per member to read their residues
+    const int edgeSeqType = tDbr->getDbtype();
+    const bool canStreamMSA = edgeSeqType == Sequence::AMINO_ACIDS || edgeSeqType == Sequence::NUCLEOTIDES;
     int xAmioAcid = subMat.aa2int[(int)'X'];
 
+    // the MSA and the PSSM grow with the query length times the number of result lines
+    CostScheduler scheduler(dbFrom, dbSize, localThreads);
+    for (size_t id = dbFrom; id < dbFrom + dbSize; id++) {
+        const size_t queryId = qDbr->getId(resultReader.getDbKey(id));
+        if (queryId != UINT_MAX) {
+            scheduler.setCost(id, qDbr->getSeqLens(queryId) * resultReader.getSeqLens(id));
+        }
+    }
+    scheduler.sortByCost();
+
 #pragma omp parallel
     {
         Matcher matcher(qDbr->getDbtype(), maxSequenceLength, &subMat, &evalueComputation, par.compBiasCorrection, Matcher::GAP_OPEN, Matcher::GAP_EXTEND);
@@ -153,6 +168,7 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
         std::string result;
         result.reserve(par.maxSeqLen * Sequence::PROFILE_READIN_SIZE * sizeof(char));
         char *charSequence = new char[maxSequenceLength];
+        unsigned char *edgeResidueBuffer = new unsigned char[maxSequenceLength];
 
         unsigned int thread_idx = 0;
 #ifdef OPENMP
@@ -160,8 +176,9 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
 #endif
 
 #pragma omp for schedule(dynamic, 10)
-        for (size_t id = dbFrom; id < (dbFrom + dbSize); id++) {
-            Debug::printProgress(id);
+        for (size_t i = 0; i < dbSize; i++) {
+            Debug::printProgress(i);
+            const size_t id = scheduler.getId(i);
 
             // Get the sequence from the queryDB
             unsigned int queryKey = resultReader.getDbKey(id);
@@ -185,9 +202,66 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
             }
 
             char *results = resultReader.getData(id);
+            MultipleAlignment::MSAResult res(0, 0, 0, NULL);
+            // without a backtrace in every result the members are realigned by computeMSA
+            bool isStreamed = canStreamMSA;
+            if (canStreamMSA) {
+                aligner.beginMSA(&centerSequence);
+                char *data = results;
+                while (*data != '\0') {
+                    char dbKey[255 + 1];
+                    Util::parseKey(data, dbKey);
+                    const unsigned int key = (unsigned int) strtoul(dbKey, NULL, 10);
+                    // in the same database case, we have the query repeated
+                    if ((key == queryKey && sameDatabase == true)) {
+                        data = Util::skipLine(data);
+                        continue;
+                    }
+
+                    char *entry[255];
+                    const size_t columns = Util::getWordsOfLine(data, entry, 255);
+                    if (columns <= Matcher::ALN_RES_WITH_OUT_BT_COL_CNT) {
+                        isStreamed = false;
+                        break;
+                    }
+
+                    const size_t edgeId = tDbr->getId(key);
+                    const unsigned char *edgeResidues = edgeResidueBuffer;
+                    size_t edgeLength = 0;
+                    if (tSeqLookup != NULL) {
+                        std::pair<const unsigned char*, const unsigned int> sequence = tSeqLookup->getSequence(edgeId);
+                        edgeResidues = sequence.first;
+                        edgeLength = sequence.second;
+                    } else {
+                        char *dbSeqData = tDbr->getData(edgeId);
+                        if (dbSeqData == NULL) {
+#pragma omp critical
+                            {
+                                Debug(Debug::ERROR) << "ERROR: Sequence " << key << " is required in the database,"
+                                                    << "but is not contained in the target sequence database!\n"
+                                                    << "Please check your database.\n";
+                                EXIT(EXIT_FAILURE);
+                            }
+                        }
+                        // same mapping as Sequence::mapSequence
+                        while (dbSeqData[edgeLength] != '\0' && dbSeqData[edgeLength] != '\n') {
+                            edgeResidueBuffer[edgeLength] = subMat.aa2int[(int) dbSeqData[edgeLength]];
+                            edgeLength++;
+                        }
+                    }
+
+                    aligner.addMember(Util::fast_atoi<int>(entry[4]), Util::fast_atoi<int>(entry[7]), entry[10],
+                                      edgeResidues, edgeLength);
+                    data = Util::skipLine(data);
+                }
+                if (isStreamed) {
+                    res = aligner.getMSA();
+                }
+            }
+
             std::vector<Matcher::result_t> alnResults;
             std::vector<Sequence *> seqSet;
-            while (*results != '\0') {
+            while (isStreamed == false && *results != '\0') {
                 char dbKey[255 + 1];
                 Util::parseKey(results, dbKey);
                 const unsigned int key = (unsigned int) strtoul(dbKey, NULL, 10);
@@ -206,7 +280,7 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
 
                 const size_t edgeId = tDbr->getId(key);
                 Sequence *edgeSequence = new Sequence(tDbr->getSeqLens(edgeId),
-                                                      tDbr->getDbtype(), &subMat, 0, false, false);
+                                                      edgeSeqType, &subMat, 0, false, false);
 
                 if (tSeqLookup != NULL) {
                     std::pair<const unsigned char*, const unsigned int> sequence = tSeqLookup->getSequence(edgeId);
@@ -229,10 +303,12 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
                 results = Util::skipLine(results);
             }
 
-            // Recompute if not all the backtraces are present
-            MultipleAlignment::MSAResult res = (alnResults.size() == seqSet.size())
-                                               ? aligner.computeMSA(&centerSequence, seqSet, alnResults, true)
-                                               : aligner.computeMSA(&centerSequence, seqSet, true);
+            if (isStreamed == false) {
+                // Recompute if not all the backtraces are present
+                res = (alnResults.size() == seqSet.size())
+                      ? aligner.computeMSA(&centerSequence, seqSet, alnResults, true)
+                      : aligner.computeMSA(&centerSequence, seqSet, true);
+            }
 
 
 //            MultipleAlignment::print(res, &subMat);
@@ -306,14 +382,20 @@ int result2profile(DBReader<unsigned int> &resultReader, Parameters &par, const
                 consensusStr.push_back('\n');
                 consensusWriter->writeData(consensusStr.c_str(), consensusStr.length(), queryKey, thread_idx);
             }
-            MultipleAlignment::deleteMSA(&res);
+            // the rows of a streamed MSA stay with the aligner
+            if (isStreamed == false) {
+                MultipleAlignment::deleteMSA(&res);
+            }
             for (std::vector<Sequence *>::iterator it = seqSet.begin(); it != seqSet.end(); ++it) {
                 Sequence *seq = *it;
                 delete seq;
             }
+            scheduler.entryDone(thread_idx);
         }
         delete [] charSequence;
+        delete [] edgeResidueBuffer;
     }
+    scheduler.printThreadTimes();
 
     // cleanup
     if (consensusWriter != NULL) {
@@ -123,7 +123,7 @@ int clusteringworkflow(int argc, const char **argv, const Command& command) {
                               << " in combination with coverage mode " << par.covMode << " can produce wrong results.\n"
                               << "Please use --cov-mode 2\n";
     }
-    if (par.cascaded == true && par.clusteringMode == Parameters::CONNECTED_COMPONENT) {
+    if (par.cascaded == true && (par.clusteringMode == Parameters::CONNECTED_COMPONENT || par.clusteringMode == Parameters::CONNECTED_COMPONENT_MEM)) {
         Debug(Debug::WARNING) << "WARNING: connected component clustering produces less clusters in a single step clustering.\n"
                               << "Please use --single-step-cluster";
     }
@@ -145,6 +145,9 @@ int clusteringworkflow(int argc, const char **argv, const Command& command) {
 
     const int originalRescoreMode = par.rescoreMode;
 
+    // the low memory greedy clustering reads the binary edges instead of the text alignment result
+    par.writeEdges = (par.clusteringMode == Parameters::GREEDY_MEM);
+
     CommandCaller cmd;
     cmd.addVariable("REMOVE_TMP", par.removeTmpFiles ? "TRUE" : NULL);
     par.rescoreMode = Parameters::RESCORE_MODE_ALIGNMENT;
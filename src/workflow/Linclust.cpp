@@ -29,6 +29,11 @@ int linclust(int argc, const char **argv, const Command& command) {
     par.parseParameters(argc, argv, command, 3);
 
     const int dbType = DBReader<unsigned int>::parseDbType(par.db1.c_str());
+    // the k-mer matches are filtered and aligned again later, which needs the text result
+    if (par.kmerResultMode == Parameters::KMER_RESULT_EDGE_LIST) {
+        Debug(Debug::ERROR) << "The binary edge list (--kmer-result-mode 2) cannot be used in the linclust workflow.\n";
+        EXIT(EXIT_FAILURE);
+    }
 
     if (FileUtil::directoryExists(par.db3.c_str()) == false) {
         Debug(Debug::INFO) << "Tmp " << par.db3 << " folder does not exist or is not a directory.\n";
@@ -103,10 +108,16 @@ int linclust(int argc, const char **argv, const Command& command) {
     // filter by diagonal in case of AA (do not filter for nucl, profiles, ...)
     cmd.addVariable("FILTER", dbType == Sequence::AMINO_ACIDS ? "1" : NULL);
     cmd.addVariable("KMERMATCHER_PAR", par.createParameterString(par.kmermatcher).c_str());
+    // greedy low mem pre-clustering can be fused with k-mer matching and Hamming distance rescoring
+    // kmerprecluster runs on a single node, with an MPI runner kmermatcher distributes the k-mer splits instead
+    // set cover needs the complete rescored graph, see kmerprecluster.cpp
+    const bool fusePreclustering = par.clusteringMode == Parameters::GREEDY_MEM && par.runner.empty();
+    cmd.addVariable("PRECLUSTER_PAR", fusePreclustering ? par.createParameterString(par.kmerprecluster).c_str() : NULL);
     par.alphabetSize = alphabetSize;
     par.kmerSize = kmerSize;
 
     // # 2. Hamming distance pre-clustering
+    par.writeEdges = false;
     par.rescoreMode = Parameters::RESCORE_MODE_HAMMING;
     par.filterHits = false;
     float prevSeqId = par.seqIdThr;
@@ -126,6 +137,8 @@ int linclust(int argc, const char **argv, const Command& command) {
     cmd.addVariable("UNGAPPED_ALN_PAR", par.createParameterString(par.rescorediagonal).c_str());
     // # 4. Local gapped sequence alignment.
     par.maxResListLen = INT_MAX;
+    // the low memory greedy clustering reads the binary edges instead of the text alignment result
+    par.writeEdges = (par.clusteringMode == Parameters::GREEDY_MEM);
 
     if (isUngappedMode) {
         const int originalRescoreMode = par.rescoreMode;